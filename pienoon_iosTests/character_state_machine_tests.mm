@@ -0,0 +1,133 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <set>
+#include <string>
+#include "character_state_machine.h"
+#include "character_state_machine_def_generated.h"
+#include "test_assets.h"
+#include "utilities.h"
+
+using fpl::pie_noon::CharacterState;
+using fpl::pie_noon::CharacterStateMachineDef;
+using fpl::pie_noon::CharacterStateMachineTable;
+using fpl::pie_noon::Condition;
+using fpl::pie_noon::ConditionInputs;
+using fpl::pie_noon::EvaluateCondition;
+
+namespace {
+
+// The transition CharacterStateMachine::Update follows without a table.
+int InterpretedNextState(const CharacterState* state,
+                         const ConditionInputs& inputs) {
+  if (!state->transitions()) return -1;
+  for (auto it = state->transitions()->begin();
+       it != state->transitions()->end(); ++it) {
+    const Condition* condition = it->condition();
+    if (condition && EvaluateCondition(condition, inputs)) {
+      return it->target_state();
+    }
+  }
+  return -1;
+}
+
+// Calls visit(subset) for every subset of the bits in mask.
+template <typename Visit>
+void ForEachSubset(int32_t mask, Visit visit) {
+  for (int32_t subset = mask;; subset = (subset - 1) & mask) {
+    visit(subset);
+    if (subset == 0) break;
+  }
+}
+
+}  // namespace
+
+@interface CharacterStateMachineTests : XCTestCase
+@end
+
+@implementation CharacterStateMachineTests
+
+// The compiled table must pick the same transition as the interpreter for
+// every state, in both game modes, for every combination of the input bits
+// any condition looks at, and at every time on either side of a condition's
+// time window.
+- (void)testTableMatchesInterpreter {
+  std::string source;
+  XCTAssertTrue(fpl::LoadFile(
+      TestAssetPath("character_state_machine_def.bin").c_str(), &source));
+  if (source.empty()) return;
+  const CharacterStateMachineDef* state_machine_def =
+      fpl::pie_noon::GetCharacterStateMachineDef(source.c_str());
+  XCTAssertTrue(
+      fpl::pie_noon::CharacterStateMachineDef_Validate(state_machine_def));
+  CharacterStateMachineTable table;
+  table.Compile(state_machine_def);
+
+  int32_t down_bits = 0;
+  int32_t went_down_bits = 0;
+  int32_t went_up_bits = 0;
+  std::set<int> times;
+  times.insert(0);
+  auto states = state_machine_def->states();
+  for (auto state = states->begin(); state != states->end(); ++state) {
+    if (!state->transitions()) continue;
+    for (auto it = state->transitions()->begin();
+         it != state->transitions()->end(); ++it) {
+      const Condition* condition = it->condition();
+      if (!condition) continue;
+      down_bits |= condition->is_down() | condition->is_up();
+      went_down_bits |= condition->went_down();
+      went_up_bits |= condition->went_up();
+      times.insert(condition->time());
+      times.insert(condition->time() - 1);
+      times.insert(condition->end_time());
+      times.insert(condition->end_time() - 1);
+    }
+  }
+
+  int num_checked = 0;
+  int num_mismatches = 0;
+  ConditionInputs inputs = ConditionInputs();
+  for (int state = 0; state < static_cast<int>(states->Length()); ++state) {
+    ForEachSubset(down_bits, [&](int32_t is_down) {
+      ForEachSubset(went_down_bits, [&](int32_t went_down) {
+        ForEachSubset(went_up_bits, [&](int32_t went_up) {
+          for (auto time = times.begin(); time != times.end(); ++time) {
+            for (int multiscreen = 0; multiscreen < 2; ++multiscreen) {
+              inputs.is_down = is_down;
+              inputs.went_down = went_down;
+              inputs.went_up = went_up;
+              inputs.animation_time = *time;
+              inputs.is_multiscreen = multiscreen != 0;
+              const int expected =
+                  InterpretedNextState(states->Get(state), inputs);
+              if (table.NextState(state, inputs) != expected) {
+                num_mismatches++;
+              }
+              num_checked++;
+            }
+          }
+        });
+      });
+    });
+  }
+  NSLog(@"Checked %d transitions", num_checked);
+  XCTAssertGreaterThan(num_checked, 0);
+  XCTAssertEqual(num_mismatches, 0);
+}
+
+@end
@@ -0,0 +1,160 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <string.h>
+#include "components/drip_and_vanish.h"
+#include "components/scene_object.h"
+#include "components/shakeable_prop.h"
+#include "entity/entity_manager.h"
+#include "motive/engine.h"
+#include "motive/init.h"
+#include "scene_description.h"
+#include "thread_pool.h"
+
+using fpl::Renderable;
+using fpl::SceneDescription;
+using fpl::ThreadPool;
+using fpl::entity::EntityManager;
+using fpl::entity::EntityRef;
+using fpl::entity::WorldTime;
+using fpl::pie_noon::DripAndVanishComponent;
+using fpl::pie_noon::DripAndVanishData;
+using fpl::pie_noon::SceneObjectComponent;
+using fpl::pie_noon::SceneObjectData;
+using fpl::pie_noon::ShakeablePropComponent;
+using fpl::pie_noon::ShakeablePropData;
+using mathfu::vec3;
+
+namespace {
+
+// Enough of each that the thread pool splits their updates into chunks.
+const int kNumProps = 500;
+const int kSplattersPerProp = 4;
+const int kNumFrames = 60;
+const WorldTime kDeltaTime = 17;
+
+// The components GameState registers that can update on several threads,
+// with a deterministic scene built straight into their data.
+struct ComponentWorld {
+  motive::MotiveEngine engine;
+  EntityManager entity_manager;
+  SceneObjectComponent scene_objects;
+  ShakeablePropComponent props;
+  DripAndVanishComponent splatters;
+
+  ComponentWorld() : scene_objects(&engine) {
+    entity_manager.RegisterComponent<SceneObjectComponent>(&scene_objects);
+    entity_manager.RegisterComponent<ShakeablePropComponent>(&props);
+    entity_manager.RegisterComponent<DripAndVanishComponent>(&splatters);
+    props.set_engine(&engine);
+
+    motive::OvershootInit shake_init;
+    shake_init.set_range(fpl::Range(-0.5f, 0.5f));
+    shake_init.set_max_velocity(0.01f);
+    shake_init.set_max_delta(0.1f);
+    shake_init.set_accel_per_difference(0.0001f);
+    shake_init.set_wrong_direction_multiplier(4.0f);
+    shake_init.set_max_delta_time(10);
+
+    EntityRef root = entity_manager.AllocateNewEntity();
+    scene_objects.AddEntity(root);
+    for (int i = 0; i < kNumProps; ++i) {
+      EntityRef prop = entity_manager.AllocateNewEntity();
+      ShakeablePropData* sp_data = props.AddEntity(prop);
+      sp_data->axis = static_cast<fpl::pie_noon::Axis>(i % 3);
+      sp_data->shake_scale = 1.0f;
+      sp_data->motivator.Initialize(shake_init, &engine);
+      sp_data->motivator.SetTarget(
+          motive::Current1f(0.0f, 0.001f * (i % 7 - 3)));
+      scene_objects.SetParent(prop, root);
+      scene_objects.GetEntityData(prop)->SetTranslation(
+          vec3(static_cast<float>(i % 20), 0.0f, static_cast<float>(i / 20)));
+
+      for (int j = 0; j < kSplattersPerProp; ++j) {
+        EntityRef splatter = entity_manager.AllocateNewEntity();
+        DripAndVanishData* dv_data = splatters.AddEntity(splatter);
+        scene_objects.SetParent(splatter, prop);
+        SceneObjectData* so_data = scene_objects.GetEntityData(splatter);
+        so_data->SetTranslation(vec3(0.1f * j, 1.0f, 0.0f));
+        so_data->SetScale(vec3(0.5f + 0.1f * j));
+        splatters.SetStartingValues(splatter);
+
+        // Some drip for the whole test, some vanish part way through.
+        dv_data->lifetime_remaining =
+            static_cast<float>(kDeltaTime * (10 + (i * 7 + j * 13) % 80));
+        dv_data->slide_time = static_cast<float>(kDeltaTime * (5 + j * 5));
+        dv_data->drip_distance = 0.25f * (j + 1);
+        dv_data->slide_amount = -1.0f;
+      }
+    }
+  }
+
+  void Run(ThreadPool* thread_pool, SceneDescription* scene) {
+    entity_manager.set_thread_pool(thread_pool);
+    for (int frame = 0; frame < kNumFrames; ++frame) {
+      engine.AdvanceFrame(kDeltaTime);
+      entity_manager.UpdateComponents(kDeltaTime);
+    }
+    scene->Clear();
+    scene_objects.PopulateScene(scene);
+  }
+};
+
+}  // namespace
+
+@interface ComponentUpdateTests : XCTestCase
+@end
+
+@implementation ComponentUpdateTests
+
+- (void)setUp {
+  [super setUp];
+  motive::OvershootInit::Register();
+  motive::SmoothInit::Register();
+  motive::MatrixInit::Register();
+}
+
+// Updating on the thread pool must leave every scene object exactly where a
+// serial update leaves it, and delete the same splatters.
+- (void)testParallelUpdateMatchesSerial {
+  ComponentWorld serial_world;
+  SceneDescription serial_scene;
+  serial_world.Run(nullptr, &serial_scene);
+
+  ThreadPool thread_pool;
+  thread_pool.Start(3);
+  ComponentWorld parallel_world;
+  SceneDescription parallel_scene;
+  parallel_world.Run(&thread_pool, &parallel_scene);
+  thread_pool.Stop();
+
+  // Some, but not all, of the splatters vanished.
+  const std::vector<Renderable>& serial = serial_scene.renderables();
+  const std::vector<Renderable>& parallel = parallel_scene.renderables();
+  XCTAssertEqual(serial.size(), parallel.size());
+  XCTAssertGreaterThan(serial.size(), static_cast<size_t>(1 + kNumProps));
+  const size_t num_scene_objects = 1 + kNumProps * (1 + kSplattersPerProp);
+  XCTAssertLessThan(serial.size(), num_scene_objects);
+  const size_t count = std::min(serial.size(), parallel.size());
+  for (size_t i = 0; i < count; ++i) {
+    XCTAssertEqual(memcmp(&serial[i].world_matrix(),
+                          &parallel[i].world_matrix(), sizeof(mathfu::mat4)),
+                   0);
+  }
+}
+
+@end
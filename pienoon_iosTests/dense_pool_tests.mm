@@ -0,0 +1,252 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <set>
+#include <vector>
+#include "entity/dense_pool.h"
+#include "entity/vector_pool.h"
+
+using fpl::DensePool;
+using fpl::VectorPool;
+using fpl::kAddToBack;
+
+namespace {
+
+// About the size of the component data the pools hold in the game.
+struct Element {
+  Element() : value(0) {
+    for (int i = 0; i < 16; ++i) matrix[i] = 0.0f;
+  }
+  int value;
+  float matrix[16];
+};
+
+// Adds elements with the values [0, count) to the pool, and returns their
+// handles, in order.
+std::vector<size_t> AddElements(DensePool<Element>* pool, int count) {
+  std::vector<size_t> handles;
+  for (int i = 0; i < count; ++i) {
+    DensePool<Element>::Iterator it = pool->GetNewElement(kAddToBack);
+    it->value = i;
+    handles.push_back(it.index());
+  }
+  return handles;
+}
+
+// Returns whether every handle resolves to the element with the value at the
+// same position, and the pool holds nothing else.
+bool HandlesResolve(const DensePool<Element>& pool,
+                    const std::vector<size_t>& handles,
+                    const std::vector<int>& values) {
+  if (pool.active_count() != handles.size()) return false;
+  for (size_t i = 0; i < handles.size(); ++i) {
+    const Element* element = pool.GetElementData(handles[i]);
+    if (!element || element->value != values[i]) return false;
+  }
+  return true;
+}
+
+// Fills a pool with `count` elements, then frees every third one and adds as
+// many back, so that a VectorPool's list of active elements jumps around in
+// memory the way a component's does after some churn.
+template <template <typename> class Pool>
+void FillWithChurn(Pool<Element>* pool, int count) {
+  pool->Reserve(count);
+  std::vector<size_t> indices;
+  for (int i = 0; i < count; ++i) {
+    indices.push_back(pool->GetNewElement(kAddToBack).index());
+  }
+  for (int i = 0; i < count; i += 3) pool->FreeElement(indices[i]);
+  for (int i = 0; i < count; i += 3) pool->GetNewElement(kAddToBack);
+  int value = 0;
+  for (auto it = pool->begin(); it != pool->end(); ++it) {
+    it->value = value++;
+    it->matrix[0] = 1.0f;
+  }
+}
+
+// Visits every element of the pool 100 times, as a component's update does
+// over 100 frames, and returns a sum of them.
+template <template <typename> class Pool>
+float IteratePool(Pool<Element>* pool) {
+  float sum = 0.0f;
+  for (int pass = 0; pass < 100; ++pass) {
+    for (auto it = pool->begin(); it != pool->end(); ++it) {
+      it->matrix[1] += it->matrix[0];
+      sum += it->matrix[1];
+    }
+  }
+  return sum;
+}
+
+}  // namespace
+
+@interface DensePoolTests : XCTestCase
+@end
+
+@implementation DensePoolTests
+
+// Freeing through the iterator moves the last element into the freed slot,
+// which the loop must still visit, and each element is visited once.
+- (void)testFreeDuringIteration {
+  DensePool<Element> pool;
+  const std::vector<size_t> all = AddElements(&pool, 10);
+  std::multiset<int> visited;
+  for (auto it = pool.begin(); it != pool.end();) {
+    visited.insert(it->value);
+    if (it->value % 3 == 0) {
+      it = pool.FreeElement(it);
+    } else {
+      ++it;
+    }
+  }
+  XCTAssertEqual(visited.size(), static_cast<size_t>(10));
+  XCTAssertEqual(std::set<int>(visited.begin(), visited.end()).size(),
+                 static_cast<size_t>(10));
+
+  std::vector<size_t> handles;
+  std::vector<int> values;
+  for (int i = 0; i < 10; ++i) {
+    if (i % 3 == 0) {
+      XCTAssertTrue(pool.GetElementData(all[i]) == nullptr);
+    } else {
+      handles.push_back(all[i]);
+      values.push_back(i);
+    }
+  }
+  XCTAssertTrue(HandlesResolve(pool, handles, values));
+}
+
+// Freeing the element in the last slot has nothing to move into its place.
+- (void)testFreeLastElement {
+  DensePool<Element> pool;
+  std::vector<size_t> handles = AddElements(&pool, 3);
+  std::vector<int> values = {0, 1, 2};
+  pool.FreeElement(handles.back());
+  XCTAssertTrue(pool.GetElementData(handles.back()) == nullptr);
+  handles.pop_back();
+  values.pop_back();
+  XCTAssertTrue(HandlesResolve(pool, handles, values));
+
+  // Through an iterator, the next element to visit is then the end.
+  DensePool<Element>::Iterator last = pool.begin();
+  ++last;
+  last = pool.FreeElement(last);
+  XCTAssertTrue(last == pool.end());
+  handles.pop_back();
+  values.pop_back();
+  XCTAssertTrue(HandlesResolve(pool, handles, values));
+
+  // And freeing the only element empties the pool.
+  DensePool<Element>::Iterator only = pool.FreeElement(pool.begin());
+  XCTAssertTrue(only == pool.end());
+  XCTAssertTrue(pool.begin() == pool.end());
+  XCTAssertEqual(pool.active_count(), static_cast<size_t>(0));
+}
+
+// Freeing an element from the middle moves the last one, whose handle must
+// still find it.
+- (void)testFreeElementIterator {
+  DensePool<Element> pool;
+  const std::vector<size_t> all = AddElements(&pool, 5);
+  DensePool<Element>::Iterator it = pool.begin();
+  ++it;
+  it = pool.FreeElement(it);
+  XCTAssertEqual(it->value, 4);
+  XCTAssertEqual(it.index(), all[4]);
+  XCTAssertTrue(pool.GetElementData(all[1]) == nullptr);
+  XCTAssertTrue(HandlesResolve(pool, {all[0], all[2], all[3], all[4]},
+                               {0, 2, 3, 4}));
+}
+
+// A freed handle is handed out again, for a new default constructed element,
+// and the other handles are undisturbed.
+- (void)testHandleReuseAfterFree {
+  DensePool<Element> pool;
+  const std::vector<size_t> all = AddElements(&pool, 4);
+  pool.FreeElement(all[1]);
+  XCTAssertTrue(pool.GetElementData(all[1]) == nullptr);
+  XCTAssertEqual(pool.Size(), static_cast<size_t>(4));
+
+  DensePool<Element>::Iterator it = pool.GetNewElement(kAddToBack);
+  XCTAssertEqual(it.index(), all[1]);
+  XCTAssertEqual(it->value, 0);
+  it->value = 10;
+  XCTAssertEqual(pool.Size(), static_cast<size_t>(4));
+  XCTAssertTrue(HandlesResolve(pool, all, {0, 10, 2, 3}));
+
+  // Once the free handles are used up, new ones are added.
+  XCTAssertEqual(pool.GetNewElement(kAddToBack).index(),
+                 static_cast<size_t>(4));
+}
+
+// Iterating over pools after add/remove churn, as components do each frame.
+- (void)testDensePoolIteration10k {
+  DensePool<Element> pool;
+  FillWithChurn(&pool, 10000);
+  DensePool<Element>* p = &pool;
+  [self measureBlock:^{
+    XCTAssertGreaterThan(IteratePool(p), 0.0f);
+  }];
+}
+
+- (void)testDensePoolIteration50k {
+  DensePool<Element> pool;
+  FillWithChurn(&pool, 50000);
+  DensePool<Element>* p = &pool;
+  [self measureBlock:^{
+    XCTAssertGreaterThan(IteratePool(p), 0.0f);
+  }];
+}
+
+- (void)testDensePoolIteration100k {
+  DensePool<Element> pool;
+  FillWithChurn(&pool, 100000);
+  DensePool<Element>* p = &pool;
+  [self measureBlock:^{
+    XCTAssertGreaterThan(IteratePool(p), 0.0f);
+  }];
+}
+
+- (void)testVectorPoolIteration10k {
+  VectorPool<Element> pool;
+  FillWithChurn(&pool, 10000);
+  VectorPool<Element>* p = &pool;
+  [self measureBlock:^{
+    XCTAssertGreaterThan(IteratePool(p), 0.0f);
+  }];
+}
+
+- (void)testVectorPoolIteration50k {
+  VectorPool<Element> pool;
+  FillWithChurn(&pool, 50000);
+  VectorPool<Element>* p = &pool;
+  [self measureBlock:^{
+    XCTAssertGreaterThan(IteratePool(p), 0.0f);
+  }];
+}
+
+- (void)testVectorPoolIteration100k {
+  VectorPool<Element> pool;
+  FillWithChurn(&pool, 100000);
+  VectorPool<Element>* p = &pool;
+  [self measureBlock:^{
+    XCTAssertGreaterThan(IteratePool(p), 0.0f);
+  }];
+}
+
+@end
@@ -0,0 +1,179 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <vector>
+#include "entity/component.h"
+#include "entity/entity_manager.h"
+#include "entity/vector_pool.h"
+
+using fpl::VectorPool;
+using fpl::entity::EntityManager;
+using fpl::entity::EntityRef;
+
+namespace {
+
+struct CountData {
+  CountData() : value(-1) {}
+  int value;
+};
+
+struct DenseCountData {
+  DenseCountData() : value(-1) {}
+  int value;
+};
+
+// A component of each kind of storage, holding a number per entity.
+class CountComponent : public fpl::entity::Component<CountData> {
+ public:
+  virtual void AddFromRawData(EntityRef& /*entity*/, const void* /*data*/) {}
+};
+
+class DenseCountComponent
+    : public fpl::entity::Component<DenseCountData, fpl::DensePool> {
+ public:
+  virtual void AddFromRawData(EntityRef& /*entity*/, const void* /*data*/) {}
+};
+
+}  // namespace
+
+FPL_ENTITY_REGISTER_COMPONENT(CountComponent, CountData, 1)
+FPL_ENTITY_REGISTER_COMPONENT(DenseCountComponent, DenseCountData, 2)
+
+namespace {
+
+// Returns whether every entity finds its data in both components, holding
+// the entity's position in `entities`.
+bool EntitiesResolve(EntityManager* entity_manager,
+                     std::vector<EntityRef>* entities) {
+  for (size_t i = 0; i < entities->size(); ++i) {
+    EntityRef& entity = (*entities)[i];
+    const CountData* count =
+        entity_manager->GetComponentData<CountData>(entity);
+    const DenseCountData* dense_count =
+        entity_manager->GetComponentData<DenseCountData>(entity);
+    if (!count || count->value != static_cast<int>(i) || !dense_count ||
+        dense_count->value != static_cast<int>(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+@interface EntityManagerTests : XCTestCase
+@end
+
+@implementation EntityManagerTests
+
+// After entities come and go, compacting packs each component's data and
+// every entity still finds its own, as GameState::Reset relies on.
+- (void)testCompactComponentsKeepsEntitiesResolving {
+  EntityManager entity_manager;
+  CountComponent counts;
+  DenseCountComponent dense_counts;
+  entity_manager.RegisterComponent<CountComponent>(&counts);
+  entity_manager.RegisterComponent<DenseCountComponent>(&dense_counts);
+
+  std::vector<EntityRef> entities;
+  for (int i = 0; i < 100; ++i) {
+    EntityRef entity = entity_manager.AllocateNewEntity();
+    counts.AddEntity(entity);
+    dense_counts.AddEntity(entity);
+    entities.push_back(entity);
+  }
+  std::vector<EntityRef> live;
+  for (size_t i = 0; i < entities.size(); ++i) {
+    if (i % 3 == 0) {
+      entity_manager.DeleteEntityImmediately(entities[i]);
+    } else {
+      live.push_back(entities[i]);
+    }
+  }
+  for (int i = 0; i < 10; ++i) {
+    EntityRef entity = entity_manager.AllocateNewEntity();
+    counts.AddEntity(entity);
+    dense_counts.AddEntity(entity);
+    live.push_back(entity);
+  }
+  for (size_t i = 0; i < live.size(); ++i) {
+    counts.GetEntityData(live[i])->value = static_cast<int>(i);
+    dense_counts.GetEntityData(live[i])->value = static_cast<int>(i);
+  }
+  XCTAssertTrue(EntitiesResolve(&entity_manager, &live));
+
+  entity_manager.CompactComponents();
+  XCTAssertTrue(EntitiesResolve(&entity_manager, &live));
+  for (size_t i = 0; i < entities.size(); i += 3) {
+    XCTAssertFalse(entities[i].IsValid());
+  }
+
+  // The data is packed, in iteration order.
+  size_t num_counts = 0;
+  size_t last_index = 0;
+  for (auto it = counts.begin(); it != counts.end(); ++it) {
+    XCTAssertTrue(num_counts == 0 || it.index() == last_index + 1);
+    last_index = it.index();
+    num_counts++;
+  }
+  XCTAssertEqual(num_counts, live.size());
+
+  // And entities can still be added and removed afterwards.
+  EntityRef entity = entity_manager.AllocateNewEntity();
+  counts.AddEntity(entity);
+  dense_counts.AddEntity(entity);
+  counts.GetEntityData(entity)->value = static_cast<int>(live.size());
+  dense_counts.GetEntityData(entity)->value = static_cast<int>(live.size());
+  live.push_back(entity);
+  entity_manager.DeleteEntityImmediately(live[0]);
+  live.erase(live.begin());
+  for (size_t i = 0; i < live.size(); ++i) {
+    counts.GetEntityData(live[i])->value = static_cast<int>(i);
+    dense_counts.GetEntityData(live[i])->value = static_cast<int>(i);
+  }
+  XCTAssertTrue(EntitiesResolve(&entity_manager, &live));
+}
+
+// References to a compacted pool's elements are invalid, never pointing at
+// another element, until they're remapped.
+- (void)testCompactRemapsReferences {
+  VectorPool<int> pool;
+  std::vector<VectorPool<int>::VectorPoolReference> refs;
+  for (int i = 0; i < 20; ++i) {
+    VectorPool<int>::VectorPoolReference ref =
+        pool.GetNewElement(fpl::kAddToBack);
+    *ref = i;
+    refs.push_back(ref);
+  }
+  for (int i = 0; i < 20; i += 2) pool.FreeElement(refs[i]);
+
+  std::vector<size_t> remap;
+  pool.Compact(&remap);
+  XCTAssertEqual(pool.active_count(), static_cast<size_t>(10));
+  for (int i = 0; i < 20; ++i) {
+    VectorPool<int>::VectorPoolReference stale = refs[i];
+    refs[i].Remap(remap);
+    if (i % 2 == 0) {
+      XCTAssertFalse(refs[i].IsValid());
+    } else {
+      XCTAssertTrue(refs[i].IsValid() && *refs[i] == i);
+      XCTAssertTrue(!stale.IsValid() || *stale == i);
+    }
+  }
+}
+
+@end
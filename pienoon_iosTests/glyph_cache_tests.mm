@@ -0,0 +1,288 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <cmath>
+#include <random>
+#include <utility>
+#include <vector>
+#include "glyph_cache.h"
+
+using fpl::GlyphCache;
+using fpl::GlyphCacheEntry;
+using mathfu::vec2i;
+
+namespace {
+
+// First code point of the CJK Unified Ideographs block.
+const uint32_t kFirstIdeograph = 0x4E00;
+
+// The texel a glyph has at (x, y) in these tests, never 0 so that an empty
+// cache texel doesn't pass for one.
+uint8_t GlyphTexel(uint32_t code_point, int32_t y_size, int x, int y) {
+  return static_cast<uint8_t>((code_point * 31 + y_size * 7 + x * 3 + y * 5) |
+                              1);
+}
+
+vec2i GlyphSize(uint32_t code_point, int32_t y_size) {
+  return vec2i(y_size - 2 - static_cast<int>(code_point % 5),
+               y_size - 1 - static_cast<int>(code_point % 3));
+}
+
+// Text that draws from a large set of ideographs, a few of them far more
+// often than the rest, at a mix of sizes, like a page of Chinese text.
+class CjkText {
+ public:
+  explicit CjkText(int num_code_points) : random_(1), size_({5, 4, 2, 1}) {
+    std::vector<double> weights(num_code_points);
+    for (int i = 0; i < num_code_points; ++i) {
+      weights[i] = 1.0 / std::pow(i + 1, 0.9);
+    }
+    code_point_ = std::discrete_distribution<int>(weights.begin(),
+                                                  weights.end());
+  }
+
+  // Returns the next glyph's code point, from the first `limit` ones, and
+  // size.
+  std::pair<uint32_t, int32_t> Next(int limit) {
+    static const int32_t kSizes[] = {16, 24, 32, 48};
+    const uint32_t code_point = kFirstIdeograph + code_point_(random_) % limit;
+    return std::make_pair(code_point, kSizes[size_(random_)]);
+  }
+
+ private:
+  std::mt19937 random_;
+  std::discrete_distribution<int> code_point_;
+  std::discrete_distribution<int> size_;
+};
+
+// Finds the glyph, or rasterizes it into the cache, flushing the cache if
+// even that fails, as FontManager does. Returns null if it doesn't fit at all.
+const GlyphCacheEntry* FindOrSet(GlyphCache<uint8_t>* cache,
+                                 uint32_t code_point, int32_t y_size,
+                                 bool* flushed) {
+  const GlyphCacheEntry* cached = cache->Find(code_point, y_size);
+  if (cached) return cached;
+  GlyphCacheEntry entry;
+  entry.set_code_point(code_point);
+  const vec2i size = GlyphSize(code_point, y_size);
+  entry.set_size(size);
+  std::vector<uint8_t> image(size.x() * size.y());
+  for (int y = 0; y < size.y(); ++y) {
+    for (int x = 0; x < size.x(); ++x) {
+      image[y * size.x() + x] = GlyphTexel(code_point, y_size, x, y);
+    }
+  }
+  cached = cache->Set(image.data(), y_size, entry);
+  if (!cached) {
+    cache->Flush();
+    *flushed = true;
+    cached = cache->Set(image.data(), y_size, entry);
+  }
+  return cached;
+}
+
+// Returns whether the glyph's texels in `buffer`, a copy of its page, are
+// the ones it was set with.
+bool GlyphIntact(const GlyphCache<uint8_t>& cache, const uint8_t* buffer,
+                 uint32_t code_point, int32_t y_size,
+                 const GlyphCacheEntry& entry) {
+  const vec2i page_size = cache.get_size();
+  const vec2i pos(mathfu::vec2(entry.get_uv().x(), entry.get_uv().y()) *
+                      mathfu::vec2(page_size) +
+                  0.5f);
+  for (int y = 0; y < entry.get_size().y(); ++y) {
+    for (int x = 0; x < entry.get_size().x(); ++x) {
+      if (buffer[(pos.y() + y) * page_size.x() + pos.x() + x] !=
+          GlyphTexel(code_point, y_size, x, y)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+@interface GlyphCacheTests : XCTestCase
+@end
+
+@implementation GlyphCacheTests
+
+// Glyphs used in the current cycle can't be evicted, so once they fill the
+// cache Set fails and leaves them alone. In the next cycle they can go.
+- (void)testGlyphsInUseAreNeverEvicted {
+  GlyphCache<uint8_t> cache(vec2i(64, 64));
+  cache.Update();
+  uint32_t code_point = kFirstIdeograph;
+  int num_set = 0;
+  for (;; ++code_point) {
+    GlyphCacheEntry entry;
+    entry.set_code_point(code_point);
+    entry.set_size(GlyphSize(code_point, 16));
+    std::vector<uint8_t> image(16 * 16, 1);
+    if (!cache.Set(image.data(), 16, entry)) break;
+    num_set++;
+  }
+  XCTAssertEqual(cache.get_stats().set_failures, 1);
+  XCTAssertEqual(cache.get_stats().evictions, 0);
+  XCTAssertEqual(cache.get_num_glyphs(), num_set);
+
+  // The glyph that didn't fit does once the others are no longer in use.
+  cache.Update();
+  bool flushed = false;
+  const GlyphCacheEntry* entry = FindOrSet(&cache, code_point, 16, &flushed);
+  XCTAssertTrue(entry != nullptr);
+  XCTAssertFalse(flushed);
+  XCTAssertGreaterThan(cache.get_stats().evictions, 0);
+}
+
+// A burst of more distinct glyphs than one page holds, then a long quiet
+// spell. Every glyph used in a cycle must be intact at the end of it,
+// through evictions, extra pages and their release.
+- (void)testStressKeepsGlyphsIntact {
+  const int kBusyCycles = 600;
+  const int kQuietCycles = 1200;
+  const int kBusyGlyphsPerCycle = 150;
+  const int kQuietGlyphsPerCycle = 20;
+  const int kMaxPages = 4;
+  GlyphCache<uint8_t> cache(vec2i(256, 256), kMaxPages);
+  CjkText text(6000);
+  int num_flushes = 0;
+  int most_pages = 0;
+  int num_damaged = 0;
+  std::vector<std::pair<uint32_t, int32_t>> used;
+  for (int cycle = 0; cycle < kBusyCycles + kQuietCycles; ++cycle) {
+    cache.Update();
+    const bool busy = cycle < kBusyCycles;
+    const int num_glyphs = busy ? kBusyGlyphsPerCycle : kQuietGlyphsPerCycle;
+    used.clear();
+    for (int i = 0; i < num_glyphs; ++i) {
+      const std::pair<uint32_t, int32_t> glyph = text.Next(busy ? 6000 : 50);
+      bool flushed = false;
+      const GlyphCacheEntry* entry =
+          FindOrSet(&cache, glyph.first, glyph.second, &flushed);
+      XCTAssertTrue(entry != nullptr);
+      if (flushed) {
+        num_flushes++;
+        used.clear();
+      }
+      used.push_back(glyph);
+    }
+    most_pages = std::max(most_pages, cache.get_num_live_pages());
+
+    for (auto it = used.begin(); it != used.end(); ++it) {
+      const GlyphCacheEntry* entry = cache.Find(it->first, it->second);
+      if (!entry || !GlyphIntact(cache, cache.get_buffer(entry->get_page()),
+                                 it->first, it->second, *entry)) {
+        num_damaged++;
+      }
+    }
+  }
+  NSLog(@"%d flushes, %d evictions, %d defragmentations, pages: %d most, "
+        @"%d added, %d released",
+        num_flushes, cache.get_stats().evictions,
+        cache.get_stats().defragmentations, most_pages,
+        cache.get_stats().pages_added, cache.get_stats().pages_released);
+  XCTAssertEqual(num_damaged, 0);
+  XCTAssertGreaterThan(most_pages, 1);
+  XCTAssertLessThanOrEqual(most_pages, kMaxPages);
+  XCTAssertGreaterThan(cache.get_stats().evictions, 0);
+  XCTAssertGreaterThan(cache.get_stats().pages_released, 0);
+  XCTAssertLessThan(cache.get_num_live_pages(), most_pages);
+}
+
+// Uploading only the dirty rects of each page must keep a copy of the pages,
+// standing in for the textures, identical to the cache where glyphs are.
+- (void)testDirtyRectsCoverEveryChange {
+  const int kPageSize = 256;
+  GlyphCache<uint8_t> cache(vec2i(kPageSize, kPageSize), 4);
+  CjkText text(6000);
+  std::vector<std::vector<uint8_t>> textures;
+  std::vector<std::pair<uint32_t, int32_t>> used;
+  int num_overlaps = 0;
+  int num_stale = 0;
+  for (int cycle = 0; cycle < 600; ++cycle) {
+    cache.Update();
+    used.clear();
+    for (int i = 0; i < 150; ++i) {
+      const std::pair<uint32_t, int32_t> glyph = text.Next(6000);
+      bool flushed = false;
+      FindOrSet(&cache, glyph.first, glyph.second, &flushed);
+      if (flushed) used.clear();
+      used.push_back(glyph);
+    }
+
+    textures.resize(cache.get_num_pages());
+    for (int page = 0; page < cache.get_num_pages(); ++page) {
+      if (!cache.has_page(page)) {
+        textures[page].clear();
+        continue;
+      }
+      const uint8_t* buffer = cache.get_buffer(page);
+      if (textures[page].empty()) {
+        textures[page].assign(buffer, buffer + kPageSize * kPageSize);
+        cache.set_dirty_state(page, false);
+        continue;
+      }
+      const std::vector<mathfu::vec4i>& rects = cache.get_dirty_rects(page);
+      for (size_t i = 0; i < rects.size(); ++i) {
+        const mathfu::vec4i& r = rects[i];
+        for (size_t j = i + 1; j < rects.size(); ++j) {
+          const mathfu::vec4i& q = rects[j];
+          if (r.x() < q.z() && q.x() < r.z() && r.y() < q.w() &&
+              q.y() < r.w()) {
+            num_overlaps++;
+          }
+        }
+        for (int y = r.y(); y < r.w(); ++y) {
+          memcpy(&textures[page][y * kPageSize + r.x()],
+                 buffer + y * kPageSize + r.x(), r.z() - r.x());
+        }
+      }
+      cache.set_dirty_state(page, false);
+    }
+
+    for (auto it = used.begin(); it != used.end(); ++it) {
+      const GlyphCacheEntry* entry = cache.Find(it->first, it->second);
+      if (!entry || !GlyphIntact(cache, textures[entry->get_page()].data(),
+                                 it->first, it->second, *entry)) {
+        num_stale++;
+      }
+    }
+  }
+  XCTAssertEqual(num_overlaps, 0);
+  XCTAssertEqual(num_stale, 0);
+}
+
+// Laying out CJK text through a cache too small for all of it: 300 cycles
+// of 400 glyphs drawn from 3000 ideographs.
+- (void)testCjkBenchmark {
+  [self measureBlock:^{
+    GlyphCache<uint8_t> cache(vec2i(512, 512), 4);
+    CjkText text(3000);
+    for (int cycle = 0; cycle < 300; ++cycle) {
+      cache.Update();
+      for (int i = 0; i < 400; ++i) {
+        const std::pair<uint32_t, int32_t> glyph = text.Next(3000);
+        bool flushed = false;
+        FindOrSet(&cache, glyph.first, glyph.second, &flushed);
+      }
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,107 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <string.h>
+#include <random>
+#include <vector>
+#include "particles.h"
+
+using fpl::pie_noon::Particle;
+using fpl::pie_noon::ParticleManager;
+using mathfu::vec3;
+using mathfu::vec4;
+
+namespace {
+
+// Adds `count` particles with random values in every channel.
+void AddRandomParticles(ParticleManager* particle_manager, int count) {
+  std::mt19937 random(1);
+  std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+  auto random_vec3 = [&]() {
+    const float x = value(random);
+    const float y = value(random);
+    const float z = value(random);
+    return vec3(x, y, z);
+  };
+  for (int i = 0; i < count; ++i) {
+    Particle p = particle_manager->CreateParticle();
+    p.set_base_position(random_vec3());
+    p.set_base_velocity(random_vec3());
+    p.set_acceleration(random_vec3());
+    p.set_base_orientation(random_vec3());
+    p.set_rotational_velocity(random_vec3() * 0.01f);
+    p.set_base_scale(random_vec3());
+    const vec3 tint = random_vec3();
+    p.set_base_tint(vec4(tint, value(random)));
+    p.set_duration(static_cast<fpl::WorldTime>(1000 + 50 * value(random)));
+    p.set_duration_of_fade_out(500);
+    p.set_duration_of_shrink_out(300);
+  }
+}
+
+// Returns the number of particles whose batched matrix or tint differs in
+// any bit from the one Particle computes on its own.
+int CountMismatches(const ParticleManager& particle_manager) {
+  const size_t num_particles = particle_manager.num_particles();
+  std::vector<mathfu::mat4> matrices(num_particles + 1);
+  std::vector<vec4> tints(num_particles + 1);
+  particle_manager.CalculateRenderData(matrices.data(), tints.data());
+  int mismatches = 0;
+  for (size_t i = 0; i < num_particles; ++i) {
+    const Particle p = particle_manager.particle(i);
+    const mathfu::mat4 matrix = p.CalculateMatrix();
+    const vec4 tint = p.CurrentTint();
+    if (memcmp(&matrix, &matrices[i], sizeof(matrix)) != 0 ||
+        memcmp(&tint, &tints[i], sizeof(tint)) != 0) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+}  // namespace
+
+@interface ParticleTests : XCTestCase
+@end
+
+@implementation ParticleTests
+
+// The batched kernel must give exactly the per-particle results, part way
+// through the particles' lives, fading and shrinking.
+- (void)testBatchMatchesScalar {
+  ParticleManager particle_manager;
+  AddRandomParticles(&particle_manager, 999);
+  particle_manager.AdvanceFrame(700);
+  XCTAssertGreaterThan(particle_manager.num_particles(),
+                       static_cast<size_t>(100));
+  XCTAssertEqual(CountMismatches(particle_manager), 0);
+}
+
+// Counts that leave a tail of fewer than four particles, which takes the
+// per-particle path, and counts too small for a whole batch.
+- (void)testBatchTails {
+  for (int count = 0; count <= 9; ++count) {
+    ParticleManager particle_manager;
+    AddRandomParticles(&particle_manager, count);
+    particle_manager.AdvanceFrame(10);
+    XCTAssertEqual(particle_manager.num_particles(),
+                   static_cast<size_t>(count));
+    XCTAssertEqual(CountMismatches(particle_manager), 0);
+  }
+}
+
+@end
@@ -0,0 +1,171 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <random>
+#include <vector>
+#include "pixel_convert.h"
+
+namespace {
+
+// Pixel counts around the SIMD widths, so every kernel runs with and without
+// a scalar tail, and a texture sized count.
+const size_t kSizes[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32,
+                         33, 63, 64, 65, 1000, 1024 * 1024 + 13};
+
+// Side of the square texture the benchmarks convert.
+const size_t kBenchmarkSide = 2048;
+
+std::vector<uint8_t> RandomBytes(size_t count) {
+  std::mt19937 random(static_cast<uint32_t>(count));
+  std::vector<uint8_t> bytes(count);
+  for (size_t i = 0; i < count; ++i) {
+    bytes[i] = static_cast<uint8_t>(random());
+  }
+  return bytes;
+}
+
+// Runs `convert` and `reference` on the same random pixels, at every size in
+// kSizes and from each of the first 3 bytes of the source, and returns the
+// number of runs whose outputs differ. Outputs start at an odd element, so
+// they aren't aligned either.
+template <typename Dst>
+int CountMismatches(void (*convert)(const uint8_t *, size_t, Dst *),
+                    void (*reference)(const uint8_t *, size_t, Dst *),
+                    size_t src_bytes_per_pixel, size_t dst_per_pixel) {
+  int mismatches = 0;
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+    const size_t num_pixels = kSizes[i];
+    const std::vector<uint8_t> src =
+        RandomBytes(num_pixels * src_bytes_per_pixel + 3);
+    for (size_t offset = 0; offset < 3; ++offset) {
+      std::vector<Dst> dst(num_pixels * dst_per_pixel + 1, 0);
+      std::vector<Dst> expected(dst);
+      convert(src.data() + offset, num_pixels, dst.data() + 1);
+      reference(src.data() + offset, num_pixels, expected.data() + 1);
+      if (dst != expected) mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+}  // namespace
+
+@interface PixelConvertTests : XCTestCase
+@end
+
+@implementation PixelConvertTests
+
+- (void)testRGBA8888To5551MatchesScalar {
+  XCTAssertEqual(CountMismatches(fpl::ConvertRGBA8888To5551,
+                                 fpl::ConvertRGBA8888To5551Scalar, 4, 1),
+                 0);
+}
+
+- (void)testRGB888To565MatchesScalar {
+  XCTAssertEqual(CountMismatches(fpl::ConvertRGB888To565,
+                                 fpl::ConvertRGB888To565Scalar, 3, 1),
+                 0);
+}
+
+- (void)testLuminanceMatchesScalar {
+  XCTAssertEqual(CountMismatches(fpl::ConvertRGBA8888ToLuminance,
+                                 fpl::ConvertRGBA8888ToLuminanceScalar, 4, 1),
+                 0);
+}
+
+- (void)testPremultiplyAlphaMatchesScalar {
+  XCTAssertEqual(CountMismatches(fpl::PremultiplyAlpha,
+                                 fpl::PremultiplyAlphaScalar, 4, 4),
+                 0);
+}
+
+// Every color and alpha pair, converted in place as the texture cache does,
+// against the scalar version and the rounding the header promises.
+- (void)testPremultiplyAlphaExhaustive {
+  std::vector<uint8_t> pixels;
+  for (int alpha = 0; alpha < 256; ++alpha) {
+    for (int value = 0; value < 256; ++value) {
+      const uint8_t pixel[] = {static_cast<uint8_t>(value),
+                               static_cast<uint8_t>(255 - value),
+                               static_cast<uint8_t>(value ^ 0x55),
+                               static_cast<uint8_t>(alpha)};
+      pixels.insert(pixels.end(), pixel, pixel + 4);
+    }
+  }
+  const size_t num_pixels = pixels.size() / 4;
+  std::vector<uint8_t> expected(pixels.size());
+  fpl::PremultiplyAlphaScalar(pixels.data(), num_pixels, expected.data());
+  std::vector<uint8_t> in_place(pixels);
+  fpl::PremultiplyAlpha(in_place.data(), num_pixels, in_place.data());
+  XCTAssertTrue(in_place == expected);
+
+  int wrong = 0;
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    const int alpha = pixels[i | 3];
+    const int rounded = (i & 3) == 3 ? alpha : (pixels[i] * alpha + 127) / 255;
+    if (expected[i] != rounded) wrong++;
+  }
+  XCTAssertEqual(wrong, 0);
+}
+
+// Converting a 2048x2048 texture, as CreateTexture does for 5551 and 565
+// formats, and with the scalar versions for comparison.
+- (void)testRGBA8888To5551Benchmark {
+  const std::vector<uint8_t> src =
+      RandomBytes(kBenchmarkSide * kBenchmarkSide * 4);
+  std::vector<uint16_t> dst(kBenchmarkSide * kBenchmarkSide);
+  const uint8_t *s = src.data();
+  uint16_t *d = dst.data();
+  [self measureBlock:^{
+    fpl::ConvertRGBA8888To5551(s, kBenchmarkSide * kBenchmarkSide, d);
+  }];
+}
+
+- (void)testRGBA8888To5551ScalarBenchmark {
+  const std::vector<uint8_t> src =
+      RandomBytes(kBenchmarkSide * kBenchmarkSide * 4);
+  std::vector<uint16_t> dst(kBenchmarkSide * kBenchmarkSide);
+  const uint8_t *s = src.data();
+  uint16_t *d = dst.data();
+  [self measureBlock:^{
+    fpl::ConvertRGBA8888To5551Scalar(s, kBenchmarkSide * kBenchmarkSide, d);
+  }];
+}
+
+- (void)testRGB888To565Benchmark {
+  const std::vector<uint8_t> src =
+      RandomBytes(kBenchmarkSide * kBenchmarkSide * 3);
+  std::vector<uint16_t> dst(kBenchmarkSide * kBenchmarkSide);
+  const uint8_t *s = src.data();
+  uint16_t *d = dst.data();
+  [self measureBlock:^{
+    fpl::ConvertRGB888To565(s, kBenchmarkSide * kBenchmarkSide, d);
+  }];
+}
+
+- (void)testRGB888To565ScalarBenchmark {
+  const std::vector<uint8_t> src =
+      RandomBytes(kBenchmarkSide * kBenchmarkSide * 3);
+  std::vector<uint16_t> dst(kBenchmarkSide * kBenchmarkSide);
+  const uint8_t *s = src.data();
+  uint16_t *d = dst.data();
+  [self measureBlock:^{
+    fpl::ConvertRGB888To565Scalar(s, kBenchmarkSide * kBenchmarkSide, d);
+  }];
+}
+
+@end
@@ -0,0 +1,179 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <type_traits>
+#include "render_queue.h"
+#include "renderer.h"
+
+using fpl::BatchQuad;
+using fpl::Material;
+using fpl::Mesh;
+using fpl::RenderQueue;
+using fpl::RenderQueueStats;
+using fpl::Renderer;
+using fpl::Shader;
+using fpl::kRenderPassBlended;
+using fpl::kRenderPassUnordered;
+
+namespace {
+
+// The layers PieNoonGame draws each cardboard cutout in.
+const int kLayerStick = 1;
+const int kLayerFront = 2;
+
+// What the queue needs to plan draws. Planning never touches the shaders'
+// programs or the meshes, so these need no GL: the shaders have program 0,
+// and the mesh is only ever passed by pointer, so it isn't constructed.
+struct QueueWorld {
+  QueueWorld()
+      : shader(0, 0, 0),
+        batch_shader(0, 0, 0),
+        unbatched_shader(0, 0, 0),
+        mesh(reinterpret_cast<Mesh *>(&mesh_storage)) {
+    queue.SetBatchShader(&shader, &batch_shader);
+  }
+
+  void Add(fpl::RenderPass pass, float depth, int layer, Material *material,
+           const BatchQuad *batch_quad) {
+    queue.Add(pass, depth, layer, &shader, mesh, material, renderer, nullptr,
+              batch_quad);
+  }
+
+  RenderQueue queue;
+  Renderer renderer;
+  Shader shader;
+  Shader batch_shader;
+  Shader unbatched_shader;
+  Material material;
+  Material other_material;
+  BatchQuad quad;
+  std::aligned_storage<sizeof(Mesh), alignof(Mesh)>::type mesh_storage;
+  Mesh *mesh;
+};
+
+}  // namespace
+
+@interface RenderQueueTests : XCTestCase
+@end
+
+@implementation RenderQueueTests
+
+// Shadows share a shader and texture, so the unordered pass draws them all
+// at once, whatever their depths.
+- (void)testShadowsMergeIntoOneBatch {
+  QueueWorld world;
+  for (int i = 0; i < 10; ++i) {
+    world.Add(kRenderPassUnordered, static_cast<float>(i % 3), 0,
+              &world.material, &world.quad);
+  }
+  world.queue.Sort();
+  const RenderQueueStats stats = world.queue.PlanDraws(kRenderPassUnordered);
+  XCTAssertEqual(stats.draws, 1);
+  XCTAssertEqual(stats.batches, 1);
+  XCTAssertEqual(stats.batched_quads, 10);
+  XCTAssertEqual(world.queue.PlanDraws(kRenderPassBlended).draws, 0);
+}
+
+// A draw with another material, without a quad, or with a shader that has
+// no batch shader, ends a run.
+- (void)testUnbatchableDrawsEndRuns {
+  QueueWorld world;
+  world.Add(kRenderPassBlended, 5.0f, 0, &world.material, &world.quad);
+  world.Add(kRenderPassBlended, 5.0f, 0, &world.material, &world.quad);
+  world.Add(kRenderPassBlended, 5.0f, 0, &world.other_material, &world.quad);
+  world.Add(kRenderPassBlended, 5.0f, 0, &world.material, &world.quad);
+  world.Add(kRenderPassBlended, 5.0f, 0, &world.material, nullptr);
+  world.Add(kRenderPassBlended, 5.0f, 0, &world.material, &world.quad);
+  world.queue.Add(kRenderPassBlended, 5.0f, 0, &world.unbatched_shader,
+                  world.mesh, &world.material, world.renderer, nullptr,
+                  &world.quad);
+  world.queue.Add(kRenderPassBlended, 5.0f, 0, &world.unbatched_shader,
+                  world.mesh, &world.material, world.renderer, nullptr,
+                  &world.quad);
+  world.queue.Sort();
+  const RenderQueueStats stats = world.queue.PlanDraws(kRenderPassBlended);
+  XCTAssertEqual(stats.draws, 7);
+  XCTAssertEqual(stats.batches, 1);
+  XCTAssertEqual(stats.batched_quads, 2);
+}
+
+// The blended pass as PieNoonGame queues it: a stick front, a stick back and
+// a front per cutout, each with its own material. Sorting back to front
+// comes first, so a cutout's draws only merge with those of cutouts at
+// exactly the same depth, or with a neighbor in depth that ends with the
+// same material the next one starts with.
+- (void)testBlendedPassMergesOnlyNeighborsInDepth {
+  QueueWorld world;
+  Material stick_front;
+  Material stick_back;
+  Material front;
+  for (int i = 0; i < 20; ++i) {
+    const float depth = 10.0f + i * 0.25f;
+    world.Add(kRenderPassBlended, depth, kLayerStick, &stick_front,
+              &world.quad);
+    world.Add(kRenderPassBlended, depth, kLayerStick, &stick_back,
+              &world.quad);
+    world.Add(kRenderPassBlended, depth, kLayerFront, &front, &world.quad);
+  }
+  world.queue.Sort();
+  RenderQueueStats stats = world.queue.PlanDraws(kRenderPassBlended);
+  XCTAssertEqual(stats.draws, 60);
+  XCTAssertEqual(stats.batches, 0);
+
+  // Two more cutouts at the depth of the first: the three fronts merge, but
+  // each stick still sits between sticks of the other material.
+  for (int i = 0; i < 2; ++i) {
+    world.Add(kRenderPassBlended, 10.0f, kLayerStick, &stick_front,
+              &world.quad);
+    world.Add(kRenderPassBlended, 10.0f, kLayerStick, &stick_back,
+              &world.quad);
+    world.Add(kRenderPassBlended, 10.0f, kLayerFront, &front, &world.quad);
+  }
+  world.queue.Sort();
+  stats = world.queue.PlanDraws(kRenderPassBlended);
+  XCTAssertEqual(stats.batches, 1);
+  XCTAssertEqual(stats.batched_quads, 3);
+  XCTAssertEqual(stats.draws, 64);
+
+  // Cutouts without sticks that share a front merge at any depths, as long
+  // as nothing else is drawn between them.
+  for (int i = 0; i < 4; ++i) {
+    world.Add(kRenderPassBlended, 100.0f + i, kLayerFront, &front,
+              &world.quad);
+  }
+  world.queue.Sort();
+  stats = world.queue.PlanDraws(kRenderPassBlended);
+  XCTAssertEqual(stats.batches, 2);
+  XCTAssertEqual(stats.batched_quads, 7);
+  XCTAssertEqual(stats.draws, 65);
+}
+
+// Batches are split where their 16-bit indices would overflow.
+- (void)testBatchSplitsAtIndexLimit {
+  QueueWorld world;
+  const int kNumQuads = 0x10000 / 4 + 1;
+  for (int i = 0; i < kNumQuads; ++i) {
+    world.Add(kRenderPassUnordered, 0.0f, 0, &world.material, &world.quad);
+  }
+  world.queue.Sort();
+  const RenderQueueStats stats = world.queue.PlanDraws(kRenderPassUnordered);
+  XCTAssertEqual(stats.draws, 2);
+  XCTAssertEqual(stats.batches, 2);
+  XCTAssertEqual(stats.batched_quads, kNumQuads);
+}
+
+@end
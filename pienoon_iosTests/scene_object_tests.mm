@@ -0,0 +1,185 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <vector>
+#include "components/scene_object.h"
+#include "entity/entity_manager.h"
+#include "motive/engine.h"
+#include "motive/init.h"
+#include "scene_description.h"
+
+using fpl::SceneDescription;
+using fpl::entity::EntityManager;
+using fpl::entity::EntityRef;
+using fpl::pie_noon::SceneObjectComponent;
+using fpl::pie_noon::SceneObjectData;
+using mathfu::vec3;
+
+namespace {
+
+bool Near(const vec3& a, const vec3& b) { return (a - b).Length() < 1e-5f; }
+
+// Characters in the benchmark, each a chain of kAccessoryDepth nested
+// scene objects with kAccessoriesPerLevel leaves at every level.
+const int kNumCharacters = 200;
+const int kAccessoryDepth = 8;
+const int kAccessoriesPerLevel = 3;
+const int kBenchmarkFrames = 100;
+
+// The scene objects of a test, outside of any game.
+struct SceneWorld {
+  motive::MotiveEngine engine;
+  EntityManager entity_manager;
+  SceneObjectComponent scene_objects;
+  SceneDescription scene;
+
+  SceneWorld() : scene_objects(&engine) {
+    entity_manager.RegisterComponent<SceneObjectComponent>(&scene_objects);
+  }
+
+  EntityRef AddObject(uint16_t renderable_id, const vec3& translation) {
+    EntityRef entity = entity_manager.AllocateNewEntity();
+    SceneObjectData* data = scene_objects.AddEntity(entity);
+    data->set_renderable_id(renderable_id);
+    data->SetTranslation(translation);
+    return entity;
+  }
+
+  // Advances the matrices, then returns the global position of the
+  // renderable with the given id.
+  vec3 GlobalPosition(uint16_t renderable_id) {
+    engine.AdvanceFrame(1);
+    scene.Clear();
+    scene_objects.PopulateScene(&scene);
+    for (auto it = scene.renderables().begin();
+         it != scene.renderables().end(); ++it) {
+      if (it->id() == renderable_id) {
+        return it->world_matrix().TranslationVector3D();
+      }
+    }
+    return vec3(-1000.0f);
+  }
+};
+
+// Builds the characters of the benchmark, and returns their roots.
+std::vector<EntityRef> AddCharacters(SceneWorld* world) {
+  std::vector<EntityRef> roots;
+  for (int i = 0; i < kNumCharacters; ++i) {
+    EntityRef parent =
+        world->AddObject(0, vec3(static_cast<float>(i), 0.0f, 0.0f));
+    roots.push_back(parent);
+    for (int depth = 0; depth < kAccessoryDepth; ++depth) {
+      for (int j = 0; j < kAccessoriesPerLevel; ++j) {
+        EntityRef accessory = world->AddObject(1, vec3(0.1f * j, 0.0f, 0.01f));
+        world->scene_objects.SetParent(accessory, parent);
+      }
+      EntityRef child = world->AddObject(2, vec3(0.0f, 0.5f, 0.0f));
+      world->scene_objects.GetEntityData(child)->SetRotationAboutZ(0.1f);
+      world->scene_objects.SetParent(child, parent);
+      parent = child;
+    }
+  }
+  return roots;
+}
+
+// Moves every `stride`th character each frame, and draws them all.
+void RunCharacters(SceneWorld* world, const std::vector<EntityRef>& roots,
+                   size_t stride) {
+  for (int frame = 0; frame < kBenchmarkFrames; ++frame) {
+    for (size_t i = frame % stride; i < roots.size(); i += stride) {
+      EntityRef root = roots[i];
+      world->scene_objects.GetEntityData(root)->SetRotationAboutY(
+          0.01f * frame);
+    }
+    world->engine.AdvanceFrame(1);
+    world->scene.Clear();
+    world->scene_objects.PopulateScene(&world->scene);
+  }
+}
+
+}  // namespace
+
+@interface SceneObjectTests : XCTestCase
+@end
+
+@implementation SceneObjectTests
+
+- (void)setUp {
+  [super setUp];
+  motive::MatrixInit::Register();
+}
+
+// Objects are sorted by depth, so one added before its parent still gets
+// the parent's transform, down a whole chain added leaf first.
+- (void)testChildAddedBeforeParent {
+  SceneWorld world;
+  EntityRef grandchild = world.AddObject(3, vec3(0.0f, 0.0f, 1.0f));
+  EntityRef child = world.AddObject(2, vec3(0.0f, 1.0f, 0.0f));
+  XCTAssertTrue(Near(world.GlobalPosition(3), vec3(0.0f, 0.0f, 1.0f)));
+
+  EntityRef parent = world.AddObject(1, vec3(1.0f, 2.0f, 3.0f));
+  world.scene_objects.SetParent(grandchild, child);
+  world.scene_objects.SetParent(child, parent);
+  XCTAssertTrue(Near(world.GlobalPosition(2), vec3(1.0f, 3.0f, 3.0f)));
+  XCTAssertTrue(Near(world.GlobalPosition(3), vec3(1.0f, 3.0f, 4.0f)));
+
+  // Moving the parent, without changing the hierarchy, moves the others.
+  world.scene_objects.GetEntityData(parent)->SetTranslation(
+      vec3(-1.0f, 0.0f, 0.0f));
+  XCTAssertTrue(Near(world.GlobalPosition(2), vec3(-1.0f, 1.0f, 0.0f)));
+  XCTAssertTrue(Near(world.GlobalPosition(3), vec3(-1.0f, 1.0f, 1.0f)));
+}
+
+// Hiding an object hides its descendants, whichever order they were added.
+- (void)testHiddenParentHidesChildren {
+  SceneWorld world;
+  EntityRef child = world.AddObject(2, vec3(0.0f, 1.0f, 0.0f));
+  EntityRef parent = world.AddObject(1, vec3(1.0f, 0.0f, 0.0f));
+  world.scene_objects.SetParent(child, parent);
+  world.scene_objects.GetEntityData(parent)->set_visible(false);
+  world.GlobalPosition(1);
+  XCTAssertEqual(world.scene.renderables().size(), static_cast<size_t>(0));
+
+  world.scene_objects.GetEntityData(parent)->set_visible(true);
+  XCTAssertTrue(Near(world.GlobalPosition(2), vec3(1.0f, 1.0f, 0.0f)));
+  XCTAssertEqual(world.scene.renderables().size(), static_cast<size_t>(2));
+}
+
+// Deep accessory hierarchies, all of them moving every frame.
+- (void)testMovingHierarchyBenchmark {
+  SceneWorld world;
+  const std::vector<EntityRef> roots = AddCharacters(&world);
+  SceneWorld* w = &world;
+  const std::vector<EntityRef>* r = &roots;
+  [self measureBlock:^{
+    RunCharacters(w, *r, 1);
+  }];
+}
+
+// The same hierarchies, with a tenth of them moving each frame, so most
+// subtrees keep their global matrices.
+- (void)testMostlyStillHierarchyBenchmark {
+  SceneWorld world;
+  const std::vector<EntityRef> roots = AddCharacters(&world);
+  SceneWorld* w = &world;
+  const std::vector<EntityRef>* r = &roots;
+  [self measureBlock:^{
+    RunCharacters(w, *r, 10);
+  }];
+}
+
+@end
@@ -0,0 +1,30 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIENOON_IOS_TESTS_TEST_ASSETS_H_
+#define PIENOON_IOS_TESTS_TEST_ASSETS_H_
+
+#import <Foundation/Foundation.h>
+
+#include <string>
+
+// Returns the path of `name` in the assets directory bundled with the app
+// that hosts the tests.
+inline std::string TestAssetPath(const char* name) {
+  NSString* assets = [[[NSBundle mainBundle] resourcePath]
+      stringByAppendingPathComponent:@"assets"];
+  return std::string([assets fileSystemRepresentation]) + "/" + name;
+}
+
+#endif  // PIENOON_IOS_TESTS_TEST_ASSETS_H_
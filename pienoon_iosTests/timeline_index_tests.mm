@@ -0,0 +1,213 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <XCTest/XCTest.h>
+
+#include "precompiled.h"
+#include <string>
+#include <vector>
+#include "character.h"
+#include "timeline_generated.h"
+#include "timeline_index.h"
+
+using fpl::Timeline;
+using fpl::TimelineAccessory;
+using fpl::TimelineRenderable;
+using fpl::WorldTime;
+using fpl::pie_noon::TimelineIndex;
+using fpl::pie_noon::TimelineIndexBeforeTime;
+using fpl::pie_noon::TimelineIndicesWithTime;
+
+namespace {
+
+// Builds a timeline with a renderable at each of renderable_times and an
+// accessory for each pair of accessory_times, into *buffer.  A null vector
+// leaves that member out of the timeline.
+const Timeline* BuildTimeline(const std::vector<uint16_t>* renderable_times,
+                              const std::vector<uint16_t>* accessory_times,
+                              std::string* buffer) {
+  flatbuffers::FlatBufferBuilder builder;
+  flatbuffers::Offset<flatbuffers::Vector<const TimelineRenderable*>>
+      renderables = 0;
+  if (renderable_times) {
+    std::vector<TimelineRenderable> structs;
+    for (size_t i = 0; i < renderable_times->size(); ++i) {
+      structs.push_back(TimelineRenderable((*renderable_times)[i],
+                                           static_cast<uint16_t>(i)));
+    }
+    renderables = builder.CreateVectorOfStructs(structs);
+  }
+  flatbuffers::Offset<flatbuffers::Vector<const TimelineAccessory*>>
+      accessories = 0;
+  if (accessory_times) {
+    std::vector<TimelineAccessory> structs;
+    for (size_t i = 0; i + 1 < accessory_times->size(); i += 2) {
+      structs.push_back(TimelineAccessory(
+          (*accessory_times)[i], (*accessory_times)[i + 1],
+          static_cast<uint16_t>(i), fpl::PixelOffset(0, 0)));
+    }
+    accessories = builder.CreateVectorOfStructs(structs);
+  }
+  builder.Finish(fpl::CreateTimeline(builder, 0, renderables, accessories));
+  buffer->assign(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                 builder.GetSize());
+  return fpl::GetTimeline(buffer->data());
+}
+
+// Counts the times in [begin_time, end_time) at which `index` disagrees with
+// the linear searches over `timeline`.
+int CountMismatches(const TimelineIndex& index, const Timeline* timeline,
+                    WorldTime begin_time, WorldTime end_time) {
+  auto renderables = timeline ? timeline->renderables() : nullptr;
+  auto accessories = timeline ? timeline->accessories() : nullptr;
+  int mismatches = 0;
+  for (WorldTime t = begin_time; t < end_time; ++t) {
+    if (index.RenderableIndexAtTime(t) !=
+        TimelineIndexBeforeTime(renderables, t)) {
+      mismatches++;
+    }
+    const int* indices = nullptr;
+    const int count = index.AccessoryIndicesAtTime(t, &indices);
+    const std::vector<int> expected = TimelineIndicesWithTime(accessories, t);
+    if (std::vector<int>(indices, indices + count) != expected) {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+}  // namespace
+
+@interface TimelineIndexTests : XCTestCase
+@end
+
+@implementation TimelineIndexTests
+
+- (void)testNullTimeline {
+  TimelineIndex index;
+  index.Bake(nullptr);
+  XCTAssertEqual(CountMismatches(index, nullptr, -100, 100), 0);
+}
+
+- (void)testEmptyTimelines {
+  const std::vector<uint16_t> empty;
+  std::string buffer;
+  TimelineIndex index;
+
+  const Timeline* no_members = BuildTimeline(nullptr, nullptr, &buffer);
+  index.Bake(no_members);
+  XCTAssertEqual(CountMismatches(index, no_members, -100, 100), 0);
+
+  const Timeline* empty_members = BuildTimeline(&empty, &empty, &buffer);
+  index.Bake(empty_members);
+  XCTAssertEqual(CountMismatches(index, empty_members, -100, 100), 0);
+}
+
+- (void)testSingleRenderable {
+  const std::vector<uint16_t> renderable_times(1, 50);
+  std::string buffer;
+  const Timeline* timeline = BuildTimeline(&renderable_times, nullptr, &buffer);
+  TimelineIndex index;
+  index.Bake(timeline);
+  XCTAssertEqual(CountMismatches(index, timeline, -100, 200), 0);
+}
+
+// Times before the start of the timeline show the first renderable, and no
+// accessories.
+- (void)testNegativeTimes {
+  const uint16_t renderable_times[] = {0, 0, 10, 20};
+  const uint16_t accessory_times[] = {0, 10, 5, 0};
+  const std::vector<uint16_t> renderables(
+      renderable_times, renderable_times + sizeof(renderable_times) / 2);
+  const std::vector<uint16_t> accessories(
+      accessory_times, accessory_times + sizeof(accessory_times) / 2);
+  std::string buffer;
+  const Timeline* timeline = BuildTimeline(&renderables, &accessories,
+                                           &buffer);
+  TimelineIndex index;
+  index.Bake(timeline);
+  XCTAssertEqual(index.RenderableIndexAtTime(-1), 0);
+  XCTAssertEqual(index.RenderableIndexAtTime(-1000), 0);
+  const int* indices = nullptr;
+  XCTAssertEqual(index.AccessoryIndicesAtTime(-1, &indices), 0);
+  XCTAssertEqual(CountMismatches(index, timeline, -1000, 100), 0);
+}
+
+// Renderables that share a time are stepped over together, to the last of
+// them, and an accessory ending as another starts hands over at that time.
+- (void)testEqualTimes {
+  const uint16_t renderable_times[] = {0, 10, 10, 10, 20, 20, 30};
+  const uint16_t accessory_times[] = {10, 20, 20, 30, 10, 20, 30, 0, 30, 30};
+  const std::vector<uint16_t> renderables(
+      renderable_times, renderable_times + sizeof(renderable_times) / 2);
+  const std::vector<uint16_t> accessories(
+      accessory_times, accessory_times + sizeof(accessory_times) / 2);
+  std::string buffer;
+  const Timeline* timeline = BuildTimeline(&renderables, &accessories,
+                                           &buffer);
+  TimelineIndex index;
+  index.Bake(timeline);
+  XCTAssertEqual(index.RenderableIndexAtTime(9), 0);
+  XCTAssertEqual(index.RenderableIndexAtTime(10), 3);
+  XCTAssertEqual(index.RenderableIndexAtTime(20), 5);
+  XCTAssertEqual(CountMismatches(index, timeline, -10, 50), 0);
+}
+
+// Renderables out of time order: the linear search stops at the first one
+// after t, which the index has to reproduce.
+- (void)testUnsortedTimes {
+  const uint16_t renderable_times[] = {40, 30, 10, 50, 20, 60};
+  const std::vector<uint16_t> renderables(
+      renderable_times, renderable_times + sizeof(renderable_times) / 2);
+  std::string buffer;
+  const Timeline* timeline = BuildTimeline(&renderables, nullptr, &buffer);
+  TimelineIndex index;
+  index.Bake(timeline);
+  XCTAssertEqual(CountMismatches(index, timeline, -10, 100), 0);
+}
+
+// Random timelines, including ones with repeated and out of order times.
+- (void)testRandomTimelines {
+  std::string buffer;
+  TimelineIndex index;
+  unsigned int seed = 1;
+  for (int n = 0; n < 200; ++n) {
+    std::vector<uint16_t> renderables;
+    std::vector<uint16_t> accessories;
+    uint16_t time = 0;
+    const int num_renderables = n % 12;
+    for (int i = 0; i < num_renderables; ++i) {
+      seed = seed * 1103515245 + 12345;
+      // Mostly increasing, sometimes repeated or going back.
+      time = static_cast<uint16_t>((seed >> 16) % 8 == 0
+                                       ? (seed >> 20) % 100
+                                       : time + (seed >> 16) % 20);
+      renderables.push_back(time);
+    }
+    const int num_accessories = n % 7;
+    for (int i = 0; i < num_accessories; ++i) {
+      seed = seed * 1103515245 + 12345;
+      const uint16_t start = static_cast<uint16_t>((seed >> 16) % 100);
+      const uint16_t length = static_cast<uint16_t>((seed >> 24) % 40);
+      accessories.push_back(start);
+      accessories.push_back(length == 0 ? 0 : start + length);
+    }
+    const Timeline* timeline = BuildTimeline(&renderables, &accessories,
+                                             &buffer);
+    index.Bake(timeline);
+    XCTAssertEqual(CountMismatches(index, timeline, -20, 200), 0);
+  }
+}
+
+@end
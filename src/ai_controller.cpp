@@ -57,11 +57,12 @@ void AiController::AdvanceFrame(WorldTime delta_time) {
 
   if (time_to_next_action_ > 0) return;
 
-  time_to_next_action_ = mathfu::RandomInRange<WorldTime>(
+  RandomGenerator& random = gamestate_->random();
+  time_to_next_action_ = random.InRange<WorldTime>(
       config_->ai_minimum_time_between_actions(),
       config_->ai_maximum_time_between_actions());
 
-  float action = mathfu::Random<float>();
+  float action = random.Random();
   if (action < config_->ai_chance_to_change_aim()) {
     if (action < config_->ai_chance_to_change_aim() / 2) {
       SetLogicalInputs(LogicalInputs_Left, true);
@@ -76,8 +77,8 @@ void AiController::AdvanceFrame(WorldTime delta_time) {
 
   if (!gamestate_->is_in_cardboard() &&
       IsInDanger(character_id_) &&
-      mathfu::Random<float>() < config_->ai_chance_to_block()) {
-    block_timer_ = mathfu::RandomInRange<WorldTime>(
+      random.Random() < config_->ai_chance_to_block()) {
+    block_timer_ = random.InRange<WorldTime>(
         config_->ai_block_min_duration(), config_->ai_block_max_duration());
     SetLogicalInputs(LogicalInputs_Deflect, true);
   }
@@ -17,34 +17,20 @@
 
 namespace fpl {
 
-// Push this to signal the worker thread that it's time to quit.
-class BookendAsyncResource : public AsyncResource {
-  static std::string kBookendFileName;
-
- public:
-  BookendAsyncResource() : AsyncResource(kBookendFileName) {}
-  virtual ~BookendAsyncResource() {}
-  virtual void Load() {}
-  virtual void Finalize() {}
-  static bool IsBookend(const AsyncResource &res) {
-    return res.filename() == kBookendFileName;
-  }
-};
-
-// static
-std::string BookendAsyncResource::kBookendFileName = "bookend";
-
-AsyncLoader::AsyncLoader() {
+AsyncLoader::AsyncLoader()
+    : next_sequence_(0),
+      num_loading_(0),
+      stopping_(false),
+      done_(nullptr),
+      finalize_head_(0) {
   mutex_ = SDL_CreateMutex();
   job_semaphore_ = SDL_CreateSemaphore(0);
-  worker_thread_ = nullptr;
   assert(mutex_ && job_semaphore_);
-    
 }
 
 AsyncLoader::~AsyncLoader() {
   StopLoadingWhenComplete();
-  SDL_WaitThread(worker_thread_, nullptr);
+  WaitForWorkers();
 
   if (mutex_) {
     SDL_DestroyMutex(mutex_);
@@ -56,29 +42,54 @@ AsyncLoader::~AsyncLoader() {
   }
 }
 
-void AsyncLoader::QueueJob(AsyncResource *res) {
-  Lock([this, res]() { queue_.push_back(res); });
+// static
+bool AsyncLoader::LoadsAfter(const AsyncResource *a, const AsyncResource *b) {
+  if (a->priority_ != b->priority_) return a->priority_ < b->priority_;
+  return a->sequence_ > b->sequence_;
+}
+
+void AsyncLoader::QueueJob(AsyncResource *res, int priority) {
+  Lock([this, res, priority]() {
+    res->priority_ = priority;
+    res->sequence_ = next_sequence_++;
+    queue_.push_back(res);
+    std::push_heap(queue_.begin(), queue_.end(), LoadsAfter);
+    num_loading_++;
+  });
   SDL_SemPost(job_semaphore_);
 }
 
 void AsyncLoader::LoaderWorker() {
   for (;;) {
-    auto res = LockReturn<AsyncResource *>(
-        [this]() { return queue_.empty() ? nullptr : queue_[0]; });
-    if (!res) {
-      SDL_SemWait(job_semaphore_);
-      continue;
-    }
-    // Stop loading once we reach the bookend enqueued by
-    // StopLoadingWhenComplete(). To start loading again, call StartLoading().
-    if (BookendAsyncResource::IsBookend(*res)) break;
+    SDL_SemWait(job_semaphore_);
+    AsyncResource *res = nullptr;
+    bool exit = false;
+    Lock([this, &res, &exit]() {
+      if (!queue_.empty()) {
+        std::pop_heap(queue_.begin(), queue_.end(), LoadsAfter);
+        res = queue_.back();
+        queue_.pop_back();
+      } else {
+        // Stop loading once the queue has drained after
+        // StopLoadingWhenComplete(). To start again, call StartLoading().
+        exit = stopping_;
+      }
+    });
+    if (exit) break;
+    if (!res) continue;
+
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "async load: %s",
                  res->filename_.c_str());
     res->Load();
-    Lock([this, res]() {
-      queue_.erase(queue_.begin());
-      done_.push_back(res);
-    });
+
+    // Hand the job to TryFinalize before it stops counting as loading, so
+    // that there's no moment when it's neither loading nor done.
+    void *head;
+    do {
+      head = SDL_AtomicGetPtr(&done_);
+      res->next_done_ = static_cast<AsyncResource *>(head);
+    } while (!SDL_AtomicCASPtr(&done_, head, res));
+    Lock([this]() { num_loading_--; });
   }
 }
 
@@ -87,29 +98,102 @@ int AsyncLoader::LoaderThread(void *user_data) {
   return 0;
 }
 
-void AsyncLoader::StartLoading() {
-  worker_thread_ =
-      SDL_CreateThread(AsyncLoader::LoaderThread, "FPL Loader Thread", this);
-  assert(worker_thread_);
+void AsyncLoader::StartLoading(int num_threads) {
+  // Finish off the workers of a previous StartLoading, if any. They only exit
+  // once told to stop, so do that first, or joining them never returns.
+  if (!worker_threads_.empty()) {
+    StopLoadingWhenComplete();
+    WaitForWorkers();
+  }
+  Lock([this]() { stopping_ = false; });
+  finalize_timings_.clear();
+
+  if (num_threads <= 0) num_threads = SDL_GetCPUCount();
+  num_threads = mathfu::Clamp(num_threads, 1, kMaxLoaderThreads);
+  for (int i = 0; i < num_threads; i++) {
+    auto thread =
+        SDL_CreateThread(AsyncLoader::LoaderThread, "FPL Loader Thread", this);
+    assert(thread);
+    worker_threads_.push_back(thread);
+  }
 }
 
 void AsyncLoader::StopLoadingWhenComplete() {
-  // When the loader thread hits the bookend, it will exit.
-  static BookendAsyncResource bookend;
-  QueueJob(&bookend);
+  // Each worker exits when it wakes up to find the queue empty.
+  Lock([this]() { stopping_ = true; });
+  for (size_t i = 0; i < worker_threads_.size(); i++) {
+    SDL_SemPost(job_semaphore_);
+  }
 }
 
-bool AsyncLoader::TryFinalize() {
-  for (;;) {
-    auto res = LockReturn<AsyncResource *>(
-        [this]() { return done_.empty() ? nullptr : done_[0]; });
-    if (!res) break;
+void AsyncLoader::WaitForWorkers() {
+  for (auto it = worker_threads_.begin(); it != worker_threads_.end(); ++it) {
+    SDL_WaitThread(*it, nullptr);
+  }
+  worker_threads_.clear();
+}
+
+// Returns microseconds since an arbitrary point in time.
+static int64_t MicrosecondsNow() {
+  static const uint64_t frequency = SDL_GetPerformanceFrequency();
+  const uint64_t counter = SDL_GetPerformanceCounter();
+  // Split the conversion, so that large counters can't overflow.
+  return static_cast<int64_t>((counter / frequency) * 1000000 +
+                              (counter % frequency) * 1000000 / frequency);
+}
+
+bool AsyncLoader::TryFinalize(int64_t budget_us, size_t budget_bytes) {
+  // Check before taking the finished jobs, so that if nothing was loading,
+  // everything it loaded is finalized below.
+  const bool all_loaded = LockReturn<bool>([this]() {
+    return num_loading_ == 0;
+  });
+
+  // Take all finished jobs at once. They come off the stack newest first, so
+  // reverse them to finalize in the order they finished.
+  auto res = static_cast<AsyncResource *>(SDL_AtomicSetPtr(&done_, nullptr));
+  AsyncResource *oldest = nullptr;
+  while (res) {
+    auto next = res->next_done_;
+    res->next_done_ = oldest;
+    oldest = res;
+    res = next;
+  }
+  for (res = oldest; res; res = res->next_done_) {
+    finalize_queue_.push_back(res);
+  }
+
+  const int64_t start_us = MicrosecondsNow();
+  size_t bytes = 0;
+  while (finalize_head_ < finalize_queue_.size()) {
+    res = finalize_queue_[finalize_head_];
+    const size_t size = res->FinalizeSize();
+    // Always finalize the first, or a single large resource could never fit.
+    if (budget_bytes && bytes && bytes + size > budget_bytes) break;
+
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "finalize: %s",
                  res->filename_.c_str());
+    FinalizeTiming timing;
+    timing.filename = res->filename_;
+    timing.bytes = size;
+    const int64_t res_start_us = MicrosecondsNow();
+    res->next_done_ = nullptr;
     res->Finalize();
-    Lock([this]() { done_.erase(done_.begin()); });
+    const int64_t end_us = MicrosecondsNow();
+    timing.microseconds = end_us - res_start_us;
+    finalize_timings_.push_back(timing);
+
+    finalize_head_++;
+    bytes += size;
+    if (budget_us && end_us - start_us >= budget_us) break;
+  }
+
+  // Reclaim the finalized prefix once it's all been consumed.
+  if (finalize_head_ == finalize_queue_.size()) {
+    finalize_queue_.clear();
+    finalize_head_ = 0;
   }
-  return LockReturn<bool>([this]() { return queue_.empty(); });
+  return all_loaded && finalize_queue_.empty();
 }
 
 }  // namespace fpl
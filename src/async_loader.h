@@ -23,49 +23,90 @@ class AsyncLoader;
 class AsyncResource {
  public:
   AsyncResource(const std::string &filename)
-      : filename_(filename), data_(nullptr) {}
+      : filename_(filename),
+        data_(nullptr),
+        priority_(0),
+        sequence_(0),
+        next_done_(nullptr) {}
   virtual ~AsyncResource() {}
 
   // Load should perform the actual loading of filename_, and store the
-  // result in data_, or nullptr upon failure. It is called on the loader
+  // result in data_, or nullptr upon failure. It is called on a loader
   // thread, so should not access any program state outside of this object.
-  // Since there will be only one loader thread, any libraries called by Load
-  // need not be MT-safe as long as they're not also called by the main thread.
+  // There are several loader threads, so any libraries called by Load must
+  // be safe to call for different resources at the same time.
   virtual void Load() = 0;
 
   // This should implement the behavior of turning data_ into the actual
   // desired resource. Called on the main thread only.
   virtual void Finalize() = 0;
 
+  // Roughly how many bytes Finalize() will hand to the GPU or copy, used to
+  // spread finalization over several frames. Called on the main thread,
+  // after Load() and before Finalize().
+  virtual size_t FinalizeSize() const { return 0; }
+
   const std::string &filename() const { return filename_; }
 
  protected:
   std::string filename_;
   uint8_t *data_;
 
+ private:
+  // Bookkeeping for AsyncLoader.
+  int priority_;
+  uint64_t sequence_;
+  AsyncResource *next_done_;
+
   friend class AsyncLoader;
 };
 
+// How long one AsyncResource::Finalize() call took.
+struct FinalizeTiming {
+  std::string filename;
+  // AsyncResource::FinalizeSize() of the resource.
+  size_t bytes;
+  int64_t microseconds;
+};
+
+// Loads resources on a pool of worker threads, then finalizes them on the
+// main thread.
 class AsyncLoader {
  public:
   AsyncLoader();
   ~AsyncLoader();
 
-  // Call this any number of times before StartLoading.
-  void QueueJob(AsyncResource *res);
+  // Call this any number of times, before or after StartLoading. Jobs with
+  // a higher priority are loaded first. Jobs with equal priority are loaded
+  // in the order they were queued.
+  void QueueJob(AsyncResource *res, int priority = 0);
 
-  // Launches the loading thread.
-  void StartLoading();
+  // Launches the loading threads. `num_threads` of 0 means one per CPU core,
+  // up to kMaxLoaderThreads. Threads of an earlier call that are still
+  // running first finish the queued jobs and exit, which this waits for.
+  void StartLoading(int num_threads = 0);
 
-  // Cleans-up the background loading thread once all jobs have been completed.
-  // You can restart with StartLoading() if you like.
+  // Cleans-up the background loading threads once all jobs have been
+  // completed. You can restart with StartLoading() if you like.
   void StopLoadingWhenComplete();
 
-  // Call this once per frame after StartLoading. Will call Finalize on any
-  // resources that have finished loading. One it returns true, that means
-  // the queue is empty, all resources have been processed, and the loading
-  // thread has terminated.
-  bool TryFinalize();
+  // Call this once per frame after StartLoading. Will call Finalize on
+  // resources that have finished loading, until `budget_us` microseconds or
+  // `budget_bytes` of FinalizeSize() have been spent. Resources left over
+  // are finalized by later calls. At least one resource is finalized per
+  // call, so that progress is always made. A budget of 0 means no limit.
+  // Once it returns true, that means the queue is empty, and all resources
+  // have been processed.
+  bool TryFinalize(int64_t budget_us = 0, size_t budget_bytes = 0);
+
+  // Timings of every Finalize() call since the last StartLoading() or
+  // ClearFinalizeTimings(), in the order they were made.
+  const std::vector<FinalizeTiming> &finalize_timings() const {
+    return finalize_timings_;
+  }
+  void ClearFinalizeTimings() { finalize_timings_.clear(); }
+
+  static const int kMaxLoaderThreads = 8;
 
  private:
   void Lock(const std::function<void()> &body) {
@@ -82,19 +123,40 @@ class AsyncLoader {
     return ret;
   }
 
+  // Orders queue_ as a heap, with the next job to load at the front.
+  static bool LoadsAfter(const AsyncResource *a, const AsyncResource *b);
+
+  void WaitForWorkers();
   void LoaderWorker();
   static int LoaderThread(void *user_data);
 
-  std::vector<AsyncResource *> queue_, done_;
-
-  // Keep handle to the worker thread around so that we can wait for it to
-  // finish before destroying the class.
-  SDL_Thread *worker_thread_;
-
-  // This lock protects ALL state in this class, i.e. the two vectors.
+  // Jobs waiting for a worker. A heap ordered by LoadsAfter().
+  std::vector<AsyncResource *> queue_;
+  uint64_t next_sequence_;
+  // Jobs queued or being loaded, i.e. not yet handed to TryFinalize.
+  int num_loading_;
+  // Set by StopLoadingWhenComplete(), so that idle workers exit.
+  bool stopping_;
+
+  // Jobs that have been loaded, but not finalized. A lock-free stack linked
+  // through AsyncResource::next_done_, pushed by the workers, and emptied
+  // all at once by TryFinalize().
+  void *done_;
+
+  // Jobs taken from done_ that didn't fit in TryFinalize's budget, oldest
+  // first, starting at index finalize_head_. Main thread only.
+  std::vector<AsyncResource *> finalize_queue_;
+  size_t finalize_head_;
+  std::vector<FinalizeTiming> finalize_timings_;
+
+  // Keep handles to the worker threads around so that we can wait for them
+  // to finish before destroying the class.
+  std::vector<SDL_Thread *> worker_threads_;
+
+  // This lock protects queue_, next_sequence_, num_loading_ and stopping_.
   SDL_mutex *mutex_;
 
-  // Kick-off the worker thread when a new job arrives.
+  // Wakes a worker thread when a new job arrives, or when they should exit.
   SDL_semaphore *job_semaphore_;
 };
 
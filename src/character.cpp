@@ -39,7 +39,8 @@ static const float kMaxPosition = 20.0f;
 
 Character::Character(
     CharacterId id, Controller* controller, const Config& config,
-    const CharacterStateMachineDef* character_state_machine_def)
+    const CharacterStateMachineDef* character_state_machine_def,
+    const CharacterStateMachineTable* state_machine_table)
     : config_(&config),
       id_(id),
       target_(0),
@@ -48,7 +49,7 @@ Character::Character(
       position_(mathfu::kZeros3f),
       controller_(controller),
       just_joined_game_(false),
-      state_machine_(character_state_machine_def),
+      state_machine_(character_state_machine_def, state_machine_table),
       victory_state_(kResultUnknown),
       visible_(true) {
   ResetStats();
@@ -90,8 +91,11 @@ uint16_t Character::RenderableId(WorldTime anim_time) const {
   if (!timeline || !timeline->renderables()) return RenderableId_Invalid;
 
   // Grab the TimelineRenderable for 'anim_time', from the timeline.
+  const TimelineIndex* timeline_index = CurrentTimelineIndex();
   const int renderable_index =
-      TimelineIndexBeforeTime(timeline->renderables(), anim_time);
+      timeline_index
+          ? timeline_index->RenderableIndexAtTime(anim_time)
+          : TimelineIndexBeforeTime(timeline->renderables(), anim_time);
   const TimelineRenderable* renderable =
       timeline->renderables()->Get(renderable_index);
   if (!renderable) return RenderableId_Invalid;
@@ -54,10 +54,12 @@ enum VictoryState { kResultUnknown, kVictorious, kFailure };
 // to the state machine, like health.
 class Character {
  public:
-  // The Character does not take ownership of the controller or
-  // character_state_machine_def pointers.
+  // The Character does not take ownership of the controller,
+  // character_state_machine_def or state_machine_table pointers.
+  // state_machine_table may be null (see CharacterStateMachine).
   Character(CharacterId id, Controller* controller, const Config& config,
-            const CharacterStateMachineDef* character_state_machine_def);
+            const CharacterStateMachineDef* character_state_machine_def,
+            const CharacterStateMachineTable* state_machine_table = nullptr);
 
   // Resets the character to the start-of-game state.
   void Reset(CharacterId target, CharacterHealth health, Angle face_angle,
@@ -91,6 +93,12 @@ class Character {
     return state_machine_.current_state()->timeline();
   }
 
+  // Returns the baked timeline of the current state, or null if the state
+  // machine wasn't given a compiled table.
+  const TimelineIndex* CurrentTimelineIndex() const {
+    return state_machine_.current_timeline_index();
+  }
+
   // Returns the current state from the character-state-machine.
   uint16_t State() const {
     return static_cast<uint16_t>(state_machine_.current_state()->id());
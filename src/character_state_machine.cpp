@@ -20,21 +20,87 @@
 namespace fpl {
 namespace pie_noon {
 
+void CharacterStateMachineTable::Compile(
+    const CharacterStateMachineDef* const state_machine_def) {
+  auto states = state_machine_def->states();
+  transitions_.clear();
+  state_begin_.clear();
+  timelines_.resize(states->Length());
+  for (uint16_t i = 0; i < states->Length(); i++) {
+    timelines_[i].Bake(states->Get(i)->timeline());
+    state_begin_.push_back(static_cast<uint16_t>(transitions_.size()));
+    auto transitions = states->Get(i)->transitions();
+    if (!transitions) continue;
+    for (auto it = transitions->begin(); it != transitions->end(); ++it) {
+      const Condition* condition = it->condition();
+      if (!condition) continue;
+      CompiledTransition transition;
+      transition.is_down = condition->is_down();
+      transition.is_up = condition->is_up();
+      transition.went_down = condition->went_down();
+      transition.went_up = condition->went_up();
+      transition.time = condition->time();
+      transition.end_time = condition->end_time();
+      switch (condition->game_mode()) {
+        case GameModeCondition_AnyMode:
+          transition.game_modes = kSingleScreenBit | kMultiScreenBit;
+          break;
+        case GameModeCondition_SinglePlayerOnly:
+          transition.game_modes = kSingleScreenBit;
+          break;
+        case GameModeCondition_MultiPlayerOnly:
+          transition.game_modes = kMultiScreenBit;
+          break;
+        default:
+          transition.game_modes = 0;
+          break;
+      }
+      transition.target_state = static_cast<uint16_t>(it->target_state());
+      transitions_.push_back(transition);
+    }
+  }
+  state_begin_.push_back(static_cast<uint16_t>(transitions_.size()));
+}
+
+int CharacterStateMachineTable::NextState(int state,
+                                          const ConditionInputs& inputs) const {
+  const uint32_t is_down = static_cast<uint32_t>(inputs.is_down);
+  const uint32_t went_down = static_cast<uint32_t>(inputs.went_down);
+  const uint32_t went_up = static_cast<uint32_t>(inputs.went_up);
+  const uint16_t game_mode =
+      inputs.is_multiscreen ? kMultiScreenBit : kSingleScreenBit;
+  const CompiledTransition* transition =
+      transitions_.data() + state_begin_[state];
+  const CompiledTransition* end = transitions_.data() + state_begin_[state + 1];
+  for (; transition != end; ++transition) {
+    if ((is_down & transition->is_down) == transition->is_down &&
+        (~is_down & transition->is_up) == transition->is_up &&
+        (went_down & transition->went_down) == transition->went_down &&
+        (went_up & transition->went_up) == transition->went_up &&
+        inputs.animation_time >= transition->time &&
+        inputs.animation_time < transition->end_time &&
+        (transition->game_modes & game_mode) != 0) {
+      return transition->target_state;
+    }
+  }
+  return -1;
+}
+
 CharacterStateMachine::CharacterStateMachine(
-    const CharacterStateMachineDef* const state_machine_def)
-    : state_machine_def_(state_machine_def) {
+    const CharacterStateMachineDef* const state_machine_def,
+    const CharacterStateMachineTable* const table)
+    : state_machine_def_(state_machine_def), table_(table) {
   Reset();
 }
 
 void CharacterStateMachine::Reset() {
-  current_state_ =
-      state_machine_def_->states()->Get(state_machine_def_->initial_state());
-  current_state_start_time_ = 0;
+  SetCurrentState(state_machine_def_->initial_state(), 0);
 }
 
 void CharacterStateMachine::SetCurrentState(int new_stateId,
                                             WorldTime state_start_time) {
   current_state_ = state_machine_def_->states()->Get(new_stateId);
+  current_state_id_ = new_stateId;
   current_state_start_time_ = state_start_time;
 }
 
@@ -65,6 +131,11 @@ bool EvaluateCondition(const Condition* condition,
 }
 
 void CharacterStateMachine::Update(const ConditionInputs& inputs) {
+  if (table_) {
+    const int next_state = table_->NextState(current_state_id_, inputs);
+    if (next_state >= 0) SetCurrentState(next_state, inputs.current_time);
+    return;
+  }
   if (!current_state_->transitions()) {
     return;
   }
@@ -72,8 +143,7 @@ void CharacterStateMachine::Update(const ConditionInputs& inputs) {
        it != current_state_->transitions()->end(); ++it) {
     const Condition* condition = it->condition();
     if (condition && EvaluateCondition(condition, inputs)) {
-      current_state_ = state_machine_def_->states()->Get(it->target_state());
-      current_state_start_time_ = inputs.current_time;
+      SetCurrentState(it->target_state(), inputs.current_time);
       return;
     }
   }
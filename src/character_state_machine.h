@@ -16,7 +16,9 @@
 #define CHARACTER_STATE_MACHINE_
 
 #include <cstdint>
+#include <vector>
 #include "common.h"
+#include "timeline_index.h"
 
 namespace fpl {
 namespace pie_noon {
@@ -41,12 +43,58 @@ struct ConditionInputs {
   bool is_multiscreen;
 };
 
+// The transitions of a CharacterStateMachineDef, compiled at load time into
+// one flat array, so that following them doesn't go through the flatbuffer
+// accessors. Each state's transitions are contiguous and in declaration
+// order. Transitions without a condition never fire, so they're left out.
+// The timeline of each state is baked into a TimelineIndex too.
+class CharacterStateMachineTable {
+ public:
+  // Compiles the transitions of state_machine_def, which must be valid (see
+  // CharacterStateMachineDef_Validate).
+  void Compile(const CharacterStateMachineDef* const state_machine_def);
+
+  // Returns the timeline of `state`, baked.
+  const TimelineIndex& timeline_index(int state) const {
+    return timelines_[state];
+  }
+
+  // Returns the target of the first transition out of `state` whose condition
+  // is met by `inputs`, or -1 if there's none. This is the transition that
+  // walking the state's transitions with EvaluateCondition would follow.
+  int NextState(int state, const ConditionInputs& inputs) const;
+
+ private:
+  // A Condition, with its game mode turned into a mask of the kGameModeBits
+  // it may trigger in.
+  struct CompiledTransition {
+    uint32_t is_down;
+    uint32_t is_up;
+    uint32_t went_down;
+    uint32_t went_up;
+    int32_t time;
+    int32_t end_time;
+    uint16_t game_modes;
+    uint16_t target_state;
+  };
+
+  enum GameModeBits { kSingleScreenBit = 1 << 0, kMultiScreenBit = 1 << 1 };
+
+  std::vector<CompiledTransition> transitions_;
+  // The transitions out of state i are transitions_[state_begin_[i]] up to
+  // transitions_[state_begin_[i + 1]].
+  std::vector<uint16_t> state_begin_;
+  std::vector<TimelineIndex> timelines_;
+};
+
 class CharacterStateMachine {
  public:
   // Initializes a state machine with the given state machine definition.
-  // This class does not take ownership of the definition.
+  // If table isn't null, it must be compiled from the same definition, and is
+  // used to follow transitions. This class does not take ownership of either.
   CharacterStateMachine(
-      const CharacterStateMachineDef* const state_machine_def);
+      const CharacterStateMachineDef* const state_machine_def,
+      const CharacterStateMachineTable* const table = nullptr);
 
   // Resets back to initial conditions. Assumes time is reseting to 0 too.
   void Reset();
@@ -59,6 +107,12 @@ class CharacterStateMachine {
 
   const CharacterState* current_state() const { return current_state_; }
 
+  // Returns the baked timeline of the current state, or null if there's no
+  // compiled table.
+  const TimelineIndex* current_timeline_index() const {
+    return table_ ? &table_->timeline_index(current_state_id_) : nullptr;
+  }
+
   void SetCurrentState(int new_stateId, WorldTime state_start_time);
 
   WorldTime current_state_start_time() const {
@@ -67,7 +121,9 @@ class CharacterStateMachine {
 
  private:
   const CharacterStateMachineDef* state_machine_def_;
+  const CharacterStateMachineTable* table_;
   const CharacterState* current_state_;
+  int current_state_id_;
   WorldTime current_state_start_time_;
 };
 
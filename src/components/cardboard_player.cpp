@@ -143,7 +143,8 @@ void CardboardPlayerComponent::InitEntity(entity::EntityRef& entity) {
   entity_manager_->AddEntityToComponent(cp_data->loaded_pie,
                                         ComponentDataUnion_SceneObjectDef);
   SceneObjectData* pie_so_data = Data<SceneObjectData>(cp_data->loaded_pie);
-  pie_so_data->set_parent(pc_data->base_circle);
+  SceneObjectComponent* scene_objects = GetComponent<SceneObjectComponent>();
+  scene_objects->SetParent(cp_data->loaded_pie, pc_data->base_circle);
   pie_so_data->SetRotationAboutZ(-fpl::kHalfPi);
   pie_so_data->SetTranslation(LoadVec3(config_->cardboard_pie_offset()));
   pie_so_data->SetScale(LoadVec3(config_->cardboard_pie_scale()));
@@ -155,7 +156,7 @@ void CardboardPlayerComponent::InitEntity(entity::EntityRef& entity) {
     entity_manager_->AddEntityToComponent(heart,
                                           ComponentDataUnion_SceneObjectDef);
     SceneObjectData* heart_so_data = Data<SceneObjectData>(heart);
-    heart_so_data->set_parent(pc_data->base_circle);
+    scene_objects->SetParent(heart, pc_data->base_circle);
     heart_so_data->SetRotationAboutZ(-fpl::kHalfPi);
     heart_so_data->set_visible(false);
   }
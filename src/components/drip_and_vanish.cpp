@@ -25,37 +25,56 @@ using mathfu::vec3;
 // Gives a child scene object behavior such that it waits for a while,
 // and then slowly sinks, while shrinking.  It's used to govern behavior
 // for splatters on the background.
-void DripAndVanishComponent::UpdateAllEntities(entity::WorldTime delta_time) {
-  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
-    SceneObjectData* so_data = Data<SceneObjectData>(iter->entity);
+void DripAndVanishComponent::UpdateEntities(entity::WorldTime delta_time,
+                                            EntityIterator begin,
+                                            EntityIterator end) {
+  for (auto iter = begin; iter != end; ++iter) {
     DripAndVanishData* dv_data = GetEntityData(iter->entity);
 
     dv_data->lifetime_remaining -= delta_time;
-    if (dv_data->lifetime_remaining > 0) {
-      if (dv_data->lifetime_remaining < dv_data->slide_time) {
-        float slide_amount =
-            1.0f - dv_data->lifetime_remaining / dv_data->slide_time;
-
-        vec3 relative_offset = so_data->Translation();
-        vec3 relative_scale = so_data->Scale();
-
-        // The amount it moves is a cubic function, mostly because
-        // that looked the prettiest.
-        relative_offset.y() = vec3(dv_data->start_position).y() -
-                              (slide_amount * slide_amount * slide_amount) *
-                                  dv_data->drip_distance;
-
-        relative_scale = vec3(dv_data->start_scale) * (1.0f - slide_amount);
-
-        so_data->SetTranslation(relative_offset);
-        so_data->SetScale(relative_scale);
-      }
-    } else {
+    dv_data->slide_amount =
+        dv_data->lifetime_remaining > 0 &&
+                dv_data->lifetime_remaining < dv_data->slide_time
+            ? 1.0f - dv_data->lifetime_remaining / dv_data->slide_time
+            : -1.0f;
+  }
+}
+
+// Deleting isn't safe from UpdateEntities, which may run on several threads,
+// and neither is moving the scene objects, whose transforms all live in one
+// motive processor. Both happen here, on the thread that runs the update.
+void DripAndVanishComponent::FinishUpdate(entity::WorldTime /*delta_time*/) {
+  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
+    const DripAndVanishData& dv_data = iter->data;
+    if (dv_data.lifetime_remaining <= 0) {
       entity_manager_->DeleteEntity(iter->entity);
+      continue;
     }
+    if (dv_data.slide_amount < 0.0f) continue;
+
+    SceneObjectData* so_data = Data<SceneObjectData>(iter->entity);
+    const float slide_amount = dv_data.slide_amount;
+    vec3 relative_offset = so_data->Translation();
+
+    // The amount it moves is a cubic function, mostly because
+    // that looked the prettiest.
+    relative_offset.y() = vec3(dv_data.start_position).y() -
+                          (slide_amount * slide_amount * slide_amount) *
+                              dv_data.drip_distance;
+
+    so_data->SetTranslation(relative_offset);
+    so_data->SetScale(vec3(dv_data.start_scale) * (1.0f - slide_amount));
   }
 }
 
+// Each splatter only moves its own scene object, and only from FinishUpdate.
+void DripAndVanishComponent::GetUpdateAccess(
+    entity::UpdateAccess* access) const {
+  access->declared = true;
+  access->parallel_entities = true;
+  access->Write<SceneObjectData>();
+}
+
 void DripAndVanishComponent::AddFromRawData(entity::EntityRef& entity,
                                             const void* raw_data) {
   auto component_data = static_cast<const ComponentDefInstance*>(raw_data);
@@ -70,6 +89,7 @@ void DripAndVanishComponent::AddFromRawData(entity::EntityRef& entity,
       dripandvanish_data->total_lifetime() * kMillisecondsPerSecond;
   entity_data->slide_time =
       dripandvanish_data->time_spent_dripping() * kMillisecondsPerSecond;
+  entity_data->slide_amount = -1.0f;
 }
 
 // Make sure we have an accessory.
@@ -31,6 +31,9 @@ struct DripAndVanishData {
   float drip_distance;
   mathfu::vec3_packed start_position;
   mathfu::vec3_packed start_scale;
+  // How far through the slide the splatter is, from 0 to 1, or negative when
+  // it isn't sliding. Set in UpdateEntities and applied in FinishUpdate.
+  float slide_amount;
 };
 
 // Basic behavior for pie splatters:  They stay there for a while,
@@ -38,7 +41,10 @@ struct DripAndVanishData {
 class DripAndVanishComponent : public entity::Component<DripAndVanishData> {
  public:
   virtual void AddFromRawData(entity::EntityRef& entity, const void* data);
-  virtual void UpdateAllEntities(entity::WorldTime /*delta_time*/);
+  virtual void UpdateEntities(entity::WorldTime delta_time,
+                              EntityIterator begin, EntityIterator end);
+  virtual void FinishUpdate(entity::WorldTime delta_time);
+  virtual void GetUpdateAccess(entity::UpdateAccess* access) const;
   virtual void InitEntity(entity::EntityRef& entity);
   void SetStartingValues(entity::EntityRef& entity);
 };
@@ -127,12 +127,23 @@ int PlayerCharacterComponent::PopulatePieAccessories(entity::EntityRef entity,
 
   if (timeline) {
     // Get accessories that are valid for the current time.
-    const std::vector<int> accessory_indices =
-        TimelineIndicesWithTime(timeline->accessories(), anim_time);
+    const TimelineIndex* timeline_index = character->CurrentTimelineIndex();
+    std::vector<int> unbaked_indices;
+    const int* accessory_indices;
+    int accessory_count;
+    if (timeline_index) {
+      accessory_count =
+          timeline_index->AccessoryIndicesAtTime(anim_time, &accessory_indices);
+    } else {
+      unbaked_indices =
+          TimelineIndicesWithTime(timeline->accessories(), anim_time);
+      accessory_indices = unbaked_indices.data();
+      accessory_count = static_cast<int>(unbaked_indices.size());
+    }
 
-    for (auto it = accessory_indices.begin(); it != accessory_indices.end();
-         ++it) {
-      const TimelineAccessory& accessory = *timeline->accessories()->Get(*it);
+    for (int i = 0; i < accessory_count; ++i) {
+      const TimelineAccessory& accessory =
+          *timeline->accessories()->Get(accessory_indices[i]);
 
       entity::EntityRef& accessory_entity =
           pc_data->accessories[num_accessories];
@@ -274,7 +285,7 @@ void PlayerCharacterComponent::InitEntity(entity::EntityRef& entity) {
     SceneObjectData* accessory_so_data = Data<SceneObjectData>(accessory);
 
     accessory_so_data->set_visible(false);
-    accessory_so_data->set_parent(entity);
+    GetComponent<SceneObjectComponent>()->SetParent(accessory, entity);
   }
 }
 
@@ -85,61 +85,123 @@ void SceneObjectComponent::AddFromRawData(entity::EntityRef& entity,
   entity_data->set_visible(scene_object_data->visible() != 0);
 }
 
+const int SceneObjectComponent::kNoParent;
+
 void SceneObjectComponent::InitEntity(entity::EntityRef& entity) {
   SceneObjectData* data = GetEntityData(entity);
   data->Initialize(engine_);
+  hierarchy_changed_ = true;
 }
 
-void SceneObjectComponent::UpdateGlobalMatrix(
-    entity::EntityRef& entity,
-    std::vector<bool>& matrix_updated) {
-  const size_t data_index = GetEntityDataIndex(entity);
-  SceneObjectData* data = GetEntityData(data_index);
-
-  if (data->HasParent()) {
-    // Recurse into parent if its matrix has not been calculated.
-    const size_t parent_index = GetEntityDataIndex(data->parent());
-    if (!matrix_updated[parent_index]) {
-      UpdateGlobalMatrix(data->parent(), matrix_updated);
-    }
+void SceneObjectComponent::CleanupEntity(entity::EntityRef& /*entity*/) {
+  hierarchy_changed_ = true;
+}
+
+void SceneObjectComponent::SetParent(entity::EntityRef& entity,
+                                     entity::EntityRef& parent) {
+  GetEntityData(entity)->set_parent(parent);
+  hierarchy_changed_ = true;
+}
 
-    // Multiply our local matrix by our parent's global matrix to get our
-    // global matrix.
-    SceneObjectData* parent = GetEntityData(parent_index);
-    data->set_global_matrix(parent->global_matrix() * data->LocalMatrix());
-  } else {
+// Sort the scene objects by their depth in the hierarchy, keeping the
+// entity order between objects of the same depth.
+void SceneObjectComponent::SortTransformHierarchy() {
+  depths_.assign(entity_data_.Size(), -1);
+  depth_offsets_.clear();
 
-    // No parent means that our local matrix equals the global matrix.
-    data->set_global_matrix(data->LocalMatrix());
+  // Find the depth of each object. Walk up to the nearest ancestor whose
+  // depth we already know, then fill in the depths on the way back down.
+  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
+    size_t data_index = iter.index();
+    while (depths_[data_index] < 0) {
+      ancestors_.push_back(data_index);
+      const SceneObjectData* data = GetEntityData(data_index);
+      if (!data->HasParent()) break;
+      data_index = GetEntityDataIndex(data->parent());
+      assert(ancestors_.size() <= entity_data_.active_count());
+    }
+    while (!ancestors_.empty()) {
+      const size_t ancestor = ancestors_.back();
+      ancestors_.pop_back();
+      const SceneObjectData* data = GetEntityData(ancestor);
+      const int depth =
+          data->HasParent()
+              ? depths_[GetEntityDataIndex(data->parent())] + 1
+              : 0;
+      depths_[ancestor] = depth;
+      if (depth_offsets_.size() <= static_cast<size_t>(depth)) {
+        depth_offsets_.resize(depth + 1, 0);
+      }
+      depth_offsets_[depth]++;
+    }
   }
 
-  // Remember that we've calculated this matrix so we don't try to calculate
-  // it again.
-  matrix_updated[data_index] = true;
+  // Counting sort by depth.
+  int offset = 0;
+  for (auto it = depth_offsets_.begin(); it != depth_offsets_.end(); ++it) {
+    const int count = *it;
+    *it = offset;
+    offset += count;
+  }
+  transform_positions_.assign(entity_data_.Size(), kNoParent);
+  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
+    const size_t data_index = iter.index();
+    transform_positions_[data_index] = depth_offsets_[depths_[data_index]]++;
+  }
+  transform_order_.resize(offset);
+  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
+    TransformNode& node = transform_order_[transform_positions_[iter.index()]];
+    node.data_index = iter.index();
+    node.parent = iter->data.HasParent()
+                      ? transform_positions_[GetEntityDataIndex(
+                            iter->data.parent())]
+                      : kNoParent;
+  }
+  global_matrix_changed_.resize(offset);
+  visible_in_hierarchy_.resize(offset);
 }
 
-// Traverse scene hierarchy convert local matrices into global matrices.
+// Convert local matrices into global matrices, and work out which objects
+// are visible, in one pass over the hierarchy from the roots down.
+// An object whose local matrix hasn't changed, and whose parent's global
+// matrix hasn't changed, keeps its global matrix.
 void SceneObjectComponent::UpdateGlobalMatrices() {
-  std::vector<bool> matrix_updated(entity_data_.Size(), false);
-
-  // Loop through every entity and update its global matrix.
-  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
+  const bool recalculate_all = hierarchy_changed_;
+  if (hierarchy_changed_) {
+    SortTransformHierarchy();
+    hierarchy_changed_ = false;
+  }
 
-    // The update process is recursive, so we may have already calculated a
-    // matrix by the time we get there. If so, skip over it.
-    if (!matrix_updated[iter.index()] && iter->data.visible()) {
-      UpdateGlobalMatrix(iter->entity, matrix_updated);
+  for (size_t i = 0; i < transform_order_.size(); ++i) {
+    const TransformNode& node = transform_order_[i];
+    SceneObjectData* data = GetEntityData(node.data_index);
+    const bool local_changed = data->LocalMatrixChanged();
+
+    if (node.parent == kNoParent) {
+      visible_in_hierarchy_[i] = data->visible();
+      if (local_changed || recalculate_all) {
+        // No parent means that our local matrix equals the global matrix.
+        data->set_global_matrix(data->LocalMatrix());
+        global_matrix_changed_[i] = true;
+      } else {
+        global_matrix_changed_[i] = false;
+      }
+      continue;
     }
-  }
-}
 
-bool SceneObjectComponent::VisibleInHierarchy(
-    const entity::EntityRef& entity) const {
-  const SceneObjectData* data = GetEntityData(entity);
-  if (!data->HasParent()) {
-    return data->visible();
-  } else {
-    return data->visible() && VisibleInHierarchy(data->parent());
+    visible_in_hierarchy_[i] =
+        data->visible() && visible_in_hierarchy_[node.parent];
+    if (local_changed || recalculate_all ||
+        global_matrix_changed_[node.parent]) {
+      // Multiply our local matrix by our parent's global matrix to get our
+      // global matrix.
+      const SceneObjectData* parent =
+          GetEntityData(transform_order_[node.parent].data_index);
+      data->set_global_matrix(parent->global_matrix() * data->LocalMatrix());
+      global_matrix_changed_[i] = true;
+    } else {
+      global_matrix_changed_[i] = false;
+    }
   }
 }
 
@@ -147,11 +209,10 @@ void SceneObjectComponent::PopulateScene(SceneDescription* scene) {
   UpdateGlobalMatrices();
 
   for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
-    entity::EntityRef entity = iter->entity;
-    if (VisibleInHierarchy(entity)) {
-      SceneObjectData* data = GetEntityData(entity);
-      scene->renderables().push_back(std::unique_ptr<Renderable>(new Renderable(
-          data->renderable_id(), data->global_matrix(), data->tint())));
+    if (visible_in_hierarchy_[transform_positions_[iter.index()]]) {
+      const SceneObjectData& data = iter->data;
+      scene->renderables().push_back(Renderable(
+          data.renderable_id(), data.global_matrix(), data.tint()));
     }
   }
 }
@@ -29,6 +29,8 @@ class MatrixInit;
 namespace fpl {
 namespace pie_noon {
 
+class SceneObjectComponent;
+
 // Data for scene object components.
 class SceneObjectData {
  public:
@@ -118,10 +120,10 @@ class SceneObjectData {
   void set_global_matrix(const mathfu::mat4& m) { global_matrix_ = m; }
   const mathfu::mat4& global_matrix() const { return global_matrix_; }
 
+  // To change the parent, use SceneObjectComponent::SetParent.
   bool HasParent() const { return parent_.IsValid(); }
   entity::EntityRef& parent() { return parent_; }
   const entity::EntityRef& parent() const { return parent_; }
-  void set_parent(entity::EntityRef& parent) { parent_ = parent; }
 
   mathfu::vec4 tint() const { return mathfu::vec4(tint_); }
   void set_tint(const mathfu::vec4& tint) { tint_ = tint; }
@@ -133,6 +135,20 @@ class SceneObjectData {
   void set_visible(bool visible) { visible_ = visible; }
 
  private:
+  friend class SceneObjectComponent;
+
+  void set_parent(entity::EntityRef& parent) { parent_ = parent; }
+
+  // Returns true if LocalMatrix() has changed since the last call.
+  bool LocalMatrixChanged() {
+    const mathfu::mat4& local = transform_.Value();
+    if (memcmp(&local, &cached_local_matrix_, sizeof(local)) == 0) {
+      return false;
+    }
+    cached_local_matrix_ = local;
+    return true;
+  }
+
   // Basic matrix operations from with 'transform_.Value()' is calculated.
   // These operations are applied last-to-first to convert the object from
   // object space (i.e. the space in which it was authored) to local space
@@ -159,6 +175,9 @@ class SceneObjectData {
   // Position, orientation, and scale (in world-space) of the object.
   mathfu::mat4 global_matrix_;
 
+  // 'transform_.Value()' when global_matrix_ was last calculated.
+  mathfu::mat4 cached_local_matrix_;
+
   // Position, orientation, and scale (in local space) of the object.
   // Composed of the basic matrix operations in TransformMatrixOperations.
   motive::MotivatorMatrix4f transform_;
@@ -182,21 +201,55 @@ class SceneObjectData {
 
 // A sceneobject is "a thing I want to place in the scene and move around."
 // So it contains basic drawing info.
-class SceneObjectComponent : public entity::Component<SceneObjectData> {
+// Every scene object is visited at least twice a frame, so the data is kept
+// packed in a DensePool.
+class SceneObjectComponent
+    : public entity::Component<SceneObjectData, DensePool> {
  public:
   explicit SceneObjectComponent(motive::MotiveEngine* engine)
-      : engine_(engine) {}
+      : engine_(engine), hierarchy_changed_(true) {}
   virtual void AddFromRawData(entity::EntityRef& entity, const void* data);
   virtual void InitEntity(entity::EntityRef& entity);
+  virtual void CleanupEntity(entity::EntityRef& entity);
   void PopulateScene(SceneDescription* scene);
 
+  // Positions `entity` relative to `parent`. See SceneObjectData::parent_.
+  void SetParent(entity::EntityRef& entity, entity::EntityRef& parent);
+  // Scene objects have no per-frame update, so never hold up other
+  // components.
+  virtual void GetUpdateAccess(entity::UpdateAccess* access) const {
+    access->declared = true;
+  }
+
  private:
-  void UpdateGlobalMatrix(entity::EntityRef& entity,
-                          std::vector<bool>& matrix_calculated);
+  // An entry in transform_order_.
+  struct TransformNode {
+    // Index of the entity's data.
+    size_t data_index;
+    // Position of the parent in transform_order_, or kNoParent.
+    int parent;
+  };
+  static const int kNoParent = -1;
+
+  void SortTransformHierarchy();
   void UpdateGlobalMatrices();
-  bool VisibleInHierarchy(const entity::EntityRef& entity) const;
 
   motive::MotiveEngine* engine_;
+
+  // Every scene object, sorted by depth in the hierarchy, so parents come
+  // before their children. Rebuilt when hierarchy_changed_ is set.
+  std::vector<TransformNode> transform_order_;
+  bool hierarchy_changed_;
+  // Position in transform_order_ of each data index.
+  std::vector<int> transform_positions_;
+  // Per entry of transform_order_, whether UpdateGlobalMatrices changed
+  // its global matrix, and whether it and all of its ancestors are visible.
+  std::vector<uint8_t> global_matrix_changed_;
+  std::vector<uint8_t> visible_in_hierarchy_;
+  // Scratch space for SortTransformHierarchy.
+  std::vector<int> depths_;
+  std::vector<int> depth_offsets_;
+  std::vector<size_t> ancestors_;
 };
 
 }  // pie_noon
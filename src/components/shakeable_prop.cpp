@@ -24,21 +24,41 @@ using mathfu::mat4;
 namespace fpl {
 namespace pie_noon {
 
-void ShakeablePropComponent::UpdateAllEntities(
-    entity::WorldTime /*delta_time*/) {
-  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
-    entity::EntityRef entity = iter->entity;
+void ShakeablePropComponent::UpdateEntities(entity::WorldTime /*delta_time*/,
+                                            EntityIterator begin,
+                                            EntityIterator end) {
+  for (auto iter = begin; iter != end; ++iter) {
     ShakeablePropData* sp_data = GetEntityData(iter->entity);
-    SceneObjectData* so_data = Data<SceneObjectData>(entity);
-    assert(so_data != nullptr && sp_data != nullptr);
+    assert(sp_data != nullptr);
 
     if (sp_data->motivator.Valid()) {
-      so_data->SetPreRotationAboutAxis(sp_data->motivator.Value(),
-                                       sp_data->axis);
+      sp_data->angle = sp_data->motivator.Value();
     }
   }
 }
 
+// Scene object transforms all live in one motive processor, which isn't safe
+// to write from several threads, so they're only set here, on the thread
+// that runs the update.
+void ShakeablePropComponent::FinishUpdate(entity::WorldTime /*delta_time*/) {
+  for (auto iter = entity_data_.begin(); iter != entity_data_.end(); ++iter) {
+    const ShakeablePropData& sp_data = iter->data;
+    if (!sp_data.motivator.Valid()) continue;
+
+    SceneObjectData* so_data = Data<SceneObjectData>(iter->entity);
+    assert(so_data != nullptr);
+    so_data->SetPreRotationAboutAxis(sp_data.angle, sp_data.axis);
+  }
+}
+
+// Each prop only turns its own scene object, and only from FinishUpdate.
+void ShakeablePropComponent::GetUpdateAccess(
+    entity::UpdateAccess* access) const {
+  access->declared = true;
+  access->parallel_entities = true;
+  access->Write<SceneObjectData>();
+}
+
 // Add the basic renderable component to the entity, if it doesn't have it
 // already.
 void ShakeablePropComponent::InitEntity(entity::EntityRef& entity) {
@@ -29,15 +29,21 @@ namespace fpl {
 namespace pie_noon {
 
 struct ShakeablePropData {
-  ShakeablePropData() {}
+  ShakeablePropData() : angle(0.0f) {}
   float shake_scale;
   Axis axis;
   motive::Motivator1f motivator;
+  // The motivator's value this frame. Read in UpdateEntities and applied to
+  // the scene object in FinishUpdate.
+  float angle;
 };
 
 class ShakeablePropComponent : public entity::Component<ShakeablePropData> {
  public:
-  virtual void UpdateAllEntities(entity::WorldTime delta_time);
+  virtual void UpdateEntities(entity::WorldTime delta_time,
+                              EntityIterator begin, EntityIterator end);
+  virtual void FinishUpdate(entity::WorldTime delta_time);
+  virtual void GetUpdateAccess(entity::UpdateAccess* access) const;
   virtual void AddFromRawData(entity::EntityRef& entity, const void* data);
   virtual void InitEntity(entity::EntityRef& entity);
   virtual void CleanupEntity(entity::EntityRef& entity);
@@ -17,6 +17,7 @@
 
 #include "component_id_lookup.h"
 #include "component_interface.h"
+#include "dense_pool.h"
 #include "entity.h"
 #include "entity_common.h"
 #include "entity_manager.h"
@@ -29,7 +30,11 @@ namespace entity {
 // All components should should extend this class.  The type T is used to
 // specify the structure of the data that needs to be associated with each
 // entity.
-template <typename T>
+// Storage is the pool the data lives in. The default, VectorPool, never moves
+// data once allocated. DensePool keeps the data packed, so that iterating over
+// every entity is a linear scan, but moves data when other entities are
+// removed, and requires T to be copyable or movable.
+template <typename T, template <typename> class Storage = VectorPool>
 class Component : public ComponentInterface {
  public:
   // Structure associated with each entity.
@@ -39,7 +44,8 @@ class Component : public ComponentInterface {
     EntityRef entity;
     T data;
   };
-  typedef typename VectorPool<EntityData>::Iterator EntityIterator;
+  typedef Storage<EntityData> EntityStorage;
+  typedef typename EntityStorage::Iterator EntityIterator;
 
   Component() : entity_manager_(nullptr) {}
 
@@ -65,13 +71,17 @@ class Component : public ComponentInterface {
     entity->SetComponentDataIndex(GetComponentId(), index);
     EntityData* entity_data = entity_data_.GetElementData(index);
     entity_data->entity = entity;
-    new (&(entity_data->data)) T();
+    ConstructData(&entity_data_, entity_data);
     InitEntity(entity);
     return &(entity_data->data);
   }
 
   T* AddEntity(EntityRef entity) { return AddEntity(entity, kAddToBack); }
 
+  virtual void ReserveEntities(size_t count) {
+    ReserveData(&entity_data_, count);
+  }
+
   // Removes an entity from our list of entities, marks the entity as not using
   // this component anymore, calls the destructor on the data, and returns
   // the memory to the memory pool.
@@ -81,13 +91,22 @@ class Component : public ComponentInterface {
     entity->SetComponentDataIndex(GetComponentId(), kUnusedComponentIndex);
   }
 
+  virtual void RemoveEntities(EntityRef* entities, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+      if (entities[i]->IsRegisteredForComponent(GetComponentId())) {
+        RemoveEntity(entities[i]);
+      }
+    }
+  }
+
   // Same as RemoveEntity() above, but returns an iterator to the entity after
   // the one we've just removed.
   virtual EntityIterator RemoveEntity(EntityIterator iter) {
-    RemoveEntityInternal(iter->entity);
+    // Freeing may move another entity's data into this slot.
+    EntityRef entity = iter->entity;
+    RemoveEntityInternal(entity);
     auto new_iter = entity_data_.FreeElement(iter);
-    iter->entity->SetComponentDataIndex(GetComponentId(),
-                                        kUnusedComponentIndex);
+    entity->SetComponentDataIndex(GetComponentId(), kUnusedComponentIndex);
     return new_iter;
   }
 
@@ -99,7 +118,52 @@ class Component : public ComponentInterface {
   virtual EntityIterator end() { return entity_data_.end(); }
 
   // Updates all entities.  Normally called by EntityManager, once per frame.
-  virtual void UpdateAllEntities(WorldTime /*delta_time*/) {}
+  // Components can override this, or UpdateEntities and FinishUpdate, which
+  // also lets EntityManager update chunks of the entities in parallel.
+  virtual void UpdateAllEntities(WorldTime delta_time) {
+    UpdateEntities(delta_time, begin(), end());
+    FinishUpdate(delta_time);
+  }
+
+  // Updates the entities from begin up to end.  If the component declares
+  // UpdateAccess::parallel_entities, this may run for several ranges at once,
+  // so it must not add or remove entities.
+  virtual void UpdateEntities(WorldTime /*delta_time*/,
+                              EntityIterator /*begin*/,
+                              EntityIterator /*end*/) {}
+
+  // Called after every entity has been through UpdateEntities, on the thread
+  // calling EntityManager::UpdateComponents.
+  virtual void FinishUpdate(WorldTime /*delta_time*/) {}
+
+  // Override this to declare what the update touches.  By default the
+  // component is updated on its own.
+  virtual void GetUpdateAccess(UpdateAccess* /*access*/) const {}
+
+  virtual int SplitUpdate(int max_chunks) {
+    const int num_entities = static_cast<int>(entity_data_.active_count());
+    const int num_chunks = std::max(
+        1, std::min(max_chunks, num_entities / kMinEntitiesPerUpdateChunk));
+    update_chunks_.clear();
+    auto iter = begin();
+    for (int i = 0, n = 0; i < num_chunks; i++) {
+      update_chunks_.push_back(iter);
+      for (const int next = num_entities * (i + 1) / num_chunks; n < next;
+           n++) {
+        ++iter;
+      }
+    }
+    update_chunks_.push_back(end());
+    return num_chunks;
+  }
+
+  virtual void UpdateChunk(WorldTime delta_time, int chunk) {
+    UpdateEntities(delta_time, update_chunks_[chunk],
+                   update_chunks_[chunk + 1]);
+  }
+
+  // Chunks smaller than this aren't worth handing to another thread.
+  static const int kMinEntitiesPerUpdateChunk = 64;
 
   // Returns the data for an entity as a void pointer.  The calling function
   // is expected to know what to do with it.
@@ -143,6 +207,8 @@ class Component : public ComponentInterface {
     return const_cast<Component*>(this)->GetEntityData(entity);
   }
 
+  virtual void CompactEntityData() { CompactData(&entity_data_); }
+
   // Clears all tracked entity data.
   void virtual ClearEntityData() {
     for (auto iter = entity_data_.begin(); iter != entity_data_.end();
@@ -198,15 +264,44 @@ class Component : public ComponentInterface {
     // Allow components to handle any per-entity cleanup that it needs to do.
     CleanupEntity(entity);
 
-    // Manually call the destructor on the data, since it is not actually being
-    // freed, just returned to the pool.
     const size_t data_index = GetEntityDataIndex(entity);
     EntityData* entity_data = entity_data_.GetElementData(data_index);
+    DestroyData(&entity_data_, entity_data);
+  }
+
+  // VectorPool keeps freed elements around to reuse them, so we construct
+  // and destroy the data ourselves. DensePool constructs data when it's
+  // allocated and destroys it when it's freed.
+  static void ConstructData(VectorPool<EntityData>*, EntityData* entity_data) {
+    new (&(entity_data->data)) T();
+  }
+  static void ConstructData(DensePool<EntityData>*, EntityData*) {}
+
+  // Manually call the destructor on the data, since it is not actually being
+  // freed, just returned to the pool.
+  static void DestroyData(VectorPool<EntityData>*, EntityData* entity_data) {
     entity_data->data.~T();
+  }
+  static void DestroyData(DensePool<EntityData>*, EntityData*) {}
+
+  // Compacting a VectorPool moves the data, so each entity is told where its
+  // data went.  DensePool is always packed.
+  void CompactData(VectorPool<EntityData>* pool) {
+    pool->Compact(nullptr);
+    for (auto iter = pool->begin(); iter != pool->end(); ++iter) {
+      iter->entity->SetComponentDataIndex(GetComponentId(), iter.index());
+    }
+  }
+  void CompactData(DensePool<EntityData>*) {}
 
-    // Add a reference destructor is empty and the line above is implicitly
-    // removed.
-    (void)entity_data;
+  // VectorPool::Reserve counts every element, used, free or reserved for its
+  // lists.  DensePool::Reserve only counts used elements.
+  static void ReserveData(VectorPool<EntityData>* pool, size_t count) {
+    typedef VectorPool<EntityData> Pool;
+    pool->Reserve(pool->active_count() + Pool::kTotalReserved + count);
+  }
+  static void ReserveData(DensePool<EntityData>* pool, size_t count) {
+    pool->Reserve(pool->active_count() + count);
   }
 
  protected:
@@ -214,8 +309,10 @@ class Component : public ComponentInterface {
     return entity->GetComponentDataIndex(GetComponentId());
   }
 
-  VectorPool<EntityData> entity_data_;
+  EntityStorage entity_data_;
   EntityManager* entity_manager_;
+  // Boundaries of the chunks made by SplitUpdate.
+  std::vector<EntityIterator> update_chunks_;
 };
 
 }  // entity
@@ -15,6 +15,8 @@
 #ifndef FPL_BASE_COMPONENT_H_
 #define FPL_BASE_COMPONENT_H_
 
+#include <bitset>
+#include "component_id_lookup.h"
 #include "entity.h"
 #include "entity_common.h"
 #include "entity_manager.h"
@@ -27,6 +29,39 @@ class EntityManager;
 
 typedef VectorPool<entity::Entity>::VectorPoolReference EntityRef;
 
+// The component data a component's update touches, besides its own.
+// EntityManager uses this to update components on several threads at once,
+// while giving the same results as updating them one after another.
+struct UpdateAccess {
+  UpdateAccess() : declared(false), parallel_entities(false) {}
+
+  // Marks the data of the component with data type T as read or written.
+  template <typename T>
+  void Read() {
+    reads.set(ComponentIdLookup<T>::kComponentId);
+  }
+  template <typename T>
+  void Write() {
+    writes.set(ComponentIdLookup<T>::kComponentId);
+  }
+
+  // True if one update writes data the other reads or writes.
+  bool ConflictsWith(const UpdateAccess& other) const {
+    return (writes & (other.reads | other.writes)).any() ||
+           (reads & other.writes).any();
+  }
+
+  // False if the update touches anything outside of the entity system, or
+  // component data not listed in reads and writes. Such components are
+  // updated on their own, on the thread calling UpdateComponents.
+  bool declared;
+  // True if updating one entity only touches the data of that entity, so
+  // that chunks of the entities can be updated at the same time.
+  bool parallel_entities;
+  std::bitset<kMaxComponentCount> reads;
+  std::bitset<kMaxComponentCount> writes;
+};
+
 // Basic component functionality.  All components implement this, and it's the
 // minimum set of things you can do with a component even if you don't know what
 // type it is.
@@ -40,8 +75,24 @@ class ComponentInterface {
   virtual void AddEntityGenerically(EntityRef& entity) = 0;
   // Remove an entity from the component's list.
   virtual void RemoveEntity(EntityRef& entity) = 0;
+  // Remove every one of `count` entities that has this component, skipping
+  // the rest.
+  virtual void RemoveEntities(EntityRef* entities, size_t count) = 0;
+  // Repack the entity data after many removals, so that updates walk through
+  // memory in order.
+  virtual void CompactEntityData() = 0;
   // Update all entities that contain this component.
   virtual void UpdateAllEntities(WorldTime delta_time) = 0;
+  // Describe what UpdateAllEntities touches.
+  virtual void GetUpdateAccess(UpdateAccess* access) const = 0;
+  // The same update as UpdateAllEntities, in pieces: SplitUpdate divides
+  // the entities into at most max_chunks chunks and returns how many it
+  // made, UpdateChunk updates one chunk, and FinishUpdate does whatever has
+  // to wait until every chunk is done.  UpdateChunk may be called for
+  // several chunks at once, on different threads.
+  virtual int SplitUpdate(int max_chunks) = 0;
+  virtual void UpdateChunk(WorldTime delta_time, int chunk) = 0;
+  virtual void FinishUpdate(WorldTime delta_time) = 0;
   // Clear all entity data, effectively disassociating this component
   // from any entities.  (Note that this does NOT change entities, so they may
   // still think we have data for them.)  Normally this isn't something you
@@ -58,6 +109,9 @@ class ComponentInterface {
   virtual void InitEntity(EntityRef& entity) = 0;
   // Used to build entities from data.  All components need to implement one.
   virtual void AddFromRawData(EntityRef& entity, const void* data) = 0;
+  // Make room for `count` more entities, so that adding them doesn't
+  // reallocate.
+  virtual void ReserveEntities(size_t count) = 0;
   // Called just before removal from the entitymanager.
   virtual void Cleanup() = 0;
   // Called when the entity is removed from the manager.
@@ -0,0 +1,197 @@
+// Copyright 2015 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DENSE_POOL_H
+#define DENSE_POOL_H
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+#include "assert.h"
+#include "vector_pool.h"
+
+namespace fpl {
+
+// Pool allocator that keeps every active element packed at the front of a
+// vector, so iterating over them is a linear scan through memory.
+// Freeing an element moves the last element into its place ("swap-remove"),
+// so elements don't keep their position. Callers address elements by a
+// handle instead, which stays the same for the element's whole life, and
+// which a sparse table maps to the element's current slot.
+//
+// Has the same interface as VectorPool where Component uses it, so it can be
+// used as a Component's storage. Unlike VectorPool, T must be copyable or
+// movable, pointers to elements are invalidated by any allocation or free,
+// and elements are always added at the back.
+template <typename T>
+class DensePool {
+ public:
+  static const size_t kOutOfBounds = static_cast<size_t>(-1);
+
+  // ---------------------------
+  // Iterator over the active elements, in slot order.
+  // Freeing the element an iterator points at moves the last element into
+  // its slot, so the iterator then points at the next element to visit.
+  class Iterator {
+    friend class DensePool<T>;
+
+   public:
+    Iterator(DensePool<T>* container, size_t slot)
+        : container_(container), slot_(slot) {}
+
+    // Standard equality operator
+    bool operator==(const Iterator& other) const {
+      return container_ == other.container_ && slot_ == other.slot_;
+    }
+
+    // Standard inequality operator
+    bool operator!=(const Iterator& other) const {
+      return !operator==(other);
+    }
+
+    // Prefix increment - moves the iterator to the next slot.
+    Iterator& operator++() {
+      slot_++;
+      return (*this);
+    }
+
+    // Postfix increment - moves the iterator to the next slot, but returns
+    // the original (unincremented) iterator.
+    Iterator operator++(int) {
+      Iterator temp = *this;
+      ++(*this);
+      return temp;
+    }
+
+    // Iterator dereference
+    T& operator*() { return container_->elements_[slot_]; }
+
+    // Member access on the object
+    T* operator->() { return &container_->elements_[slot_]; }
+
+    // Returns the handle of the element, as passed to GetElementData.
+    size_t index() const { return container_->handles_[slot_]; }
+
+   private:
+    DensePool<T>* container_;
+    size_t slot_;
+  };
+
+  // ---------------------------
+
+  DensePool() {}
+
+  // Get data for the element with the specified handle.
+  // Returns null if the handle isn't in use.  Asserts if it is obviously
+  // illegal.  (i. e. was never handed out)
+  // Note that the pointer is only valid until the next allocation or free.
+  T* GetElementData(size_t handle) {
+    assert(handle < slots_.size());
+    const size_t slot = slots_[handle];
+    return slot == kOutOfBounds ? nullptr : &elements_[slot];
+  }
+
+  // Const version of the above.
+  const T* GetElementData(size_t handle) const {
+    return const_cast<DensePool*>(this)->GetElementData(handle);
+  }
+
+  // Appends a default constructed element, and returns an iterator pointing
+  // at it.  The location is ignored: elements are always added at the back.
+  Iterator GetNewElement(AllocationLocation /*alloc_location*/) {
+    size_t handle;
+    if (!free_handles_.empty()) {
+      handle = free_handles_.back();
+      free_handles_.pop_back();
+    } else {
+      handle = slots_.size();
+      slots_.push_back(kOutOfBounds);
+    }
+    const size_t slot = elements_.size();
+    slots_[handle] = slot;
+    elements_.push_back(T());
+    handles_.push_back(handle);
+    return Iterator(this, slot);
+  }
+
+  // Frees up an element, moving the last element into its slot.
+  void FreeElement(size_t handle) {
+    assert(handle < slots_.size() && slots_[handle] != kOutOfBounds);
+    const size_t slot = slots_[handle];
+    const size_t last = elements_.size() - 1;
+    if (slot != last) {
+      elements_[slot] = std::move(elements_[last]);
+      handles_[slot] = handles_[last];
+      slots_[handles_[slot]] = slot;
+    }
+    elements_.pop_back();
+    handles_.pop_back();
+    slots_[handle] = kOutOfBounds;
+    free_handles_.push_back(handle);
+  }
+
+  // Free element, except it accepts an iterator.  Returns an iterator to the
+  // element that should be visited next, which is now in the same slot.
+  Iterator FreeElement(Iterator iter) {
+    FreeElement(iter.index());
+    return iter;
+  }
+
+  // Returns the number of handles allocated, used or free.  Every handle is
+  // less than this.
+  size_t Size() const { return slots_.size(); }
+
+  // Returns the total number of active elements.
+  size_t active_count() const { return elements_.size(); }
+
+  // Frees every element and forgets every handle.
+  void Clear() {
+    elements_.clear();
+    handles_.clear();
+    slots_.clear();
+    free_handles_.clear();
+  }
+
+  // Returns an iterator at the first active element.
+  Iterator begin() { return Iterator(this, 0); }
+
+  // Returns an iterator one past the last active element.  Since freeing
+  // elements moves the end, re-read this each time round a loop that frees.
+  Iterator end() { return Iterator(this, elements_.size()); }
+
+  // Reserves space for at least new_size active elements, so that adding
+  // them doesn't reallocate.
+  void Reserve(size_t new_size) {
+    elements_.reserve(new_size);
+    handles_.reserve(new_size);
+    slots_.reserve(new_size);
+  }
+
+ private:
+  // The active elements, packed.
+  std::vector<T> elements_;
+  // Handle of the element in each slot of elements_.
+  std::vector<size_t> handles_;
+  // Slot of each handle, or kOutOfBounds if the handle is free.
+  std::vector<size_t> slots_;
+  // Handles to hand out again before growing slots_.
+  std::vector<size_t> free_handles_;
+};
+
+template <typename T>
+const size_t DensePool<T>::kOutOfBounds;
+
+}  // fpl
+
+#endif  // DENSE_POOL_H
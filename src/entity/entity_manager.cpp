@@ -13,13 +13,17 @@
 // limitations under the License.
 
 #include <assert.h>
+#include <algorithm>
 #include "component_id_lookup.h"
 #include "entity_manager.h"
+#include "profiler.h"
+#include "thread_pool.h"
 
 namespace fpl {
 namespace entity {
 
-EntityManager::EntityManager() : entity_factory_(nullptr) {
+EntityManager::EntityManager()
+    : entity_factory_(nullptr), thread_pool_(nullptr) {
   for (int i = 0; i < kMaxComponentCount; i++) {
     components_[i] = nullptr;
   }
@@ -38,7 +42,7 @@ void EntityManager::DeleteEntity(EntityRef entity) {
     return;
   }
   entity->set_marked_for_deletion(true);
-  entities_to_delete_.push_back(entity);
+  entities_to_delete_.push_back(entity.ToHandle());
 }
 
 // This deletes the entity instantly.  You should generally use the regular
@@ -49,12 +53,33 @@ void EntityManager::DeleteEntityImmediately(EntityRef entity) {
 }
 
 void EntityManager::DeleteMarkedEntities() {
+  if (entities_to_delete_.empty()) return;
+  deleted_entities_.clear();
   for (size_t i = 0; i < entities_to_delete_.size(); i++) {
-    EntityRef entity = entities_to_delete_[i];
-    RemoveAllComponents(entity);
-    entities_.FreeElement(entity);
+    // Skip entities that were deleted immediately after being marked.
+    if (!entities_.IsValid(entities_to_delete_[i])) continue;
+    deleted_entities_.push_back(entities_.ToReference(entities_to_delete_[i]));
   }
   entities_to_delete_.resize(0);
+
+  // A component at a time, rather than an entity at a time, so that each
+  // component's data stays in the cache while it frees the whole batch.
+  for (ComponentId i = 0; i < kMaxComponentCount; i++) {
+    if (components_[i]) {
+      components_[i]->RemoveEntities(deleted_entities_.data(),
+                                     deleted_entities_.size());
+    }
+  }
+  for (size_t i = 0; i < deleted_entities_.size(); i++) {
+    entities_.FreeElement(deleted_entities_[i]);
+  }
+  deleted_entities_.clear();
+}
+
+void EntityManager::CompactComponents() {
+  for (ComponentId i = 0; i < kMaxComponentCount; i++) {
+    if (components_[i]) components_[i]->CompactEntityData();
+  }
 }
 
 void EntityManager::RemoveAllComponents(EntityRef entity) {
@@ -97,13 +122,77 @@ const void* EntityManager::GetComponentDataAsVoid(
 }
 
 void EntityManager::UpdateComponents(WorldTime delta_time) {
-  // Update all the registered components.
-  for (size_t i = 0; i < kMaxComponentCount; i++) {
-    if (components_[i]) components_[i]->UpdateAllEntities(delta_time);
+  if (thread_pool_ == nullptr) {
+    // Update all the registered components.
+    for (size_t i = 0; i < kMaxComponentCount; i++) {
+      if (components_[i]) components_[i]->UpdateAllEntities(delta_time);
+    }
+    DeleteMarkedEntities();
+    return;
   }
+
+  // Walk the components in order, gathering them into phases of components
+  // that don't conflict with each other.  A component that conflicts with
+  // the current phase starts the next one, so any two components that
+  // conflict still update in order.
+  const int max_chunks = thread_pool_->num_workers() * kUpdateChunksPerWorker;
+  UpdateAccess phase_access;
+  update_phase_.clear();
+  for (ComponentId i = 0; i < kMaxComponentCount; i++) {
+    ComponentInterface* component = components_[i];
+    if (!component) continue;
+    UpdateAccess access;
+    component->GetUpdateAccess(&access);
+    access.writes.set(i);
+    if (!access.declared || access.ConflictsWith(phase_access)) {
+      UpdatePhase(delta_time);
+      update_phase_.clear();
+      phase_access = UpdateAccess();
+    }
+    if (!access.declared) {
+      component->UpdateAllEntities(delta_time);
+      continue;
+    }
+    update_phase_.push_back(
+        std::make_pair(component, access.parallel_entities ? max_chunks : 0));
+    phase_access.reads |= access.reads;
+    phase_access.writes |= access.writes;
+  }
+  UpdatePhase(delta_time);
   DeleteMarkedEntities();
 }
 
+void EntityManager::UpdatePhase(WorldTime delta_time) {
+  update_tasks_.clear();
+  for (auto it = update_phase_.begin(); it != update_phase_.end(); ++it) {
+    if (it->second == 0) {
+      update_tasks_.push_back(std::make_pair(it->first, -1));
+      continue;
+    }
+    const int num_chunks = it->first->SplitUpdate(it->second);
+    for (int chunk = 0; chunk < num_chunks; chunk++) {
+      update_tasks_.push_back(std::make_pair(it->first, chunk));
+    }
+  }
+
+  thread_pool_->ParallelFor(
+      static_cast<int>(update_tasks_.size()), [this, delta_time](int i) {
+        FPL_PROFILE_SCOPE("EntityManager::UpdateChunk");
+        const std::pair<ComponentInterface*, int>& task = update_tasks_[i];
+        if (task.second < 0) {
+          task.first->UpdateAllEntities(delta_time);
+        } else {
+          task.first->UpdateChunk(delta_time, task.second);
+        }
+      });
+
+  // In component order, so that anything they do outside their own data,
+  // like deleting entities, happens in the same order as a serial update.
+  for (auto it = update_phase_.begin(); it != update_phase_.end(); ++it) {
+    if (it->second != 0) it->first->FinishUpdate(delta_time);
+  }
+}
+
 void EntityManager::Clear() {
   for (size_t i = 0; i < kMaxComponentCount; i++) {
     if (components_[i]) {
@@ -120,5 +209,95 @@ EntityRef EntityManager::CreateEntityFromData(const void* data) {
   return entity_factory_->CreateEntityFromData(data, this);
 }
 
+void EntityManager::ParsePrefab(const void* data, EntityPrefab* prefab) {
+  assert(entity_factory_ != nullptr);
+  prefab->components.clear();
+  entity_factory_->ParseEntityData(data, prefab);
+}
+
+void EntityManager::AllocateBatch(size_t count,
+                                  const size_t* component_counts) {
+  entities_.Reserve(entities_.active_count() +
+                    EntityStorageContainer::kTotalReserved + count);
+  for (ComponentId i = 0; i < kMaxComponentCount; i++) {
+    if (component_counts[i] > 0) {
+      assert(components_[i] != nullptr);
+      components_[i]->ReserveEntities(component_counts[i]);
+    }
+  }
+  batch_entities_.clear();
+  for (size_t i = 0; i < count; i++) {
+    batch_entities_.push_back(AllocateNewEntity());
+  }
+}
+
+void EntityManager::CreateEntitiesFromData(const void* const* data,
+                                           size_t count,
+                                           std::vector<EntityRef>* entities) {
+  if (batch_prefabs_.size() < count) batch_prefabs_.resize(count);
+  size_t component_counts[kMaxComponentCount] = {0};
+  size_t max_components = 0;
+  for (size_t i = 0; i < count; i++) {
+    EntityPrefab& prefab = batch_prefabs_[i];
+    ParsePrefab(data[i], &prefab);
+    for (auto it = prefab.components.begin(); it != prefab.components.end();
+         ++it) {
+      component_counts[it->component_id]++;
+    }
+    max_components = std::max(max_components, prefab.components.size());
+  }
+  AllocateBatch(count, component_counts);
+
+  // Round k adds the k-th component of every entity, so each entity gets
+  // its components in order.  Within a round, the adds are grouped by
+  // component, keeping entity order.
+  for (size_t k = 0; k < max_components; k++) {
+    batch_adds_.clear();
+    for (size_t i = 0; i < count; i++) {
+      const std::vector<EntityPrefab::ComponentData>& components =
+          batch_prefabs_[i].components;
+      if (k < components.size()) {
+        batch_adds_.push_back(std::make_pair(components[k].component_id, i));
+      }
+    }
+    std::sort(batch_adds_.begin(), batch_adds_.end());
+    for (auto it = batch_adds_.begin(); it != batch_adds_.end(); ++it) {
+      components_[it->first]->AddFromRawData(
+          batch_entities_[it->second],
+          batch_prefabs_[it->second].components[k].data);
+    }
+  }
+
+  if (entities) {
+    entities->insert(entities->end(), batch_entities_.begin(),
+                     batch_entities_.end());
+  }
+}
+
+void EntityManager::CreateEntitiesFromPrefab(
+    const EntityPrefab& prefab, size_t count,
+    std::vector<EntityRef>* entities) {
+  size_t component_counts[kMaxComponentCount] = {0};
+  for (auto it = prefab.components.begin(); it != prefab.components.end();
+       ++it) {
+    component_counts[it->component_id] += count;
+  }
+  AllocateBatch(count, component_counts);
+
+  for (auto it = prefab.components.begin(); it != prefab.components.end();
+       ++it) {
+    ComponentInterface* component = components_[it->component_id];
+    for (auto entity = batch_entities_.begin(); entity != batch_entities_.end();
+         ++entity) {
+      component->AddFromRawData(*entity, it->data);
+    }
+  }
+
+  if (entities) {
+    entities->insert(entities->end(), batch_entities_.begin(),
+                     batch_entities_.end());
+  }
+}
+
 }  // entity
 }  // fpl
@@ -22,13 +22,31 @@
 #include "vector_pool.h"
 
 namespace fpl {
+
+class ThreadPool;
+
 namespace entity {
 
 typedef VectorPool<Entity>::VectorPoolReference EntityRef;
+// Compact form of an EntityRef, resolved through the EntityManager's pool.
+typedef VectorPool<Entity>::Handle EntityHandle;
 
 class EntityFactoryInterface;
 class ComponentInterface;
 
+// An entity definition broken down into the component data it is built
+// from, in the order the components should be added.  Parsing a definition
+// into a prefab once lets it be instantiated many times without looking at
+// the definition again.
+struct EntityPrefab {
+  struct ComponentData {
+    ComponentId component_id;
+    // Passed to the component's AddFromRawData.
+    const void* data;
+  };
+  std::vector<ComponentData> components;
+};
+
 // Entity Manager is the main piece of code that manages all entities and
 // components in the game.  Normally the game will instantiate one instance
 // of this, and then use it to create and control entities.  The main
@@ -114,14 +132,28 @@ class EntityManager {
     RegisterComponentHelper(new_component, ComponentIdLookup<T>::kComponentId);
   }
 
+  // Repacks the data of every component after lots of entities have been
+  // deleted, so that updates go through memory in order again.  Pointers to
+  // component data are invalidated, but EntityRefs are not.
+  void CompactComponents();
+
   // Removes all components from an entity, causing any associated components
   // to drop any data they have allocated for the entity.
   void RemoveAllComponents(EntityRef entity);
 
   // Iterates through all registered components, and causes them to update.
   // delta_time represents the timestep since last update.
+  // With a thread pool, components whose updates don't conflict (see
+  // UpdateAccess) are updated at the same time, and so are chunks of
+  // components that allow it.  The results are the same as updating every
+  // component in turn, in order of component id.
   void UpdateComponents(WorldTime delta_time);
 
+  // Thread pool used by UpdateComponents, or null to update every component
+  // on the calling thread.
+  void set_thread_pool(ThreadPool* thread_pool) { thread_pool_ = thread_pool; }
+  ThreadPool* thread_pool() const { return thread_pool_; }
+
   // Clears all data from all components, then dumps the list of components
   // themselves, and then dumps the list of entities.  Basically resets
   // the entity manager into its original state.
@@ -144,6 +176,24 @@ class EntityManager {
   // specified in set_entity_factory.
   EntityRef CreateEntityFromData(const void* data);
 
+  // Creates one entity from each of the `count` definitions in `data`, and
+  // appends them, in order, to `entities` if it isn't null.  Equivalent to
+  // calling CreateEntityFromData on each, except that storage is reserved
+  // up front, and the components are added a component type at a time.
+  // Each entity still gets its components in the order its definition
+  // lists them.
+  void CreateEntitiesFromData(const void* const* data, size_t count,
+                              std::vector<EntityRef>* entities);
+
+  // Parses a definition, as understood by the entity factory, into a prefab
+  // for CreateEntitiesFromPrefab.
+  void ParsePrefab(const void* data, EntityPrefab* prefab);
+
+  // Creates `count` entities from `prefab`, and appends them to `entities`
+  // if it isn't null.
+  void CreateEntitiesFromPrefab(const EntityPrefab& prefab, size_t count,
+                                std::vector<EntityRef>* entities);
+
   // Registers an entity with a component.  This causes the component to
   // allocate data for the entity, and includes the entity in that component's
   // update routines.
@@ -174,6 +224,15 @@ class EntityManager {
 
   // Delete all the entities we have marked for deletion.
   void DeleteMarkedEntities();
+
+  // Allocates `count` entities into batch_entities_, reserving space in
+  // every component `component_counts` says will get some of them.
+  void AllocateBatch(size_t count, const size_t* component_counts);
+
+  // Updates the components in update_phase_, which don't conflict with each
+  // other, on thread_pool_.
+  void UpdatePhase(WorldTime delta_time);
+
   // Storage of all the entities currently tracked by the entitymanager
   EntityStorageContainer entities_;
 
@@ -181,16 +240,38 @@ class EntityManager {
   // have entities added to them.
   ComponentInterface* components_[kMaxComponentCount];
   // Entities that we plan to delete at the end of the frame.
-  std::vector<EntityRef> entities_to_delete_;
+  std::vector<EntityHandle> entities_to_delete_;
   // Factory used for spawning new entities from data.  Provided by the
   // calling program.
   EntityFactoryInterface* entity_factory_;
+
+  ThreadPool* thread_pool_;
+  // Tasks per worker thread to split a component's update into, so that
+  // threads that finish early have something left to steal.
+  static const int kUpdateChunksPerWorker = 4;
+  // Scratch space for UpdateComponents.  Each phase entry is a component and
+  // the most chunks to split it into, or 0 to not split it.  Each task is a
+  // component and a chunk, or -1 for the whole update.
+  std::vector<std::pair<ComponentInterface*, int>> update_phase_;
+  std::vector<std::pair<ComponentInterface*, int>> update_tasks_;
+
+  // Scratch space for DeleteMarkedEntities.
+  std::vector<EntityRef> deleted_entities_;
+
+  // Scratch space for CreateEntitiesFromData and CreateEntitiesFromPrefab,
+  // which therefore mustn't be called from inside AddFromRawData.
+  std::vector<EntityRef> batch_entities_;
+  std::vector<EntityPrefab> batch_prefabs_;
+  // Component to add and index into batch_entities_.
+  std::vector<std::pair<ComponentId, size_t>> batch_adds_;
 };
 
 class EntityFactoryInterface {
  public:
   virtual EntityRef CreateEntityFromData(const void* data,
                                          EntityManager* entity_manager) = 0;
+  // Lists the components the definition `data` adds, for batch creation.
+  virtual void ParseEntityData(const void* data, EntityPrefab* prefab) = 0;
 };
 
 }  // entity
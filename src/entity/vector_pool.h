@@ -16,6 +16,8 @@
 #define VECTOR_POOL_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <utility>
 #include <vector>
 #include "assert.h"
 
@@ -36,6 +38,33 @@ class VectorPool {
   typedef IteratorTemplate<false> Iterator;
   typedef IteratorTemplate<true> ConstIterator;
 
+  // ---------------------------
+  // Compact, trivially copyable reference to an element: its index and
+  // unique id packed into 64 bits.  Unlike VectorPoolReference it doesn't
+  // know its pool, so it's resolved through the pool it came from, with
+  // VectorPool::IsValid and VectorPool::ToReference.
+  class Handle {
+    friend class VectorPool<T>;
+
+   public:
+    Handle() : bits_(0) {}
+
+    bool operator==(const Handle& other) const { return bits_ == other.bits_; }
+    bool operator!=(const Handle& other) const { return bits_ != other.bits_; }
+
+    size_t index() const { return static_cast<size_t>(bits_ & 0xFFFFFFFFu); }
+
+   private:
+    Handle(size_t index, UniqueIdType unique_id)
+        : bits_(static_cast<uint64_t>(unique_id) << 32 |
+                static_cast<uint32_t>(index)) {}
+    UniqueIdType unique_id() const {
+      return static_cast<UniqueIdType>(bits_ >> 32);
+    }
+
+    uint64_t bits_;
+  };
+
   // ---------------------------
   // Reference object for pointing into the vector pool.
   // Basically works as a pointer for vector pool elements, except
@@ -52,9 +81,9 @@ class VectorPool {
     VectorPoolReference() : container_(nullptr), index_(0), unique_id_(0) {}
 
     VectorPoolReference(VectorPool<T>* container, size_t index)
-        : container_(container), index_(index) {
-      unique_id_ = container->GetElement(index)->unique_id;
-    }
+        : container_(container),
+          index_(static_cast<uint32_t>(index)),
+          unique_id_(container->unique_ids_[index]) {}
 
     // Standard equality operator
     bool operator==(const VectorPoolReference& other) const {
@@ -68,10 +97,11 @@ class VectorPool {
 
     // Check to make sure that the reference is still valid.  Will return false
     // if the object pointed to has been freed, even if the location was
-    // later filled with a new object.
+    // later filled with a new object.  Only reads the pool's id table, not
+    // the element itself.
     bool IsValid() const {
       return container_ != nullptr &&
-             (container_->GetElement(index_)->unique_id == unique_id_);
+             container_->IsValid(Handle(index_, unique_id_));
     }
 
     // Member access operator.  Returns a pointer to the data the
@@ -138,9 +168,21 @@ class VectorPool {
     // Returns the raw index into the underlying vector for this object.
     size_t index() { return index_; }
 
+    // Returns the compact form of this reference.
+    Handle ToHandle() const { return Handle(index_, unique_id_); }
+
+    // Points the reference at its element's new index, after the pool was
+    // compacted with `remap`.  References to elements that weren't active
+    // stay invalid.
+    void Remap(const std::vector<size_t>& remap) {
+      if (index_ < remap.size() && remap[index_] != kOutOfBounds) {
+        index_ = static_cast<uint32_t>(remap[index_]);
+      }
+    }
+
    private:
     VectorPool<T>* container_;
-    size_t index_;
+    uint32_t index_;
     UniqueIdType unique_id_;
   };
 
@@ -224,13 +266,13 @@ class VectorPool {
 
   static const size_t kOutOfBounds = static_cast<size_t>(-1);
   static const UniqueIdType kInvalidId = 0;
+  // The unique id of each element is kept apart, in unique_ids_, so that
+  // checking a reference doesn't pull the element into the cache.
   struct VectorPoolElement {
-    VectorPoolElement()
-        : next(kOutOfBounds), prev(kOutOfBounds), unique_id(kInvalidId) {}
+    VectorPoolElement() : next(kOutOfBounds), prev(kOutOfBounds) {}
     T data;
     size_t next;
     size_t prev;
-    UniqueIdType unique_id;
   };
 
   // Constants for our first/last elements. They're never given actual data,
@@ -278,6 +320,7 @@ class VectorPool {
     } else {
       index = elements_.size();
       elements_.push_back(VectorPoolElement());
+      unique_ids_.push_back(kInvalidId);
     }
     switch (alloc_location) {
       case kAddToFront:
@@ -293,7 +336,7 @@ class VectorPool {
     // Placement new, to make sure we always give back a cleanly constructed
     // element:
     new (&(elements_[index].data)) T;
-    elements_[index].unique_id = AllocateUniqueId();
+    unique_ids_[index] = AllocateUniqueId();
     return VectorPoolReference(this, index);
   }
 
@@ -302,7 +345,7 @@ class VectorPool {
   void FreeElement(size_t index) {
     RemoveFromList(index);
     AddToListFront(index, kFirstFree);
-    elements_[index].unique_id = kInvalidId;
+    unique_ids_[index] = kInvalidId;
     active_count_--;
   }
 
@@ -322,6 +365,63 @@ class VectorPool {
     return iter;
   }
 
+  // Returns true if `handle` refers to an element that hasn't been freed.
+  bool IsValid(Handle handle) const {
+    const size_t index = handle.index();
+    return index < unique_ids_.size() &&
+           unique_ids_[index] == handle.unique_id() &&
+           handle.unique_id() != kInvalidId;
+  }
+
+  // Returns a full reference for `handle`, which must be valid.
+  VectorPoolReference ToReference(Handle handle) {
+    assert(IsValid(handle));
+    return VectorPoolReference(this, handle.index());
+  }
+
+  // Returns the data `handle` refers to, or null if it's no longer valid.
+  T* GetElementData(Handle handle) {
+    return IsValid(handle) ? &elements_[handle.index()].data : nullptr;
+  }
+
+  // Moves the active elements to the front of the vector, in iteration order,
+  // and drops every free element, so that iterating is a linear scan again.
+  // If remap isn't null, it's filled with the new index of the element at
+  // each old index, or kOutOfBounds if that element wasn't active.
+  // Elements keep their unique ids, so references and handles to them become
+  // invalid rather than pointing at another element, unless they're remapped.
+  // T must be copyable or movable, and pointers to elements are invalidated.
+  void Compact(std::vector<size_t>* remap) {
+    if (remap) remap->assign(elements_.size(), kOutOfBounds);
+    std::vector<VectorPoolElement> elements(kTotalReserved);
+    std::vector<UniqueIdType> unique_ids(kTotalReserved, kInvalidId);
+    elements.reserve(kTotalReserved + active_count_);
+    unique_ids.reserve(kTotalReserved + active_count_);
+    for (size_t index = elements_[kFirstUsed].next; index != kLastUsed;
+         index = elements_[index].next) {
+      if (remap) (*remap)[index] = elements.size();
+      elements.push_back(VectorPoolElement());
+      elements.back().data = std::move(elements_[index].data);
+      unique_ids.push_back(unique_ids_[index]);
+    }
+    elements_.swap(elements);
+    unique_ids_.swap(unique_ids);
+
+    const size_t size = elements_.size();
+    for (size_t index = kTotalReserved; index < size; index++) {
+      elements_[index].prev = index - 1;
+      elements_[index].next = index + 1;
+    }
+    const size_t first = size > kTotalReserved ? kTotalReserved : kLastUsed;
+    const size_t last = size > kTotalReserved ? size - 1 : kFirstUsed;
+    elements_[kFirstUsed].next = first;
+    elements_[first].prev = kFirstUsed;
+    elements_[last].next = kLastUsed;
+    elements_[kLastUsed].prev = last;
+    elements_[kFirstFree].next = kLastFree;
+    elements_[kLastFree].prev = kFirstFree;
+  }
+
   // Returns the total size of the vector pool.  This is the total number of
   // allocated elements (used AND free) by the underlying vector.
   size_t Size() const { return elements_.size(); }
@@ -333,6 +433,7 @@ class VectorPool {
   // vector to the minimum.
   void Clear() {
     elements_.resize(kTotalReserved);
+    unique_ids_.resize(kTotalReserved);
     elements_[kFirstUsed].next = kLastUsed;
     elements_[kLastUsed].prev = kFirstUsed;
     elements_[kFirstFree].next = kLastFree;
@@ -365,8 +466,8 @@ class VectorPool {
     if (current_size >= new_size) return;
 
     elements_.resize(new_size);
+    unique_ids_.resize(new_size, kInvalidId);
     for (; current_size < new_size; current_size++) {
-      elements_[current_size].unique_id = kInvalidId;
       AddToListFront(current_size, kFirstFree);
     }
   }
@@ -435,10 +536,17 @@ class VectorPool {
   }
 
   std::vector<VectorPoolElement> elements_;
+  // Unique id of the element at each index, or kInvalidId if it's free.
+  std::vector<UniqueIdType> unique_ids_;
   size_t active_count_;
   UniqueIdType next_unique_id_;
 };
 
+template <typename T>
+const size_t VectorPool<T>::kOutOfBounds;
+template <typename T>
+const typename VectorPool<T>::UniqueIdType VectorPool<T>::kInvalidId;
+
 }  // fpl
 
 #endif  // VECTOR_POOL_H
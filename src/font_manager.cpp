@@ -23,135 +23,133 @@
 #include <hb-ft.h>
 
 #include "font_manager.h"
+#include "thread_pool.h"
 #include "utilities.h"
 
-namespace fpl {
+// GL_UNPACK_ROW_LENGTH is core in desktop GL and OpenGL ES3.0, and comes with
+// GL_EXT_unpack_subimage in ES2.0, always with this value. The ES2.0 headers
+// don't define it.
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH 0x0CF2
+#endif
 
-// Singleton object of FreeType&Harfbuzz.
-FT_Library *FontManager::ft_;
-hb_buffer_t *FontManager::harfbuzz_buf_;
+namespace fpl {
 
 FontManager::FontManager()
     : renderer_(nullptr),
       face_initialized_(false),
+      texture_cache_(kFontTextureCacheBytes),
+      buffer_cache_(kFontBufferCacheBytes),
       current_atlas_revision_(0),
-      current_pass_(0) {
-  Initialize();
+      current_pass_(0),
+      unpack_row_length_supported_(false),
+      atlas_upload_bytes_(0),
+      thread_pool_(nullptr),
+      rasterizer_mutex_(SDL_CreateMutex()) {
+  assert(rasterizer_mutex_);
 
   // Initialize glyph cache.
   glyph_cache_.reset(new GlyphCache<uint8_t>(
-      mathfu::vec2i(kGlyphCacheWidth, kGlyphCacheHeight)));
+      mathfu::vec2i(kGlyphCacheWidth, kGlyphCacheHeight),
+      kGlyphCacheMaxPages));
 }
 
-FontManager::FontManager(const mathfu::vec2i &cache_size)
+FontManager::FontManager(const mathfu::vec2i &cache_size,
+                         int32_t max_pages)
     : renderer_(nullptr),
       face_initialized_(false),
+      texture_cache_(kFontTextureCacheBytes),
+      buffer_cache_(kFontBufferCacheBytes),
       current_atlas_revision_(0),
-      current_pass_(0) {
-  Initialize();
+      current_pass_(0),
+      unpack_row_length_supported_(false),
+      atlas_upload_bytes_(0),
+      thread_pool_(nullptr),
+      rasterizer_mutex_(SDL_CreateMutex()) {
+  assert(rasterizer_mutex_);
 
   // Initialize glyph cache.
-  glyph_cache_.reset(new GlyphCache<uint8_t>(cache_size));
+  glyph_cache_.reset(new GlyphCache<uint8_t>(cache_size, max_pages));
 }
 
-FontManager::~FontManager() { Close(); }
-
-void FontManager::Initialize() {
-  assert(ft_ == nullptr);
-  ft_ = new FT_Library;
-  FT_Error err;
-  if ((err = FT_Init_FreeType(ft_))) {
-    // Error! Please fix me.
-    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
-                 "Can't initialize freetype. FT_Error:%d\n", err);
-    assert(0);
-  }
-
-  // Create a buffer for harfbuzz.
-  harfbuzz_buf_ = hb_buffer_create();
+FontManager::~FontManager() {
+  Close();
+  SDL_DestroyMutex(rasterizer_mutex_);
 }
 
-void FontManager::Terminate() {
-  assert(ft_ != nullptr);
-  hb_buffer_destroy(harfbuzz_buf_);
-  harfbuzz_buf_ = nullptr;
-
-  FT_Done_FreeType(*ft_);
-  ft_ = nullptr;
+FontBuffer *FontManager::FindBuffer(const char *text, const float ysize) {
+  return buffer_cache_.Find(text, static_cast<int32_t>(ysize));
 }
 
 FontBuffer *FontManager::GetBuffer(const char *text, const float ysize) {
   // Adjust y size if the size selector is set.
   int32_t converted_ysize = ConvertSize(ysize);
-  float scale = ysize / static_cast<float>(converted_ysize);
 
   // Check cache if we already have a FontBuffer generated.
-  auto it = map_buffers_.find(text);
-  if (it != map_buffers_.end()) {
-    auto t = it->second.find(ysize);
-    if (t != it->second.end()) {
-      // Update current pass.
-      if (current_pass_ != kRenderPass) {
-        t->second->set_pass(current_pass_);
-      }
-
-      // Update UV of the buffer
-      auto ret = UpdateUV(converted_ysize, t->second.get());
-      return ret;
+  FontBuffer *existing = FindBuffer(text, ysize);
+  if (existing != nullptr) {
+    // Update current pass.
+    if (current_pass_ != kRenderPass) {
+      existing->set_pass(current_pass_);
     }
+
+    // Update UV of the buffer
+    return UpdateUV(converted_ysize, existing);
   }
 
   // Otherwise, create new FontBuffer.
 
-  // Set freetype settings.
-  FT_Set_Pixel_Sizes(face_, 0, converted_ysize);
-
   // Layout text.
-  auto string_width = LayoutText(text) * scale;
+  rasterizer_.SetPixelSize(converted_ysize);
+  ShapedText shaped;
+  rasterizer_.Shape(text, &shaped);
 
-  // Retrieve layout info.
-  uint32_t glyph_count;
-  hb_glyph_info_t *glyph_info =
-      hb_buffer_get_glyph_infos(harfbuzz_buf_, &glyph_count);
-  hb_glyph_position_t *glyph_pos =
-      hb_buffer_get_glyph_positions(harfbuzz_buf_, &glyph_count);
+  PrefetchGlyphs(shaped.code_points, converted_ysize);
+  return CreateBuffer(text, ysize, converted_ysize, shaped);
+}
+
+FontBuffer *FontManager::CreateBuffer(const char *text, const float ysize,
+                                      const int32_t converted_ysize,
+                                      const ShapedText &shaped) {
+  float scale = ysize / static_cast<float>(converted_ysize);
+  auto string_width = shaped.width * scale;
+  const size_t glyph_count = shaped.code_points.size();
 
   // Create FontBuffer with derived string length.
   std::unique_ptr<FontBuffer> buffer(new FontBuffer(glyph_count));
 
   // Initialize font metrics parameters.
-  int32_t base_line = ysize * face_->ascender / face_->units_per_EM;
+  FT_Face face = rasterizer_.face();
+  int32_t base_line = ysize * face->ascender / face->units_per_EM;
   FontMetrics initial_metrics(base_line, 0, base_line, base_line - ysize, 0);
 
   mathfu::vec2 pos(mathfu::kZeros2f);
-  FT_GlyphSlot glyph = face_->glyph;
+
+  // Glyph cache revision before adding any glyph. If making room for a later
+  // glyph moves an earlier one, the revision changes, and the buffer's UVs
+  // are updated on the next use.
+  const uint32_t revision = glyph_cache_->get_revision();
 
   for (size_t i = 0; i < glyph_count; ++i) {
-    auto code_point = glyph_info[i].codepoint;
+    auto code_point = shaped.code_points[i];
     auto cache = GetCachedEntry(code_point, converted_ysize);
     if (cache == nullptr) {
-      // Cleanup buffer contents.
-      hb_buffer_clear_contents(harfbuzz_buf_);
       return nullptr;
     }
 
     // Add the code point to the buffer. This information is used when
     // re-fetching UV information when the texture atlas is updated.
     buffer->get_code_points()->push_back(code_point);
+    buffer->get_glyph_pages()->push_back(cache->get_page());
 
     // Calculate internal/external leading value and expand a buffer if
     // necessary.
     FontMetrics new_metrics;
-    if (UpdateMetrics(glyph, initial_metrics, &new_metrics)) {
+    if (UpdateMetrics(cache->get_offset().y(), cache->get_size().y(),
+                      initial_metrics, &new_metrics)) {
       initial_metrics = new_metrics;
     }
 
-    // Construct indices array.
-    const uint16_t kIndices[] = {0, 1, 2, 1, 2, 3};
-    for (auto index : kIndices) {
-      buffer->get_indices()->push_back(index + i * 4);
-    }
-
     // Construct intermediate vertices array.
     // The vertices array is update in the render pass with correct
     // glyph size & glyph cache entry information.
@@ -162,14 +160,17 @@ FontBuffer *FontManager::GetBuffer(const char *text, const float ysize) {
     // Update UV.
     buffer->UpdateUV(i, cache->get_uv());
 
-    // Set buffer revision using glyph cache revision.
-    buffer->set_revision(glyph_cache_->get_revision());
-
     // Advance positions.
-    pos += mathfu::vec2(glyph_pos[i].x_advance, -glyph_pos[i].y_advance) *
+    pos += mathfu::vec2(shaped.advances[i].x(), -shaped.advances[i].y()) *
            scale / kFreeTypeUnit;
   }
 
+  // Set buffer revision using glyph cache revision.
+  buffer->set_revision(revision);
+
+  // Construct indices array, grouped by page.
+  buffer->UpdateSlices();
+
   // Setup size.
   buffer->set_size(vec2i(string_width, ysize));
 
@@ -181,17 +182,13 @@ FontBuffer *FontManager::GetBuffer(const char *text, const float ysize) {
     buffer->set_pass(current_pass_);
   }
 
-  // Cleanup buffer contents.
-  hb_buffer_clear_contents(harfbuzz_buf_);
-
   // Verify the buffer.
   assert(buffer->Verify());
 
-  // Insert the created entry to the hash map.
-  auto insert =
-      map_buffers_[text].insert(std::pair<int32_t, std::unique_ptr<FontBuffer>>(
-          ysize, std::move(buffer)));
-  return insert.first->second.get();
+  // Insert the created entry to the cache.
+  const size_t bytes = buffer->GetMemoryBytes();
+  return buffer_cache_.Insert(text, static_cast<int32_t>(ysize),
+                              std::move(buffer), bytes);
 }
 
 FontBuffer *FontManager::UpdateUV(const int32_t ysize, FontBuffer *buffer) {
@@ -202,9 +199,13 @@ FontBuffer *FontManager::UpdateUV(const int32_t ysize, FontBuffer *buffer) {
     // layout information.
 
     // Set freetype settings.
-    FT_Set_Pixel_Sizes(face_, 0, ysize);
+    rasterizer_.SetPixelSize(ysize);
+
+    // Revision before fetching any glyph, as in CreateBuffer().
+    const uint32_t revision = glyph_cache_->get_revision();
 
     auto code_points = buffer->get_code_points();
+    PrefetchGlyphs(*code_points, ysize);
     for (size_t i = 0; i < code_points->size(); ++i) {
       auto code_point = code_points->at(i);
       auto cache = GetCachedEntry(code_point, ysize);
@@ -212,42 +213,199 @@ FontBuffer *FontManager::UpdateUV(const int32_t ysize, FontBuffer *buffer) {
         return nullptr;
       }
 
-      // Update UV.
+      // Update UV and page.
       buffer->UpdateUV(i, cache->get_uv());
-
-      // Update revision.
-      buffer->set_revision(glyph_cache_->get_revision());
+      (*buffer->get_glyph_pages())[i] = cache->get_page();
     }
+
+    // Update revision.
+    buffer->set_revision(revision);
+
+    // Glyphs may have moved to other pages.
+    buffer->UpdateSlices();
   }
   return buffer;
 }
 
+void FontManager::QueueBuffer(const char *text, const float ysize) {
+  QueuedBuffer queued;
+  queued.text = text;
+  queued.ysize = ysize;
+  queued.converted_ysize = ConvertSize(ysize);
+  queued_buffers_.push_back(std::move(queued));
+}
+
+bool FontManager::PrewarmBuffers() {
+  // Strings that have buffers already need nothing.
+  queued_buffers_.erase(
+      std::remove_if(queued_buffers_.begin(), queued_buffers_.end(),
+                     [this](const QueuedBuffer &queued) {
+                       return FindBuffer(queued.text.c_str(), queued.ysize);
+                     }),
+      queued_buffers_.end());
+
+  // Layout the strings.
+  const bool shaped =
+      ParallelRasterize(static_cast<int32_t>(queued_buffers_.size()),
+                        [this](GlyphRasterizer &rasterizer, int32_t i) {
+    QueuedBuffer &queued = queued_buffers_[i];
+    rasterizer.SetPixelSize(queued.converted_ysize);
+    rasterizer.Shape(queued.text.c_str(), &queued.shaped);
+  });
+  if (!shaped) {
+    // Some strings were never laid out, and would get empty buffers.
+    queued_buffers_.clear();
+    return false;
+  }
+
+  // Render the glyphs the strings need, each once.
+  std::vector<RasterizedGlyph> glyphs;
+  std::unordered_set<uint64_t> added;
+  for (auto &queued : queued_buffers_) {
+    AddMissingGlyphs(queued.shaped.code_points, queued.converted_ysize,
+                     &glyphs, &added);
+  }
+  bool fits = CacheGlyphs(&glyphs);
+
+  // Create the buffers, whose glyphs are all in the cache now.
+  for (auto &queued : queued_buffers_) {
+    if (!fits) break;
+    const char *text = queued.text.c_str();
+    if (FindBuffer(text, queued.ysize)) continue;
+    rasterizer_.SetPixelSize(queued.converted_ysize);
+    fits = CreateBuffer(text, queued.ysize, queued.converted_ysize,
+                        queued.shaped) != nullptr;
+  }
+  queued_buffers_.clear();
+  return fits;
+}
+
+void FontManager::AddMissingGlyphs(const std::vector<uint32_t> &code_points,
+                                   const int32_t y_size,
+                                   std::vector<RasterizedGlyph> *glyphs,
+                                   std::unordered_set<uint64_t> *added) {
+  for (auto code_point : code_points) {
+    if (glyph_cache_->Contains(code_point, y_size)) continue;
+    const uint64_t key = static_cast<uint64_t>(code_point) << 32 |
+                         static_cast<uint32_t>(y_size);
+    if (!added->insert(key).second) continue;
+
+    glyphs->push_back(RasterizedGlyph());
+    glyphs->back().entry.set_code_point(code_point);
+    glyphs->back().y_size = y_size;
+  }
+}
+
+bool FontManager::CacheGlyphs(std::vector<RasterizedGlyph> *glyphs) {
+  const bool rasterized =
+      ParallelRasterize(static_cast<int32_t>(glyphs->size()),
+                        [glyphs](GlyphRasterizer &rasterizer, int32_t i) {
+    RasterizedGlyph &glyph = (*glyphs)[i];
+    rasterizer.SetPixelSize(glyph.y_size);
+    rasterizer.Rasterize(&glyph);
+  });
+
+  // Glyphs the font doesn't have are left to fail in GetCachedEntry().
+  for (auto &glyph : *glyphs) {
+    if (!glyph.loaded) continue;
+    if (!glyph_cache_->Set(glyph.image.data(), glyph.y_size, glyph.entry)) {
+      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                  "Glyph cache is full. Need to flush and re-create.\n");
+      return false;
+    }
+  }
+  return rasterized;
+}
+
+void FontManager::PrefetchGlyphs(const std::vector<uint32_t> &code_points,
+                                 const int32_t y_size) {
+  if (thread_pool_ == nullptr ||
+      static_cast<int32_t>(code_points.size()) < kMinParallelGlyphs) {
+    return;
+  }
+  std::vector<RasterizedGlyph> glyphs;
+  std::unordered_set<uint64_t> added;
+  AddMissingGlyphs(code_points, y_size, &glyphs, &added);
+  if (static_cast<int32_t>(glyphs.size()) < kMinParallelGlyphs) return;
+  CacheGlyphs(&glyphs);
+}
+
+bool FontManager::ParallelRasterize(
+    const int32_t count,
+    const std::function<void(GlyphRasterizer &, int32_t)> &task) {
+  if (thread_pool_ == nullptr || count < 2) {
+    for (int32_t i = 0; i < count; ++i) task(rasterizer_, i);
+    return true;
+  }
+
+  SDL_atomic_t skipped;
+  SDL_AtomicSet(&skipped, 0);
+  for (int32_t begin = 0; begin < count; begin += ThreadPool::kMaxTasks) {
+    const int32_t batch = std::min(count - begin, ThreadPool::kMaxTasks);
+    thread_pool_->ParallelFor(batch, [this, &task, &skipped, begin](int i) {
+      GlyphRasterizer *rasterizer = AcquireRasterizer();
+      if (rasterizer == nullptr) {
+        SDL_AtomicAdd(&skipped, 1);
+        return;
+      }
+      task(*rasterizer, begin + i);
+      ReleaseRasterizer(rasterizer);
+    });
+  }
+  return SDL_AtomicGet(&skipped) == 0;
+}
+
+GlyphRasterizer *FontManager::AcquireRasterizer() {
+  SDL_LockMutex(rasterizer_mutex_);
+  GlyphRasterizer *rasterizer = nullptr;
+  if (!free_rasterizers_.empty()) {
+    rasterizer = free_rasterizers_.back();
+    free_rasterizers_.pop_back();
+  } else {
+    // Fewer rasterizers than tasks running. Rasterizers share font_data_,
+    // but nothing else.
+    std::unique_ptr<GlyphRasterizer> created(new GlyphRasterizer());
+    if (created->Open(font_data_)) {
+      rasterizer = created.get();
+      worker_rasterizers_.push_back(std::move(created));
+    } else {
+      SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                   "Can't create a rasterizer for a worker thread.\n");
+    }
+  }
+  SDL_UnlockMutex(rasterizer_mutex_);
+  return rasterizer;
+}
+
+void FontManager::ReleaseRasterizer(GlyphRasterizer *rasterizer) {
+  SDL_LockMutex(rasterizer_mutex_);
+  free_rasterizers_.push_back(rasterizer);
+  SDL_UnlockMutex(rasterizer_mutex_);
+}
+
 FontTexture *FontManager::GetTexture(const char *text,
                                      const float original_ysize) {
   // Round up y size if the size selector is set.
   int32_t ysize = ConvertSize(original_ysize);
 
   // Check cache if we already have a texture.
-  auto it = map_textures_.find(text);
-  if (it != map_textures_.end()) {
-    auto t = it->second.find(ysize);
-    if (t != it->second.end()) return t->second.get();
-  }
+  FontTexture *existing = texture_cache_.Find(text, ysize);
+  if (existing != nullptr) return existing;
 
   // Otherwise, create new texture.
 
   // Set freetype settings.
-  FT_Set_Pixel_Sizes(face_, 0, ysize);
+  rasterizer_.SetPixelSize(ysize);
 
   // Layout text.
-  auto string_width = LayoutText(text);
+  auto string_width = rasterizer_.LayoutText(text);
 
   // Retrieve layout info.
   uint32_t glyph_count;
   hb_glyph_info_t *glyph_info =
-      hb_buffer_get_glyph_infos(harfbuzz_buf_, &glyph_count);
+      hb_buffer_get_glyph_infos(rasterizer_.buffer(), &glyph_count);
   hb_glyph_position_t *glyph_pos =
-      hb_buffer_get_glyph_positions(harfbuzz_buf_, &glyph_count);
+      hb_buffer_get_glyph_positions(rasterizer_.buffer(), &glyph_count);
 
   // Calculate texture size. The texture may be expanded later depending on
   // glyph sizes.
@@ -255,7 +413,8 @@ FontTexture *FontManager::GetTexture(const char *text,
   int32_t height = mathfu::RoundUpToPowerOf2(ysize);
 
   // Initialize font metrics parameters.
-  int32_t base_line = ysize * face_->ascender / face_->units_per_EM;
+  FT_Face face = rasterizer_.face();
+  int32_t base_line = ysize * face->ascender / face->units_per_EM;
   FontMetrics initial_metrics(base_line, 0, base_line, base_line - ysize, 0);
 
   // rasterized image format in FreeType is 8 bit gray scale format.
@@ -265,25 +424,20 @@ FontTexture *FontManager::GetTexture(const char *text,
   // TODO: make padding values configurable.
   uint32_t kGlyphPadding = 0;
   mathfu::vec2 pos(kGlyphPadding, kGlyphPadding);
-  FT_GlyphSlot glyph = face_->glyph;
+  FT_GlyphSlot glyph = face->glyph;
 
   for (size_t i = 0; i < glyph_count; ++i) {
-    FT_Error err;
-
     // Load glyph using harfbuzz layout information.
-    // Note that harfbuzz takes care of ligatures.
-    if ((err = FT_Load_Glyph(face_, glyph_info[i].codepoint, FT_LOAD_RENDER))) {
-      // Error. This could happen typically the loaded font does not support
-      // particular glyph.
-      SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't load glyph %c FT_Error:%d\n",
-                   text[i], err);
+    if (!rasterizer_.LoadGlyph(glyph_info[i].codepoint)) {
+      rasterizer_.ClearLayout();
       return nullptr;
     }
 
     // Calculate internal/external leading value and expand a buffer if
     // necessary.
     FontMetrics new_metrics;
-    if (UpdateMetrics(glyph, initial_metrics, &new_metrics)) {
+    if (UpdateMetrics(glyph->bitmap_top, glyph->bitmap.rows, initial_metrics,
+                      &new_metrics)) {
       if (new_metrics.total() != initial_metrics.total()) {
         // Expand buffer and update height if necessary.
         if (ExpandBuffer(width, height, initial_metrics, new_metrics, &image)) {
@@ -327,12 +481,11 @@ FontTexture *FontManager::GetTexture(const char *text,
   tex->set_metrics(initial_metrics);
 
   // Cleanup buffer contents.
-  hb_buffer_clear_contents(harfbuzz_buf_);
+  rasterizer_.ClearLayout();
 
-  // Put to the dic.
-  map_textures_[text][ysize].reset(tex);
-
-  return tex;
+  // Put to the cache.
+  return texture_cache_.Insert(text, ysize, std::unique_ptr<FontTexture>(tex),
+                               width * height);
 }
 
 bool FontManager::ExpandBuffer(const int32_t width, const int32_t height,
@@ -395,25 +548,11 @@ bool FontManager::Open(const char *font_name) {
   }
 
   // Open the font.
-  FT_Error err;
-  if ((err = FT_New_Memory_Face(
-           *ft_, reinterpret_cast<const unsigned char *>(&font_data_[0]),
-           font_data_.size(), 0, &face_))) {
-    // Failed to open font.
-    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
-                 "Failed to initialize font:%s FT_Error:%d\n", font_name, err);
-    return false;
-  }
-
-  // Create harfbuzz font information from freetype face.
-  harfbuzz_font_ = hb_ft_font_create(face_, NULL);
-  if (!harfbuzz_font_) {
+  if (!rasterizer_.Open(font_data_)) {
     // Failed to open font.
-    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
-                 "Failed to initialize harfbuzz layout information:%s\n",
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Failed to initialize font:%s\n",
                  font_name);
     font_data_.clear();
-    FT_Done_Face(face_);
     return false;
   }
 
@@ -424,13 +563,15 @@ bool FontManager::Open(const char *font_name) {
 bool FontManager::Close() {
   if (!face_initialized_) return false;
 
-  map_textures_.clear();
+  texture_cache_.Clear();
 
-  map_buffers_.clear();
+  buffer_cache_.Clear();
 
-  hb_font_destroy(harfbuzz_font_);
+  // Rasterizers on the thread pool use font_data_ too.
+  free_rasterizers_.clear();
+  worker_rasterizers_.clear();
 
-  FT_Done_Face(face_);
+  rasterizer_.Close();
 
   font_data_.clear();
 
@@ -442,26 +583,102 @@ bool FontManager::Close() {
 void FontManager::StartLayoutPass() {
   // Reset pass.
   current_pass_ = 0;
+  atlas_upload_bytes_ = 0;
+
+  // Buffers and textures used in the last frame may be evicted now.
+  buffer_cache_.Update();
+  texture_cache_.Update();
 }
 
-void FontManager::UpdatePass(const bool start_subpass) {
-  // Increment a cycle counter in glyph cache.
-  glyph_cache_->Update();
+void FontManager::UpdateAtlasTextures() {
+  const int32_t num_pages = glyph_cache_->get_num_pages();
+  if (static_cast<int32_t>(atlas_textures_.size()) < num_pages) {
+    atlas_textures_.resize(num_pages);
+  }
+  for (int32_t page = 0; page < static_cast<int32_t>(atlas_textures_.size());
+       ++page) {
+    std::unique_ptr<Texture> &texture = atlas_textures_[page];
+    if (!glyph_cache_->has_page(page)) {
+      texture.reset();
+    } else if (!texture) {
+      // Initialize the font atlas texture with the whole page.
+      texture.reset(new Texture(*renderer_));
+      texture->LoadFromMemory(glyph_cache_->get_buffer(page),
+                              glyph_cache_->get_size(), kFormatLuminance,
+                              false);
+
+      // Disable mipmap for the atlas texture.
+      texture->Set(0);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glyph_cache_->set_dirty_state(page, false);
+      atlas_upload_bytes_ +=
+          glyph_cache_->get_size().x() * glyph_cache_->get_size().y();
+    }
+  }
+}
 
-  if (glyph_cache_->get_dirty_state() && current_pass_ <= 0) {
-    auto rect = glyph_cache_->get_dirty_rect();
-    atlas_texture_.get()->Set(0);
+bool FontManager::SupportsUnpackRowLength() {
+#ifdef PLATFORM_MOBILE
+  auto version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+  auto exts = reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+  return (version && strstr(version, "OpenGL ES 3")) ||
+         (exts && strstr(exts, "GL_EXT_unpack_subimage"));
+#else
+  return true;
+#endif
+}
 
+void FontManager::UploadAtlasRect(const int32_t page,
+                                  const mathfu::vec4i &rect) {
+  const int32_t pitch = glyph_cache_->get_size().x();
+  const vec2i size = rect.zw() - rect.xy();
+  const uint8_t *image =
+      glyph_cache_->get_buffer(page) + rect.y() * pitch + rect.x();
+
+  // Rows of a rect needn't be 4 byte aligned.
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (size.x() == pitch) {
+    // Whole rows are contiguous in the glyph cache already.
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, rect.y(), size.x(), size.y(),
+                    GL_LUMINANCE, GL_UNSIGNED_BYTE, image);
+  } else if (unpack_row_length_supported_) {
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), rect.y(), size.x(), size.y(),
+                    GL_LUMINANCE, GL_UNSIGNED_BYTE, image);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  } else {
     // In OpenGL ES2.0, width and pitch of the src buffer needs to match. So
-    // that we are updating entire row at once.
-    // TODO: Optimize glTexSubImage2D call in ES3.0 capable platform.
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, rect.y(),
-                    glyph_cache_.get()->get_size().x(), rect.w() - rect.y(),
-                    GL_LUMINANCE, GL_UNSIGNED_BYTE,
-                    glyph_cache_.get()->get_buffer() +
-                        glyph_cache_.get()->get_size().x() * rect.y());
+    // pack the rows of the rect together first.
+    upload_staging_.resize(size.x() * size.y());
+    for (int32_t y = 0; y < size.y(); ++y) {
+      memcpy(&upload_staging_[y * size.x()], image + y * pitch, size.x());
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x(), rect.y(), size.x(), size.y(),
+                    GL_LUMINANCE, GL_UNSIGNED_BYTE, upload_staging_.data());
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  atlas_upload_bytes_ += size.x() * size.y();
+}
+
+void FontManager::UpdatePass(const bool start_subpass) {
+  // Increment a cycle counter in glyph cache. This may release idle pages.
+  glyph_cache_->Update();
+
+  if (current_pass_ <= 0) {
+    UpdateAtlasTextures();
+    for (int32_t page = 0; page < glyph_cache_->get_num_pages(); ++page) {
+      if (!glyph_cache_->has_page(page) ||
+          !glyph_cache_->get_dirty_state(page)) {
+        continue;
+      }
+      atlas_textures_[page]->Set(0);
+      for (auto &rect : glyph_cache_->get_dirty_rects(page)) {
+        UploadAtlasRect(page, rect);
+      }
+      glyph_cache_->set_dirty_state(page, false);
+    }
+    // The textures now match the cache, including pages released above.
     current_atlas_revision_ = glyph_cache_->get_revision();
-    glyph_cache_->set_dirty_state(false);
   }
 
   if (start_subpass) {
@@ -481,50 +698,20 @@ void FontManager::UpdatePass(const bool start_subpass) {
   }
 }
 
-uint32_t FontManager::LayoutText(const char *text) {
-  size_t length = strlen(text);
-
-  // TODO: make harfbuzz settings (and other font settings) configurable.
-  // Set harfbuzz settings.
-  hb_buffer_set_direction(harfbuzz_buf_, HB_DIRECTION_LTR);
-  hb_buffer_set_script(harfbuzz_buf_, HB_SCRIPT_LATIN);
-  hb_buffer_set_language(harfbuzz_buf_, hb_language_from_string(text, length));
-
-  // Layout the text.
-  hb_buffer_add_utf8(harfbuzz_buf_, text, length, 0, length);
-  hb_shape(harfbuzz_font_, harfbuzz_buf_, nullptr, 0);
-
-  // Retrieve layout info.
-  uint32_t glyph_count;
-  hb_glyph_position_t *glyph_pos =
-      hb_buffer_get_glyph_positions(harfbuzz_buf_, &glyph_count);
-
-  // Retrieve a width of the string.
-  uint32_t string_width = 0;
-  for (uint32_t i = 0; i < glyph_count; ++i) {
-    string_width += glyph_pos[i].x_advance;
-  }
-  string_width /= kFreeTypeUnit;
-
-  return string_width;
-}
-
-bool FontManager::UpdateMetrics(const FT_GlyphSlot g,
+bool FontManager::UpdateMetrics(const int32_t top, const int32_t rows,
                                 const FontMetrics &current_metrics,
                                 FontMetrics *new_metrics) {
   // Calculate internal/external leading value and expand a buffer if
   // necessary.
-  if (g->bitmap_top > current_metrics.ascender() ||
-      static_cast<int32_t>(g->bitmap_top - g->bitmap.rows) <
-      current_metrics.descender()) {
+  if (top > current_metrics.ascender() ||
+      top - rows < current_metrics.descender()) {
     *new_metrics = current_metrics;
     new_metrics->set_internal_leading(
         std::max(current_metrics.internal_leading(),
-                 g->bitmap_top - current_metrics.ascender()));
+                 top - current_metrics.ascender()));
     new_metrics->set_external_leading(
         std::min(current_metrics.external_leading(),
-                 static_cast<int32_t>(g->bitmap_top - g->bitmap.rows
-                                      - current_metrics.descender())));
+                 top - rows - current_metrics.descender()));
     new_metrics->set_base_line(new_metrics->internal_leading() +
                                new_metrics->ascender());
 
@@ -539,18 +726,10 @@ const GlyphCacheEntry *FontManager::GetCachedEntry(const uint32_t code_point,
 
   if (cache == nullptr) {
     // Load glyph using harfbuzz layout information.
-    // Note that harfbuzz takes care of ligatures.
-    FT_Error err;
-    if ((err = FT_Load_Glyph(face_, code_point, FT_LOAD_RENDER))) {
-      // Error. This could happen typically the loaded font does not support
-      // particular glyph.
-      SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't load glyph %c FT_Error:%d\n",
-                   code_point, err);
-      return nullptr;
-    }
+    if (!rasterizer_.LoadGlyph(code_point)) return nullptr;
 
     // Store the glyph to cache.
-    FT_GlyphSlot g = face_->glyph;
+    FT_GlyphSlot g = rasterizer_.face()->glyph;
     GlyphCacheEntry entry;
     entry.set_code_point(code_point);
     entry.set_size(vec2i(g->bitmap.width, g->bitmap.rows));
@@ -595,6 +774,40 @@ void FontBuffer::AddVertices(const vec2 &pos, const int32_t base_line,
                          0.0f);
 }
 
+void FontBuffer::UpdateSlices() {
+  indices_.clear();
+  slices_.clear();
+
+  // Glyphs are rarely spread over more than a page or two, so go over them
+  // once per page, in page order.
+  const uint16_t kIndices[] = {0, 1, 2, 1, 2, 3};
+  int32_t page = -1;
+  for (;;) {
+    // Find the next page used.
+    int32_t next_page = -1;
+    for (auto glyph_page : glyph_pages_) {
+      if (glyph_page > page && (next_page < 0 || glyph_page < next_page)) {
+        next_page = glyph_page;
+      }
+    }
+    if (next_page < 0) break;
+    page = next_page;
+
+    FontBufferSlice slice;
+    slice.page = page;
+    slice.index_offset = static_cast<int32_t>(indices_.size());
+    for (size_t i = 0; i < glyph_pages_.size(); ++i) {
+      if (glyph_pages_[i] != page) continue;
+      for (auto index : kIndices) {
+        indices_.push_back(index + i * kVerticesPerCodePoint);
+      }
+    }
+    slice.index_count =
+        static_cast<int32_t>(indices_.size()) - slice.index_offset;
+    slices_.push_back(slice);
+  }
+}
+
 void FontBuffer::UpdateUV(const int32_t index, const vec4 &uv) {
   vertices_[index * 4].uv_ = uv.xy();
   vertices_[index * 4 + 1].uv_ = mathfu::vec2(uv.x(), uv.w());
@@ -15,34 +15,41 @@
 #ifndef FONT_MANAGER_H
 #define FONT_MANAGER_H
 
+#include <unordered_set>
+
 #include "renderer.h"
 #include "glyph_cache.h"
+#include "glyph_rasterizer.h"
+#include "text_cache.h"
 #include "common.h"
 
-// Forward decls for FreeType & Harfbuzz
-typedef struct FT_LibraryRec_ *FT_Library;
-typedef struct FT_FaceRec_ *FT_Face;
-typedef struct FT_GlyphSlotRec_ *FT_GlyphSlot;
-struct hb_font_t;
-struct hb_buffer_t;
-
 namespace fpl {
 
 // Forward decl.
 class FontTexture;
 class FontBuffer;
 class FontMetrics;
-
-// Constant to convert FreeType unit to pixel unit.
-// In FreeType & Harfbuzz, the position value unit is 1/64 px whereas
-// configurable in imgui. The constant is used to convert FreeType unit
-// to px.
-const int32_t kFreeTypeUnit = 64;
+class ThreadPool;
 
 // Default size of glyph cache.
 const int32_t kGlyphCacheWidth = 1024;
 const int32_t kGlyphCacheHeight = 1024;
 
+// Default number of pages the glyph cache may grow to. Each page takes
+// kGlyphCacheWidth * kGlyphCacheHeight bytes, plus a texture of that size.
+const int32_t kGlyphCacheMaxPages = 4;
+
+// GetBuffer() renders the glyphs of a string missing from the glyph cache on
+// the thread pool when there are at least this many of them. Fewer aren't
+// worth waking the worker threads for.
+const int32_t kMinParallelGlyphs = 8;
+
+// Default budgets of the caches of FontBuffers and FontTextures, in bytes of
+// their vertex arrays and texture images. Least recently used strings are
+// evicted beyond them.
+const size_t kFontBufferCacheBytes = 512 * 1024;
+const size_t kFontTextureCacheBytes = 4 * 1024 * 1024;
+
 // FontManager manages font rendering with OpenGL utilizing freetype
 // and harfbuzz as a glyph rendering and layout back end.
 //
@@ -50,14 +57,19 @@ const int32_t kGlyphCacheHeight = 1024;
 // An application can use the generated texture for a text rendering.
 //
 // The class is not threadsafe, it's expected to be only used from
-// within OpenGL rendering thread.
+// within OpenGL rendering thread. Given a thread pool, it lays out strings
+// and renders glyphs on the pool's threads too, each with a GlyphRasterizer
+// of its own, then stores the glyphs in the glyph cache on the calling
+// thread.
 class FontManager {
  public:
   FontManager();
-  // Constructor with a cache size in pixels.
+  // Constructor with a cache page size in pixels, and the number of pages
+  // the cache may grow to.
   // The given size is rounded up to nearest power of 2 internally to be used as
   // an OpenGL texture sizes.
-  FontManager(const mathfu::vec2i &cache_size);
+  FontManager(const mathfu::vec2i &cache_size,
+              int32_t max_pages = kGlyphCacheMaxPages);
   ~FontManager();
 
   // Open font face, TTF, OT fonts are supported.
@@ -73,27 +85,42 @@ class FontManager {
   // This API doesn't use the glyph cache, instead it writes the string image
   // directly to the returned texture. The user can use this API when a font
   // texture is used for a long time, such as a string image used in game HUD.
+  // The texture may be evicted from the next StartLayoutPass() on, so call
+  // this again in every frame that uses it.
   FontTexture *GetTexture(const char *text, const float ysize);
 
   // Retrieve a vertex buffer for a font rendering using glyph cache.
+  // As with GetTexture(), the buffer is valid until the next
+  // StartLayoutPass().
   // Returns nullptr if the string does not fit in the glyph cache.
   // When this happens, caller may flush the glyph cache with
   // FlushAndUpdate() call and re-try the GetBuffer() call.
   FontBuffer *GetBuffer(const char *text, const float ysize);
 
+  // Queue a string for PrewarmBuffers().
+  void QueueBuffer(const char *text, const float ysize);
+
+  // Lay out the queued strings and render their glyphs on the thread pool,
+  // then store the glyphs in the glyph cache and create the strings'
+  // FontBuffers, so that GetBuffer() for them finds everything ready.
+  // Use while loading, e.g. with the labels of a menu about to be shown.
+  // Returns false if some of the strings don't fit in the glyph cache, or if
+  // a worker couldn't get a rasterizer to lay them out or render them.
+  // GetBuffer() handles those as usual.
+  bool PrewarmBuffers();
+
+  // Set the thread pool to lay out strings and render glyphs on. Without
+  // one, the work is done on the calling thread.
+  void set_thread_pool(ThreadPool *thread_pool) { thread_pool_ = thread_pool; }
+
   // Set renderer. Renderer is used to create a texture instance.
   void SetRenderer(Renderer &renderer) {
     renderer_ = &renderer;
+    unpack_row_length_supported_ = SupportsUnpackRowLength();
 
-    // Initialize the font atlas texture.
-    atlas_texture_.reset(new Texture(renderer));
-    atlas_texture_.get()->LoadFromMemory(glyph_cache_->get_buffer(),
-                                         glyph_cache_->get_size(),
-                                         kFormatLuminance, false);
-
-    // Disable mipmap for the atlas texture.
-    atlas_texture_.get()->Set(0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // Initialize the font atlas texture of the first page. Textures of other
+    // pages are created as the glyph cache adds the pages.
+    UpdateAtlasTextures();
   }
 
   // Returns if a font has been loaded.
@@ -121,8 +148,42 @@ class FontManager {
   // a render pass.
   void StartRenderPass() { UpdatePass(false); }
 
-  // Getter of the font atlas texture.
-  Texture *GetAtlasTexture() { return atlas_texture_.get(); }
+  // Getter of the font atlas texture of a glyph cache page, as given by
+  // FontBuffer::get_slices().
+  // A page added since the last pass gets its texture here.
+  Texture *GetAtlasTexture(int32_t page) {
+    if (page >= static_cast<int32_t>(atlas_textures_.size()) ||
+        !atlas_textures_[page]) {
+      UpdateAtlasTextures();
+    }
+    return atlas_textures_[page].get();
+  }
+
+  // Bytes of glyph images uploaded to the atlas textures since the last
+  // StartLayoutPass(), which is once a frame.
+  int32_t GetAtlasUploadBytes() const { return atlas_upload_bytes_; }
+
+  // Getter of the glyph cache usage statistics.
+  const GlyphCacheStats &GetGlyphCacheStats() const {
+    return glyph_cache_->get_stats();
+  }
+
+  // Getters of the usage statistics of the FontBuffer and FontTexture caches,
+  // including their hit rates and resident bytes.
+  const TextCacheStats &GetBufferCacheStats() const {
+    return buffer_cache_.get_stats();
+  }
+  const TextCacheStats &GetTextureCacheStats() const {
+    return texture_cache_.get_stats();
+  }
+
+  // Set the budgets of the FontBuffer and FontTexture caches in bytes.
+  void SetBufferCacheBudget(const size_t bytes) {
+    buffer_cache_.set_byte_budget(bytes);
+  }
+  void SetTextureCacheBudget(const size_t bytes) {
+    texture_cache_.set_byte_budget(bytes);
+  }
 
   // The user can supply a size selector function to adjust glyph sizes when
   // storing a glyph cache entry.
@@ -140,13 +201,13 @@ class FontManager {
   // Pass indicating rendering pass.
   static const int32_t kRenderPass = -1;
 
-  // Initialize static data associated with the class.
-  static void Initialize();
-
-  // Clean up static data associated with the class.
-  // Note that after the call, an application needs to call Initialize() again
-  // to use the class.
-  static void Terminate();
+  // A string queued by QueueBuffer().
+  struct QueuedBuffer {
+    std::string text;
+    float ysize;
+    int32_t converted_ysize;
+    ShapedText shaped;
+  };
 
   // Expand a texture image buffer when the font metrics is changed.
   // Returns true if the image buffer was reallocated.
@@ -155,16 +216,55 @@ class FontManager {
                            const FontMetrics &new_metrics,
                            std::unique_ptr<uint8_t[]> *image);
 
-  // Layout text and update harfbuzz_buf_.
-  // Returns the width of the text layout in pixels.
-  uint32_t LayoutText(const char *text);
-
-  // Calculate internal/external leading value and expand a buffer if
-  // necessary.
+  // Calculate internal/external leading value of a glyph whose bitmap has
+  // `rows` rows, the first `top` pixels above the baseline, and expand a
+  // buffer if necessary.
   // Returns true if the size of metrics has been changed.
-  bool UpdateMetrics(const FT_GlyphSlot glyph,
-                     const FontMetrics &current_metrics,
-                     FontMetrics *new_metrics);
+  static bool UpdateMetrics(const int32_t top, const int32_t rows,
+                            const FontMetrics &current_metrics,
+                            FontMetrics *new_metrics);
+
+  // Returns the FontBuffer created for a string, or nullptr if there is none.
+  FontBuffer *FindBuffer(const char *text, const float ysize);
+
+  // Create the FontBuffer of a string laid out at converted_ysize, and add it
+  // to buffer_cache_.
+  // Returns nullptr if the string does not fit in the glyph cache.
+  FontBuffer *CreateBuffer(const char *text, const float ysize,
+                           const int32_t converted_ysize,
+                           const ShapedText &shaped);
+
+  // Add the glyphs in code_points that are missing from both the glyph cache
+  // and `glyphs` to `glyphs`. `added` holds the code point and size of each
+  // glyph in `glyphs`, so that checking for one doesn't search them all.
+  void AddMissingGlyphs(const std::vector<uint32_t> &code_points,
+                        const int32_t y_size,
+                        std::vector<RasterizedGlyph> *glyphs,
+                        std::unordered_set<uint64_t> *added);
+
+  // Render glyphs on the thread pool, then store them in the glyph cache.
+  // Returns false if some of them weren't rendered or don't fit.
+  bool CacheGlyphs(std::vector<RasterizedGlyph> *glyphs);
+
+  // Render the glyphs of a string missing from the glyph cache on the thread
+  // pool, if there are enough of them to be worth it. GetCachedEntry() then
+  // finds them in the cache.
+  void PrefetchGlyphs(const std::vector<uint32_t> &code_points,
+                      const int32_t y_size);
+
+  // Calls task(rasterizer, i) for every i in [0, count), on the thread pool
+  // if there is one. Calls running at the same time get different
+  // rasterizers.
+  // Returns false if some calls were skipped because no rasterizer could be
+  // created for them.
+  bool ParallelRasterize(
+      const int32_t count,
+      const std::function<void(GlyphRasterizer &, int32_t)> &task);
+
+  // Take a rasterizer for a task on the thread pool from
+  // free_rasterizers_, or create one, and give it back.
+  GlyphRasterizer *AcquireRasterizer();
+  void ReleaseRasterizer(GlyphRasterizer *rasterizer);
 
   // Retrieve cached entry from the glyph cache.
   // If an entry is not found in the glyph cache, the API tries to create new
@@ -185,6 +285,18 @@ class FontManager {
   // flushed during a rendering pass.
   void UpdatePass(const bool start_subpass);
 
+  // Create textures for pages the glyph cache has added, and destroy those
+  // of pages it has released.
+  void UpdateAtlasTextures();
+
+  // Upload a rect of a glyph cache page to its atlas texture.
+  void UploadAtlasRect(const int32_t page, const mathfu::vec4i &rect);
+
+  // Returns if the GL context lets GL_UNPACK_ROW_LENGTH set the pitch of
+  // uploaded images, so that a rect can be uploaded straight from the glyph
+  // cache.
+  static bool SupportsUnpackRowLength();
+
   // Update UV value in the FontBuffer.
   // Returns nullptr if one of UV values couldn't be updated.
   FontBuffer *UpdateUV(const int32_t ysize, FontBuffer *buffer);
@@ -195,12 +307,9 @@ class FontManager {
   // Renderer instance.
   Renderer *renderer_;
 
-  // freetype's fontface instance. In this version of FontManager, it supports
-  // only 1 font opened at a time.
-  FT_Face face_;
-
-  // harfbuzz's font information instance.
-  hb_font_t *harfbuzz_font_;
+  // FreeType & harfbuzz instances used on the rendering thread. In this
+  // version of FontManager, it supports only 1 font opened at a time.
+  GlyphRasterizer rasterizer_;
 
   // Opened font file data.
   // The file needs to be kept open until FreeType finishes using the file.
@@ -210,24 +319,14 @@ class FontManager {
   bool face_initialized_;
 
   // Texture cache for a rendered string image.
-  // Using the std::string & its' vertical size in pixels (int32_t) as keys.
-  // The map is used for GetTexture() API.
-  std::unordered_map<std::string,
-                     std::unordered_map<int32_t, std::unique_ptr<FontTexture>>>
-      map_textures_;
+  // Using the string & its' vertical size in pixels (int32_t) as keys.
+  // The cache is used for GetTexture() API.
+  TextCache<FontTexture> texture_cache_;
 
   // Cache for a texture atlas + vertex array rendering.
-  // Using the std:;string & its' vertical size in pixels (int32_t) as keys.
-  // The map is used for GetBuffer() API.
-  std::unordered_map<std::string,
-                     std::unordered_map<int32_t, std::unique_ptr<FontBuffer>>>
-      map_buffers_;
-
-  // Singleton instance of Freetype library.
-  static FT_Library *ft_;
-
-  // Harfbuzz buffer
-  static hb_buffer_t *harfbuzz_buf_;
+  // Using the string & its' vertical size in pixels (int32_t) as keys.
+  // The cache is used for GetBuffer() API.
+  TextCache<FontBuffer> buffer_cache_;
 
   // Unique pointer to a glyph cache.
   std::unique_ptr<GlyphCache<uint8_t>> glyph_cache_;
@@ -235,8 +334,9 @@ class FontManager {
   // Current atlas texture's contents revision.
   uint32_t current_atlas_revision_;
 
-  // Unique pointer to a font atlas texture.
-  std::unique_ptr<Texture> atlas_texture_;
+  // Font atlas textures, indexed by glyph cache page. Null where the glyph
+  // cache has no page.
+  std::vector<std::unique_ptr<Texture>> atlas_textures_;
 
   // Current pass counter.
   // Current implementation only supports up to 2 passes in a rendering cycle.
@@ -244,6 +344,31 @@ class FontManager {
 
   // Size selector function object used to adjust a glyph size.
   std::function<int32_t(const int32_t)> size_selector_;
+
+  // If GL_UNPACK_ROW_LENGTH can be used for uploads.
+  bool unpack_row_length_supported_;
+
+  // Dirty rects packed for upload, where GL_UNPACK_ROW_LENGTH can't be used.
+  std::vector<uint8_t> upload_staging_;
+
+  // Bytes uploaded to the atlas textures in this frame.
+  int32_t atlas_upload_bytes_;
+
+  // Thread pool to lay out strings and render glyphs on, or nullptr.
+  ThreadPool *thread_pool_;
+
+  // Rasterizers for tasks run on the thread pool, opened on font_data_. One
+  // is created for each task running at the same time, at most.
+  std::vector<std::unique_ptr<GlyphRasterizer>> worker_rasterizers_;
+
+  // Rasterizers of worker_rasterizers_ not used by a task.
+  std::vector<GlyphRasterizer *> free_rasterizers_;
+
+  // Guards free_rasterizers_ and worker_rasterizers_ while tasks run.
+  SDL_mutex *rasterizer_mutex_;
+
+  // Strings queued by QueueBuffer().
+  std::vector<QueuedBuffer> queued_buffers_;
 };
 
 // Font texture class inherits Texture publicly.
@@ -372,6 +497,14 @@ struct FontVertex {
   mathfu::vec2_packed uv_;
 };
 
+// Range of a FontBuffer's indices whose glyphs are all on the same glyph
+// cache page, so that they can be drawn with one draw call.
+struct FontBufferSlice {
+  int32_t page;
+  int32_t index_offset;
+  int32_t index_count;
+};
+
 // Font buffer class
 // Used with the texture atlas rendering.
 class FontBuffer {
@@ -387,6 +520,7 @@ class FontBuffer {
     indices_.reserve(size * kIndiciesPerCodePoint);
     vertices_.reserve(size * kVerticesPerCodePoint);
     code_points_.reserve(size);
+    glyph_pages_.reserve(size);
   }
   ~FontBuffer() {}
 
@@ -406,6 +540,13 @@ class FontBuffer {
   std::vector<uint32_t> *get_code_points() { return &code_points_; }
   const std::vector<uint32_t> *get_code_points() const { return &code_points_; }
 
+  // Getter of the glyph cache page of each code point.
+  std::vector<int32_t> *get_glyph_pages() { return &glyph_pages_; }
+  const std::vector<int32_t> *get_glyph_pages() const { return &glyph_pages_; }
+
+  // Getter of the ranges of indices to draw, one per glyph cache page.
+  const std::vector<FontBufferSlice> *get_slices() const { return &slices_; }
+
   // Getter/Setter of the size of the string.
   const vec2i &get_size() const { return size_; }
   void set_size(const vec2i &size) { size_ = size; }
@@ -433,10 +574,24 @@ class FontBuffer {
   // bottom right of UV value s wz component of the vector.
   void UpdateUV(const int32_t index, const vec4 &uv);
 
+  // Rebuild the indices array, grouping the glyphs by glyph cache page, and
+  // the slices to match. Call after changing the glyph pages.
+  void UpdateSlices();
+
+  // Bytes of memory the arrays of the buffer take.
+  size_t GetMemoryBytes() const {
+    return indices_.capacity() * sizeof(uint16_t) +
+           vertices_.capacity() * sizeof(FontVertex) +
+           code_points_.capacity() * sizeof(uint32_t) +
+           glyph_pages_.capacity() * sizeof(int32_t) +
+           slices_.capacity() * sizeof(FontBufferSlice);
+  }
+
   // Verify sizes of arrays used in the buffer are correct.
   bool Verify() {
     assert(vertices_.size() == code_points_.size() * kVerticesPerCodePoint);
     assert(indices_.size() == code_points_.size() * kIndiciesPerCodePoint);
+    assert(glyph_pages_.size() == code_points_.size());
     return true;
   }
 
@@ -458,6 +613,12 @@ class FontBuffer {
   // entries when the glyph cache is flushed.
   std::vector<uint32_t> code_points_;
 
+  // Glyph cache page of each code point.
+  std::vector<int32_t> glyph_pages_;
+
+  // Ranges of indices_ with glyphs on the same page, in page order.
+  std::vector<FontBufferSlice> slices_;
+
   // Size of the string in pixels.
   vec2i size_;
 
@@ -28,6 +28,7 @@
 #include "multiplayer_director.h"
 #include "pie_noon_common_generated.h"
 #include "pindrop/pindrop.h"
+#include "profiler.h"
 #include "scene_description.h"
 #include "timeline_generated.h"
 #include "utilities.h"
@@ -105,6 +106,20 @@ entity::EntityRef PieNoonEntityFactory::CreateEntityFromData(
   return entity;
 }
 
+void PieNoonEntityFactory::ParseEntityData(const void* data,
+                                           entity::EntityPrefab* prefab) {
+  const EntityDefinition* def = static_cast<const EntityDefinition*>(data);
+  assert(def != nullptr);
+  for (size_t i = 0; i < def->component_list()->size(); i++) {
+    const ComponentDefInstance* currentInstance = def->component_list()->Get(i);
+    entity::EntityPrefab::ComponentData component;
+    component.component_id =
+        static_cast<entity::ComponentId>(currentInstance->data_type());
+    component.data = currentInstance;
+    prefab->components.push_back(component);
+  }
+}
+
 GameState::GameState()
     : time_(0),
       config_(nullptr),
@@ -115,6 +130,16 @@ GameState::GameState()
       is_in_cardboard_(false),
       use_undistort_rendering_(true) {}
 
+void GameState::SetUpdateThreads(int num_threads) {
+  update_thread_pool_.Stop();
+  if (num_threads < 0) {
+    entity_manager_.set_thread_pool(nullptr);
+    return;
+  }
+  update_thread_pool_.Start(num_threads);
+  entity_manager_.set_thread_pool(&update_thread_pool_);
+}
+
 GameState::~GameState() {}
 
 // Calculate the direction a character is facing at the start of the game.
@@ -153,6 +178,7 @@ static const CharacterArrangement* GetBestArrangement(const Config* config,
 void GameState::ShakeProps(float damage_percent, const vec3& damage_position) {
   shakeable_prop_component_.ShakeProps(damage_percent, damage_position);
 
+  splatter_props_.clear();
   for (auto iter = shakeable_prop_component_.begin();
        iter != shakeable_prop_component_.end(); ++iter) {
     const SceneObjectData* so_data =
@@ -160,10 +186,13 @@ void GameState::ShakeProps(float damage_percent, const vec3& damage_position) {
     assert(so_data != nullptr);
     float dist_squared =
         (so_data->GlobalPosition() - damage_position).LengthSquared();
-    if (dist_squared < config_->splatter_radius_squared()) {
-      AddSplatterToProp(iter->entity);
+    if (dist_squared < config_->splatter_radius_squared() &&
+        iter->entity->IsRegisteredForComponent(
+            ComponentDataUnion_SceneObjectDef)) {
+      splatter_props_.push_back(iter->entity);
     }
   }
+  AddSplattersToProps(splatter_props_);
 }
 
 // Returns true if the game is over.
@@ -228,9 +257,14 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
   player_character_component_.set_gamestate_ptr(this);
   cardboard_player_component_.set_gamestate_ptr(this);
   // Load Entities from flatbuffer!
-  for (size_t i = 0; i < layout_config->entity_list()->size(); i++) {
-    entity_manager_.CreateEntityFromData(layout_config->entity_list()->Get(i));
+  auto entity_list = layout_config->entity_list();
+  std::vector<const void*> entity_defs(entity_list->size());
+  for (size_t i = 0; i < entity_list->size(); i++) {
+    entity_defs[i] = entity_list->Get(i);
   }
+  entity_manager_.CreateEntitiesFromData(entity_defs.data(), entity_defs.size(),
+                                         nullptr);
+  entity_manager_.ParsePrefab(config_->splatter_def(), &splatter_prefab_);
 
   // Reset characters to their initial state.
   const CharacterId num_ids = static_cast<CharacterId>(characters_.size());
@@ -266,6 +300,11 @@ void GameState::Reset(AnalyticsMode analytics_mode) {
     }
   }
 
+  // The entities above reused the data the Clear() above freed, in whatever
+  // order it was freed. Nothing holds on to component data between frames,
+  // so pack it here, where it's cheap, to update it in memory order.
+  entity_manager_.CompactComponents();
+
   particle_manager_.RemoveAllParticles();
 }
 
@@ -288,7 +327,7 @@ void GameState::ProcessSounds(pindrop::AudioEngine* audio_engine,
                               WorldTime delta_time) const {
   // Process sounds in timeline.
   const Timeline* const timeline = character.CurrentTimeline();
-  if (!timeline) return;
+  if (!timeline || !audio_engine) return;
 
   const WorldTime anim_time = GetAnimationTime(character);
   const auto sounds = timeline->sounds();
@@ -306,14 +345,17 @@ void GameState::ProcessSounds(pindrop::AudioEngine* audio_engine,
   }
 }
 
-static float CalculatePieHeight(const Config& config) {
+static float CalculatePieHeight(const Config& config,
+                                RandomGenerator* random) {
   return config.pie_arc_height() +
-         config.pie_arc_height_variance() * (mathfu::Random<float>() * 2 - 1);
+         config.pie_arc_height_variance() * (random->Random() * 2 - 1);
 }
 
-static float CalculatePieRotations(const Config& config) {
+static float CalculatePieRotations(const Config& config,
+                                   RandomGenerator* random) {
   const int variance = config.pie_rotation_variance();
-  const int bonus = variance == 0 ? 0 : (rand() % (variance * 2)) - variance;
+  const int bonus =
+      variance == 0 ? 0 : random->InRange(0, variance * 2) - variance;
   return config.pie_rotations() + bonus;
 }
 
@@ -339,9 +381,9 @@ void GameState::CreatePie(CharacterId original_source_id, CharacterId source_id,
                           CharacterId target_id,
                           CharacterHealth original_damage,
                           CharacterHealth damage) {
-  const float peak_height =
-      CalculatePieHeight(is_in_cardboard_ ? *cardboard_config_ : *config_);
-  const int rotations = CalculatePieRotations(*config_);
+  const float peak_height = CalculatePieHeight(
+      is_in_cardboard_ ? *cardboard_config_ : *config_, &random_);
+  const int rotations = CalculatePieRotations(*config_, &random_);
   const float y_rotation = CalculatePieYRotation(source_id, target_id);
   pies_.push_back(std::unique_ptr<AirbornePie>(new AirbornePie(
       original_source_id, *characters_[source_id], *characters_[target_id],
@@ -350,7 +392,7 @@ void GameState::CreatePie(CharacterId original_source_id, CharacterId source_id,
       &engine_)));
 }
 
-CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) const {
+CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) {
   switch (config_->pie_deflection_mode()) {
     case PieDeflectionMode_ToTargetOfTarget: {
       return characters_[pie.target_id]->target();
@@ -359,7 +401,7 @@ CharacterId GameState::DetermineDeflectionTarget(const ReceivedPie& pie) const {
       return pie.source_id;
     }
     case PieDeflectionMode_ToRandom: {
-      return rand() % characters_.size();
+      return random_.InRange(0, static_cast<int>(characters_.size()));
     }
     default: {
       assert(0);
@@ -474,7 +516,7 @@ void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
             config_->blocked_sound_id_for_pie_damage()->Length() - 1);
         const auto& sound_name =
             config_->blocked_sound_id_for_pie_damage()->Get(index);
-        audio_engine->PlaySound(sound_name->c_str());
+        if (audio_engine) audio_engine->PlaySound(sound_name->c_str());
 
         const CharacterHealth deflected_pie_damage =
             pie.damage + config_->pie_damage_change_when_deflected();
@@ -508,37 +550,33 @@ void GameState::ProcessEvent(pindrop::AudioEngine* audio_engine,
   }
 }
 
-static vec3 RandomInRangeVec3(const vec3& min_range, const vec3& max_range) {
-  // TODO: Fix mathfu::RandomInRange to take "const T&" instead of "T".
-  // Will avoid alignment error on Visual Studio.
-  return vec3(mathfu::RandomInRange(min_range.x(), max_range.x()),
-              mathfu::RandomInRange(min_range.y(), max_range.y()),
-              mathfu::RandomInRange(min_range.z(), max_range.z()));
-}
-
-void GameState::AddSplatterToProp(entity::EntityRef prop) {
+void GameState::AddSplattersToProps(
+    const std::vector<entity::EntityRef>& props) {
   static RenderableId id_list[] = {
       RenderableId_Splatter1, RenderableId_Splatter2, RenderableId_Splatter3};
-  if (prop->IsRegisteredForComponent(ComponentDataUnion_SceneObjectDef)) {
-    entity::EntityRef splatter =
-        entity_manager_.CreateEntityFromData(config_->splatter_def());
+  splatters_.clear();
+  entity_manager_.CreateEntitiesFromPrefab(splatter_prefab_, props.size(),
+                                           &splatters_);
+  for (size_t i = 0; i < props.size(); i++) {
+    entity::EntityRef prop = props[i];
+    entity::EntityRef& splatter = splatters_[i];
     auto so_data = entity_manager_.GetComponentData<SceneObjectData>(splatter);
 
-    so_data->set_renderable_id(id_list[mathfu::RandomInRange(0, 3)]);
-    so_data->set_parent(prop);
+    so_data->set_renderable_id(id_list[random_.InRange(0, 3)]);
+    sceneobject_component_.SetParent(splatter, prop);
 
     vec3 min_range = LoadVec3(config_->splatter_range_min());
     vec3 max_range = LoadVec3(config_->splatter_range_max());
 
-    const vec3 offset = RandomInRangeVec3(min_range, max_range);
+    const vec3 offset = random_.InRange(min_range, max_range);
     so_data->SetTranslation(offset);
 
     const Angle rotation_angle =
-        Angle::FromWithinThreePi(mathfu::RandomInRange(-M_PI_2, M_PI_2));
+        Angle::FromWithinThreePi(random_.InRange(-M_PI_2, M_PI_2));
     so_data->SetRotationAboutZ(rotation_angle.ToRadians());
 
-    float scale = mathfu::RandomInRange(config_->splatter_scale_min(),
-                                        config_->splatter_scale_max());
+    float scale = random_.InRange(config_->splatter_scale_min(),
+                                  config_->splatter_scale_max());
     so_data->SetScale(vec3(scale));
 
     drip_and_vanish_component_.SetStartingValues(splatter);
@@ -863,7 +901,7 @@ void GameState::CreatePieSplatter(pindrop::AudioEngine* audio_engine,
   const CharacterHealth index = mathfu::Clamp<CharacterHealth>(
       damage, 0, config_->hit_sound_id_for_pie_damage()->Length() - 1);
   const auto& sound_name = config_->hit_sound_id_for_pie_damage()->Get(index);
-  audio_engine->PlaySound(sound_name->c_str());
+  if (audio_engine) audio_engine->PlaySound(sound_name->c_str());
 }
 
 // Creates confetti when a character presses buttons on the join screen.
@@ -898,42 +936,45 @@ void GameState::SpawnParticles(const mathfu::vec3& position,
           : mathfu::kZeros3f;
 
   for (int i = 0; i < particle_count; i++) {
-    Particle* p = particle_manager_.CreateParticle();
-    // if we got back a null, it means new particles can't be spawned right now.
-    if (p == nullptr) {
+    Particle p = particle_manager_.CreateParticle();
+    // if we got back an invalid view, new particles can't be spawned right now.
+    if (!p.valid()) {
       break;
     }
-    p->set_base_scale(
+    p.set_base_scale(
         def->preserve_aspect()
-            ? vec3(mathfu::RandomInRange(min_scale.x(), max_scale.x()))
-            : vec3::RandomInRange(min_scale, max_scale));
+            ? vec3(random_.InRange(min_scale.x(), max_scale.x()))
+            : random_.InRange(min_scale, max_scale));
 
-    p->set_base_velocity(vec3::RandomInRange(min_velocity, max_velocity));
-    p->set_acceleration(LoadVec3(def->acceleration()));
-    p->set_renderable_id(def->renderable()->Get(
-        mathfu::RandomInRange<int>(0, def->renderable()->size())));
+    p.set_base_velocity(random_.InRange(min_velocity, max_velocity));
+    p.set_acceleration(LoadVec3(def->acceleration()));
+    p.set_renderable_id(def->renderable()->Get(
+        random_.InRange<int>(0, def->renderable()->size())));
     mathfu::vec4 tint = LoadVec4(
-        def->tint()->Get(mathfu::RandomInRange<int>(0, def->tint()->size())));
-    p->set_base_tint(
+        def->tint()->Get(random_.InRange<int>(0, def->tint()->size())));
+    p.set_base_tint(
         mathfu::vec4(tint.x() * base_tint.x(), tint.y() * base_tint.y(),
                      tint.z() * base_tint.z(), tint.w() * base_tint.w()));
-    p->set_duration(static_cast<float>(mathfu::RandomInRange<int32_t>(
+    p.set_duration(static_cast<float>(random_.InRange<int32_t>(
         def->min_duration(), def->max_duration())));
-    p->set_base_position(position + vec3::RandomInRange(min_position_offset,
-                                                        max_position_offset));
-    p->set_base_orientation(
+    p.set_base_position(position + random_.InRange(min_position_offset,
+                                                   max_position_offset));
+    p.set_base_orientation(
         additional_rotation +
-        vec3::RandomInRange(min_orientation_offset, max_orientation_offset));
-    p->set_rotational_velocity(
-        vec3::RandomInRange(min_angular_velocity, max_angular_velocity));
-    p->set_duration_of_shrink_out(
+        random_.InRange(min_orientation_offset, max_orientation_offset));
+    p.set_rotational_velocity(
+        random_.InRange(min_angular_velocity, max_angular_velocity));
+    p.set_duration_of_shrink_out(
         static_cast<TimeStep>(def->shrink_duration()));
-    p->set_duration_of_fade_out(static_cast<TimeStep>(def->fade_duration()));
+    p.set_duration_of_fade_out(static_cast<TimeStep>(def->fade_duration()));
   }
 }
 
 void GameState::AdvanceFrame(WorldTime delta_time,
                              pindrop::AudioEngine* audio_engine) {
+  FPL_PROFILE_SCOPE("GameState::AdvanceFrame");
+  ProfileScope phase("Logical inputs");
+
   // Increment the world time counter. This happens at the start of the
   // function so that functions that reference the current world time will
   // include the delta_time. For example, GetAnimationTime needs to compare
@@ -983,9 +1024,11 @@ void GameState::AdvanceFrame(WorldTime delta_time,
   }
 
   // Update all the particles.
+  phase.Next("ParticleManager::AdvanceFrame");
   particle_manager_.AdvanceFrame(static_cast<TimeStep>(delta_time));
 
   // Update pies. Modify state machine input when character hit by pie.
+  phase.Next("Pies");
   for (auto it = pies_.begin(); it != pies_.end();) {
     auto& pie = *it;
 
@@ -1007,6 +1050,7 @@ void GameState::AdvanceFrame(WorldTime delta_time,
   }
 
   // Update the character state machines and the facing angles.
+  phase.Next("State machines");
   for (unsigned int i = 0; i < characters_.size(); ++i) {
     auto& character = characters_[i];
 
@@ -1032,6 +1076,7 @@ void GameState::AdvanceFrame(WorldTime delta_time,
   }
 
   // Look to timeline to see what's happening. Make it happen.
+  phase.Next("Events");
   for (unsigned int i = 0; i < characters_.size(); ++i) {
     ProcessEvents(audio_engine, characters_[i].get(), &event_data[i],
                   delta_time);
@@ -1043,18 +1088,22 @@ void GameState::AdvanceFrame(WorldTime delta_time,
   }
 
   // Play the sounds that need to be played at this point in time.
+  phase.Next("Sounds");
   for (unsigned int i = 0; i < characters_.size(); ++i) {
     ProcessSounds(audio_engine, *characters_[i].get(), delta_time);
   }
 
   // Update entities.
+  phase.Next("EntityManager::UpdateComponents");
   entity_manager_.UpdateComponents(delta_time);
 
   // Update all Motivators. Motivator updates are done in bulk for scalability.
   // Must come after entity_manager_'s update because matrix Motivators are
   // modified by Components.
+  phase.Next("MotiveEngine::AdvanceFrame");
   engine_.AdvanceFrame(delta_time);
 
+  phase.Next("Camera");
   camera_.AdvanceFrame(delta_time);
 }
 
@@ -1101,15 +1150,23 @@ class CharacterDepthComparer {
 
 // Add anything in the list of particles into the scene description:
 void GameState::AddParticlesToScene(SceneDescription* scene) const {
-  auto plist = particle_manager_.get_particle_list();
-  for (auto it = plist.begin(); it != plist.end(); ++it) {
-    scene->renderables().push_back(std::unique_ptr<Renderable>(
-        new Renderable((*it)->renderable_id(), (*it)->CalculateMatrix(),
-                       (*it)->CurrentTint())));
+  const size_t num_particles = particle_manager_.num_particles();
+  if (num_particles == 0) return;
+  if (particle_matrices_.size() < num_particles) {
+    particle_matrices_.resize(num_particles);
+    particle_tints_.resize(num_particles);
+  }
+  particle_manager_.CalculateRenderData(&particle_matrices_[0],
+                                        &particle_tints_[0]);
+  const uint16_t* renderable_ids = particle_manager_.renderable_ids();
+  for (size_t i = 0; i < num_particles; ++i) {
+    scene->renderables().push_back(Renderable(
+        renderable_ids[i], particle_matrices_[i], particle_tints_[i]));
   }
 }
 
 void GameState::PopulateScene(SceneDescription* scene) {
+  FPL_PROFILE_SCOPE("GameState::PopulateScene");
   scene->Clear();
   // Camera.
   scene->set_camera(CameraMatrix());
@@ -1122,17 +1179,17 @@ void GameState::PopulateScene(SceneDescription* scene) {
   const auto lights = config_->light_positions();
   for (auto it = lights->begin(); it != lights->end(); ++it) {
     const vec3 light_position = LoadVec3(*it);
-    scene->lights().push_back(std::unique_ptr<vec3>(new vec3(light_position)));
+    scene->lights().push_back(light_position);
   }
 
   // Pies.
   if (config_->draw_pies()) {
     for (auto it = pies_.begin(); it != pies_.end(); ++it) {
       auto& pie = *it;
-      scene->renderables().push_back(std::unique_ptr<Renderable>(new Renderable(
+      scene->renderables().push_back(Renderable(
           EnumerationValueForPieDamage<uint16_t>(
               pie->damage(), *(config_->renderable_id_for_pie_damage())),
-          pie->Matrix())));
+          pie->Matrix()));
     }
   }
 
@@ -1144,30 +1201,30 @@ void GameState::PopulateScene(SceneDescription* scene) {
     for (int i = 0; i < 8; ++i) {
       const mat4 axis_dot =
           mat4::FromTranslationVector(vec3(static_cast<float>(i), 0.0f, 0.0f));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, axis_dot)));
+      scene->renderables().push_back(
+          Renderable(RenderableId_PieSmall, axis_dot));
     }
     for (int i = 0; i < 4; ++i) {
       const mat4 axis_dot =
           mat4::FromTranslationVector(vec3(0.0f, 0.0f, static_cast<float>(i)));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, axis_dot)));
+      scene->renderables().push_back(
+          Renderable(RenderableId_PieSmall, axis_dot));
     }
     for (int i = 0; i < 2; ++i) {
       const mat4 axis_dot =
           mat4::FromTranslationVector(vec3(0.0f, static_cast<float>(i), 0.0f));
-      scene->renderables().push_back(std::unique_ptr<Renderable>(
-          new Renderable(RenderableId_PieSmall, axis_dot)));
+      scene->renderables().push_back(
+          Renderable(RenderableId_PieSmall, axis_dot));
     }
   }
 
   // Draw one renderable right in the middle of the world, for debugging.
   // Rotate about z-axis so that it faces the camera.
   if (config_->draw_fixed_renderable() != RenderableId_Invalid) {
-    scene->renderables().push_back(std::unique_ptr<Renderable>(new Renderable(
+    scene->renderables().push_back(Renderable(
         static_cast<uint16_t>(config_->draw_fixed_renderable()),
         mat4::FromRotationMatrix(
-            Quat::FromAngleAxis(kPi, mathfu::kAxisY3f).ToMatrix()))));
+            Quat::FromAngleAxis(kPi, mathfu::kAxisY3f).ToMatrix())));
   }
 }
 
@@ -30,6 +30,8 @@
 #include "motive/processor.h"
 #include "motive/util.h"
 #include "particles.h"
+#include "random_generator.h"
+#include "thread_pool.h"
 
 namespace pindrop {
 class AudioEngine;
@@ -52,6 +54,7 @@ class PieNoonEntityFactory : public entity::EntityFactoryInterface {
  public:
   virtual entity::EntityRef CreateEntityFromData(
       const void* data, entity::EntityManager* entity_manager);
+  virtual void ParseEntityData(const void* data, entity::EntityPrefab* prefab);
 };
 
 class GameState {
@@ -70,8 +73,14 @@ class GameState {
   void Reset();
 
   // Update controller and state machine for each character.
+  // audio_engine may be null, to run without sound.
   void AdvanceFrame(WorldTime delta_time, pindrop::AudioEngine* audio_engine);
 
+  // Sets how many extra threads entities are updated on.  0 means one per
+  // core beyond the first, and -1 means updating them all on the thread
+  // calling AdvanceFrame, which is the default.
+  void SetUpdateThreads(int num_threads);
+
   // To be run before starting a game and after ending one to log data about
   // gameplay.
   void PreGameLogging() const;
@@ -132,6 +141,15 @@ class GameState {
   motive::MotiveEngine& engine() { return engine_; }
   ParticleManager& particle_manager() { return particle_manager_; }
 
+  // Every random choice in the game, including the AI's, comes from here.
+  // Seeded with 1 unless reseeded, so unrelated GameStates, such as ones on
+  // different threads, don't share any random state.
+  RandomGenerator& random() { return random_; }
+
+  // The pool entities are updated on. Other work on the thread calling
+  // AdvanceFrame, such as laying out text, may use it between updates.
+  ThreadPool& update_thread_pool() { return update_thread_pool_; }
+
   // Sets up the players in joining mode, where all they can do is jump up
   // and down.
   void EnterJoiningMode();
@@ -162,7 +180,7 @@ class GameState {
                  CharacterHealth damage);
   float CalculatePieYRotation(CharacterId source_id,
                               CharacterId target_id) const;
-  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie) const;
+  CharacterId DetermineDeflectionTarget(const ReceivedPie& pie);
   void ProcessEvent(pindrop::AudioEngine* audio_engine, Character* character,
                     unsigned int event, const EventData& event_data);
   void PopulateConditionInputs(ConditionInputs* condition_inputs,
@@ -192,7 +210,7 @@ class GameState {
                       const int particle_count,
                       const mathfu::vec4& base_tint = mathfu::vec4(1, 1, 1, 1));
   void ShakeProps(float percent, const mathfu::vec3& damage_position);
-  void AddSplatterToProp(entity::EntityRef prop);
+  void AddSplattersToProps(const std::vector<entity::EntityRef>& props);
 
   WorldTime time_;
   // countdown_time_ is in seconds and is derived from the length of the game
@@ -207,12 +225,26 @@ class GameState {
   const Config* config_;
   const CharacterArrangement* arrangement_;
   ParticleManager particle_manager_;
+  RandomGenerator random_;
+  // Scratch space for evaluating particles in bulk in AddParticlesToScene.
+  // Kept between frames so the buffers only grow when the particle count
+  // reaches a new high.
+  mutable std::vector<mathfu::mat4> particle_matrices_;
+  mutable std::vector<mathfu::vec4> particle_tints_;
   AnalyticsMode analytics_mode_;
 
+  // Threads that entity_manager_ updates components on. Declared before
+  // entity_manager_ so that it outlives it.
+  ThreadPool update_thread_pool_;
   // Entity manager that tracks all of our entities.
   entity::EntityManager entity_manager_;
   // Entity factory for creating entities from flatbuffers:
   PieNoonEntityFactory pie_noon_entity_factory_;
+  // config_->splatter_def(), parsed once per Reset().
+  entity::EntityPrefab splatter_prefab_;
+  // Scratch space for ShakeProps.
+  std::vector<entity::EntityRef> splatter_props_;
+  std::vector<entity::EntityRef> splatters_;
 
   // Component for handling movable objects in the scene.
   SceneObjectComponent sceneobject_component_;
@@ -15,9 +15,11 @@
 #ifndef GLYPH_CACH_H
 #define GLYPH_CACH_H
 
-#include <map>
-#include <unordered_map>
+#include <algorithm>
 #include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "SDL_log.h"
 #include "common.h"
@@ -25,30 +27,32 @@
 
 namespace fpl {
 
-// The glyph cache maintains a list of GlyphCacheRow. Each row has a fixed sizes
-// of height, which is determined at a row creation time. A row can include
-// multiple GlyphCacheEntry with a same or smaller height and they can have
-// variable width. In a row,
-// GlyphCacheEntry are stored from left to right in the order of registration
-// and won't be evicted per entry, but entire row is flushed when necessary to
-// make a room for new GlyphCacheEntry.
-// The purpose of this design is to cache as many glyphs and to achieve high
-// caching perfomance estimating same size of glphys tends to be stored in a
-// cache at same time. (e.g. Caching a string in a same size.)
+// The glyph cache packs glyph images into texture atlas pages with a shelf
+// packer. Each page is split into horizontal rows (shelves), top to bottom.
+// A row holds glyphs of its own height or a little less, side by side, and
+// keeps a list of the free spans between them. A row with no glyphs is free
+// space: the first glyph put in it cuts the row down to the glyph's height,
+// and leaves the rest as a new empty row. Empty rows that touch are merged
+// again.
+//
+// Glyphs are evicted one at a time, least recently used first, and never
+// while they're in use in the current rendering cycle. Evicting a glyph gives
+// its span back to its row, and the row back to the free space once it's
+// empty. When evicting everything that can go still leaves no room, the
+// cache adds another page, which is another texture of the same size, up to
+// a limit. Failing that, it defragments a page: if the glyphs of a page and
+// the new one all fit when repacked tallest first, it moves the glyphs and
+// their images to match. Otherwise nothing moves, and Set() fails. While
+// there is more than one page, the cache periodically evicts idle glyphs and
+// moves the glyphs of the last page to the others, evicting those that
+// don't fit, so that the page can be released.
 //
 // When looking up a cached entry, the API looks up unordered_map which is O(1)
 // operation.
 // If there is no cached entry for given code point, the caller needs to invoke
 // Set() API to fill in a cache.
-// Set() operation takes
-// O(log N (N=# of rows)) when there is a room in the cache for the request,
-// + O(N (N=# of rows)) to look up and evict least recently used row with
-// sufficient height.
-
-// Enable tracking stats in Debug build.
-#ifdef _DEBUG
-#define GLYPH_CACHE_STATS (1)
-#endif
+// Set() operation takes O(N (N=# of rows)) to find the best fitting row, plus
+// the evictions needed, which happen at most once per cached glyph.
 
 // Forward decl.
 template <typename T>
@@ -63,6 +67,54 @@ const int32_t kGlyphCacheHeightRound = 4;
 const int32_t kGlyphCachePaddingX = 1;
 const int32_t kGlyphCachePaddingY = 1;
 
+// A row that has glyphs already is used for a shorter glyph only if the glyph
+// is at least this fraction of the row height, given as a divisor: at most
+// 1/kGlyphCacheRowWasteDivisor of the row height goes unused. Otherwise the
+// glyph starts a new row, if there is free space for one.
+const int32_t kGlyphCacheRowWasteDivisor = 4;
+
+// Most dirty rectangles kept per page. Beyond that, the two whose bounding
+// box covers the least extra area are merged.
+const int32_t kGlyphCacheMaxDirtyRects = 16;
+
+// Glyphs not used for this many rendering cycles are idle. Every this many
+// cycles, a cache with more than one page evicts idle glyphs, and releases
+// its last page, moving the glyphs left on it to the other pages where they
+// fit and evicting the rest.
+const uint32_t kGlyphCacheIdleCycles = 600;
+
+// Usage statistics of a GlyphCache. Counted since the cache was created, or
+// since the last ResetStats().
+struct GlyphCacheStats {
+  GlyphCacheStats()
+      : lookups(0),
+        hits(0),
+        sets(0),
+        evictions(0),
+        defragmentations(0),
+        flushes(0),
+        set_failures(0),
+        pages_added(0),
+        pages_released(0) {}
+
+  // Find() calls, and those that found the glyph in the cache.
+  int32_t lookups;
+  int32_t hits;
+  // Glyphs added to the cache.
+  int32_t sets;
+  // Glyphs evicted one at a time to make room for others.
+  int32_t evictions;
+  // Times the glyphs were repacked to make room.
+  int32_t defragmentations;
+  // Flush() calls, each evicting every glyph.
+  int32_t flushes;
+  // Set() calls that found no room even after evicting and defragmenting.
+  int32_t set_failures;
+  // Pages allocated, including the first one, and pages released.
+  int32_t pages_added;
+  int32_t pages_released;
+};
+
 // Cache entry for a glyph.
 class GlyphCacheEntry {
  public:
@@ -71,7 +123,15 @@ class GlyphCacheEntry {
       uint64_t, std::unique_ptr<GlyphCacheEntry>>::iterator iterator;
   typedef std::list<GlyphCacheRow>::iterator iterator_row;
 
-  GlyphCacheEntry() : code_point_(0), size_(0, 0), offset_(0, 0) {}
+  GlyphCacheEntry()
+      : code_point_(0),
+        size_(0, 0),
+        offset_(0, 0),
+        key_(0),
+        page_(0),
+        pos_(0, 0),
+        reserved_size_(0, 0),
+        last_used_counter_(0) {}
 
   // Setter/Getter of code point.
   // Code point is an entry in a font file, not a direct transform of Unicode.
@@ -90,6 +150,10 @@ class GlyphCacheEntry {
   mathfu::vec4 get_uv() const { return uv_; }
   void set_uv(const mathfu::vec4& uv) { uv_ = uv; }
 
+  // Getter of the id of the page the glyph image is on. UV is relative to
+  // that page's texture.
+  int32_t get_page() const { return page_; }
+
  private:
   // Friend class, GlyphCache needs an access to internal variables of the
   // class.
@@ -108,11 +172,27 @@ class GlyphCacheEntry {
   // Glyph image's UV in the texture atlas.
   mathfu::vec4 uv_;
 
+  // Key of the entry in the look-up map.
+  uint64_t key_;
+
+  // Page the glyph image is on.
+  int32_t page_;
+
+  // Top left corner of the glyph image in the buffer.
+  mathfu::vec2i pos_;
+
+  // Area reserved in the row, which is the glyph size plus padding.
+  mathfu::vec2i reserved_size_;
+
+  // Last rendering cycle the glyph was used in. Glyphs used in the current
+  // cycle can't be evicted.
+  uint32_t last_used_counter_;
+
   // Iterator to the row entry.
-  GlyphCacheEntry::iterator_row it_row;
+  iterator_row it_row_;
 
-  // Iterator to the row LRU entry.
-  std::list<GlyphCacheEntry::iterator_row>::iterator it_lru_row_;
+  // Iterator to the glyph LRU entry.
+  std::list<GlyphCacheEntry*>::iterator it_lru_;
 };
 
 // Single row in a cache. A row correspond to a horizontal slice of a texture.
@@ -120,8 +200,8 @@ class GlyphCacheEntry {
 // 16, the row corresponds to 256x16 pixels of the overall texture.)
 //
 // One cache row contains multiple GlyphCacheEntry with a same or smaller
-// height. GlyphCacheEntry entries are stored from left to right and not evicted
-// per glyph, but entire row at once for a performance reason.
+// height. The row tracks the free spans between them, so that the space of an
+// evicted glyph can be reused by another one.
 // GlyphCacheRow is an internal class for GlyphCache.
 class GlyphCacheRow {
  public:
@@ -135,36 +215,72 @@ class GlyphCacheRow {
   }
   ~GlyphCacheRow() {}
 
-  // Initialize the row width and height.
+  // Initialize the row width and height. The whole row is free.
   void Initialize(const int32_t y_pos, const mathfu::vec2i& size) {
-    last_used_counter_ = 0;
     y_pos_ = y_pos;
-    remaining_width_ = size.x();
     size_ = size;
-    cached_entries_.clear();
+    num_glyphs_ = 0;
+    free_spans_.clear();
+    free_spans_.push_back(mathfu::vec2i(0, size.x()));
+    widest_free_span_ = size.x();
   }
 
   // Check if the row has a room for a requested width and height.
   bool DoesFit(const mathfu::vec2i& size) const {
-    return !(size.x() > remaining_width_ || size.y() > size_.y());
+    return !(size.x() > widest_free_span_ || size.y() > size_.y());
   }
 
-  // Reserve an area in the row.
-  int32_t Reserve(const GlyphCacheEntry::iterator it,
-                  const mathfu::vec2i& size) {
+  // Reserve an area in the row, at the left of the first free span wide
+  // enough.
+  // Returns the horizontal position of the area.
+  int32_t Reserve(const mathfu::vec2i& size) {
     assert(DoesFit(size));
-
-    // Update row info.
-    int32_t pos = size_.x() - remaining_width_;
-    remaining_width_ -= size.x();
-    cached_entries_.push_back(it);
+    auto span = free_spans_.begin();
+    while (span->y() - span->x() < size.x()) ++span;
+
+    int32_t pos = span->x();
+    const bool was_widest = span->y() - span->x() == widest_free_span_;
+    span->x() += size.x();
+    if (span->x() == span->y()) free_spans_.erase(span);
+    num_glyphs_++;
+
+    if (was_widest) {
+      widest_free_span_ = 0;
+      for (auto& free_span : free_spans_) {
+        widest_free_span_ =
+            std::max(widest_free_span_, free_span.y() - free_span.x());
+      }
+    }
     return pos;
   }
 
-  // Setter/Getter of last used counter.
-  uint32_t get_last_used_counter() const { return last_used_counter_; }
-  void set_last_used_counter(const uint32_t counter) {
-    last_used_counter_ = counter;
+  // Give an area reserved with Reserve() back to the row, merging it with
+  // the free spans next to it.
+  void Release(const int32_t pos, const int32_t width) {
+    assert(num_glyphs_ > 0);
+    num_glyphs_--;
+    const int32_t end = pos + width;
+    auto next = std::lower_bound(
+        free_spans_.begin(), free_spans_.end(), pos,
+        [](const mathfu::vec2i& span, int32_t x) { return span.x() < x; });
+    const bool merge_prev =
+        next != free_spans_.begin() && std::prev(next)->y() == pos;
+    const bool merge_next = next != free_spans_.end() && next->x() == end;
+    mathfu::vec2i merged;
+    if (merge_prev && merge_next) {
+      std::prev(next)->y() = next->y();
+      merged = *std::prev(next);
+      free_spans_.erase(next);
+    } else if (merge_prev) {
+      std::prev(next)->y() = end;
+      merged = *std::prev(next);
+    } else if (merge_next) {
+      next->x() = pos;
+      merged = *next;
+    } else {
+      merged = *free_spans_.insert(next, mathfu::vec2i(pos, end));
+    }
+    widest_free_span_ = std::max(widest_free_span_, merged.y() - merged.x());
   }
 
   // Setter/Getter of row size.
@@ -176,86 +292,51 @@ class GlyphCacheRow {
   void set_y_pos(const int32_t y_pos) { y_pos_ = y_pos; }
 
   // Getter of cached glyphs.
-  int32_t get_num_glyphs() const { return cached_entries_.size(); }
-
-  // Setter/Getter of iterator to row LRU.
-  const std::list<GlyphCacheEntry::iterator_row>::iterator get_it_lru_row()
-      const {
-    return it_lru_row_;
-  }
-  void set_it_lru_row(
-      const std::list<GlyphCacheEntry::iterator_row>::iterator it_lru_row) {
-    it_lru_row_ = it_lru_row;
-  }
+  int32_t get_num_glyphs() const { return num_glyphs_; }
 
-  // Setter/Getter of iterator to row height map.
-  std::multimap<int32_t, GlyphCacheEntry::iterator_row>::iterator
-  get_it_row_height_map() const {
-    return it_row_height_map_;
-  }
-  void set_it_row_height_map(const std::multimap<
-      int32_t, GlyphCacheEntry::iterator_row>::iterator it_row_height_map) {
-    it_row_height_map_ = it_row_height_map;
-  }
-
-  // Getter of cached glyph entries.
-  std::vector<GlyphCacheEntry::iterator>& get_cached_entries() {
-    return cached_entries_;
+  // Getter of the free width of the row, over all of its free spans.
+  int32_t get_free_width() const {
+    int32_t width = 0;
+    for (auto span : free_spans_) width += span.y() - span.x();
+    return width;
   }
 
  private:
-  // Last used counter value of the entry. The value is used to determine
-  // if the entry can be evicted from the cache.
-  uint32_t last_used_counter_;
-
-  // Remaining width of the row.
-  // As new contents are added to the row, remaining width decreases.
-  int32_t remaining_width_;
+  // Number of glyphs in the row.
+  int32_t num_glyphs_;
 
   // Size of the row.
   mathfu::vec2i size_;
 
   // Vertical position of the row in the entire cache buffer.
-  uint32_t y_pos_;
-
-  // Iterator to the row LRU list.
-  std::list<GlyphCacheEntry::iterator_row>::iterator it_lru_row_;
+  int32_t y_pos_;
 
-  // Iterator to the row height map.
-  std::multimap<int32_t, GlyphCacheEntry::iterator_row>::iterator
-      it_row_height_map_;
+  // Free horizontal spans of the row, as [x, y), sorted and never touching.
+  std::vector<mathfu::vec2i> free_spans_;
 
-  // Tracking cached entries in the row.
-  // When flushing the row, entries in the map is removed using the vector.
-  std::vector<GlyphCacheEntry::iterator> cached_entries_;
+  // Width of the widest free span, so that DoesFit() needn't look at them
+  // all.
+  int32_t widest_free_span_;
 };
 
 template <typename T>
 class GlyphCache {
  public:
   // Constructor with parameters.
-  // width: width of the glyph cache texture. Rounded up to power of 2.
-  // height: height of the glyph cache texture. Rounded up to power of 2.
-  GlyphCache(const mathfu::vec2i& size)
-      : counter_(0), revision_(0), dirty_(false) {
+  // size: size of each page of the glyph cache texture. Rounded up to power
+  // of 2.
+  // max_pages: number of pages the cache may grow to, when the glyphs used
+  // in one rendering cycle don't fit in fewer.
+  GlyphCache(const mathfu::vec2i& size, const int32_t max_pages = 1)
+      : counter_(0), max_pages_(max_pages), revision_(0) {
+    assert(max_pages >= 1);
+
     // Round up cache sizes to power of 2.
     size_.x() = mathfu::RoundUpToPowerOf2(size.x());
     size_.y() = mathfu::RoundUpToPowerOf2(size.y());
 
-    // Allocate the glyph cache buffer.
-    // A buffer format can be 8/32 bpp (32 bpp is mostly used for Emoji).
-    buffer_.reset(new T[size_.x() * size_.y()]);
-
-    // Clearing allocated buffer.
-    const int32_t kCacheClearValue = 0x0;
-    memset(buffer_.get(), kCacheClearValue, size_.x() * size_.y() * sizeof(T));
-
-    // Create first (empty) row entry.
-    InsertNewRow(0, size_, list_row_.end());
-
-#ifdef GLYPH_CACHE_STATS
-    ResetStats();
-#endif
+    // Create first page, which is never released.
+    AddPage();
   }
   ~GlyphCache(){};
 
@@ -263,26 +344,16 @@ class GlyphCache {
   // Return value: A pointer to a cached glyph entry.
   // nullptr if not found.
   const GlyphCacheEntry* Find(const uint32_t code_point, const int32_t y_size) {
-#ifdef GLYPH_CACHE_STATS
-    // Update debug variable.
-    stats_lookup_++;
-#endif
-    auto it =
-        map_entries_.find(static_cast<uint64_t>(code_point) << 32 | y_size);
+    stats_.lookups++;
+    auto it = map_entries_.find(Key(code_point, y_size));
     if (it != map_entries_.end()) {
       // Found an entry!
-
-      // Mark the row as being used in current cycle.
-      it->second->it_row->set_last_used_counter(counter_);
-
-      // Update row LRU entry. The row is now most recently used.
-      lru_row_.splice(lru_row_.end(), lru_row_, it->second->it_lru_row_);
-
-#ifdef GLYPH_CACHE_STATS
-      // Update debug variable.
-      stats_hit_++;
-#endif
-      return it->second.get();
+      // Mark it as being used in current cycle, and as most recently used.
+      GlyphCacheEntry* entry = it->second.get();
+      entry->last_used_counter_ = counter_;
+      lru_entries_.splice(lru_entries_.end(), lru_entries_, entry->it_lru_);
+      stats_.hits++;
+      return entry;
     }
 
     // Didn't find a cached entry. A caller may call Store() function to store
@@ -290,130 +361,51 @@ class GlyphCache {
     return nullptr;
   }
 
+  // Returns if a glyph is in the cache, without marking it as used or
+  // counting a lookup.
+  bool Contains(const uint32_t code_point, const int32_t y_size) const {
+    return map_entries_.find(Key(code_point, y_size)) != map_entries_.end();
+  }
+
   // Set an entry to the cache.
-  // Return value: true if caching succeeded. false if there is no room in the
-  // cache for a requested entry.
-  // Returns a pointer to inserted entry.
+  // To make room, evicts glyphs that weren't used in the current cycle, then
+  // adds a page if there are fewer than max_pages, then defragments a page
+  // if that makes room. Glyphs used in the current cycle are never evicted.
+  // Returns a pointer to inserted entry, or nullptr if there is no room in
+  // the cache for a requested entry.
   const GlyphCacheEntry* Set(const T* const image, const int32_t y_size,
                              const GlyphCacheEntry& entry) {
     // Lookup entries if the entry is already stored in the cache.
     auto p = Find(entry.get_code_point(), y_size);
-#ifdef GLYPH_CACHE_STATS
-    // Adjust debug variable.
-    stats_lookup_--;
-#endif
+    stats_.lookups--;
     if (p) {
       // Make sure cached entry has same properties.
       // The cache only support one entry per a glyph code point for now.
       assert(p->get_size().x() == entry.get_size().x());
       assert(p->get_size().y() == entry.get_size().y());
-#ifdef GLYPH_CACHE_STATS
-      // Adjust debug variable.
-      stats_hit_--;
-#endif
+      stats_.hits--;
       return p;
     }
 
-    // Adjust requested height & width.
-    // Height is rounded up to multiple of kGlyphCacheHeightRound.
-    // Expecting kGlyphCacheHeightRound is base 2.
-    int32_t req_width = entry.get_size().x() + kGlyphCachePaddingX;
-    int32_t req_height = ((entry.get_size().y() + kGlyphCachePaddingY +
-                           (kGlyphCacheHeightRound - 1)) &
-                          ~(kGlyphCacheHeightRound - 1));
-
-    // Look up the row map to retrieve a row iterator to start with.
-    auto it = map_row_.lower_bound(req_height);
-    while (it != map_row_.end()) {
-      if (it->second->DoesFit(mathfu::vec2i(req_width, req_height))) {
-        break;
-      }
-      it++;
-    }
-
-    GlyphCacheEntry* ret;
-    if (it != map_row_.end()) {
-      // Found sufficient space in the buffer.
-      auto it_row = it->second;
-
-      if (it_row->get_num_glyphs() == 0) {
-        // Putting first entry to the row.
-        // In this case, we create new empty row to track rest of free space.
-        auto original_height = it_row->get_size().y();
-        auto original_y_pos = it_row->get_y_pos();
-
-        if (original_height - req_height >= kGlyphCacheHeightRound) {
-          // Create new row for free space.
-          it_row->set_size(mathfu::vec2i(size_.x(), req_height));
-
-          // Update row height map key as well.
-          map_row_.erase(it_row->get_it_row_height_map());
-          auto it_map =
-              map_row_.insert(std::pair<int32_t, GlyphCacheEntry::iterator_row>(
-                  req_height, it_row));
-          it_row->set_it_row_height_map(it_map);
-
-          InsertNewRow(original_y_pos + req_height,
-                       mathfu::vec2i(size_.x(), original_height - req_height),
-                       list_row_.end());
-        }
-      }
-
-      // Create new entry in the look-up map.
-      auto pair = map_entries_.insert(
-          std::pair<uint64_t, std::unique_ptr<GlyphCacheEntry>>(
-              static_cast<uint64_t>(entry.get_code_point()) << 32 | y_size,
-              std::unique_ptr<GlyphCacheEntry>(new GlyphCacheEntry(entry))));
-      auto it_entry = pair.first;
-      ret = it_entry->second.get();
-
-      // Reserve a region in the row.
-      auto pos = mathfu::vec2i(
-          it_row->Reserve(it_entry, mathfu::vec2i(req_width, req_height)),
-          it_row->get_y_pos());
-
-      // Store given image into the buffer.
-      CopyImage(pos, image, it_entry->second.get());
-
-      // Update UV of the entry.
-      auto p = mathfu::vec4(
-          mathfu::vec2(pos) / mathfu::vec2(size_),
-          mathfu::vec2(pos + entry.get_size()) / mathfu::vec2(size_));
-      ret->set_uv(p);
-
-      // Establish links.
-      ret->it_row = it_row;
-      ret->it_lru_row_ = it_row->get_it_lru_row();
-
-      // Update row LRU entry.
-      lru_row_.splice(lru_row_.end(), lru_row_, it_row->get_it_lru_row());
-      it_row->set_last_used_counter(counter_);
-    } else {
-      // Couldn't find sufficient row entry nor free space to create new row.
-
-      // Try to find a row that is not used in current cycle and has enough
-      // height from LRU list.
-      for (auto row : lru_row_) {
-        if (row->get_last_used_counter() == counter_) {
-          // The row is being used in current rendering cycle.
-          // We can not evict the row.
-          continue;
-        }
-        if (row->get_size().y() >= req_height) {
-          // Now flush & initialize the row.
-          FlushRow(row);
-          row->Initialize(row->get_y_pos(), row->get_size());
-
-          // Call the function recursively.
-          return Set(image, y_size, entry);
+    const mathfu::vec2i req_size = ReservedSize(entry.get_size());
+    int32_t page = 0;
+    GlyphCacheEntry::iterator_row it_row;
+    const bool too_large = req_size.x() > size_.x() || req_size.y() > size_.y();
+    bool fits = !too_large &&
+                (AllocateAnyPage(req_size, get_num_pages(), &page, &it_row) ||
+                 EvictUntilFits(req_size, &page, &it_row) ||
+                 AllocateNewPage(req_size, &page, &it_row));
+    if (!fits && !too_large) {
+      for (page = 0; page < get_num_pages(); ++page) {
+        if (pages_[page] && Defragment(req_size, page, &it_row)) {
+          fits = true;
+          break;
         }
       }
-#ifdef GLYPH_CACHE_STATS
-      stats_set_fail_++;
-#endif
-      // TODO: Try to flush multiple rows and merge them to free up space.
-      // TODO: Evaluate re-allocate solution.
-      // Now we don't have any space in the cache.
+    }
+    if (!fits) {
+      stats_.set_failures++;
+      // Even the glyphs used in this cycle don't all fit.
       // It's caller's responsivility to recover from the situation.
       // Possible work arounds are:
       // - Draw glyphs with current glyph cache contents and then flush them,
@@ -422,160 +414,582 @@ class GlyphCache {
       return nullptr;
     }
 
+    // Create new entry in the look-up map.
+    const uint64_t key = Key(entry.get_code_point(), y_size);
+    auto pair = map_entries_.insert(
+        std::pair<uint64_t, std::unique_ptr<GlyphCacheEntry>>(
+            key, std::unique_ptr<GlyphCacheEntry>(new GlyphCacheEntry(entry))));
+    GlyphCacheEntry* ret = pair.first->second.get();
+    ret->key_ = key;
+    ret->reserved_size_ = req_size;
+    ret->last_used_counter_ = counter_;
+    ret->it_lru_ = lru_entries_.insert(lru_entries_.end(), ret);
+    Place(ret, page, it_row);
+
+    // Store given image into the buffer.
+    CopyImage(ret->pos_, image, ret->get_size().x(), ret);
+    stats_.sets++;
     return ret;
   }
 
-  // Flush all cache entries.
+  // Flush all cache entries. The pages stay allocated until they're idle.
   bool Flush() {
-#ifdef GLYPH_CACHE_STATS
-    ResetStats();
-#endif
     map_entries_.clear();
-    lru_row_.clear();
-    list_row_.clear();
-    map_row_.clear();
+    lru_entries_.clear();
+    for (auto& page : pages_) {
+      if (!page) continue;
+      page->rows.clear();
+      page->rows.push_back(GlyphCacheRow(0, size_));
+      page->dirty_rects.clear();
+    }
 
     // Update cache revision.
     revision_ = counter_;
-
-    // Create first (empty) row entry.
-    InsertNewRow(0, size_, list_row_.end());
-
-    dirty_ = false;
+    stats_.flushes++;
 
     return true;
   }
 
-  // Increment a cycle counter of the cache.
+  // Increment a cycle counter of the cache, and every kGlyphCacheIdleCycles
+  // try to release a page.
   // Invoke this API for each rendering cycle.
   // The counter is used to determine which cache entries can be evicted when
   // cache entries are full.
-  void Update() { counter_++; }
+  void Update() {
+    counter_++;
+    if (counter_ % kGlyphCacheIdleCycles == 0 && get_num_live_pages() > 1) {
+      ShrinkPages();
+    }
+  }
+
+  // Fraction of the area of rows with glyphs in them that the glyphs don't
+  // use, in [0, 1]. The higher this is, the less fits before glyphs need to
+  // be evicted.
+  float GetFragmentation() const {
+    int32_t row_area = 0;
+    int32_t free_area = 0;
+    for (auto& page : pages_) {
+      if (!page) continue;
+      for (auto& row : page->rows) {
+        if (row.get_num_glyphs() == 0) continue;
+        row_area += row.get_size().x() * row.get_size().y();
+        free_area += row.get_free_width() * row.get_size().y();
+      }
+    }
+    for (auto& it : map_entries_) {
+      const GlyphCacheEntry* entry = it.second.get();
+      free_area += entry->reserved_size_.x() * entry->reserved_size_.y() -
+                   entry->get_size().x() * entry->get_size().y();
+    }
+    return row_area ? static_cast<float>(free_area) / row_area : 0.0f;
+  }
 
   // Debug API to show cache statistics.
   void Status() {
-#ifdef GLYPH_CACHE_STATS
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Cache size: %dx%d", size_.x(),
-                size_.y());
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Cache hit: %d / %d", stats_hit_,
-                stats_lookup_);
-
-    auto total_glyph = 0;
-    for (auto row : list_row_) {
-      SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
-                  "Row start:%d height:%d glyphs:%d counter:%d",
-                  row.get_y_pos(), row.get_size().y(), row.get_num_glyphs(),
-                  row.get_last_used_counter());
-      total_glyph += row.get_num_glyphs();
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Cache size: %dx%d, %d/%d pages",
+                size_.x(), size_.y(), get_num_live_pages(), max_pages_);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Cache hit: %d / %d",
+                stats_.hits, stats_.lookups);
+
+    for (size_t i = 0; i < pages_.size(); ++i) {
+      if (!pages_[i]) continue;
+      for (auto& row : pages_[i]->rows) {
+        SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                    "Page %d row start:%d height:%d glyphs:%d free:%d",
+                    static_cast<int32_t>(i), row.get_y_pos(),
+                    row.get_size().y(), row.get_num_glyphs(),
+                    row.get_free_width());
+      }
     }
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Cached glyphs: %d", total_glyph);
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Row flush: %d",
-                stats_row_flush_);
-    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Set fail: %d", stats_set_fail_);
-#endif
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Cached glyphs: %d",
+                static_cast<int32_t>(map_entries_.size()));
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Fragmentation: %.1f%%",
+                GetFragmentation() * 100.0f);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "Set: %d evict: %d defragment: %d flush: %d fail: %d",
+                stats_.sets, stats_.evictions, stats_.defragmentations,
+                stats_.flushes, stats_.set_failures);
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "Pages added: %d released: %d",
+                stats_.pages_added, stats_.pages_released);
+  }
+
+  // Getter of the usage statistics.
+  const GlyphCacheStats& get_stats() const { return stats_; }
+  void ResetStats() { stats_ = GlyphCacheStats(); }
+
+  // Getter of the number of cached glyphs.
+  int32_t get_num_glyphs() const {
+    return static_cast<int32_t>(map_entries_.size());
   }
 
   // Getter/Setter of the counter.
   uint32_t get_revision() const { return revision_; }
   void set_revision(const uint32_t revision) { revision_ = revision; }
 
-  // Getter/Setter of dirty state.
-  bool get_dirty_state() const { return dirty_; };
-  void set_dirty_state(const bool dirty) { dirty_ = dirty; }
+  // Getter of the number of page ids in use. Pages that have been released
+  // leave a gap, which has_page() tells apart.
+  int32_t get_num_pages() const { return static_cast<int32_t>(pages_.size()); }
 
-  // Getter of dirty rect.
-  const mathfu::vec4i& get_dirty_rect() const { return dirty_rect_; }
+  // Returns if the page with the given id is allocated.
+  bool has_page(const int32_t page) const {
+    return page < get_num_pages() && pages_[page] != nullptr;
+  }
 
-  // Getter of allocated glyph cache buffer.
-  const T* get_buffer() const { return buffer_.get(); }
+  // Getter of the number of pages allocated.
+  int32_t get_num_live_pages() const {
+    int32_t count = 0;
+    for (auto& page : pages_) count += page != nullptr;
+    return count;
+  }
 
-  // Getter of the cache size.
+  // Getter/Setter of dirty state of a page. Setting a page dirty marks all
+  // of it as dirty, and setting it clean forgets its dirty rects.
+  bool get_dirty_state(const int32_t page) const {
+    return !pages_[page]->dirty_rects.empty();
+  };
+  void set_dirty_state(const int32_t page, const bool dirty) {
+    pages_[page]->dirty_rects.clear();
+    if (dirty) {
+      pages_[page]->dirty_rects.push_back(
+          mathfu::vec4i(mathfu::kZeros2i, size_));
+    }
+  }
+
+  // Getter of dirty rects of a page, as (left, top, right, bottom). They
+  // don't overlap.
+  const std::vector<mathfu::vec4i>& get_dirty_rects(const int32_t page) const {
+    return pages_[page]->dirty_rects;
+  }
+
+  // Getter of allocated glyph cache buffer of a page.
+  const T* get_buffer(const int32_t page) const {
+    return pages_[page]->buffer.get();
+  }
+
+  // Getter of the cache page size.
   const mathfu::vec2i& get_size() const { return size_; }
 
  private:
-  // Insert new row to the row list with a given size.
-  // It tries to merge 2 rows if next row is also empty one.
-  void InsertNewRow(const int32_t y_pos, const mathfu::vec2i& size,
-                    const GlyphCacheEntry::iterator_row pos) {
-    // First, check if we can merge the requested row with next row to free up
-    // more spaces.
-    // New row is always inserted right after valid row entry. So we don't have
-    // to check previous row entry to merge.
-    if (pos != list_row_.end()) {
-      auto next_entry = std::next(pos);
-      if (next_entry->get_num_glyphs() == 0) {
-        // We can merge them.
-        mathfu::vec2i next_size = next_entry->get_size();
-        next_size.y() += size.y();
-        next_entry->set_y_pos(next_entry->get_y_pos() - size.y());
-        next_entry->set_size(next_size);
-        next_entry->set_last_used_counter(counter_);
-        return;
+  // A page of the cache, which corresponds to one atlas texture.
+  struct Page {
+    // Cache buffer;
+    std::unique_ptr<T[]> buffer;
+
+    // list of rows in the page, top to bottom.
+    std::list<GlyphCacheRow> rows;
+
+    // Dirty regions in the buffer, which corresponding font atlas texture
+    // needs to be uploaded. At most kGlyphCacheMaxDirtyRects, and disjoint.
+    std::vector<mathfu::vec4i> dirty_rects;
+  };
+
+  static uint64_t Key(const uint32_t code_point, const int32_t y_size) {
+    return static_cast<uint64_t>(code_point) << 32 | y_size;
+  }
+
+  // Size of the area a glyph takes in a row, with padding.
+  // Height is rounded up to multiple of kGlyphCacheHeightRound.
+  // Expecting kGlyphCacheHeightRound is base 2.
+  static mathfu::vec2i ReservedSize(const mathfu::vec2i& glyph_size) {
+    return mathfu::vec2i(glyph_size.x() + kGlyphCachePaddingX,
+                         (glyph_size.y() + kGlyphCachePaddingY +
+                          (kGlyphCacheHeightRound - 1)) &
+                             ~(kGlyphCacheHeightRound - 1));
+  }
+
+  // Allocate a page, reusing the id of a released page if there is one.
+  // Returns the page id, or -1 if there are max_pages_ already.
+  int32_t AddPage() {
+    if (get_num_live_pages() >= max_pages_) return -1;
+    auto slot = std::find(pages_.begin(), pages_.end(), nullptr);
+    if (slot == pages_.end()) slot = pages_.insert(pages_.end(), nullptr);
+    slot->reset(new Page());
+    Page* page = slot->get();
+
+    // Allocate the glyph cache buffer.
+    // A buffer format can be 8/32 bpp (32 bpp is mostly used for Emoji).
+    const int32_t buffer_size = size_.x() * size_.y();
+    page->buffer.reset(new T[buffer_size]);
+
+    // Clearing allocated buffer.
+    const int32_t kCacheClearValue = 0x0;
+    memset(page->buffer.get(), kCacheClearValue, buffer_size * sizeof(T));
+
+    // Create first (empty) row entry.
+    page->rows.push_back(GlyphCacheRow(0, size_));
+    stats_.pages_added++;
+    return static_cast<int32_t>(slot - pages_.begin());
+  }
+
+  // Evict idle glyphs, then move the glyphs of the last page to the other
+  // pages, evicting those that don't fit, and release it.
+  void ShrinkPages() {
+    while (!lru_entries_.empty() &&
+           counter_ - lru_entries_.front()->last_used_counter_ >=
+               kGlyphCacheIdleCycles) {
+      Evict(lru_entries_.front());
+    }
+
+    int32_t last = get_num_pages() - 1;
+    while (!pages_[last]) last--;
+    if (last == 0) return;
+
+    std::vector<GlyphCacheEntry*> entries;
+    for (auto entry : lru_entries_) {
+      if (entry->page_ == last) entries.push_back(entry);
+    }
+    SortTallestFirst(&entries);
+    for (auto entry : entries) {
+      int32_t page;
+      GlyphCacheEntry::iterator_row it_row;
+      if (!AllocateAnyPage(entry->reserved_size_, last, &page, &it_row)) {
+        // None of the glyphs is in use yet this cycle, so one that doesn't
+        // fit can go, and be set again when it's next needed.
+        Evict(entry);
+        continue;
       }
+      const T* image = pages_[last]->buffer.get() + entry->pos_.x() +
+                       entry->pos_.y() * size_.x();
+      ReleaseSpace(entry);
+      Place(entry, page, it_row);
+      CopyImage(entry->pos_, image, size_.x(), entry);
     }
+    if (!entries.empty()) revision_ = counter_;
+    pages_[last].reset();
+    stats_.pages_released++;
+  }
 
-    // Insert new row.
-    auto it = list_row_.insert(pos, GlyphCacheRow(y_pos, size));
-    auto it_lru_row = lru_row_.insert(lru_row_.end(), it);
-    auto it_map = map_row_.insert(
-        std::pair<int32_t, GlyphCacheEntry::iterator_row>(size.y(), it));
+  static void SortTallestFirst(std::vector<GlyphCacheEntry*>* entries) {
+    std::sort(entries->begin(), entries->end(),
+              [](const GlyphCacheEntry* a, const GlyphCacheEntry* b) {
+                if (a->reserved_size_.y() != b->reserved_size_.y()) {
+                  return a->reserved_size_.y() > b->reserved_size_.y();
+                }
+                return a->reserved_size_.x() > b->reserved_size_.x();
+              });
+  }
 
-    // Update a link.
-    it->set_it_lru_row(it_lru_row);
-    it->set_it_row_height_map(it_map);
+  // Find the row to put a glyph of req_size in, on the given page. That's the
+  // shortest row with glyphs in it that has room, unless it would waste too
+  // much height and there is free space to start a new row, in which case
+  // it's the shortest empty row tall enough.
+  // Returns false if no row has room.
+  bool Allocate(const mathfu::vec2i& req_size, const int32_t page,
+                GlyphCacheEntry::iterator_row* it_row) {
+    return Allocate(req_size, &pages_[page]->rows, it_row);
   }
 
-  void FlushRow(const GlyphCacheEntry::iterator_row row) {
-    // Erase cached glyphs from look-up map.
-    for (auto entry : row->get_cached_entries()) {
-      map_entries_.erase(entry);
+  // As above, in a list of rows that needn't belong to a page yet.
+  bool Allocate(const mathfu::vec2i& req_size,
+                std::list<GlyphCacheRow>* page_rows,
+                GlyphCacheEntry::iterator_row* it_row) {
+    std::list<GlyphCacheRow>& rows = *page_rows;
+    auto best = rows.end();
+    auto best_empty = rows.end();
+    for (auto it = rows.begin(); it != rows.end(); ++it) {
+      const int32_t height = it->get_size().y();
+      if (height < req_size.y()) continue;
+      if (it->get_num_glyphs() == 0) {
+        if (best_empty == rows.end() || height < best_empty->get_size().y()) {
+          best_empty = it;
+        }
+      } else if ((best == rows.end() || height < best->get_size().y()) &&
+                 it->DoesFit(req_size)) {
+        best = it;
+      }
+    }
+
+    if (best != rows.end() &&
+        (best_empty == rows.end() ||
+         (best->get_size().y() - req_size.y()) * kGlyphCacheRowWasteDivisor <=
+             best->get_size().y())) {
+      *it_row = best;
+      return true;
+    }
+    if (best_empty == rows.end()) return false;
+
+    // Putting first entry to the row.
+    // In this case, we create new empty row to track rest of free space.
+    const int32_t original_height = best_empty->get_size().y();
+    if (original_height - req_size.y() >= kGlyphCacheHeightRound) {
+      best_empty->set_size(mathfu::vec2i(size_.x(), req_size.y()));
+      rows.insert(std::next(best_empty),
+                  GlyphCacheRow(best_empty->get_y_pos() + req_size.y(),
+                                mathfu::vec2i(size_.x(),
+                                              original_height - req_size.y())));
+    }
+    *it_row = best_empty;
+    return true;
+  }
+
+  // Allocate on the first page with room, among the first num_pages.
+  bool AllocateAnyPage(const mathfu::vec2i& req_size, const int32_t num_pages,
+                       int32_t* page, GlyphCacheEntry::iterator_row* it_row) {
+    for (int32_t i = 0; i < num_pages; ++i) {
+      if (pages_[i] && Allocate(req_size, i, it_row)) {
+        *page = i;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Allocate on a new page, if another page may be added.
+  bool AllocateNewPage(const mathfu::vec2i& req_size, int32_t* page,
+                       GlyphCacheEntry::iterator_row* it_row) {
+    *page = AddPage();
+    return *page >= 0 && Allocate(req_size, *page, it_row);
+  }
+
+  // Evict least recently used glyphs that weren't used in the current cycle,
+  // until a glyph of req_size fits.
+  // Glyphs in rows tall enough for the new glyph go first, since their space
+  // can be reused directly. Then the rest, as emptying rows frees up space
+  // for new rows.
+  // Returns false if the glyph still doesn't fit.
+  bool EvictUntilFits(const mathfu::vec2i& req_size, int32_t* page,
+                      GlyphCacheEntry::iterator_row* it_row) {
+    for (int pass = 0; pass < 2; ++pass) {
+      auto it = lru_entries_.begin();
+      while (it != lru_entries_.end()) {
+        GlyphCacheEntry* entry = *it;
+        // The rest were used in current rendering cycle too.
+        if (entry->last_used_counter_ == counter_) break;
+        ++it;
+        if (pass == 0 && entry->it_row_->get_size().y() < req_size.y()) {
+          continue;
+        }
+        // Evicting the last glyph of a row may merge the row away, so check
+        // the row itself only if it keeps some glyphs.
+        auto row = entry->it_row_;
+        const bool empties_row = row->get_num_glyphs() == 1;
+        *page = entry->page_;
+        Evict(entry);
+        if (empties_row) {
+          if (Allocate(req_size, *page, it_row)) return true;
+        } else if (row->DoesFit(req_size)) {
+          *it_row = row;
+          return true;
+        }
+      }
     }
+    return false;
+  }
+
+  // Give the space of a glyph back to its row.
+  void ReleaseSpace(GlyphCacheEntry* entry) {
+    auto row = entry->it_row_;
+    row->Release(entry->pos_.x(), entry->reserved_size_.x());
+    if (row->get_num_glyphs() == 0) ReleaseRow(entry->page_, row);
+  }
+
+  // Evict a glyph from the cache, giving its space back to its row.
+  void Evict(GlyphCacheEntry* entry) {
+    ReleaseSpace(entry);
+    lru_entries_.erase(entry->it_lru_);
+    map_entries_.erase(entry->key_);
 
     // Update cache revision.
     // It's setting revision equal to the current counter value so that it just
-    // change the revision once a rendering cycle even multiple cache flush
+    // change the revision once a rendering cycle even multiple cache eviction
     // happens in a cycle.
     revision_ = counter_;
+    stats_.evictions++;
+  }
 
-#ifdef GLYPH_CACHE_STATS
-    stats_row_flush_++;
-#endif
+  // Merge a row that has just become empty with the empty rows next to it.
+  // The row may be erased, with its space added to the row above it.
+  void ReleaseRow(const int32_t page, GlyphCacheEntry::iterator_row row) {
+    std::list<GlyphCacheRow>& rows = pages_[page]->rows;
+    row->Initialize(row->get_y_pos(), row->get_size());
+    auto next = std::next(row);
+    if (next != rows.end() && next->get_num_glyphs() == 0) {
+      row->Initialize(row->get_y_pos(),
+                      row->get_size() + mathfu::vec2i(0, next->get_size().y()));
+      rows.erase(next);
+    }
+    if (row != rows.begin()) {
+      auto prev = std::prev(row);
+      if (prev->get_num_glyphs() == 0) {
+        prev->Initialize(prev->get_y_pos(),
+                         prev->get_size() +
+                             mathfu::vec2i(0, row->get_size().y()));
+        rows.erase(row);
+      }
+    }
   }
 
-  // Copy glyph image into the buffer.
-  void CopyImage(const mathfu::vec2i& pos, const T* const image,
-                 const GlyphCacheEntry* entry) {
-    auto buffer = buffer_.get();
-    auto size = entry->get_size().x() * sizeof(T);
-    for (int32_t y = 0; y < entry->get_size().y(); ++y) {
-      memcpy(buffer + pos.x() + (pos.y() + y) * size_.x(),
-             image + y * entry->get_size().x(), size);
+  // Reserve an area for a glyph in the given row, and update its page,
+  // position and UV to match.
+  void Place(GlyphCacheEntry* entry, const int32_t page,
+             GlyphCacheEntry::iterator_row it_row) {
+    entry->page_ = page;
+    entry->it_row_ = it_row;
+    entry->pos_ = mathfu::vec2i(it_row->Reserve(entry->reserved_size_),
+                                it_row->get_y_pos());
+    entry->uv_ = mathfu::vec4(
+        mathfu::vec2(entry->pos_) / mathfu::vec2(size_),
+        mathfu::vec2(entry->pos_ + entry->get_size()) / mathfu::vec2(size_));
+  }
+
+  // Plan repacking the glyphs of a page and a new glyph of req_size, tallest
+  // first, into a fresh set of rows. If they all fit, move the glyphs and
+  // their images to match, and return the row for the new glyph in it_row.
+  // Otherwise leave the page as it is, and return false.
+  bool Defragment(const mathfu::vec2i& req_size, const int32_t page,
+                  GlyphCacheEntry::iterator_row* it_row) {
+    std::vector<GlyphCacheEntry*> entries;
+    for (auto entry : lru_entries_) {
+      if (entry->page_ == page) entries.push_back(entry);
+    }
+    SortTallestFirst(&entries);
+
+    // Plan on rows of our own, placing the new glyph, which has no entry yet,
+    // among the others. Swapping the rows into the page later keeps the
+    // iterators to them valid.
+    std::list<GlyphCacheRow> rows(1, GlyphCacheRow(0, size_));
+    std::vector<GlyphCacheEntry::iterator_row> planned_rows(entries.size());
+    std::vector<int32_t> planned_x(entries.size());
+    GlyphCacheEntry::iterator_row new_row;
+    int32_t new_x = -1;
+    for (size_t i = 0; i <= entries.size(); ++i) {
+      if (new_x < 0 && (i == entries.size() ||
+                        entries[i]->reserved_size_.y() < req_size.y() ||
+                        (entries[i]->reserved_size_.y() == req_size.y() &&
+                         entries[i]->reserved_size_.x() < req_size.x()))) {
+        if (!Allocate(req_size, &rows, &new_row)) return false;
+        new_x = new_row->Reserve(req_size);
+      }
+      if (i == entries.size()) break;
+      const mathfu::vec2i& size = entries[i]->reserved_size_;
+      if (!Allocate(size, &rows, &planned_rows[i])) return false;
+      planned_x[i] = planned_rows[i]->Reserve(size);
+    }
+
+    // Everything fits, so move the glyphs.
+    const int32_t buffer_size = size_.x() * size_.y();
+    std::unique_ptr<T[]> old_buffer(new T[buffer_size]);
+    T* buffer = pages_[page]->buffer.get();
+    memcpy(old_buffer.get(), buffer, buffer_size * sizeof(T));
+    memset(buffer, 0, buffer_size * sizeof(T));
+    pages_[page]->rows.swap(rows);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      GlyphCacheEntry* entry = entries[i];
+      const mathfu::vec2i old_pos = entry->pos_;
+      entry->it_row_ = planned_rows[i];
+      entry->pos_ = mathfu::vec2i(planned_x[i], planned_rows[i]->get_y_pos());
+      entry->uv_ = mathfu::vec4(
+          mathfu::vec2(entry->pos_) / mathfu::vec2(size_),
+          mathfu::vec2(entry->pos_ + entry->get_size()) / mathfu::vec2(size_));
+      CopyImage(entry->pos_,
+                old_buffer.get() + old_pos.x() + old_pos.y() * size_.x(),
+                size_.x(), entry);
     }
-    UpdateDirtyRect(mathfu::vec4i(pos, pos + entry->get_size()));
+    set_dirty_state(page, true);
+
+    // Hand the new glyph's space back for Place() to reserve it again.
+    new_row->Release(new_x, req_size.x());
+    *it_row = new_row;
+
+    // Every glyph of the page may have moved, including ones used in this
+    // cycle, whose users may already have seen the revision set by an
+    // eviction in this cycle. So start a new cycle for a new revision.
+    // Evicting came first, so every glyph left was used in the cycle.
+    counter_++;
+    for (auto entry : lru_entries_) entry->last_used_counter_ = counter_;
+    revision_ = counter_;
+    stats_.defragmentations++;
+    return true;
   }
 
-  // Update dirty rect.
-  void UpdateDirtyRect(const mathfu::vec4i& rect) {
-    if (!dirty_) {
-      // Initialize dirty rect.
-      dirty_rect_ = mathfu::vec4i(size_, mathfu::kZeros2i);
+  // Copy glyph image into the buffer of the entry's page, and clear the
+  // padding around it.
+  // pitch is the distance between rows of the image, in pixels.
+  void CopyImage(const mathfu::vec2i& pos, const T* const image,
+                 const int32_t pitch, const GlyphCacheEntry* entry) {
+    auto buffer = pages_[entry->page_]->buffer.get();
+    const mathfu::vec2i& size = entry->get_size();
+    const mathfu::vec2i& reserved_size = entry->reserved_size_;
+    for (int32_t y = 0; y < reserved_size.y(); ++y) {
+      T* dest = buffer + pos.x() + (pos.y() + y) * size_.x();
+      if (y < size.y()) {
+        memcpy(dest, image + y * pitch, size.x() * sizeof(T));
+        memset(dest + size.x(), 0,
+               (reserved_size.x() - size.x()) * sizeof(T));
+      } else {
+        memset(dest, 0, reserved_size.x() * sizeof(T));
+      }
     }
+    UpdateDirtyRect(entry->page_, mathfu::vec4i(pos, pos + reserved_size));
+  }
 
-    dirty_ = true;
-    dirty_rect_ =
-        mathfu::vec4i(mathfu::vec2i::Min(dirty_rect_.xy(), rect.xy()),
-                      mathfu::vec2i::Max(dirty_rect_.zw(), rect.zw()));
+  static int32_t RectArea(const mathfu::vec4i& rect) {
+    return (rect.z() - rect.x()) * (rect.w() - rect.y());
   }
 
-#ifdef GLYPH_CACHE_STATS
-  void ResetStats() {
-    // Initialize debug variables.
-    stats_hit_ = 0;
-    stats_lookup_ = 0;
-    stats_row_flush_ = 0;
-    stats_set_fail_ = 0;
+  static mathfu::vec4i RectUnion(const mathfu::vec4i& a,
+                                 const mathfu::vec4i& b) {
+    return mathfu::vec4i(mathfu::vec2i::Min(a.xy(), b.xy()),
+                         mathfu::vec2i::Max(a.zw(), b.zw()));
   }
-#endif
+
+  static bool RectsOverlap(const mathfu::vec4i& a, const mathfu::vec4i& b) {
+    return a.x() < b.z() && b.x() < a.z() && a.y() < b.w() && b.y() < a.w();
+  }
+
+  // Area the bounding box of two rects covers beyond the two rects.
+  static int32_t MergeGrowth(const mathfu::vec4i& a, const mathfu::vec4i& b) {
+    return RectArea(RectUnion(a, b)) - RectArea(a) - RectArea(b);
+  }
+
+  // Merge rects[index] with the rects it overlaps, or whose bounding box with
+  // it covers no more than the two do, such as a neighbour in the same row,
+  // until there are none.
+  static void MergeDirtyRect(std::vector<mathfu::vec4i>* rects, size_t index) {
+    for (size_t i = 0; i < rects->size();) {
+      mathfu::vec4i& merged = (*rects)[index];
+      if (i != index && (RectsOverlap((*rects)[i], merged) ||
+                         MergeGrowth((*rects)[i], merged) <= 0)) {
+        merged = RectUnion(merged, (*rects)[i]);
+        (*rects)[i] = rects->back();
+        rects->pop_back();
+        if (index == rects->size()) index = i;
+        i = 0;
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  // Add a rect to the dirty rects of a page, merging it with others where
+  // that costs nothing. While that leaves too many, the pair of rects whose
+  // bounding box covers the least extra area is merged. The rects stay
+  // disjoint.
+  void UpdateDirtyRect(const int32_t page, const mathfu::vec4i& rect) {
+    std::vector<mathfu::vec4i>& rects = pages_[page]->dirty_rects;
+    rects.push_back(rect);
+    MergeDirtyRect(&rects, rects.size() - 1);
+    while (static_cast<int32_t>(rects.size()) > kGlyphCacheMaxDirtyRects) {
+      size_t best_a = 0;
+      size_t best_b = 1;
+      int32_t best_growth = MergeGrowth(rects[0], rects[1]);
+      for (size_t a = 0; a < rects.size(); ++a) {
+        for (size_t b = a + 1; b < rects.size(); ++b) {
+          const int32_t growth = MergeGrowth(rects[a], rects[b]);
+          if (growth < best_growth) {
+            best_a = a;
+            best_b = b;
+            best_growth = growth;
+          }
+        }
+      }
+      rects[best_a] = RectUnion(rects[best_a], rects[best_b]);
+      rects[best_b] = rects.back();
+      rects.pop_back();
+      MergeDirtyRect(&rects, best_a == rects.size() ? best_b : best_a);
+    }
+  }
+
 
   // A time counter of the cache.
   // In each rendering cycle, the counter is incremented.
@@ -583,11 +997,14 @@ class GlyphCache {
   // cycle.
   uint32_t counter_;
 
-  // Size of the glyph cache. Rounded to power of 2.
+  // Size of each page of the glyph cache. Rounded to power of 2.
   mathfu::vec2i size_;
 
-  // Cache buffer;
-  std::unique_ptr<T> buffer_;
+  // Pages of the cache, indexed by page id. Released pages are null.
+  std::vector<std::unique_ptr<Page>> pages_;
+
+  // Number of pages the cache may allocate at a time.
+  int32_t max_pages_;
 
   // Hash map to the cache entries
   // This map is the primary place to look up the cache entries.
@@ -596,42 +1013,20 @@ class GlyphCache {
   // font file and not a Unicode value.
   std::unordered_map<uint64_t, std::unique_ptr<GlyphCacheEntry>> map_entries_;
 
-  // list of rows in the cache.
-  std::list<GlyphCacheRow> list_row_;
-
-  // LRU entries of the row. Tracks iterator to list_row_.
-  std::list<GlyphCacheEntry::iterator_row> lru_row_;
-
-  // Map to row entries to have O(log N) access to a row entry.
-  // Tracks iterator to list_row_.
-  // Using multimap because multiple rows can have same row height.
-  // Key: height of the row. With the map, an API can have quick access to a row
-  // with a given height.
-  std::multimap<int32_t, GlyphCacheEntry::iterator_row> map_row_;
+  // LRU entries of the glyphs, least recently used first.
+  std::list<GlyphCacheEntry*> lru_entries_;
 
   // Revision of the buffer.
-  // Each time one or more cache entry is evicted, a revision of the cache is
-  // updated.
+  // Each time one or more cache entry is evicted or moved, a revision of the
+  // cache is updated.
   // The revision  is used to determine if caller can make sure referencing
   // glyph cache entries are still in the cache.
   // Note that the revision is not changed when new glyph entries are added
   // because existing entries are still valid in that case.
   uint32_t revision_;
 
-  // Flag indicates if the cache is dirty. If it's dirty, corresponding font
-  // atlas texture needs to be uploaded.
-  bool dirty_;
-
-  // Dirty region in the buffer.
-  mathfu::vec4i dirty_rect_;
-
-#ifdef GLYPH_CACHE_STATS
-  // Variables to track usage stats.
-  int32_t stats_lookup_;
-  int32_t stats_hit_;
-  int32_t stats_row_flush_;
-  int32_t stats_set_fail_;
-#endif
+  // Usage stats.
+  GlyphCacheStats stats_;
 };
 
 }  // namespace fpl
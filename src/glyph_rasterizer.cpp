@@ -0,0 +1,183 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "precompiled.h"
+
+// Freetype2 header
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// Harfbuzz header
+#include <hb.h>
+#include <hb-ft.h>
+
+#include "glyph_rasterizer.h"
+
+namespace fpl {
+
+GlyphRasterizer::GlyphRasterizer()
+    : library_(nullptr),
+      face_(nullptr),
+      harfbuzz_font_(nullptr),
+      harfbuzz_buf_(nullptr),
+      pixel_size_(0) {
+  FT_Error err;
+  if ((err = FT_Init_FreeType(&library_))) {
+    // Error! Please fix me.
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Can't initialize freetype. FT_Error:%d\n", err);
+    assert(0);
+  }
+
+  // Create a buffer for harfbuzz.
+  harfbuzz_buf_ = hb_buffer_create();
+}
+
+GlyphRasterizer::~GlyphRasterizer() {
+  Close();
+  hb_buffer_destroy(harfbuzz_buf_);
+  FT_Done_FreeType(library_);
+}
+
+bool GlyphRasterizer::Open(const std::string &font_data) {
+  assert(!is_open());
+
+  // Open the font.
+  FT_Error err;
+  if ((err = FT_New_Memory_Face(
+           library_, reinterpret_cast<const unsigned char *>(&font_data[0]),
+           font_data.size(), 0, &face_))) {
+    // Failed to open font.
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Failed to initialize font face. FT_Error:%d\n", err);
+    face_ = nullptr;
+    return false;
+  }
+
+  // Create harfbuzz font information from freetype face.
+  harfbuzz_font_ = hb_ft_font_create(face_, NULL);
+  if (!harfbuzz_font_) {
+    // Failed to open font.
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Failed to initialize harfbuzz layout information\n");
+    FT_Done_Face(face_);
+    face_ = nullptr;
+    return false;
+  }
+  pixel_size_ = 0;
+  return true;
+}
+
+void GlyphRasterizer::Close() {
+  if (!is_open()) return;
+
+  hb_font_destroy(harfbuzz_font_);
+  harfbuzz_font_ = nullptr;
+
+  FT_Done_Face(face_);
+  face_ = nullptr;
+}
+
+void GlyphRasterizer::SetPixelSize(const int32_t y_size) {
+  if (y_size == pixel_size_) return;
+  FT_Set_Pixel_Sizes(face_, 0, y_size);
+  pixel_size_ = y_size;
+}
+
+uint32_t GlyphRasterizer::LayoutText(const char *text) {
+  size_t length = strlen(text);
+
+  // TODO: make harfbuzz settings (and other font settings) configurable.
+  // Set harfbuzz settings.
+  hb_buffer_set_direction(harfbuzz_buf_, HB_DIRECTION_LTR);
+  hb_buffer_set_script(harfbuzz_buf_, HB_SCRIPT_LATIN);
+  hb_buffer_set_language(harfbuzz_buf_, hb_language_from_string(text, length));
+
+  // Layout the text.
+  hb_buffer_add_utf8(harfbuzz_buf_, text, length, 0, length);
+  hb_shape(harfbuzz_font_, harfbuzz_buf_, nullptr, 0);
+
+  // Retrieve layout info.
+  uint32_t glyph_count;
+  hb_glyph_position_t *glyph_pos =
+      hb_buffer_get_glyph_positions(harfbuzz_buf_, &glyph_count);
+
+  // Retrieve a width of the string.
+  uint32_t string_width = 0;
+  for (uint32_t i = 0; i < glyph_count; ++i) {
+    string_width += glyph_pos[i].x_advance;
+  }
+  string_width /= kFreeTypeUnit;
+
+  return string_width;
+}
+
+void GlyphRasterizer::ClearLayout() { hb_buffer_clear_contents(harfbuzz_buf_); }
+
+void GlyphRasterizer::Shape(const char *text, ShapedText *shaped) {
+  shaped->width = LayoutText(text);
+
+  // Retrieve layout info.
+  uint32_t glyph_count;
+  hb_glyph_info_t *glyph_info =
+      hb_buffer_get_glyph_infos(harfbuzz_buf_, &glyph_count);
+  hb_glyph_position_t *glyph_pos =
+      hb_buffer_get_glyph_positions(harfbuzz_buf_, &glyph_count);
+
+  shaped->code_points.resize(glyph_count);
+  shaped->advances.resize(glyph_count);
+  for (uint32_t i = 0; i < glyph_count; ++i) {
+    shaped->code_points[i] = glyph_info[i].codepoint;
+    shaped->advances[i] =
+        mathfu::vec2i(glyph_pos[i].x_advance, glyph_pos[i].y_advance);
+  }
+
+  ClearLayout();
+}
+
+bool GlyphRasterizer::LoadGlyph(const uint32_t code_point) {
+  // Note that harfbuzz takes care of ligatures, so code points are glyph
+  // indices.
+  FT_Error err;
+  if ((err = FT_Load_Glyph(face_, code_point, FT_LOAD_RENDER))) {
+    // Error. This could happen typically the loaded font does not support
+    // particular glyph.
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't load glyph %c FT_Error:%d\n",
+                 code_point, err);
+    return false;
+  }
+  return true;
+}
+
+bool GlyphRasterizer::Rasterize(RasterizedGlyph *glyph) {
+  if (!LoadGlyph(glyph->entry.get_code_point())) return false;
+
+  FT_GlyphSlot g = face_->glyph;
+  const int32_t width = g->bitmap.width;
+  const int32_t rows = g->bitmap.rows;
+  glyph->entry.set_size(mathfu::vec2i(width, rows));
+  glyph->entry.set_offset(mathfu::vec2i(g->bitmap_left, g->bitmap_top));
+
+  // Copy the rows, dropping any padding at the end of each.
+  glyph->image.resize(width * rows);
+  for (int32_t y = 0; y < rows; ++y) {
+    memcpy(&glyph->image[y * width], &g->bitmap.buffer[y * g->bitmap.pitch],
+           width);
+  }
+  glyph->loaded = true;
+  return true;
+}
+
+}  // namespace fpl
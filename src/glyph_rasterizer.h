@@ -0,0 +1,138 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef GLYPH_RASTERIZER_H
+#define GLYPH_RASTERIZER_H
+
+#include "glyph_cache.h"
+#include "common.h"
+
+// Forward decls for FreeType & Harfbuzz
+typedef struct FT_LibraryRec_ *FT_Library;
+typedef struct FT_FaceRec_ *FT_Face;
+struct hb_font_t;
+struct hb_buffer_t;
+
+namespace fpl {
+
+// Constant to convert FreeType unit to pixel unit.
+// In FreeType & Harfbuzz, the position value unit is 1/64 px whereas
+// configurable in imgui. The constant is used to convert FreeType unit
+// to px.
+const int32_t kFreeTypeUnit = 64;
+
+// Layout of a string, as given by GlyphRasterizer::Shape().
+struct ShapedText {
+  ShapedText() : width(0) {}
+
+  // Glyph index of each glyph in the string. Ligatures are a single glyph.
+  std::vector<uint32_t> code_points;
+
+  // Advance of each glyph, in FreeType units.
+  std::vector<mathfu::vec2i> advances;
+
+  // Width of the string in pixels.
+  uint32_t width;
+};
+
+// Glyph image rendered by GlyphRasterizer::Rasterize(), to be stored into the
+// glyph cache.
+struct RasterizedGlyph {
+  RasterizedGlyph() : y_size(0), loaded(false) {}
+
+  // Code point, size and offset of the glyph.
+  GlyphCacheEntry entry;
+
+  // Glyph size in pixels, as used for the glyph cache.
+  int32_t y_size;
+
+  // 8 bit gray scale image, entry.get_size().x() pixels per row.
+  std::vector<uint8_t> image;
+
+  // Set once the image has been rendered.
+  bool loaded;
+};
+
+// GlyphRasterizer lays out strings and renders glyphs with its own FreeType
+// library and face, and its own harfbuzz font and buffer.
+//
+// FreeType and harfbuzz objects may not be used by two threads at once, but
+// separate instances may. So each thread that renders glyphs uses its own
+// GlyphRasterizer, all opened on the same font data.
+class GlyphRasterizer {
+ public:
+  GlyphRasterizer();
+  ~GlyphRasterizer();
+
+  // Open a face on font data that's already loaded. The data needs to be
+  // kept until Close().
+  // Return value: false when the font data is not a valid font.
+  bool Open(const std::string &font_data);
+
+  // Discard the face opened via Open().
+  void Close();
+
+  // Returns if a face has been opened.
+  bool is_open() const { return face_ != nullptr; }
+
+  // Set the size of glyphs in pixels, for following calls.
+  void SetPixelSize(const int32_t y_size);
+
+  // Layout text into the harfbuzz buffer.
+  // Returns the width of the text layout in pixels.
+  // Call ClearLayout() once done with the layout.
+  uint32_t LayoutText(const char *text);
+
+  // Clear the harfbuzz buffer contents for the next layout.
+  void ClearLayout();
+
+  // Layout text, and copy the layout to `shaped`.
+  void Shape(const char *text, ShapedText *shaped);
+
+  // Render a glyph to the glyph slot of the face.
+  // Returns false if the font doesn't have the glyph.
+  bool LoadGlyph(const uint32_t code_point);
+
+  // Render glyph->entry.get_code_point() at the current size, and copy the
+  // image and its metrics to `glyph`.
+  // Returns false if the font doesn't have the glyph.
+  bool Rasterize(RasterizedGlyph *glyph);
+
+  // Getter of the FreeType face.
+  FT_Face face() const { return face_; }
+
+  // Getter of the harfbuzz buffer.
+  hb_buffer_t *buffer() const { return harfbuzz_buf_; }
+
+ private:
+  // FreeType library instance of this rasterizer.
+  FT_Library library_;
+
+  // freetype's fontface instance.
+  FT_Face face_;
+
+  // harfbuzz's font information instance.
+  hb_font_t *harfbuzz_font_;
+
+  // Harfbuzz buffer
+  hb_buffer_t *harfbuzz_buf_;
+
+  // Glyph size set to the face, or 0 if none yet.
+  int32_t pixel_size_;
+};
+
+}  // namespace fpl
+
+#endif  // GLYPH_RASTERIZER_H
@@ -31,6 +31,14 @@ GuiMenu::GuiMenu() : time_elapsed_(0) {
 #endif
 }
 
+void GuiMenu::SetThreadPool(ThreadPool* thread_pool) {
+#ifdef USE_IMGUI
+  fontman_->set_thread_pool(thread_pool);
+#else
+  (void)thread_pool;
+#endif
+}
+
 static const char* TextureName(const ButtonTexture& button_texture) {
   const bool touch_screen =
       button_texture.touch_screen() != nullptr && TouchScreenDevice();
@@ -58,6 +58,8 @@ class GuiMenu {
   TouchscreenButton* FindButtonById(ButtonId id);
   StaticImage* FindImageById(ButtonId id);
   const UiGroup* menu_def() const { return menu_def_; }
+  // Lays out and renders the menu's text on thread_pool, if not null.
+  void SetThreadPool(ThreadPool* thread_pool);
 
  private:
   void ClearRecentSelections();
@@ -0,0 +1,170 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "headless_simulation.h"
+#include "ai_controller.h"
+#include "character_state_machine_def_generated.h"
+#include "config_generated.h"
+#include "game_state.h"
+#include "motive/init.h"
+#include "thread_pool.h"
+#include "utilities.h"
+
+namespace fpl {
+namespace pie_noon {
+
+bool HeadlessSimulation::Initialize() {
+  if (!LoadFile("config.bin", &config_source_)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "can't load config.bin\n");
+    return false;
+  }
+  config_ = GetConfig(config_source_.c_str());
+
+  if (!LoadFile("character_state_machine_def.bin", &state_machine_source_)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "Error loading character state machine.\n");
+    return false;
+  }
+  auto state_machine_def =
+      GetCharacterStateMachineDef(state_machine_source_.c_str());
+  if (!CharacterStateMachineDef_Validate(state_machine_def)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "State machine is invalid.\n");
+    return false;
+  }
+  state_machine_table_.Compile(state_machine_def);
+
+  motive::OvershootInit::Register();
+  motive::SmoothInit::Register();
+  motive::MatrixInit::Register();
+  return true;
+}
+
+void HeadlessSimulation::Run(const HeadlessSimulationSettings& settings,
+                             HeadlessSimulationResults* results) {
+  const int num_threads =
+      settings.num_threads > 0 ? settings.num_threads : SDL_GetCPUCount();
+  std::vector<HeadlessSimulationResults> thread_results(num_threads);
+  SDL_atomic_t next_match;
+  SDL_AtomicSet(&next_match, 0);
+
+  // The game logs the winners of every match.
+  const SDL_LogPriority log_priority =
+      SDL_LogGetPriority(SDL_LOG_CATEGORY_APPLICATION);
+  SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_WARN);
+
+  // Each task plays matches until they run out, so the threads stay busy
+  // however long each match lasts.
+  ThreadPool thread_pool;
+  thread_pool.Start(num_threads - 1);
+  const Uint64 start = SDL_GetPerformanceCounter();
+  thread_pool.ParallelFor(num_threads, [&](int i) {
+    RunMatches(settings, &next_match, &thread_results[i]);
+  });
+  const Uint64 end = SDL_GetPerformanceCounter();
+  thread_pool.Stop();
+  SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, log_priority);
+
+  *results = HeadlessSimulationResults();
+  results->seconds =
+      static_cast<double>(end - start) / SDL_GetPerformanceFrequency();
+  results->wins.assign(config_->character_count(), 0);
+  for (auto it = thread_results.begin(); it != thread_results.end(); ++it) {
+    results->matches += it->matches;
+    results->unfinished_matches += it->unfinished_matches;
+    results->frames += it->frames;
+    for (size_t i = 0; i < it->wins.size(); ++i) {
+      results->wins[i] += it->wins[i];
+    }
+  }
+}
+
+void HeadlessSimulation::RunMatches(const HeadlessSimulationSettings& settings,
+                                    SDL_atomic_t* next_match,
+                                    HeadlessSimulationResults* results) {
+  // The matches are spread over threads already, so each game updates its
+  // entities on its own thread, which GameState does unless told otherwise.
+  GameState game_state;
+  game_state.set_config(config_);
+  game_state.set_cardboard_config(config_);
+
+  auto state_machine_def =
+      GetCharacterStateMachineDef(state_machine_source_.c_str());
+  std::vector<std::unique_ptr<AiController>> controllers;
+  for (unsigned int i = 0; i < config_->character_count(); ++i) {
+    controllers.push_back(std::unique_ptr<AiController>(new AiController()));
+    controllers[i]->Initialize(&game_state, config_, i);
+    game_state.characters().push_back(std::unique_ptr<Character>(
+        new Character(i, controllers[i].get(), *config_, state_machine_def,
+                      &state_machine_table_)));
+  }
+  results->wins.assign(config_->character_count(), 0);
+
+  int match;
+  while ((match = SDL_AtomicAdd(next_match, 1)) < settings.num_matches) {
+    // Start each match from scratch, whatever this thread played before.
+    game_state.random().Seed(settings.seed + match);
+    for (unsigned int i = 0; i < controllers.size(); ++i) {
+      controllers[i]->Initialize(&game_state, config_, i);
+    }
+    game_state.Reset(GameState::kNoAnalytics);
+    while (!IsMatchOver(game_state) &&
+           game_state.time() < settings.max_match_time) {
+      for (size_t i = 0; i < controllers.size(); ++i) {
+        controllers[i]->AdvanceFrame(settings.time_step);
+      }
+      game_state.AdvanceFrame(settings.time_step, nullptr);
+      results->frames++;
+    }
+
+    results->matches++;
+    if (!IsMatchOver(game_state)) {
+      results->unfinished_matches++;
+      continue;
+    }
+    game_state.DetermineWinnersAndLosers();
+    for (size_t i = 0; i < game_state.characters().size(); ++i) {
+      if (game_state.characters()[i]->victory_state() == kVictorious) {
+        results->wins[i]++;
+      }
+    }
+  }
+}
+
+bool HeadlessSimulation::IsMatchOver(const GameState& game_state) const {
+  if (config_->game_mode() == GameMode_Survival) {
+    return game_state.pies().empty() && game_state.NumActiveCharacters() <= 1;
+  }
+  return game_state.IsGameOver();
+}
+
+void HeadlessSimulation::LogResults(const HeadlessSimulationResults& results) {
+  const double seconds = std::max(results.seconds, 1e-9);
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+              "Headless simulation: %d matches (%d unfinished) in %.3f s\n",
+              results.matches, results.unfinished_matches, results.seconds);
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+              "  %.0f matches/s, %.0f frames/s, %.1f frames per match\n",
+              results.matches / seconds, results.frames / seconds,
+              results.matches
+                  ? static_cast<double>(results.frames) / results.matches
+                  : 0.0);
+  for (size_t i = 0; i < results.wins.size(); ++i) {
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION, "  Player %i: %d wins\n",
+                static_cast<int>(i) + 1, results.wins[i]);
+  }
+}
+
+}  // pie_noon
+}  // fpl
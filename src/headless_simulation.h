@@ -0,0 +1,105 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef HEADLESS_SIMULATION_H_
+#define HEADLESS_SIMULATION_H_
+
+#include <string>
+#include <vector>
+#include "SDL_atomic.h"
+#include "character_state_machine.h"
+#include "common.h"
+
+namespace fpl {
+namespace pie_noon {
+
+struct Config;
+class GameState;
+
+// How HeadlessSimulation::Run plays its matches.
+struct HeadlessSimulationSettings {
+  HeadlessSimulationSettings()
+      : num_matches(1000),
+        num_threads(0),
+        time_step(16),
+        max_match_time(5 * 60 * kMillisecondsPerSecond),
+        seed(1) {}
+
+  int num_matches;
+  // Threads to play matches on at once.  0 means one per core.
+  int num_threads;
+  // Every frame advances the game by exactly this much.
+  WorldTime time_step;
+  // Matches still going after this long are stopped, and count as
+  // unfinished.
+  WorldTime max_match_time;
+  // Match n seeds its game's random numbers, which the AI uses too, with
+  // seed + n, so the same seed plays the same matches on any number of
+  // threads.
+  unsigned int seed;
+};
+
+// What HeadlessSimulation::Run measured.
+struct HeadlessSimulationResults {
+  HeadlessSimulationResults()
+      : matches(0), unfinished_matches(0), frames(0), seconds(0) {}
+
+  int matches;
+  int unfinished_matches;
+  // Total game frames advanced, over all matches.
+  long long frames;
+  // Wall clock time the matches took.
+  double seconds;
+  // Matches won by each character.  In modes where several characters can
+  // win, a match counts for each of them.
+  std::vector<int> wins;
+};
+
+// Plays matches between AI characters as fast as possible, with no window,
+// rendering or sound, on a fixed timestep.  Used to load-test balance
+// changes, and to profile the simulation on its own.
+class HeadlessSimulation {
+ public:
+  // Loads config.bin and character_state_machine_def.bin from the current
+  // directory.  Returns false if they can't be loaded.
+  bool Initialize();
+
+  void Run(const HeadlessSimulationSettings& settings,
+           HeadlessSimulationResults* results);
+
+  // Logs a summary of results.
+  static void LogResults(const HeadlessSimulationResults& results);
+
+ private:
+  // Plays matches on one thread, taking them from *next_match until it
+  // reaches settings.num_matches, and adds up what happened in *results.
+  void RunMatches(const HeadlessSimulationSettings& settings,
+                  SDL_atomic_t* next_match,
+                  HeadlessSimulationResults* results);
+
+  // Returns true once only one character is left standing, or the game
+  // ends some other way.  (GameState::IsGameOver ends survival games with
+  // no human players straight away.)
+  bool IsMatchOver(const GameState& game_state) const;
+
+  std::string config_source_;
+  std::string state_machine_source_;
+  const Config* config_;
+  CharacterStateMachineTable state_machine_table_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // HEADLESS_SIMULATION_H_
@@ -362,18 +362,19 @@ class InternalState : public Group {
 
       auto element = NextElement(text);
       if (element) {
-        fontman_.GetAtlasTexture()->Set(0);
-
         font_shader_->Set(renderer_);
         auto pos = Position(*element);
         font_shader_->SetUniform("pos_offset", vec3(pos.x(), pos.y(), 0.0f));
 
+        // One draw per glyph cache page the text uses.
         const Attribute kFormat[] = {kPosition3f, kTexCoord2f, kEND};
-        Mesh::RenderArray(
-            GL_TRIANGLES, buffer->get_indices()->size(), kFormat,
-            sizeof(FontVertex),
-            reinterpret_cast<const char *>(buffer->get_vertices()->data()),
-            buffer->get_indices()->data());
+        for (auto &slice : *buffer->get_slices()) {
+          fontman_.GetAtlasTexture(slice.page)->Set(0);
+          Mesh::RenderArray(
+              GL_TRIANGLES, slice.index_count, kFormat, sizeof(FontVertex),
+              reinterpret_cast<const char *>(buffer->get_vertices()->data()),
+              buffer->get_indices()->data() + slice.index_offset);
+        }
         Advance(element->size);
       }
     }
@@ -833,6 +834,15 @@ mathfu::vec2i VirtualToPhysical(const mathfu::vec2 &v) {
 
 float GetScale() { return Gui()->GetScale(); }
 
+void QueueLabel(FontManager &fontman, const mathfu::vec2i &window_size,
+                float virtual_resolution, const char *text, float ysize) {
+  // Same scale and rounding as InternalState::SetScale() and
+  // VirtualToPhysical().
+  auto scale = vec2(window_size) / virtual_resolution;
+  auto pixel_scale = std::min(scale.x(), scale.y());
+  fontman.QueueBuffer(text, static_cast<int>(ysize * pixel_scale + 0.5f));
+}
+
 // Example how to create a button. We will provide convenient pre-made
 // buttons like this, but it is expected many games will make custom buttons.
 Event ImageButton(const char *texture_name, float size, const char *id) {
@@ -915,5 +925,27 @@ void TestGUI(MaterialManager &matman, FontManager &fontman,
   });
 }
 
+bool PrewarmTestGUI(FontManager &fontman, const mathfu::vec2i &window_size) {
+  // The labels TestGUI() shows. Keep in sync with it.
+  static const struct {
+    const char *text;
+    float ysize;
+  } kLabels[] = {
+    { "Property T", 30 },
+    { "Test ", 30 },
+    { "ffWAWÄテスト", 30 },
+    { "The quick brown fox jumps over the lazy dog", 32 },
+    { "The quick brown fox jumps over the lazy dog", 24 },
+    { "The quick brown fox jumps over the lazy dog", 20 },
+    { "This is the about window! すし!", 32 },
+    { "You should only be able to click on the", 24 },
+    { "about button above, not anywhere else", 20 },
+  };
+  for (size_t i = 0; i < sizeof(kLabels) / sizeof(kLabels[0]); i++) {
+    QueueLabel(fontman, window_size, 1000, kLabels[i].text, kLabels[i].ysize);
+  }
+  return fontman.PrewarmBuffers();
+}
+
 }  // namespace gui
 }  // namespace fpl
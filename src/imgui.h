@@ -120,6 +120,12 @@ void Image(const char *texture_name, float ysize);
 // automatically based on the text length.
 void Label(const unsigned char *text, float ysize);
 
+// Queue a label for FontManager::PrewarmBuffers(), at the size Label() will
+// render it in a GUI positioned with virtual_resolution on a window of
+// window_size. Can be called outside Run(), e.g. while loading.
+void QueueLabel(FontManager &fontman, const mathfu::vec2i &window_size,
+                float virtual_resolution, const char *text, float ysize);
+
 // Create a group of elements with the given layout and intra-element spacing.
 // Start/end calls must be matched and may be nested to create more complex
 // layouts.
@@ -182,6 +188,9 @@ void PositionUI(float virtual_resolution, Layout horizontal, Layout vertical);
 // TODO: Move into a test application.
 #define IMGUI_TEST 0
 void TestGUI(MaterialManager &matman, FontManager &fontman, InputSystem &input);
+// Lay out the labels of TestGUI() ahead of time. Returns false if they
+// weren't all prepared; TestGUI() then prepares the rest as it goes.
+bool PrewarmTestGUI(FontManager &fontman, const mathfu::vec2i &window_size);
 
 // Use glyph cache for a font rendering
 #define USE_GLYPHCACHE (1)
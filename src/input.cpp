@@ -14,6 +14,7 @@
 
 #include "precompiled.h"
 #include "input.h"
+#include "profiler.h"
 #ifdef ANDROID_GAMEPAD
 #include <jni.h>
 #include <android/keycodes.h>
@@ -84,6 +85,7 @@ void InputSystem::AddAppEventCallback(AppEventCallback callback) {
 }
 
 void InputSystem::AdvanceFrame(vec2i *window_size) {
+  FPL_PROFILE_SCOPE("InputSystem::AdvanceFrame");
   // Update timing.
   int millis = SDL_GetTicks();
   frame_time_ = millis - last_millis_;
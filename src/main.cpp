@@ -14,11 +14,46 @@
 
 #include "precompiled.h"
 
+#include "headless_simulation.h"
 #include "pie_noon_game.h"
+#include "profiler.h"
+#include "utilities.h"
+
+// Plays AI matches with no window, as set up by the arguments after
+// --headless: the number of matches, the number of threads, then optionally
+// a file to write a profile of the run to, as a Chrome trace.
+static int RunHeadless(const char* binary_directory, int argc, char* argv[]) {
+  if (!fpl::ChangeToUpstreamDir(binary_directory, "assets")) return 1;
+
+  fpl::pie_noon::HeadlessSimulation simulation;
+  if (!simulation.Initialize()) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "PieNoon: init failed, exiting!");
+    return 1;
+  }
+
+  fpl::pie_noon::HeadlessSimulationSettings settings;
+  if (argc > 2) settings.num_matches = atoi(argv[2]);
+  if (argc > 3) settings.num_threads = atoi(argv[3]);
+  const char* profile_file_name = argc > 4 ? argv[4] : nullptr;
+  fpl::SetProfilingEnabled(profile_file_name != nullptr);
+  fpl::pie_noon::HeadlessSimulationResults results;
+  simulation.Run(settings, &results);
+  fpl::pie_noon::HeadlessSimulation::LogResults(results);
+  if (profile_file_name) {
+    fpl::SetProfilingEnabled(false);
+    fpl::LogProfileSummary();
+    fpl::WriteProfileChromeTrace(profile_file_name);
+  }
+  return 0;
+}
 
 int main(int argc, char* argv[]) {
-  fpl::pie_noon::PieNoonGame game;
   const char* binary_directory = argc > 0 ? argv[0] : "";
+  if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+    return RunHeadless(binary_directory, argc, argv);
+  }
+
+  fpl::pie_noon::PieNoonGame game;
   if (!game.Initialize(binary_directory)) {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "PieNoon: init failed, exiting!");
     return 1;
@@ -15,18 +15,64 @@
 #include "precompiled.h"
 #include "material.h"
 #include "renderer.h"
+#include "texture_cache.h"
+#include "utilities.h"
 
 namespace fpl {
 
+Texture::~Texture() {
+  Delete();
+  delete gpu_texture_;
+}
+
 void Texture::Load() {
-  data_ =
-      renderer_->LoadAndUnpackTexture(filename_.c_str(), &size_, &has_alpha_);
-  if (!data_) {
-    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "texture load: %s: %s",
-                 filename_.c_str(), renderer_->last_error().c_str());
+  if (cache_ && cache_->enabled()) {
+    LoadThroughCache();
+  } else {
+    data_ =
+        renderer_->LoadAndUnpackTexture(filename_.c_str(), &size_, &has_alpha_);
+  }
+  if (!data_ && !gpu_texture_) {
+    SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "texture load failed: %s",
+                 filename_.c_str());
   }
 }
 
+void Texture::LoadThroughCache() {
+  std::string source;
+  if (!LoadFile(filename_.c_str(), &source)) return;
+  // LoadFile appends a terminator, which isn't part of the file.
+  const uint64_t source_hash =
+      TextureCache::Hash(source.c_str(), source.length() - 1);
+  const std::string cache_filename = cache_->CachePath(filename_);
+  std::unique_ptr<GpuTexture> gpu_texture(new GpuTexture());
+  if (!gpu_texture->Map(cache_filename.c_str(), source_hash, desired_,
+                        renderer_->use_16bpp())) {
+    // Missing or stale, so decode the source and rebuild the cache entry.
+    vec2i size;
+    bool has_alpha;
+    uint8_t *pixels = renderer_->UnpackTexture(filename_.c_str(), source,
+                                               &size, &has_alpha);
+    if (!pixels) return;
+    if (!gpu_texture->Build(pixels, size, has_alpha, source_hash, desired_,
+                            renderer_->use_16bpp())) {
+      // Not a format we cache. Upload it the usual way.
+      data_ = pixels;
+      size_ = size;
+      has_alpha_ = has_alpha;
+      return;
+    }
+    free(pixels);
+    if (!gpu_texture->Write(cache_filename.c_str())) {
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION,
+                  "texture cache: can't write %s", cache_filename.c_str());
+    }
+  }
+  size_ = gpu_texture->size();
+  has_alpha_ = gpu_texture->has_alpha();
+  gpu_texture_ = gpu_texture.release();
+}
+
 void Texture::LoadFromMemory(const uint8_t *data, const vec2i size,
                              const TextureFormat format, const bool has_alpha) {
   size_ = size;
@@ -36,6 +82,11 @@ void Texture::LoadFromMemory(const uint8_t *data, const vec2i size,
 }
 
 void Texture::Finalize() {
+  if (gpu_texture_) {
+    id_ = renderer_->CreateTexture(*gpu_texture_);
+    delete gpu_texture_;
+    gpu_texture_ = nullptr;
+  }
   if (data_) {
     id_ = renderer_->CreateTexture(data_, size_, has_alpha_, desired_);
     free(data_);
@@ -43,6 +94,12 @@ void Texture::Finalize() {
   }
 }
 
+size_t Texture::FinalizeSize() const {
+  if (gpu_texture_) return gpu_texture_->file_size();
+  if (!data_) return 0;
+  return static_cast<size_t>(size_.x()) * size_.y() * (has_alpha_ ? 4 : 3);
+}
+
 void Texture::Set(size_t unit) const {
   GL_CALL(glActiveTexture(GL_TEXTURE0 + unit));
   GL_CALL(glBindTexture(GL_TEXTURE_2D, id_));
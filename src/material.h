@@ -20,7 +20,9 @@
 
 namespace fpl {
 
+class GpuTexture;
 class Renderer;
+class TextureCache;
 
 enum BlendMode {
   kBlendModeOff,
@@ -48,7 +50,9 @@ class Texture : public AsyncResource {
         size_(mathfu::kZeros2i),
         uv_(vec4(0.0f, 0.0f, 1.0f, 1.0f)),
         has_alpha_(false),
-        desired_(kFormatAuto) {}
+        desired_(kFormatAuto),
+        cache_(nullptr),
+        gpu_texture_(nullptr) {}
   Texture(Renderer &renderer)
       : AsyncResource(""),
         renderer_(&renderer),
@@ -56,13 +60,16 @@ class Texture : public AsyncResource {
         size_(mathfu::kZeros2i),
         uv_(vec4(0.0f, 0.0f, 1.0f, 1.0f)),
         has_alpha_(false),
-        desired_(kFormatAuto) {}
-  ~Texture() { Delete(); }
+        desired_(kFormatAuto),
+        cache_(nullptr),
+        gpu_texture_(nullptr) {}
+  ~Texture();
 
   virtual void Load();
   virtual void LoadFromMemory(const uint8_t *data, const vec2i size,
                               const TextureFormat format, const bool has_alpha);
   virtual void Finalize();
+  virtual size_t FinalizeSize() const;
 
   void Set(size_t unit) const;
   void Delete();
@@ -76,7 +83,13 @@ class Texture : public AsyncResource {
 
   void set_desired_format(TextureFormat format) { desired_ = format; }
 
+  // If set, Load() reads the texture from this cache when it can, and adds
+  // it to the cache when it can't.
+  void set_cache(const TextureCache *cache) { cache_ = cache; }
+
  private:
+  void LoadThroughCache();
+
   Renderer *renderer_;
 
   GLuint id_;
@@ -84,6 +97,10 @@ class Texture : public AsyncResource {
   vec4 uv_;
   bool has_alpha_;
   TextureFormat desired_;
+
+  const TextureCache *cache_;
+  // Set instead of data_ when Load() went through the cache. Owned.
+  GpuTexture *gpu_texture_;
 };
 
 class Material {
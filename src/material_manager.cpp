@@ -73,14 +73,17 @@ Texture *MaterialManager::LoadTexture(const char *filename,
   if (tex) return tex;
   tex = new Texture(renderer_, filename);
   tex->set_desired_format(format);
-  loader_.QueueJob(tex);
+  tex->set_cache(&texture_cache_);
+  loader_.QueueJob(tex, load_priority_);
   texture_map_[filename] = tex;
   return tex;
 }
 
 void MaterialManager::StartLoadingTextures() { loader_.StartLoading(); }
 
-bool MaterialManager::TryFinalize() { return loader_.TryFinalize(); }
+bool MaterialManager::TryFinalize(int64_t budget_us, size_t budget_bytes) {
+  return loader_.TryFinalize(budget_us, budget_bytes);
+}
 
 Material *MaterialManager::FindMaterial(const char *filename) {
   return FindInMap(material_map_, filename);
@@ -18,12 +18,14 @@
 #include "renderer.h"
 #include "common.h"
 #include "async_loader.h"
+#include "texture_cache.h"
 
 namespace fpl {
 
 class MaterialManager {
  public:
-  MaterialManager(Renderer &renderer) : renderer_(renderer) {}
+  MaterialManager(Renderer &renderer)
+      : renderer_(renderer), load_priority_(0) {}
 
   // Returns a previously loaded shader object, or nullptr.
   Shader *FindShader(const char *basename);
@@ -41,12 +43,27 @@ class MaterialManager {
   Texture *LoadTexture(const char *filename,
                        TextureFormat format = kFormatAuto);
   // LoadTextures doesn't actually load anything, this will start the async
-  // loading of all files, and decompression.
+  // loading of all files, and decompression, on several threads.
   void StartLoadingTextures();
+  // Keep GPU-ready copies of loaded textures in `directory`, and load from
+  // there when they're up to date. Empty disables the cache. Call this before
+  // loading any textures.
+  void set_texture_cache_directory(const std::string &directory) {
+    texture_cache_.set_directory(directory);
+  }
+  // Textures queued by Load*() calls after this are loaded before those
+  // queued with a lower priority. Defaults to 0.
+  void set_load_priority(int priority) { load_priority_ = priority; }
+  int load_priority() const { return load_priority_; }
   // Call this repeatedly until it returns true, which signals all textures
   // will have loaded, and turned into OpenGL textures.
   // Textures with a 0 id will have failed to load.
-  bool TryFinalize();
+  // Each call stops turning textures into OpenGL textures once it has spent
+  // `budget_us` microseconds or uploaded `budget_bytes`. 0 means no limit.
+  bool TryFinalize(int64_t budget_us = 0, size_t budget_bytes = 0);
+
+  // The texture loader, e.g. for its finalize_timings().
+  const AsyncLoader &loader() const { return loader_; }
 
   // Returns a previously loaded material, or nullptr.
   Material *FindMaterial(const char *filename);
@@ -83,6 +100,8 @@ class MaterialManager {
   std::map<std::string, Material *> material_map_;
   std::map<std::string, Mesh *> mesh_map_;
   AsyncLoader loader_;
+  int load_priority_;
+  TextureCache texture_cache_;
 };
 
 }  // namespace fpl
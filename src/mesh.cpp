@@ -53,6 +53,12 @@ void Mesh::SetAttributes(GLuint vbo, const Attribute *attributes, int stride,
                                       true, stride, buffer + offset));
         offset += 4;
         break;
+      case kColor4f:
+        GL_CALL(glEnableVertexAttribArray(kAttributeColor));
+        GL_CALL(glVertexAttribPointer(kAttributeColor, 4, GL_FLOAT, false,
+                                      stride, buffer + offset));
+        offset += 4 * sizeof(float);
+        break;
       case kEND:
         return;
     }
@@ -68,6 +74,7 @@ size_t Mesh::VertexSize(const Attribute *attributes) {
       case kTangent4f:  size += 4 * sizeof(float); break;
       case kTexCoord2f: size += 2 * sizeof(float); break;
       case kColor4ub:   size += 4;                 break;
+      case kColor4f:    size += 4 * sizeof(float); break;
       case kEND:        return size;
     }
   }
@@ -89,6 +96,7 @@ void Mesh::UnSetAttributes(const Attribute *attributes) {
         GL_CALL(glDisableVertexAttribArray(kAttributeTexCoord));
         break;
       case kColor4ub:
+      case kColor4f:
         GL_CALL(glDisableVertexAttribArray(kAttributeColor));
         break;
       case kEND:
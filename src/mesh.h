@@ -32,7 +32,8 @@ enum Attribute {
   kNormal3f,
   kTangent4f,
   kTexCoord2f,
-  kColor4ub
+  kColor4ub,
+  kColor4f
 };
 
 // A vertex definition specific to normalmapping.
@@ -188,7 +188,8 @@ void MultiplayerDirector::TriggerPlayerHitByPie(CharacterId player,
     }
   }
   while (num_splats > 0 && splats_available.size() > 0) {
-    unsigned int idx = mathfu::RandomInRange<int>(0, splats_available.size());
+    unsigned int idx = gamestate_->random().InRange<int>(
+        0, splats_available.size());
     unsigned int splat_used = splats_available[idx];
     unsigned int splat_mask = (1 << splat_used);
     character_splats_[player] |= splat_mask;
@@ -225,7 +226,7 @@ void MultiplayerDirector::ChooseAICommand(CharacterId id) {
   Command command = commands_[id];  // Get previous command.
   const auto* options = config_->multiscreen_options();
 
-  float action = mathfu::Random<float>();
+  float action = gamestate_->random().Random();
   if (action < options->ai_chance_to_throw()) {
     SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION,
                  "MultiplayerDirector: AI %d setting action to throw", id);
@@ -253,7 +254,7 @@ void MultiplayerDirector::ChooseAICommand(CharacterId id) {
   unsigned int self = static_cast<unsigned int>(id);  // for comparison
   std::vector<unsigned int> candidate_targets;
   // Choose how to target opponents.
-  float target = mathfu::Random<float>();
+  float target = gamestate_->random().Random();
   if (target < options->ai_chance_to_target_largest_pie()) {
     // First get the max pie damage. Then put everyone with that pie damage
     // into the candidate targets list.
@@ -336,7 +337,8 @@ void MultiplayerDirector::ChooseAICommand(CharacterId id) {
   // don't change it.
 
   if (candidate_targets.size() > 0) {
-    int which = mathfu::RandomInRange<int>(0, candidate_targets.size());
+    int which =
+        gamestate_->random().InRange<int>(0, candidate_targets.size());
     command.aim_at = candidate_targets[which];
   }
   // If we have no candidate targets, we won't change aim at all.
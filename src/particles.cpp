@@ -1,22 +1,40 @@
 #include "particles.h"
+#include "vectorial/simd4x4f.h"
+
+// The batch path uses vectorial directly rather than through mathfu, so it's
+// available wherever vectorial has SIMD instructions, even when mathfu itself
+// is built without SIMD support, as in the Xcode project.
+#if !defined(VECTORIAL_SCALAR)
+#define PARTICLES_USE_SIMD
+#endif  // !defined(VECTORIAL_SCALAR)
 
 namespace fpl {
 namespace pie_noon {
 
 const int kMaxParticles = 1000;
 
+// Channels are aligned to this many bytes so batch passes can use aligned
+// SIMD loads.
+const size_t kParticleChannelAlignment = 16;
+const size_t kFloatsPerAlignment = kParticleChannelAlignment / sizeof(float);
+
+// Each channel is padded up to a multiple of the alignment.
+const size_t kParticleChannelStride =
+    (kMaxParticles + kFloatsPerAlignment - 1) & ~(kFloatsPerAlignment - 1);
+
 void Particle::reset() {
-  base_position_ = mathfu::vec3(0, 0, 0);
-  base_velocity_ = mathfu::vec3(0, 0, 0);
-  acceleration_ = mathfu::vec3(0, 0, 0);
-  base_orientation_ = mathfu::vec3(0, 0, 0);
-  rotational_velocity_ = mathfu::vec3(0, 0, 0);
-  base_scale_ = mathfu::vec3(1, 1, 1);
-  base_tint_ = mathfu::vec4(1, 1, 1, 1);
-  duration_ = 0;
-  age_ = 0;
-  duration_of_fade_out_ = 0;
-  duration_of_shrink_out_ = 0;
+  set_base_position(mathfu::vec3(0, 0, 0));
+  set_base_velocity(mathfu::vec3(0, 0, 0));
+  set_acceleration(mathfu::vec3(0, 0, 0));
+  set_base_orientation(mathfu::vec3(0, 0, 0));
+  set_rotational_velocity(mathfu::vec3(0, 0, 0));
+  set_base_scale(mathfu::vec3(1, 1, 1));
+  set_base_tint(mathfu::vec4(1, 1, 1, 1));
+  set_duration(0);
+  set_age(0);
+  set_duration_of_fade_out(0);
+  set_duration_of_shrink_out(0);
+  set_renderable_id(0);
 }
 
 mathfu::mat4 Particle::CalculateMatrix() const {
@@ -26,77 +44,254 @@ mathfu::mat4 Particle::CalculateMatrix() const {
 }
 
 mathfu::vec3 Particle::CurrentPosition() const {
-  return base_position_ + (base_velocity_ * age_) +
-         (acceleration_ / 2.0) * age_ * age_;
+  const TimeStep age = this->age();
+  return base_position() + (base_velocity() * age) +
+         (acceleration() / 2.0) * age * age;
 }
 
 mathfu::vec3 Particle::CurrentVelocity() const {
-  return base_velocity_ + acceleration_ * age_;
+  return base_velocity() + acceleration() * age();
 }
 
 Quat Particle::CurrentOrientation() const {
-  return Quat::FromEulerAngles(base_orientation_ + rotational_velocity_ * age_);
+  return Quat::FromEulerAngles(base_orientation() +
+                               rotational_velocity() * age());
 }
 
-TimeStep Particle::DurationRemaining() const { return duration_ - age_; }
+TimeStep Particle::DurationRemaining() const { return duration() - age(); }
 
 void Particle::SetDurationRemaining(TimeStep duration) {
-  duration_ = age_ + duration;
+  set_duration(age() + duration);
+}
+
+// Fraction of the tint or scale left when `remaining` time is left in a
+// `fade_duration` long fade.
+static inline float FadeFactor(TimeStep remaining, TimeStep fade_duration) {
+  return (remaining < fade_duration) ? (float)remaining / (float)fade_duration
+                                     : 1.0f;
 }
 
 // Returns the current tint, after taking particle effects into account.
 mathfu::vec4 Particle::CurrentTint() const {
-  return base_tint_ *
-         (((duration_ - age_) < duration_of_fade_out_)
-              ? (float)(duration_ - age_) / (float)duration_of_fade_out_
-              : 1.0f);
+  return base_tint() * FadeFactor(DurationRemaining(), duration_of_fade_out());
 }
 
-void Particle::AdvanceFrame(TimeStep delta_time) { age_ += delta_time; }
+void Particle::AdvanceFrame(TimeStep delta_time) {
+  set_age(age() + delta_time);
+}
 
-bool Particle::IsFinished() const { return age_ >= duration_; }
+bool Particle::IsFinished() const { return age() >= duration(); }
 
-// Returns the current tint, after taking particle effects into account.
+// Returns the current scale, after taking particle effects into account.
 mathfu::vec3 Particle::CurrentScale() const {
-  return base_scale_ *
-         (((duration_ - age_) < duration_of_shrink_out_)
-              ? (float)(duration_ - age_) / (float)duration_of_shrink_out_
-              : 1.0f);
+  return base_scale() *
+         FadeFactor(DurationRemaining(), duration_of_shrink_out());
+}
+
+ParticleManager::ParticleManager()
+    : storage_(kParticleChannelStride * kParticleChannelCount +
+               kFloatsPerAlignment),
+      renderable_ids_(kMaxParticles),
+      num_particles_(0) {
+  // Find the first aligned float in storage_, and lay the channels out
+  // back to back from there.
+  const size_t misalignment = reinterpret_cast<size_t>(&storage_[0]) &
+                              (kParticleChannelAlignment - 1);
+  float* base = &storage_[(misalignment == 0)
+                              ? 0
+                              : (kParticleChannelAlignment - misalignment) /
+                                    sizeof(float)];
+  for (int i = 0; i < kParticleChannelCount; ++i) {
+    channels_[i] = base + i * kParticleChannelStride;
+  }
 }
 
 void ParticleManager::AdvanceFrame(TimeStep delta_time) {
-  for (auto it = particle_list_.begin(); it != particle_list_.end();) {
-    (*it)->AdvanceFrame(delta_time);
-    if ((*it)->IsFinished()) {
-      inactive_particle_list_.push_back(*it);
-      it = particle_list_.erase(it);
-    } else {
-      ++it;
+  float* age = channels_[kParticleAge];
+  const float* duration = channels_[kParticleDuration];
+
+  // Age everything in one linear pass.
+  for (size_t i = 0; i < num_particles_; ++i) {
+    age[i] += delta_time;
+  }
+
+  // Compact. Walk backwards so that each particle swapped into a hole has
+  // already been checked.
+  for (size_t i = num_particles_; i > 0; --i) {
+    if (age[i - 1] >= duration[i - 1]) {
+      SwapRemove(i - 1);
     }
   }
 }
 
-Particle* ParticleManager::CreateParticle() {
-  Particle* result;
-  if (inactive_particle_list_.size() > 0) {
-    result = inactive_particle_list_.back();
-    inactive_particle_list_.pop_back();
-  } else {
-    if (particle_list_.size() >= kMaxParticles) {
-      return nullptr;
-    }
-    result = new Particle();
+void ParticleManager::SwapRemove(size_t index) {
+  assert(index < num_particles_);
+  const size_t last = --num_particles_;
+  if (index == last) return;
+  for (int i = 0; i < kParticleChannelCount; ++i) {
+    channels_[i][index] = channels_[i][last];
+  }
+  renderable_ids_[index] = renderable_ids_[last];
+}
+
+Particle ParticleManager::CreateParticle() {
+  if (num_particles_ >= static_cast<size_t>(kMaxParticles)) {
+    return Particle();
   }
-  result->set_age(0);
-  particle_list_.push_back(result);
+  Particle result(this, num_particles_++);
+  result.reset();
   return result;
 }
 
-void ParticleManager::RemoveAllParticles() {
-  for (auto it = particle_list_.begin(); it != particle_list_.end();) {
-    inactive_particle_list_.push_back(*it);
-    it = particle_list_.erase(it);
+void ParticleManager::RemoveAllParticles() { num_particles_ = 0; }
+
+void ParticleManager::CalculateRenderDataScalar(size_t start, size_t end,
+                                                mathfu::mat4* world_matrices,
+                                                mathfu::vec4* tints) const {
+  for (size_t i = start; i < end; ++i) {
+    const Particle p = particle(i);
+    world_matrices[i] = p.CalculateMatrix();
+    tints[i] = p.CurrentTint();
+  }
+}
+
+#if defined(PARTICLES_USE_SIMD)
+// Transposes four per-particle component vectors (each lane is a different
+// particle) into one vector per particle, and writes them to `outputs`.
+static inline void StoreTransposed(simd4f x, simd4f y, simd4f z, simd4f w,
+                                   float* const outputs[4]) {
+  const simd4x4f lanes = simd4x4f_create(x, y, z, w);
+  simd4x4f per_particle;
+  simd4x4f_transpose(&lanes, &per_particle);
+  simd4f_ustore4(per_particle.x, outputs[0]);
+  simd4f_ustore4(per_particle.y, outputs[1]);
+  simd4f_ustore4(per_particle.z, outputs[2]);
+  simd4f_ustore4(per_particle.w, outputs[3]);
+}
+#endif  // defined(PARTICLES_USE_SIMD)
+
+void ParticleManager::CalculateRenderData(mathfu::mat4* world_matrices,
+                                          mathfu::vec4* tints) const {
+  size_t start = 0;
+#if defined(PARTICLES_USE_SIMD)
+  // Mirrors Particle::CalculateMatrix() and Particle::CurrentTint(), with the
+  // same operations in the same order, so results match the scalar path as
+  // long as neither is contracted to fused multiply-adds. This file is built
+  // with -ffp-contract=off for that.
+  // The translation-rotation-scale product is written out directly rather
+  // than multiplied, which can only differ in the sign of zero entries.
+  const simd4f half = simd4f_splat(0.5f);
+  const simd4f one = simd4f_splat(1.0f);
+  const simd4f two = simd4f_splat(2.0f);
+  const simd4f zero = simd4f_zero();
+  const float* age_channel = channels_[kParticleAge];
+  const float* duration_channel = channels_[kParticleDuration];
+  for (; start + 4 <= num_particles_; start += 4) {
+#define PARTICLE_LOAD(channel) \
+    simd4f_uload4(channels_[(channel)] + start)
+    const simd4f age = simd4f_uload4(age_channel + start);
+
+    simd4f position[3];
+    float half_angles[3][4];
+    for (int axis = 0; axis < 3; ++axis) {
+      const simd4f acceleration_term = simd4f_mul(
+          simd4f_mul(
+              simd4f_mul(PARTICLE_LOAD(kParticleAccelerationX + axis), half),
+              age),
+          age);
+      position[axis] = simd4f_add(
+          simd4f_add(PARTICLE_LOAD(kParticleBasePositionX + axis),
+                     simd4f_mul(PARTICLE_LOAD(kParticleBaseVelocityX + axis),
+                                age)),
+          acceleration_term);
+      const simd4f angle = simd4f_add(
+          PARTICLE_LOAD(kParticleBaseOrientationX + axis),
+          simd4f_mul(PARTICLE_LOAD(kParticleRotationalVelocityX + axis), age));
+      simd4f_ustore4(simd4f_mul(half, angle), half_angles[axis]);
+    }
+
+    // vectorial has no trigonometry, so the sines and cosines are computed
+    // per lane, exactly as Quat::FromEulerAngles() does.
+    float sines[3][4], cosines[3][4];
+    float fade[4], shrink[4];
+    for (int lane = 0; lane < 4; ++lane) {
+      for (int axis = 0; axis < 3; ++axis) {
+        sines[axis][lane] = sin(half_angles[axis][lane]);
+        cosines[axis][lane] = cos(half_angles[axis][lane]);
+      }
+      const size_t i = start + lane;
+      const TimeStep remaining = duration_channel[i] - age_channel[i];
+      fade[lane] =
+          FadeFactor(remaining, channels_[kParticleDurationOfFadeOut][i]);
+      shrink[lane] =
+          FadeFactor(remaining, channels_[kParticleDurationOfShrinkOut][i]);
+    }
+    const simd4f sx = simd4f_uload4(sines[0]), cx = simd4f_uload4(cosines[0]);
+    const simd4f sy = simd4f_uload4(sines[1]), cy = simd4f_uload4(cosines[1]);
+    const simd4f sz = simd4f_uload4(sines[2]), cz = simd4f_uload4(cosines[2]);
+
+    // Quaternion from Euler angles.
+    const simd4f qs = simd4f_add(simd4f_mul(simd4f_mul(cx, cy), cz),
+                                 simd4f_mul(simd4f_mul(sx, sy), sz));
+    const simd4f qx = simd4f_sub(simd4f_mul(simd4f_mul(sx, cy), cz),
+                                 simd4f_mul(simd4f_mul(cx, sy), sz));
+    const simd4f qy = simd4f_add(simd4f_mul(simd4f_mul(cx, sy), cz),
+                                 simd4f_mul(simd4f_mul(sx, cy), sz));
+    const simd4f qz = simd4f_sub(simd4f_mul(simd4f_mul(cx, cy), sz),
+                                 simd4f_mul(simd4f_mul(sx, sy), cz));
+
+    // Quaternion to column-major 3x3 rotation matrix.
+    const simd4f x2 = simd4f_mul(qx, qx), y2 = simd4f_mul(qy, qy),
+                 z2 = simd4f_mul(qz, qz);
+    const simd4f sxx = simd4f_mul(qs, qx), syy = simd4f_mul(qs, qy),
+                 szz = simd4f_mul(qs, qz);
+    const simd4f xz = simd4f_mul(qx, qz), yz = simd4f_mul(qy, qz),
+                 xy = simd4f_mul(qx, qy);
+    const simd4f rotation[9] = {
+        simd4f_sub(one, simd4f_mul(two, simd4f_add(y2, z2))),
+        simd4f_mul(two, simd4f_add(xy, szz)),
+        simd4f_mul(two, simd4f_sub(xz, syy)),
+        simd4f_mul(two, simd4f_sub(xy, szz)),
+        simd4f_sub(one, simd4f_mul(two, simd4f_add(x2, z2))),
+        simd4f_mul(two, simd4f_add(sxx, yz)),
+        simd4f_mul(two, simd4f_add(syy, xz)),
+        simd4f_mul(two, simd4f_sub(yz, sxx)),
+        simd4f_sub(one, simd4f_mul(two, simd4f_add(x2, y2)))};
+
+    // Columns 0-2 are the rotation scaled per axis, column 3 the position.
+    const simd4f fade_factor = simd4f_uload4(fade);
+    const simd4f shrink_factor = simd4f_uload4(shrink);
+    for (int column = 0; column < 3; ++column) {
+      const simd4f scale = simd4f_mul(
+          PARTICLE_LOAD(kParticleBaseScaleX + column), shrink_factor);
+      float* const outputs[4] = {
+          &world_matrices[start][column * 4],
+          &world_matrices[start + 1][column * 4],
+          &world_matrices[start + 2][column * 4],
+          &world_matrices[start + 3][column * 4]};
+      StoreTransposed(simd4f_mul(rotation[column * 3], scale),
+                      simd4f_mul(rotation[column * 3 + 1], scale),
+                      simd4f_mul(rotation[column * 3 + 2], scale), zero,
+                      outputs);
+    }
+    float* const translations[4] = {
+        &world_matrices[start][12], &world_matrices[start + 1][12],
+        &world_matrices[start + 2][12], &world_matrices[start + 3][12]};
+    StoreTransposed(position[0], position[1], position[2], one, translations);
+
+    float* const tint_outputs[4] = {&tints[start][0], &tints[start + 1][0],
+                                    &tints[start + 2][0],
+                                    &tints[start + 3][0]};
+    StoreTransposed(simd4f_mul(PARTICLE_LOAD(kParticleBaseTintX), fade_factor),
+                    simd4f_mul(PARTICLE_LOAD(kParticleBaseTintY), fade_factor),
+                    simd4f_mul(PARTICLE_LOAD(kParticleBaseTintZ), fade_factor),
+                    simd4f_mul(PARTICLE_LOAD(kParticleBaseTintW), fade_factor),
+                    tint_outputs);
+#undef PARTICLE_LOAD
   }
+#endif  // defined(PARTICLES_USE_SIMD)
+  // Whatever doesn't fill a whole SIMD batch takes the per-particle path.
+  CalculateRenderDataScalar(start, num_particles_, world_matrices, tints);
 }
 
 }  // pie_noon
@@ -17,16 +17,63 @@
 
 #include "common.h"
 #include "scene_description.h"
-#include <list>
+#include <vector>
 
 namespace fpl {
 namespace pie_noon {
 
 typedef float TimeStep;
 
+class ParticleManager;
+
+// Indices of the per-particle float streams held by ParticleManager.
+// Every vector quantity is split into one stream per component so that batch
+// updates can walk each stream linearly.
+enum ParticleChannel {
+  kParticleBasePositionX,
+  kParticleBasePositionY,
+  kParticleBasePositionZ,
+  kParticleBaseVelocityX,
+  kParticleBaseVelocityY,
+  kParticleBaseVelocityZ,
+  kParticleAccelerationX,
+  kParticleAccelerationY,
+  kParticleAccelerationZ,
+  kParticleBaseOrientationX,
+  kParticleBaseOrientationY,
+  kParticleBaseOrientationZ,
+  kParticleRotationalVelocityX,
+  kParticleRotationalVelocityY,
+  kParticleRotationalVelocityZ,
+  kParticleBaseScaleX,
+  kParticleBaseScaleY,
+  kParticleBaseScaleZ,
+  kParticleBaseTintX,
+  kParticleBaseTintY,
+  kParticleBaseTintZ,
+  kParticleBaseTintW,
+  kParticleDuration,
+  kParticleAge,
+  kParticleDurationOfFadeOut,
+  kParticleDurationOfShrinkOut,
+  kParticleChannelCount
+};
+
+// A view of a single particle stored inside a ParticleManager.
+// Particles are not objects in their own right; every accessor reads or
+// writes the manager's structure-of-arrays storage. A view is only valid
+// until the next call to ParticleManager::AdvanceFrame or
+// ParticleManager::RemoveAllParticles, since finished particles are
+// swap-removed and the remaining ones move around.
 class Particle {
  public:
-  Particle() { reset(); }
+  Particle() : manager_(nullptr), index_(0) {}
+  Particle(ParticleManager* manager, size_t index)
+      : manager_(manager), index_(index) {}
+
+  // Returns false for the view returned by a full ParticleManager.
+  bool valid() const { return manager_ != nullptr; }
+  size_t index() const { return index_; }
 
   void reset();
 
@@ -39,60 +86,65 @@ class Particle {
 
   void SetDurationRemaining(TimeStep duration);
 
-  mathfu::vec3 base_position() const { return base_position_; }
-
+  mathfu::vec3 base_position() const { return Vec3(kParticleBasePositionX); }
   void set_base_position(const mathfu::vec3& base_position) {
-    base_position_ = base_position;
+    SetVec3(kParticleBasePositionX, base_position);
   }
 
-  mathfu::vec3 base_velocity() const { return base_velocity_; }
+  mathfu::vec3 base_velocity() const { return Vec3(kParticleBaseVelocityX); }
   void set_base_velocity(const mathfu::vec3& base_velocity) {
-    base_velocity_ = base_velocity;
+    SetVec3(kParticleBaseVelocityX, base_velocity);
   }
 
-  mathfu::vec3 acceleration() const { return acceleration_; }
+  mathfu::vec3 acceleration() const { return Vec3(kParticleAccelerationX); }
   void set_acceleration(const mathfu::vec3& acceleration) {
-    acceleration_ = acceleration;
+    SetVec3(kParticleAccelerationX, acceleration);
   }
 
-  mathfu::vec3 base_orientation() const { return base_orientation_; }
+  mathfu::vec3 base_orientation() const {
+    return Vec3(kParticleBaseOrientationX);
+  }
   void set_base_orientation(const mathfu::vec3& base_orientation) {
-    base_orientation_ = base_orientation;
+    SetVec3(kParticleBaseOrientationX, base_orientation);
   }
 
-  mathfu::vec3 rotational_velocity() const { return rotational_velocity_; }
+  mathfu::vec3 rotational_velocity() const {
+    return Vec3(kParticleRotationalVelocityX);
+  }
   void set_rotational_velocity(const mathfu::vec3& rotational_velocity) {
-    rotational_velocity_ = rotational_velocity;
+    SetVec3(kParticleRotationalVelocityX, rotational_velocity);
   }
 
-  mathfu::vec4 base_tint() const { return base_tint_; }
-  void set_base_tint(const mathfu::vec4& base_tint) { base_tint_ = base_tint; }
+  mathfu::vec4 base_tint() const;
+  void set_base_tint(const mathfu::vec4& base_tint);
 
-  mathfu::vec3 base_scale() const { return base_scale_; }
+  mathfu::vec3 base_scale() const { return Vec3(kParticleBaseScaleX); }
   void set_base_scale(const mathfu::vec3& base_scale) {
-    base_scale_ = base_scale;
+    SetVec3(kParticleBaseScaleX, base_scale);
   }
 
-  TimeStep duration_of_fade_out() const { return duration_of_fade_out_; }
+  TimeStep duration_of_fade_out() const {
+    return Value(kParticleDurationOfFadeOut);
+  }
   void set_duration_of_fade_out(TimeStep duration_of_fade_out) {
-    duration_of_fade_out_ = duration_of_fade_out;
+    Value(kParticleDurationOfFadeOut) = duration_of_fade_out;
   }
 
-  TimeStep duration_of_shrink_out() const { return duration_of_shrink_out_; }
+  TimeStep duration_of_shrink_out() const {
+    return Value(kParticleDurationOfShrinkOut);
+  }
   void set_duration_of_shrink_out(TimeStep duration_of_shrink_out) {
-    duration_of_shrink_out_ = duration_of_shrink_out;
+    Value(kParticleDurationOfShrinkOut) = duration_of_shrink_out;
   }
 
-  uint16_t renderable_id() const { return renderable_id_; }
-  void set_renderable_id(uint16_t renderable_id) {
-    renderable_id_ = renderable_id;
-  }
+  uint16_t renderable_id() const;
+  void set_renderable_id(uint16_t renderable_id);
 
-  TimeStep duration() const { return duration_; }
-  void set_duration(TimeStep duration) { duration_ = duration; }
+  TimeStep duration() const { return Value(kParticleDuration); }
+  void set_duration(TimeStep duration) { Value(kParticleDuration) = duration; }
 
-  TimeStep age() const { return age_; }
-  void set_age(TimeStep age) { age_ = age; }
+  TimeStep age() const { return Value(kParticleAge); }
+  void set_age(TimeStep age) { Value(kParticleAge) = age; }
 
   // Generate the matrix we'll need to draw it:
   mathfu::mat4 CalculateMatrix() const;
@@ -101,55 +153,121 @@ class Particle {
   bool IsFinished() const;
 
  private:
-  mathfu::vec3 base_position_;
-  mathfu::vec3 base_velocity_;
-  mathfu::vec3 acceleration_;
-
-  // Expressed in Euler angles:
-  mathfu::vec3 base_orientation_;
-  mathfu::vec3 rotational_velocity_;
+  float& Value(ParticleChannel channel) const;
+  mathfu::vec3 Vec3(ParticleChannel first_channel) const;
+  void SetVec3(ParticleChannel first_channel, const mathfu::vec3& v);
 
-  mathfu::vec3 base_scale_;
-  mathfu::vec4 base_tint_;
-
-  // How long the particle will last, in milliseconds.
-  TimeStep duration_;
-
-  // How long the particle has been alive so far, in milliseconds
-  TimeStep age_;
-
-  // How long it will take the particle to fade or shrink away, when it reaches
-  // the end of its life span.  (In milliseconds)
-  TimeStep duration_of_fade_out_;
-  TimeStep duration_of_shrink_out_;
-
-  // the renderable ID we should use when drawing this particle.
-  uint16_t renderable_id_;
+  ParticleManager* manager_;
+  size_t index_;
 };
 
+// Owns every live particle in a fixed-capacity structure-of-arrays.
+// Each ParticleChannel is a separate 16-byte aligned float array, so
+// AdvanceFrame and other batch passes stream through memory linearly.
 class ParticleManager {
  public:
+  ParticleManager();
+
+  // Ages every particle and swap-removes the ones that have finished.
   void AdvanceFrame(TimeStep delta_time);
 
-  const std::list<Particle*>& get_particle_list() const {
-    return particle_list_;
+  // Number of live particles. Live particles occupy indices
+  // [0, num_particles()) of every channel.
+  size_t num_particles() const { return num_particles_; }
+
+  Particle particle(size_t index) {
+    assert(index < num_particles_);
+    return Particle(this, index);
+  }
+  // The returned view is const, so only the getters may be called on it.
+  const Particle particle(size_t index) const {
+    assert(index < num_particles_);
+    return Particle(const_cast<ParticleManager*>(this), index);
   }
 
-  // Returns a pointer to a new particle, ready to be populated.
-  // Note that this pointer is not guaranteed to be valid indefinitely!
-  // Also note that the initial state of the particle is undetermined, so
-  // users should either populate every field explicitly, or call
-  // Particle::reset().
-  Particle* CreateParticle();
+  // Returns a view of a new particle, reset to default values and ready to
+  // be populated. If no more particles can be spawned right now, the
+  // returned view is not valid().
+  Particle CreateParticle();
 
   // Removes all active particles.
   void RemoveAllParticles();
 
+  // Evaluates the world matrix and tint of every live particle at once.
+  // `world_matrices` and `tints` must each hold num_particles() entries.
+  // Produces the same values as calling Particle::CalculateMatrix() and
+  // Particle::CurrentTint() on each particle in turn, but walks the channels
+  // four particles at a time with SIMD where vectorial supports it.
+  void CalculateRenderData(mathfu::mat4* world_matrices,
+                           mathfu::vec4* tints) const;
+
+  // Raw access to a channel, for batch processing.
+  // Holds num_particles() valid entries.
+  float* channel(ParticleChannel channel) { return channels_[channel]; }
+  const float* channel(ParticleChannel channel) const {
+    return channels_[channel];
+  }
+  uint16_t* renderable_ids() { return &renderable_ids_[0]; }
+  const uint16_t* renderable_ids() const { return &renderable_ids_[0]; }
+
  private:
-  std::list<Particle*> particle_list_;
-  std::list<Particle*> inactive_particle_list_;
+  // Per-particle reference implementation of CalculateRenderData, for the
+  // particles in [start, end).
+  void CalculateRenderDataScalar(size_t start, size_t end,
+                                 mathfu::mat4* world_matrices,
+                                 mathfu::vec4* tints) const;
+
+  // Moves the last particle into `index`, shrinking the live range by one.
+  void SwapRemove(size_t index);
+
+  // Backing memory for all channels, over-allocated so every channel can be
+  // aligned.
+  std::vector<float> storage_;
+  float* channels_[kParticleChannelCount];
+  std::vector<uint16_t> renderable_ids_;
+  size_t num_particles_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParticleManager);
 };
 
+inline float& Particle::Value(ParticleChannel channel) const {
+  return manager_->channel(channel)[index_];
+}
+
+inline mathfu::vec3 Particle::Vec3(ParticleChannel first_channel) const {
+  return mathfu::vec3(
+      Value(first_channel),
+      Value(static_cast<ParticleChannel>(first_channel + 1)),
+      Value(static_cast<ParticleChannel>(first_channel + 2)));
+}
+
+inline void Particle::SetVec3(ParticleChannel first_channel,
+                              const mathfu::vec3& v) {
+  Value(first_channel) = v.x();
+  Value(static_cast<ParticleChannel>(first_channel + 1)) = v.y();
+  Value(static_cast<ParticleChannel>(first_channel + 2)) = v.z();
+}
+
+inline mathfu::vec4 Particle::base_tint() const {
+  return mathfu::vec4(Value(kParticleBaseTintX), Value(kParticleBaseTintY),
+                      Value(kParticleBaseTintZ), Value(kParticleBaseTintW));
+}
+
+inline void Particle::set_base_tint(const mathfu::vec4& base_tint) {
+  Value(kParticleBaseTintX) = base_tint.x();
+  Value(kParticleBaseTintY) = base_tint.y();
+  Value(kParticleBaseTintZ) = base_tint.z();
+  Value(kParticleBaseTintW) = base_tint.w();
+}
+
+inline uint16_t Particle::renderable_id() const {
+  return manager_->renderable_ids()[index_];
+}
+
+inline void Particle::set_renderable_id(uint16_t renderable_id) {
+  manager_->renderable_ids()[index_] = renderable_id;
+}
+
 }  // pie_noon
 }  // fpl
 #endif  // PARTICLES_H
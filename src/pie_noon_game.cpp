@@ -27,6 +27,7 @@
 #include "pie_noon_common_generated.h"
 #include "pie_noon_game.h"
 #include "pindrop/pindrop.h"
+#include "profiler.h"
 #include "timeline_generated.h"
 #include "touchscreen_controller.h"
 #include "utilities.h"
@@ -47,6 +48,9 @@ using mathfu::mat4;
   _snprintf_s(buffer, count, count, format, __VA_ARGS__)
 #endif  // _WIN32
 
+// Uncomment to log the RenderQueue's draw and bind counts every frame.
+// #define LOG_RENDER_QUEUE_STATS
+
 namespace fpl {
 namespace pie_noon {
 
@@ -96,6 +100,17 @@ static const Attribute kQuadMeshFormat[] = {kPosition3f, kTexCoord2f, kNormal3f,
 
 static const char kAssetsDir[] = "assets";
 
+// Order in which textures are loaded, highest first. The loading screen has
+// to be up before anything else, and the menus are what's shown next.
+static const int kLoadPriorityLoadingScreen = 2;
+static const int kLoadPriorityMenu = 1;
+static const int kLoadPriorityGame = 0;
+
+// Per frame limits on turning loaded textures into OpenGL textures, so that
+// a batch of textures finishing together doesn't stall a frame.
+static const int64_t kFinalizeBudgetMicroseconds = 4000;
+static const size_t kFinalizeBudgetBytes = 4 * 1024 * 1024;
+
 static const char kConfigFileName[] = "config.bin";
 
 #ifdef ANDROID_CARDBOARD
@@ -130,17 +145,21 @@ static inline const UiGroup* TitleScreenButtons(const Config& config) {
 /// appreciate if you left it in.
 static const char kVersion[] = "Pie Noon 1.2.0";
 
+static const char kProfileTraceFileName[] = "pie_noon_profile.json";
+
 PieNoonGame::PieNoonGame()
     : state_(kUninitialized),
       state_entry_time_(0),
       matman_(renderer_),
       cardboard_fronts_(RenderableId_Count, nullptr),
       cardboard_backs_(RenderableId_Count, nullptr),
+      cardboard_front_quads_(RenderableId_Count),
       stick_front_(nullptr),
       stick_back_(nullptr),
       shader_lit_textured_normal_(nullptr),
       shader_simple_shadow_(nullptr),
       shader_textured_(nullptr),
+      shader_textured_vertex_color_(nullptr),
       shader_grayscale_(nullptr),
       shadow_mat_(nullptr),
       prev_world_time_(0),
@@ -239,9 +258,11 @@ bool PieNoonGame::InitializeRenderer() {
 
 // Initializes 'vertices' at the specified position, aligned up-and-down.
 // 'vertices' must be an array of length kQuadNumVertices.
+// If 'quad' is non-null, it's given a copy of the positions and texture
+// coordinates.
 static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
                                const vec2& texture_coord_size,
-                               NormalMappedVertex* vertices) {
+                               NormalMappedVertex* vertices, BatchQuad* quad) {
   const float half_width = geo_size[0] * 0.5f;
   const vec3 bottom_left = offset + vec3(-half_width, 0.0f, 0.0f);
   const vec3 top_right = offset + vec3(half_width, geo_size[1], 0.0f);
@@ -263,15 +284,23 @@ static void CreateVerticalQuad(const vec3& offset, const vec2& geo_size,
 
   Mesh::ComputeNormalsTangents(vertices, &kQuadIndices[0], kQuadNumVertices,
                                kQuadNumIndices);
+
+  if (quad != nullptr) {
+    for (int i = 0; i < kQuadNumVertices; ++i) {
+      quad->pos[i] = vertices[i].pos;
+      quad->tc[i] = vertices[i].tc;
+    }
+  }
 }
 
 // Creates a mesh of a single quad (two triangles) vertically upright.
 // The quad's has x and y size determined by the size of the texture.
 // The quad is offset in (x,y,z) space by the 'offset' variable.
+// If 'quad' is non-null, it's given a CPU copy of the geometry, for batching.
 // Returns a mesh with the quad and texture, or nullptr if anything went wrong.
 Mesh* PieNoonGame::CreateVerticalQuadMesh(
     const flatbuffers::String* material_name, const vec3& offset,
-    const vec2& pixel_bounds, float pixel_to_world_scale) {
+    const vec2& pixel_bounds, float pixel_to_world_scale, BatchQuad* quad) {
   // Don't try to load obviously invalid materials. Suppresses error logs from
   // the material manager.
   if (material_name == nullptr || material_name->c_str()[0] == '\0')
@@ -293,7 +322,7 @@ Mesh* PieNoonGame::CreateVerticalQuadMesh(
 
   // Initialize a vertex array in the requested position.
   NormalMappedVertex vertices[kQuadNumVertices];
-  CreateVerticalQuad(offset, geo_size, texture_coord_size, vertices);
+  CreateVerticalQuad(offset, geo_size, texture_coord_size, vertices, quad);
 
   // Create mesh and add in quad indices.
   Mesh* mesh = new Mesh(vertices, kQuadNumVertices, sizeof(NormalMappedVertex),
@@ -316,11 +345,21 @@ bool PieNoonGame::InitializeRenderingAssets() {
     return false;
   }
 
-  // Force these textures to be queued up first, since we want to use them for
+  // Keep GPU-ready textures in our writable data directory, so that later
+  // runs don't have to decode and convert them again.
+  char* pref_path = SDL_GetPrefPath("Google", "PieNoon");
+  if (pref_path) {
+    matman_.set_texture_cache_directory(pref_path);
+    SDL_free(pref_path);
+  }
+
+  // Force these textures to be loaded first, since we want to use them for
   // the loading screen.
+  matman_.set_load_priority(kLoadPriorityLoadingScreen);
   matman_.LoadMaterial(config.loading_material()->c_str());
   matman_.LoadMaterial(config.loading_logo()->c_str());
   matman_.LoadMaterial(config.fade_material()->c_str());
+  matman_.set_load_priority(kLoadPriorityGame);
 
   // Create a mesh for the front and back of each cardboard cutout.
   const vec3 front_z_offset(0.0f, 0.0f, config.cardboard_front_z_offset());
@@ -341,11 +380,12 @@ bool PieNoonGame::InitializeRenderingAssets() {
 
     cardboard_fronts_[id] =
         CreateVerticalQuadMesh(renderable->cardboard_front(), front_offset,
-                               pixel_bounds, pixel_to_world_scale);
+                               pixel_bounds, pixel_to_world_scale,
+                               &cardboard_front_quads_[id]);
 
     cardboard_backs_[id] =
         CreateVerticalQuadMesh(renderable->cardboard_back(), back_offset,
-                               pixel_bounds, pixel_to_world_scale);
+                               pixel_bounds, pixel_to_world_scale, nullptr);
   }
 
   // We default to the invalid texture, so it has to exist.
@@ -361,10 +401,10 @@ bool PieNoonGame::InitializeRenderingAssets() {
                                config.stick_back_z_offset());
   stick_front_ = CreateVerticalQuadMesh(
       config.stick_front(), stick_front_offset, LoadVec2(config.stick_bounds()),
-      config.pixel_to_world_scale());
-  stick_back_ = CreateVerticalQuadMesh(config.stick_back(), stick_back_offset,
-                                       LoadVec2(config.stick_bounds()),
-                                       config.pixel_to_world_scale());
+      config.pixel_to_world_scale(), &stick_front_quad_);
+  stick_back_ = CreateVerticalQuadMesh(
+      config.stick_back(), stick_back_offset, LoadVec2(config.stick_bounds()),
+      config.pixel_to_world_scale(), &stick_back_quad_);
 
   // Load all shaders we use:
   shader_lit_textured_normal_ =
@@ -372,16 +412,25 @@ bool PieNoonGame::InitializeRenderingAssets() {
   shader_cardboard = matman_.LoadShader("shaders/cardboard");
   shader_simple_shadow_ = matman_.LoadShader("shaders/simple_shadow");
   shader_textured_ = matman_.LoadShader("shaders/textured");
+  shader_textured_vertex_color_ =
+      matman_.LoadShader("shaders/textured_vertex_color");
   shader_grayscale_ = matman_.LoadShader("shaders/grayscale");
   if (!(shader_lit_textured_normal_ && shader_cardboard &&
-        shader_simple_shadow_ && shader_textured_ && shader_grayscale_))
+        shader_simple_shadow_ && shader_textured_ &&
+        shader_textured_vertex_color_ && shader_grayscale_))
     return false;
 
+  // Billboards that share a texture are drawn in batches. The shadow shader
+  // works in world space already, so it can draw its own batches.
+  render_queue_.SetBatchShader(shader_textured_, shader_textured_vertex_color_);
+  render_queue_.SetBatchShader(shader_simple_shadow_, shader_simple_shadow_);
+
   // Load shadow material:
   shadow_mat_ = matman_.LoadMaterial("materials/floor_shadows.bin");
   if (!shadow_mat_) return false;
 
   // Load all the menu textures.
+  matman_.set_load_priority(kLoadPriorityMenu);
   gui_menu_.LoadAssets(TitleScreenButtons(config), &matman_);
   gui_menu_.LoadAssets(config.touchscreen_zones(), &matman_);
   gui_menu_.LoadAssets(config.pause_screen_buttons(), &matman_);
@@ -401,12 +450,14 @@ bool PieNoonGame::InitializeRenderingAssets() {
   gui_menu_.LoadAssets(config.msx_all_players_disconnected_screen_buttons(),
                        &matman_);
   gui_menu_.LoadAssets(config.game_modes_screen_buttons(), &matman_);
+  matman_.set_load_priority(kLoadPriorityGame);
+  gui_menu_.SetThreadPool(&game_state_.update_thread_pool());
   // Configure the full screen fader.
   full_screen_fader_.set_material(
       matman_.FindMaterial(config.fade_material()->c_str()));
   full_screen_fader_.set_shader(shader_textured_);
 
-  // Start the thread that actually loads all assets we requested above.
+  // Start the threads that actually load all assets we requested above.
   matman_.StartLoadingTextures();
 
   return true;
@@ -438,6 +489,7 @@ bool PieNoonGame::InitializeGameState() {
     SDL_LogError(SDL_LOG_CATEGORY_ERROR, "State machine is invalid.\n");
     return false;
   }
+  state_machine_table_.Compile(state_machine_def);
 
   for (int i = 0; i < ControlScheme::kDefinedControlSchemeCount; i++) {
     PlayerController* controller = new PlayerController();
@@ -468,7 +520,8 @@ bool PieNoonGame::InitializeGameState() {
     AiController* controller = new AiController();
     controller->Initialize(&game_state_, &config, i);
     game_state_.characters().push_back(std::unique_ptr<Character>(
-        new Character(i, controller, config, state_machine_def)));
+        new Character(i, controller, config, state_machine_def,
+                      &state_machine_table_)));
     AddController(controller);
     controller->Initialize(&game_state_, &config, i);
   }
@@ -525,6 +578,11 @@ bool PieNoonGame::Initialize(const char* const binary_directory) {
   if (!ChangeToUpstreamDir(binary_directory, kAssetsDir)) return false;
 
   if (!InitializeConfig()) return false;
+
+  // Entities update, and the font manager rasterizes glyphs, on one thread
+  // per core beyond the first. Started before any assets load, so the font
+  // prewarm can use it.
+  game_state_.SetUpdateThreads(0);
 #ifdef ANDROID_CARDBOARD
   if (!InitializeCardboardConfig()) return false;
 #endif
@@ -593,25 +651,71 @@ Mesh* PieNoonGame::GetCardboardFront(int renderable_id) {
                      : cardboard_fronts_[RenderableId_Invalid];
 }
 
-void PieNoonGame::RenderCardboard(const SceneDescription& scene,
-                                  const mat4& camera_transform) {
+// Returns the geometry of GetCardboardFront(renderable_id).
+const BatchQuad* PieNoonGame::GetCardboardFrontQuad(int renderable_id) const {
+  const bool is_valid_id = 0 <= renderable_id &&
+                           renderable_id < RenderableId_Count &&
+                           cardboard_fronts_[renderable_id] != nullptr;
+  return is_valid_id ? &cardboard_front_quads_[renderable_id]
+                     : &cardboard_front_quads_[RenderableId_Invalid];
+}
+
+// Draw order within one cardboard cutout, back-most first.
+enum CardboardLayer {
+  kCardboardLayerBack,
+  kCardboardLayerStick,
+  kCardboardLayerFront,
+};
+
+void PieNoonGame::QueueShadows(const SceneDescription& scene,
+                               const mat4& camera_transform) {
   const Config& config = GetConfig();
+  const vec3 camera_position = game_state_.camera().Position();
 
+  renderer_.model_view_projection() = camera_transform;
+  renderer_.light_pos() = scene.lights()[0];  // TODO: check amount of lights.
   for (size_t i = 0; i < scene.renderables().size(); ++i) {
     const auto& renderable = scene.renderables()[i];
-    const int id = renderable->id();
+    const int id = renderable.id();
+    if (!config.renderables()->Get(id)->shadow()) continue;
+
+    // The first texture of the shadow shader has to be that of the
+    // billboard.
+    Mesh* front = GetCardboardFront(id);
+    renderer_.model() = renderable.world_matrix();
+    const float depth =
+        (renderable.world_matrix().TranslationVector3D() - camera_position)
+            .LengthSquared();
+    render_queue_.Add(kRenderPassUnordered, depth, 0, shader_simple_shadow_,
+                      front, shadow_mat_, renderer_,
+                      front->GetMaterial(0)->textures()[0],
+                      GetCardboardFrontQuad(id));
+  }
+}
+
+void PieNoonGame::QueueCardboard(const SceneDescription& scene,
+                                 const mat4& camera_transform) {
+  const Config& config = GetConfig();
+  const vec3 camera_position = game_state_.camera().Position();
+
+  for (size_t i = 0; i < scene.renderables().size(); ++i) {
+    const auto& renderable = scene.renderables()[i];
+    const int id = renderable.id();
+    const float depth =
+        (renderable.world_matrix().TranslationVector3D() - camera_position)
+            .LengthSquared();
 
     // Set up vertex transformation into projection space.
-    const mat4 mvp = camera_transform * renderable->world_matrix();
+    const mat4 mvp = camera_transform * renderable.world_matrix();
     renderer_.model_view_projection() = mvp;
+    renderer_.model() = renderable.world_matrix();
 
     // Set the camera and light positions in object space.
-    const mat4 world_matrix_inverse = renderable->world_matrix().Inverse();
-    renderer_.camera_pos() =
-        world_matrix_inverse * game_state_.camera().Position();
+    const mat4 world_matrix_inverse = renderable.world_matrix().Inverse();
+    renderer_.camera_pos() = world_matrix_inverse * camera_position;
 
     // TODO: check amount of lights.
-    renderer_.light_pos() = world_matrix_inverse * (*scene.lights()[0]);
+    renderer_.light_pos() = world_matrix_inverse * scene.lights()[0];
 
     // The popsicle stick and cardboard back are always uncolored.
     renderer_.color() = mathfu::kOnes4f;
@@ -621,41 +725,43 @@ void PieNoonGame::RenderCardboard(const SceneDescription& scene,
     //
     // If we have a back, draw the back too, slightly offset.
     // The back is the *inside* of the cardboard, representing corrugation.
-    if (cardboard_backs_[id]) {
-      shader_cardboard->Set(renderer_);
-      cardboard_backs_[id]->Render(renderer_);
+    Mesh* back = cardboard_backs_[id];
+    if (back) {
+      render_queue_.Add(kRenderPassBlended, depth, kCardboardLayerBack,
+                        shader_cardboard, back, back->GetMaterial(0),
+                        renderer_);
     }
 
     // Draw the popsicle stick that props up the cardboard.
     if (config.renderables()->Get(id)->stick() && stick_front_ != nullptr &&
         stick_back_ != nullptr) {
-      shader_textured_->Set(renderer_);
-      stick_front_->Render(renderer_);
-      stick_back_->Render(renderer_);
+      render_queue_.Add(kRenderPassBlended, depth, kCardboardLayerStick,
+                        shader_textured_, stick_front_,
+                        stick_front_->GetMaterial(0), renderer_, nullptr,
+                        &stick_front_quad_);
+      render_queue_.Add(kRenderPassBlended, depth, kCardboardLayerStick,
+                        shader_textured_, stick_back_,
+                        stick_back_->GetMaterial(0), renderer_, nullptr,
+                        &stick_back_quad_);
     }
 
-    renderer_.color() = renderable->color();
-
-    if (config.renderables()->Get(id)->cardboard()) {
-      shader_cardboard->Set(renderer_);
-      shader_cardboard->SetUniform(
-          "ambient_material", LoadVec3(config.cardboard_ambient_material()));
-      shader_cardboard->SetUniform(
-          "diffuse_material", LoadVec3(config.cardboard_diffuse_material()));
-      shader_cardboard->SetUniform(
-          "specular_material", LoadVec3(config.cardboard_specular_material()));
-      shader_cardboard->SetUniform("shininess", config.cardboard_shininess());
-      shader_cardboard->SetUniform("normalmap_scale",
-                                   config.cardboard_normalmap_scale());
-    } else {
-      shader_textured_->Set(renderer_);
-    }
+    renderer_.color() = renderable.color();
+
+    // Cardboard is lit in object space, so only plain textured fronts can be
+    // batched.
+    const bool is_cardboard = config.renderables()->Get(id)->cardboard();
+    Shader* front_shader = is_cardboard ? shader_cardboard : shader_textured_;
     Mesh* front = GetCardboardFront(id);
-    front->Render(renderer_);
+    const BatchQuad* front_quad =
+        is_cardboard ? nullptr : GetCardboardFrontQuad(id);
+    render_queue_.Add(kRenderPassBlended, depth, kCardboardLayerFront,
+                      front_shader, front, front->GetMaterial(0), renderer_,
+                      nullptr, front_quad);
   }
 }
 
 void PieNoonGame::Render(const SceneDescription& scene) {
+  FPL_PROFILE_SCOPE("PieNoonGame::Render");
   if (game_state_.is_in_cardboard()) {
     RenderForCardboard(scene);
   } else {
@@ -739,30 +845,58 @@ void PieNoonGame::RenderScene(const SceneDescription& scene,
   const vec4 world_scale_bias(1.0f / (2.0f * ground_width), 1.0f / ground_depth,
                               0.5f, 0.0f);
 
+  // Queue shadows and cardboard for every Renderable, then draw them sorted
+  // to minimize shader and texture changes.
+  render_queue_.Clear();
+  render_queue_.set_view_projection(camera_transform);
+  QueueShadows(scene, camera_transform);
+  QueueCardboard(scene, camera_transform);
+  render_queue_.Sort();
+
   // Render shadows for all Renderables first, with depth testing off so
   // they blend properly.
   renderer_.DepthTest(false);
-  renderer_.model_view_projection() = camera_transform;
-  renderer_.light_pos() = *scene.lights()[0];  // TODO: check amount of lights.
   shader_simple_shadow_->SetUniform("world_scale_bias", world_scale_bias);
-  for (size_t i = 0; i < scene.renderables().size(); ++i) {
-    const auto& renderable = scene.renderables()[i];
-    const int id = renderable->id();
-    Mesh* front = GetCardboardFront(id);
-    if (config.renderables()->Get(id)->shadow()) {
-      renderer_.model() = renderable->world_matrix();
-      shader_simple_shadow_->Set(renderer_);
-      // The first texture of the shadow shader has to be that of the
-      // billboard.
-      shadow_mat_->textures()[0] = front->GetMaterial(0)->textures()[0];
-      shadow_mat_->Set(renderer_);
-      front->Render(renderer_, true);
-    }
-  }
+  render_queue_.Execute(kRenderPassUnordered, renderer_);
   renderer_.DepthTest(true);
 
+  // The cardboard material is the same for every Renderable, so upload it
+  // once rather than once per draw. Uniform values persist in the program.
+  shader_cardboard->SetUniform("ambient_material",
+                               LoadVec3(config.cardboard_ambient_material()));
+  shader_cardboard->SetUniform("diffuse_material",
+                               LoadVec3(config.cardboard_diffuse_material()));
+  shader_cardboard->SetUniform("specular_material",
+                               LoadVec3(config.cardboard_specular_material()));
+  shader_cardboard->SetUniform("shininess", config.cardboard_shininess());
+  shader_cardboard->SetUniform("normalmap_scale",
+                               config.cardboard_normalmap_scale());
+
   // Now render the Renderables normally, on top of the shadows.
-  RenderCardboard(scene, camera_transform);
+  render_queue_.Execute(kRenderPassBlended, renderer_);
+
+#ifdef LOG_RENDER_QUEUE_STATS
+  // Blended draws are sorted by depth first, so they only merge into batches
+  // when neighbors in that order happen to share a shader and texture.
+  static const char* kPassNames[] = {"unordered", "blended"};
+  for (int pass = 0; pass < kRenderPassCount; ++pass) {
+    const RenderQueueStats& stats =
+        render_queue_.stats(static_cast<RenderPass>(pass));
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "RenderQueue %s: %d draws, shader binds %d (was %d), "
+                "texture binds %d (was %d), %d batches of %d quads (%d bytes)",
+                kPassNames[pass], stats.draws, stats.shader_binds,
+                stats.shader_binds + stats.shader_binds_elided,
+                stats.texture_binds,
+                stats.texture_binds + stats.texture_binds_elided,
+                stats.batches, stats.batched_quads,
+                static_cast<int>(stats.batch_vertex_bytes));
+  }
+  SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+              "Uniforms this frame: %d uploaded, %d already current",
+              renderer_.uniform_stats().uploads,
+              renderer_.uniform_stats().uploads_skipped);
+#endif  // LOG_RENDER_QUEUE_STATS
 
   // Render any UI/HUD/Splash on top
   Render2DElements();
@@ -993,6 +1127,8 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
   }
   switch (state_) {
     case kLoadingInitialMaterials: {
+      // Finalize the materials that have been loaded thus far.
+      matman_.TryFinalize(kFinalizeBudgetMicroseconds, kFinalizeBudgetBytes);
       if (matman_.FindMaterial(config.loading_material()->c_str())
               ->textures()[0]
               ->id() &&
@@ -1010,7 +1146,11 @@ PieNoonState PieNoonGame::UpdatePieNoonState() {
       // When we initialized assets, we kicked off a thread to load all
       // textures. Here we check if those have finished loading.
       // We also leave the loading screen up for a minimum amount of time.
-      if (!Fading() && matman_.TryFinalize()
+      // Finalize even while fading, so loading keeps progressing.
+      const bool finalized =
+          matman_.TryFinalize(kFinalizeBudgetMicroseconds,
+                              kFinalizeBudgetBytes);
+      if (!Fading() && finalized
 #if !IMGUI_TEST
           && (time - state_entry_time_) > config.min_loading_time()
 #endif  // IMGUI_TEST
@@ -2237,6 +2377,7 @@ void PieNoonGame::SetupWaitingForPlayersMenu() {
 // and care about.  (Not all are connected to players, but we want
 // to keep them up to date so we can check their inputs as needed.)
 void PieNoonGame::UpdateControllers(WorldTime delta_time) {
+  FPL_PROFILE_SCOPE("PieNoonGame::UpdateControllers");
   for (size_t i = 0; i < active_controllers_.size(); i++) {
     if (active_controllers_[i].get() != nullptr) {
       active_controllers_[i]->AdvanceFrame(delta_time);
@@ -2380,6 +2521,30 @@ void PieNoonGame::Run() {
       SDL_Delay(min_update_time - delta_time);
       continue;
     }
+    FPL_PROFILE_SCOPE("Frame");
+
+    // Toggle profiling. Turning it off logs a summary, and writes a trace
+    // that chrome://tracing can load.
+    if (input_.GetButton(SDLK_F8).went_down()) {
+      if (ProfilingEnabled()) {
+        SetProfilingEnabled(false);
+        LogProfileSummary();
+        // The working directory may be read-only (e.g. the app bundle on
+        // iOS), so write the trace to our data directory instead.
+        char* pref_path = SDL_GetPrefPath("Google", "PieNoon");
+        if (pref_path) {
+          WriteProfileChromeTrace(
+              (std::string(pref_path) + kProfileTraceFileName).c_str());
+          SDL_free(pref_path);
+        } else {
+          SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                       "Can't write profile: no data directory\n");
+        }
+      } else {
+        ClearProfileSamples();
+        SetProfilingEnabled(true);
+      }
+    }
 
     // TODO: Can we move these to 'Render'?
     renderer_.AdvanceFrame(input_.minimized_);
@@ -2607,7 +2772,10 @@ void PieNoonGame::Run() {
         }
 
         // Update audio engine state.
-        audio_engine_.AdvanceFrame(world_time);
+        {
+          FPL_PROFILE_SCOPE("AudioEngine::AdvanceFrame");
+          audio_engine_.AdvanceFrame(world_time);
+        }
 
         // Issue draw calls for the 'scene'.
         if (state_ != kMultiscreenClient) {
@@ -2629,6 +2797,8 @@ void PieNoonGame::Run() {
         if (!fontman.FontLoaded()) {
           fontman.Open("fonts/NotoSansCJKjp-Bold.otf");
           fontman.SetRenderer(renderer_);
+          fontman.set_thread_pool(&game_state_.update_thread_pool());
+          gui::PrewarmTestGUI(fontman, renderer_.window_size());
         }
         gui::TestGUI(matman_, fontman, input_);
 #endif  // IMGUI_TEST
@@ -2706,16 +2876,14 @@ void PieNoonGame::Run() {
       }  // Fallthrough
 
       case kLoadingInitialMaterials:
-        // Finalize the materials that have been loaded thus far.
-        matman_.TryFinalize();
-
+        // UpdatePieNoonState() finalizes the materials loaded thus far.
         if (UpdatePieNoonStateAndTransition() == kFinished) {
           game_state_.Reset(GameState::kNoAnalytics);
         }
         break;
 
       case kTutorial: {
-        matman_.TryFinalize();
+        matman_.TryFinalize(kFinalizeBudgetMicroseconds, kFinalizeBudgetBytes);
 
         const bool should_transition =
             full_screen_fader_.Finished(world_time) && AnyControllerPresses();
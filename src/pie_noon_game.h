@@ -33,6 +33,7 @@
 #include "multiplayer_director.h"
 #include "pindrop/pindrop.h"
 #include "player_controller.h"
+#include "render_queue.h"
 #include "renderer.h"
 #include "scene_description.h"
 #include "touchscreen_button.h"
@@ -81,11 +82,13 @@ class PieNoonGame {
   bool InitializeRenderer();
   Mesh* CreateVerticalQuadMesh(const flatbuffers::String* material_name,
                                const vec3& offset, const vec2& pixel_bounds,
-                               float pixel_to_world_scale);
+                               float pixel_to_world_scale, BatchQuad* quad);
   bool InitializeRenderingAssets();
   bool InitializeGameState();
-  void RenderCardboard(const SceneDescription& scene,
-                       const mat4& camera_transform);
+  void QueueShadows(const SceneDescription& scene,
+                    const mat4& camera_transform);
+  void QueueCardboard(const SceneDescription& scene,
+                      const mat4& camera_transform);
   void Render(const SceneDescription& scene);
   void RenderForDefault(const SceneDescription& scene);
   void RenderForCardboard(const SceneDescription& scene);
@@ -104,6 +107,7 @@ class PieNoonGame {
   const Config& GetCardboardConfig() const;
   const CharacterStateMachineDef* GetStateMachine() const;
   Mesh* GetCardboardFront(int renderable_id);
+  const BatchQuad* GetCardboardFrontQuad(int renderable_id) const;
   PieNoonState UpdatePieNoonState();
   void TransitionToPieNoonState(PieNoonState next_state);
   PieNoonState UpdatePieNoonStateAndTransition();
@@ -190,15 +194,21 @@ class PieNoonGame {
   std::vector<Mesh*> cardboard_fronts_;
   std::vector<Mesh*> cardboard_backs_;
 
+  // Geometry of cardboard_fronts_, kept on the CPU for batching.
+  std::vector<BatchQuad> cardboard_front_quads_;
+
   // Rendering mesh for front and back of the stick that props cardboard.
   Mesh* stick_front_;
   Mesh* stick_back_;
+  BatchQuad stick_front_quad_;
+  BatchQuad stick_back_quad_;
 
   // Shaders we use.
   Shader* shader_cardboard;
   Shader* shader_lit_textured_normal_;
   Shader* shader_simple_shadow_;
   Shader* shader_textured_;
+  Shader* shader_textured_vertex_color_;
   Shader* shader_grayscale_;
 
   // Shadow material.
@@ -207,6 +217,9 @@ class PieNoonGame {
   // Hold state machine binary data.
   std::string state_machine_source_;
 
+  // Transitions of the state machine, compiled for the characters to follow.
+  CharacterStateMachineTable state_machine_table_;
+
   // Hold characters, pies, camera state.
   GameState game_state_;
 
@@ -233,6 +246,10 @@ class PieNoonGame {
   // code with a type-light structure. Recreated every frame.
   SceneDescription scene_;
 
+  // Sorted draw list for the scene. Rebuilt by RenderScene, but kept between
+  // frames to reuse its storage.
+  RenderQueue render_queue_;
+
   // World time of previous update. We use this to calculate the delta_time
   // of the current update. This value is tied to the real-world clock.
   // Note that it is distict from game_state_.time_, which is *not* tied to the
@@ -0,0 +1,294 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "pixel_convert.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FPL_PIXEL_CONVERT_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define FPL_PIXEL_CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+namespace fpl {
+
+// Luminance weights, summing to 256.
+static const int kLumaR = 77;
+static const int kLumaG = 150;
+static const int kLumaB = 29;
+
+// x / 255, rounded to nearest, for x in [0, 255 * 255].
+static inline uint8_t DivideBy255(int x) {
+  x += 128;
+  return static_cast<uint8_t>((x + (x >> 8)) >> 8);
+}
+
+void ConvertRGBA8888To5551Scalar(const uint8_t *src, size_t num_pixels,
+                                 uint16_t *dst) {
+  for (size_t i = 0; i < num_pixels; i++) {
+    auto c = &src[i * 4];
+    dst[i] = ((c[0] >> 3) << 11) | ((c[1] >> 3) << 6) | ((c[2] >> 3) << 1) |
+             ((c[3] >> 7) << 0);
+  }
+}
+
+void ConvertRGB888To565Scalar(const uint8_t *src, size_t num_pixels,
+                              uint16_t *dst) {
+  for (size_t i = 0; i < num_pixels; i++) {
+    auto c = &src[i * 3];
+    dst[i] = ((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | ((c[2] >> 3) << 0);
+  }
+}
+
+void ConvertRGBA8888ToLuminanceScalar(const uint8_t *src, size_t num_pixels,
+                                      uint8_t *dst) {
+  for (size_t i = 0; i < num_pixels; i++) {
+    auto c = &src[i * 4];
+    dst[i] = static_cast<uint8_t>(
+        (c[0] * kLumaR + c[1] * kLumaG + c[2] * kLumaB + 128) >> 8);
+  }
+}
+
+void PremultiplyAlphaScalar(const uint8_t *src, size_t num_pixels,
+                            uint8_t *dst) {
+  for (size_t i = 0; i < num_pixels; i++) {
+    auto c = &src[i * 4];
+    auto d = &dst[i * 4];
+    const int alpha = c[3];
+    d[0] = DivideBy255(c[0] * alpha);
+    d[1] = DivideBy255(c[1] * alpha);
+    d[2] = DivideBy255(c[2] * alpha);
+    d[3] = static_cast<uint8_t>(alpha);
+  }
+}
+
+#if defined(FPL_PIXEL_CONVERT_SSE2)
+
+// Packs the low 16 bits of each 32 bit lane of `a` then `b`. packs_epi32
+// saturates signed values, so sign extend the low halves first.
+static inline __m128i PackLow16(__m128i a, __m128i b) {
+  a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+  b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+  return _mm_packs_epi32(a, b);
+}
+
+// Each 32 bit lane holds a pixel with R in the low byte.
+static inline __m128i Pack5551(__m128i p) {
+  const __m128i r = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8);
+  const __m128i g =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF800)), 5);
+  const __m128i b =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF80000)), 18);
+  const __m128i a = _mm_srli_epi32(p, 31);
+  return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+
+static inline __m128i Pack565(__m128i p) {
+  const __m128i r = _mm_slli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF8)), 8);
+  const __m128i g =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xFC00)), 5);
+  const __m128i b =
+      _mm_srli_epi32(_mm_and_si128(p, _mm_set1_epi32(0xF80000)), 19);
+  return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+// Loads 4 RGB pixels into the low 3 bytes of each 32 bit lane. Reads 16
+// bytes, 4 more than the pixels take up.
+static inline __m128i LoadRGB4(const uint8_t *src) {
+  const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+  // Pixel k starts at byte 3 * k, and has to move to byte 4 * k.
+  const __m128i lane0 = _mm_set_epi32(0, 0, 0, 0xFFFFFF);
+  const __m128i lane1 = _mm_set_epi32(0, 0, 0xFFFFFF, 0);
+  const __m128i lane2 = _mm_set_epi32(0, 0xFFFFFF, 0, 0);
+  const __m128i lane3 = _mm_set_epi32(0xFFFFFF, 0, 0, 0);
+  return _mm_or_si128(
+      _mm_or_si128(_mm_and_si128(p, lane0),
+                   _mm_and_si128(_mm_slli_si128(p, 1), lane1)),
+      _mm_or_si128(_mm_and_si128(_mm_slli_si128(p, 2), lane2),
+                   _mm_and_si128(_mm_slli_si128(p, 3), lane3)));
+}
+
+// Each 32 bit lane holds a pixel. Returns luminance in each lane.
+static inline __m128i Luminance(__m128i p) {
+  // Products and sums stay below 65536, so 16 bit multiplies in the low half
+  // of each lane are enough; the high halves stay zero.
+  const __m128i byte_mask = _mm_set1_epi32(0xFF);
+  const __m128i r = _mm_and_si128(p, byte_mask);
+  const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), byte_mask);
+  const __m128i b = _mm_and_si128(_mm_srli_epi32(p, 16), byte_mask);
+  __m128i sum = _mm_mullo_epi16(r, _mm_set1_epi32(kLumaR));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(g, _mm_set1_epi32(kLumaG)));
+  sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi32(kLumaB)));
+  sum = _mm_add_epi16(sum, _mm_set1_epi32(128));
+  return _mm_srli_epi32(sum, 8);
+}
+
+// Premultiplies 2 pixels, unpacked to 16 bits per channel.
+static inline __m128i Premultiply2(__m128i c) {
+  __m128i alpha = _mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3));
+  alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3, 3, 3, 3));
+  // Multiply alpha itself by 255, which DivideBy255 maps back to alpha.
+  const __m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+  alpha = _mm_or_si128(_mm_andnot_si128(alpha_lanes, alpha),
+                       _mm_and_si128(alpha_lanes, _mm_set1_epi16(255)));
+  __m128i x = _mm_add_epi16(_mm_mullo_epi16(c, alpha), _mm_set1_epi16(128));
+  x = _mm_add_epi16(x, _mm_srli_epi16(x, 8));
+  return _mm_srli_epi16(x, 8);
+}
+
+void ConvertRGBA8888To5551(const uint8_t *src, size_t num_pixels,
+                           uint16_t *dst) {
+  size_t i = 0;
+  for (; i + 8 <= num_pixels; i += 8) {
+    const __m128i a =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+    const __m128i b =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4 + 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     PackLow16(Pack5551(a), Pack5551(b)));
+  }
+  ConvertRGBA8888To5551Scalar(src + i * 4, num_pixels - i, dst + i);
+}
+
+void ConvertRGB888To565(const uint8_t *src, size_t num_pixels,
+                        uint16_t *dst) {
+  size_t i = 0;
+  // The second LoadRGB4 reads 4 bytes past the 8th pixel, so leave at least
+  // two pixels to the scalar tail.
+  for (; i + 10 <= num_pixels; i += 8) {
+    const __m128i a = LoadRGB4(src + i * 3);
+    const __m128i b = LoadRGB4(src + i * 3 + 12);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     PackLow16(Pack565(a), Pack565(b)));
+  }
+  ConvertRGB888To565Scalar(src + i * 3, num_pixels - i, dst + i);
+}
+
+void ConvertRGBA8888ToLuminance(const uint8_t *src, size_t num_pixels,
+                                uint8_t *dst) {
+  size_t i = 0;
+  for (; i + 16 <= num_pixels; i += 16) {
+    auto p = reinterpret_cast<const __m128i *>(src + i * 4);
+    const __m128i low = _mm_packs_epi32(Luminance(_mm_loadu_si128(p)),
+                                        Luminance(_mm_loadu_si128(p + 1)));
+    const __m128i high = _mm_packs_epi32(Luminance(_mm_loadu_si128(p + 2)),
+                                         Luminance(_mm_loadu_si128(p + 3)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm_packus_epi16(low, high));
+  }
+  ConvertRGBA8888ToLuminanceScalar(src + i * 4, num_pixels - i, dst + i);
+}
+
+void PremultiplyAlpha(const uint8_t *src, size_t num_pixels, uint8_t *dst) {
+  const __m128i zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 4 <= num_pixels; i += 4) {
+    const __m128i p =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+    const __m128i low = Premultiply2(_mm_unpacklo_epi8(p, zero));
+    const __m128i high = Premultiply2(_mm_unpackhi_epi8(p, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4),
+                     _mm_packus_epi16(low, high));
+  }
+  PremultiplyAlphaScalar(src + i * 4, num_pixels - i, dst + i * 4);
+}
+
+#elif defined(FPL_PIXEL_CONVERT_NEON)
+
+void ConvertRGBA8888To5551(const uint8_t *src, size_t num_pixels,
+                           uint16_t *dst) {
+  size_t i = 0;
+  for (; i + 8 <= num_pixels; i += 8) {
+    const uint8x8x4_t c = vld4_u8(src + i * 4);
+    uint16x8_t x = vshlq_n_u16(vmovl_u8(vshr_n_u8(c.val[0], 3)), 11);
+    x = vorrq_u16(x, vshlq_n_u16(vmovl_u8(vshr_n_u8(c.val[1], 3)), 6));
+    x = vorrq_u16(x, vshlq_n_u16(vmovl_u8(vshr_n_u8(c.val[2], 3)), 1));
+    x = vorrq_u16(x, vmovl_u8(vshr_n_u8(c.val[3], 7)));
+    vst1q_u16(dst + i, x);
+  }
+  ConvertRGBA8888To5551Scalar(src + i * 4, num_pixels - i, dst + i);
+}
+
+void ConvertRGB888To565(const uint8_t *src, size_t num_pixels,
+                        uint16_t *dst) {
+  size_t i = 0;
+  for (; i + 8 <= num_pixels; i += 8) {
+    const uint8x8x3_t c = vld3_u8(src + i * 3);
+    uint16x8_t x = vshlq_n_u16(vmovl_u8(vshr_n_u8(c.val[0], 3)), 11);
+    x = vorrq_u16(x, vshlq_n_u16(vmovl_u8(vshr_n_u8(c.val[1], 2)), 5));
+    x = vorrq_u16(x, vmovl_u8(vshr_n_u8(c.val[2], 3)));
+    vst1q_u16(dst + i, x);
+  }
+  ConvertRGB888To565Scalar(src + i * 3, num_pixels - i, dst + i);
+}
+
+void ConvertRGBA8888ToLuminance(const uint8_t *src, size_t num_pixels,
+                                uint8_t *dst) {
+  size_t i = 0;
+  for (; i + 8 <= num_pixels; i += 8) {
+    const uint8x8x4_t c = vld4_u8(src + i * 4);
+    uint16x8_t sum = vmull_u8(c.val[0], vdup_n_u8(kLumaR));
+    sum = vmlal_u8(sum, c.val[1], vdup_n_u8(kLumaG));
+    sum = vmlal_u8(sum, c.val[2], vdup_n_u8(kLumaB));
+    // Rounding shift, i.e. (sum + 128) >> 8.
+    vst1_u8(dst + i, vrshrn_n_u16(sum, 8));
+  }
+  ConvertRGBA8888ToLuminanceScalar(src + i * 4, num_pixels - i, dst + i);
+}
+
+// Same rounding as DivideBy255.
+static inline uint8x8_t MultiplyDivideBy255(uint8x8_t a, uint8x8_t b) {
+  const uint16x8_t x = vmull_u8(a, b);
+  return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+void PremultiplyAlpha(const uint8_t *src, size_t num_pixels, uint8_t *dst) {
+  size_t i = 0;
+  for (; i + 8 <= num_pixels; i += 8) {
+    uint8x8x4_t c = vld4_u8(src + i * 4);
+    c.val[0] = MultiplyDivideBy255(c.val[0], c.val[3]);
+    c.val[1] = MultiplyDivideBy255(c.val[1], c.val[3]);
+    c.val[2] = MultiplyDivideBy255(c.val[2], c.val[3]);
+    vst4_u8(dst + i * 4, c);
+  }
+  PremultiplyAlphaScalar(src + i * 4, num_pixels - i, dst + i * 4);
+}
+
+#else  // No SIMD.
+
+void ConvertRGBA8888To5551(const uint8_t *src, size_t num_pixels,
+                           uint16_t *dst) {
+  ConvertRGBA8888To5551Scalar(src, num_pixels, dst);
+}
+
+void ConvertRGB888To565(const uint8_t *src, size_t num_pixels,
+                        uint16_t *dst) {
+  ConvertRGB888To565Scalar(src, num_pixels, dst);
+}
+
+void ConvertRGBA8888ToLuminance(const uint8_t *src, size_t num_pixels,
+                                uint8_t *dst) {
+  ConvertRGBA8888ToLuminanceScalar(src, num_pixels, dst);
+}
+
+void PremultiplyAlpha(const uint8_t *src, size_t num_pixels, uint8_t *dst) {
+  PremultiplyAlphaScalar(src, num_pixels, dst);
+}
+
+#endif  // FPL_PIXEL_CONVERT_SSE2
+
+}  // namespace fpl
@@ -0,0 +1,49 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_PIXEL_CONVERT_H
+#define FPL_PIXEL_CONVERT_H
+
+namespace fpl {
+
+// Pixel format conversions for texture data. Each converts `num_pixels`
+// pixels from `src` into `dst`, which the caller allocates. They use SSE2 or
+// NEON when compiled for it, and produce exactly the same output as the
+// *Scalar versions, which are the reference implementations.
+
+// RGBA 8888 to the layout of GL_UNSIGNED_SHORT_5_5_5_1.
+void ConvertRGBA8888To5551(const uint8_t *src, size_t num_pixels,
+                           uint16_t *dst);
+// RGB 888 to the layout of GL_UNSIGNED_SHORT_5_6_5.
+void ConvertRGB888To565(const uint8_t *src, size_t num_pixels, uint16_t *dst);
+// RGBA 8888 to 8 bit luminance, (77 R + 150 G + 29 B) / 256, rounded.
+// Alpha is ignored.
+void ConvertRGBA8888ToLuminance(const uint8_t *src, size_t num_pixels,
+                                uint8_t *dst);
+// Multiplies R, G and B of RGBA 8888 pixels by alpha / 255, rounded.
+// `dst` may be `src`.
+void PremultiplyAlpha(const uint8_t *src, size_t num_pixels, uint8_t *dst);
+
+void ConvertRGBA8888To5551Scalar(const uint8_t *src, size_t num_pixels,
+                                 uint16_t *dst);
+void ConvertRGB888To565Scalar(const uint8_t *src, size_t num_pixels,
+                              uint16_t *dst);
+void ConvertRGBA8888ToLuminanceScalar(const uint8_t *src, size_t num_pixels,
+                                      uint8_t *dst);
+void PremultiplyAlphaScalar(const uint8_t *src, size_t num_pixels,
+                            uint8_t *dst);
+
+}  // namespace fpl
+
+#endif  // FPL_PIXEL_CONVERT_H
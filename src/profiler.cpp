@@ -0,0 +1,162 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "profiler.h"
+#include "SDL_thread.h"
+
+namespace fpl {
+
+SDL_atomic_t g_profiling_enabled = {0};
+
+struct ProfileSample {
+  const char* name;
+  ProfileTime start;
+  ProfileTime end;
+};
+
+// The samples recorded by one thread. Only that thread writes to it.
+struct ThreadSamples {
+  int thread_index;
+  // Samples ever recorded. The latest is samples[(count - 1) %
+  // kProfileSamplesPerThread].
+  unsigned int count;
+  ProfileSample samples[kProfileSamplesPerThread];
+};
+
+// Created the first time profiling is turned on. They live until the program
+// exits, since threads may still refer to them.
+static SDL_TLSID g_thread_samples_id = 0;
+static ThreadSamples* g_thread_samples[kProfileMaxThreads];
+static int g_num_threads = 0;
+static SDL_SpinLock g_threads_lock = 0;
+
+static ThreadSamples* CurrentThreadSamples() {
+  ThreadSamples* samples =
+      static_cast<ThreadSamples*>(SDL_TLSGet(g_thread_samples_id));
+  if (samples) return samples;
+
+  SDL_AtomicLock(&g_threads_lock);
+  if (g_num_threads < kProfileMaxThreads) {
+    samples = new ThreadSamples();
+    samples->thread_index = g_num_threads;
+    samples->count = 0;
+    g_thread_samples[g_num_threads++] = samples;
+  }
+  SDL_AtomicUnlock(&g_threads_lock);
+  if (samples) SDL_TLSSet(g_thread_samples_id, samples, nullptr);
+  return samples;
+}
+
+// Calls `function` on each sample still in the ring buffers, with the index
+// of the thread that recorded it.
+template <typename Function>
+static void ForEachSample(const Function& function) {
+  for (int i = 0; i < g_num_threads; ++i) {
+    const ThreadSamples& thread = *g_thread_samples[i];
+    const unsigned int num_samples = std::min(
+        thread.count, static_cast<unsigned int>(kProfileSamplesPerThread));
+    for (unsigned int j = thread.count - num_samples; j != thread.count; ++j) {
+      function(thread.thread_index,
+               thread.samples[j % kProfileSamplesPerThread]);
+    }
+  }
+}
+
+void SetProfilingEnabled(bool enabled) {
+  if (enabled && g_thread_samples_id == 0) {
+    g_thread_samples_id = SDL_TLSCreate();
+  }
+  SDL_AtomicSet(&g_profiling_enabled, enabled ? 1 : 0);
+}
+
+void RecordProfileSample(const char* name, ProfileTime start, ProfileTime end) {
+  ThreadSamples* thread = CurrentThreadSamples();
+  if (!thread) return;
+  ProfileSample& sample =
+      thread->samples[thread->count % kProfileSamplesPerThread];
+  sample.name = name;
+  sample.start = start;
+  sample.end = end;
+  thread->count++;
+}
+
+void ClearProfileSamples() {
+  for (int i = 0; i < g_num_threads; ++i) {
+    g_thread_samples[i]->count = 0;
+  }
+}
+
+bool WriteProfileChromeTrace(const char* file_name) {
+  FILE* file = fopen(file_name, "w");
+  if (!file) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Can't write profile to %s\n",
+                 file_name);
+    return false;
+  }
+
+  ProfileTime first_start = static_cast<ProfileTime>(-1);
+  ForEachSample([&](int, const ProfileSample& sample) {
+    first_start = std::min(first_start, sample.start);
+  });
+
+  // Chrome wants times in microseconds.
+  const double microseconds_per_tick =
+      1e6 / static_cast<double>(SDL_GetPerformanceFrequency());
+  const char* separator = "";
+  fprintf(file, "{\"traceEvents\":[\n");
+  ForEachSample([&](int thread_index, const ProfileSample& sample) {
+    fprintf(file,
+            "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f}",
+            separator, sample.name, thread_index,
+            (sample.start - first_start) * microseconds_per_tick,
+            (sample.end - sample.start) * microseconds_per_tick);
+    separator = ",\n";
+  });
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0;
+}
+
+void LogProfileSummary() {
+  // Durations of each phase, keyed by name. Different string literals with
+  // the same text count as the same phase.
+  std::vector<std::pair<const char*, std::vector<ProfileTime>>> phases;
+  ForEachSample([&](int, const ProfileSample& sample) {
+    auto phase = phases.begin();
+    while (phase != phases.end() && strcmp(phase->first, sample.name) != 0) {
+      ++phase;
+    }
+    if (phase == phases.end()) {
+      phases.push_back(std::make_pair(sample.name, std::vector<ProfileTime>()));
+      phase = phases.end() - 1;
+    }
+    phase->second.push_back(sample.end - sample.start);
+  });
+
+  const double milliseconds_per_tick =
+      1e3 / static_cast<double>(SDL_GetPerformanceFrequency());
+  for (auto it = phases.begin(); it != phases.end(); ++it) {
+    std::vector<ProfileTime>& durations = it->second;
+    std::sort(durations.begin(), durations.end());
+    const size_t count = durations.size();
+    SDL_LogInfo(SDL_LOG_CATEGORY_APPLICATION,
+                "%-28s %6d samples  p50 %8.3f ms  p99 %8.3f ms\n", it->first,
+                static_cast<int>(count),
+                durations[count / 2] * milliseconds_per_tick,
+                durations[(count * 99) / 100] * milliseconds_per_tick);
+  }
+}
+
+}  // namespace fpl
@@ -0,0 +1,98 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_PROFILER_H
+#define FPL_PROFILER_H
+
+#include "SDL_atomic.h"
+#include "SDL_timer.h"
+
+namespace fpl {
+
+// Times named phases of the frame, such as the game update or rendering.
+// Put FPL_PROFILE_SCOPE("Name") at the top of a block to time the rest of
+// the block. While profiling is off, which is the default, that costs one
+// branch.
+// Each thread records into its own ring buffer, which keeps the most recent
+// kProfileSamplesPerThread samples. Those can be written out as a Chrome
+// trace (load it in chrome://tracing), or summarized in the log.
+
+typedef Uint64 ProfileTime;
+
+static const int kProfileSamplesPerThread = 8192;
+// Threads beyond this many don't record anything.
+static const int kProfileMaxThreads = 16;
+
+// Nonzero while recording. Atomic, since worker threads read it too.
+extern SDL_atomic_t g_profiling_enabled;
+
+inline bool ProfilingEnabled() {
+  return SDL_AtomicGet(&g_profiling_enabled) != 0;
+}
+
+// Turns recording on or off. Call it between frames, while no other thread
+// is recording.
+void SetProfilingEnabled(bool enabled);
+
+// Records that the phase called `name` ran from `start` to `end`, on the
+// calling thread. `name` must outlive the recorded samples.
+void RecordProfileSample(const char* name, ProfileTime start, ProfileTime end);
+
+// Forgets every recorded sample. Like the two functions below, call it
+// while no other thread is recording.
+void ClearProfileSamples();
+
+// Writes the recorded samples to `file_name` in Chrome's trace event format.
+// Returns false if the file can't be written.
+bool WriteProfileChromeTrace(const char* file_name);
+
+// Logs the median and 99th percentile duration of each phase, over the
+// samples still in the ring buffers.
+void LogProfileSummary();
+
+// Records the time from its creation to its destruction, if profiling was
+// on when it was created.
+class ProfileScope {
+ public:
+  explicit ProfileScope(const char* name)
+      : name_(name),
+        start_(ProfilingEnabled() ? SDL_GetPerformanceCounter() : 0) {}
+  ~ProfileScope() {
+    if (start_) RecordProfileSample(name_, start_, SDL_GetPerformanceCounter());
+  }
+
+  // Ends the current phase and starts the next one, called `name`, so that a
+  // function can be split into phases without a block around each.
+  void Next(const char* name) {
+    if (start_) {
+      const ProfileTime now = SDL_GetPerformanceCounter();
+      RecordProfileSample(name_, start_, now);
+      start_ = now;
+    }
+    name_ = name;
+  }
+
+ private:
+  const char* name_;
+  ProfileTime start_;
+};
+
+#define FPL_PROFILE_SCOPE_VARIABLE2(line) profile_scope_##line
+#define FPL_PROFILE_SCOPE_VARIABLE(line) FPL_PROFILE_SCOPE_VARIABLE2(line)
+#define FPL_PROFILE_SCOPE(name) \
+  ::fpl::ProfileScope FPL_PROFILE_SCOPE_VARIABLE(__LINE__)(name)
+
+}  // namespace fpl
+
+#endif  // FPL_PROFILER_H
@@ -0,0 +1,62 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_RANDOM_GENERATOR_H_
+#define PIE_NOON_RANDOM_GENERATOR_H_
+
+#include <cstdint>
+#include <random>
+#include "mathfu/glsl_mappings.h"
+
+namespace fpl {
+namespace pie_noon {
+
+// Random numbers with the same distributions as mathfu::Random and
+// mathfu::RandomInRange, but from a generator of their own instead of rand().
+// Two generators with the same seed give the same numbers, and generators
+// on different threads don't share any state.
+class RandomGenerator {
+ public:
+  explicit RandomGenerator(uint32_t seed = 1) : engine_(seed) {}
+
+  void Seed(uint32_t seed) { engine_.seed(seed); }
+
+  // Returns a number greater than or equal to 0 and less than 1.
+  float Random() {
+    return static_cast<float>(engine_() >> 8) * (1.0f / (1 << 24));
+  }
+
+  // Returns a number between range_start and range_end, rounded towards zero
+  // for integer types, as mathfu::RandomInRange does.
+  template <class T>
+  T InRange(T range_start, T range_end) {
+    return static_cast<T>(range_start + (range_end - range_start) * Random());
+  }
+
+  mathfu::vec3 InRange(const mathfu::vec3& range_start,
+                       const mathfu::vec3& range_end) {
+    const float x = InRange(range_start.x(), range_end.x());
+    const float y = InRange(range_start.y(), range_end.y());
+    const float z = InRange(range_start.z(), range_end.z());
+    return mathfu::vec3(x, y, z);
+  }
+
+ private:
+  std::mt19937 engine_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_RANDOM_GENERATOR_H_
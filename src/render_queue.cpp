@@ -0,0 +1,290 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "render_queue.h"
+#include "renderer.h"
+
+namespace fpl {
+
+// Sort key layout, from the most significant bit:
+//   kRenderPassUnordered: pass:2 | program:8 | texture:16 | depth:32 | 0:6
+//   kRenderPassBlended:   pass:2 | ~depth:32 | layer:2 | program:8 |
+//                         texture:16 | 0:4
+// Program and texture ids are truncated, so distinct ids may share a bucket.
+// That only costs an occasional extra bind; it never changes correctness.
+static const int kPassShift = 62;
+
+// Indices are 16-bit, so a batch can address at most this many quads.
+static const size_t kMaxQuadsPerBatch = 0x10000 / 4;
+
+// Maps a float to an unsigned int that sorts in the same order.
+static uint32_t SortableFloatBits(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+uint64_t RenderQueue::SortKey(RenderPass pass, float depth, int layer,
+                              GLuint program, GLuint texture) {
+  assert(0 <= layer && layer < 4);
+  const uint64_t depth_bits = SortableFloatBits(depth);
+  const uint64_t program_bits = program & 0xFF;
+  const uint64_t texture_bits = texture & 0xFFFF;
+  uint64_t key = static_cast<uint64_t>(pass) << kPassShift;
+  if (pass == kRenderPassBlended) {
+    key |= (~depth_bits & 0xFFFFFFFFu) << 30;
+    key |= static_cast<uint64_t>(layer) << 28;
+    key |= program_bits << 20;
+    key |= texture_bits << 4;
+  } else {
+    key |= program_bits << 54;
+    key |= texture_bits << 38;
+    key |= depth_bits << 6;
+  }
+  return key;
+}
+
+RenderPass RenderQueue::KeyPass(uint64_t key) {
+  return static_cast<RenderPass>(key >> kPassShift);
+}
+
+void RenderQueue::SetBatchShader(Shader *shader, Shader *batch_shader) {
+  for (auto it = batch_shaders_.begin(); it != batch_shaders_.end(); ++it) {
+    if (it->first == shader) {
+      it->second = batch_shader;
+      return;
+    }
+  }
+  batch_shaders_.push_back(std::make_pair(shader, batch_shader));
+}
+
+void RenderQueue::Clear() {
+  // Keeps capacity, so a steady-state frame doesn't allocate.
+  commands_.clear();
+  sorted_.clear();
+  for (int pass = 0; pass < kRenderPassCount; ++pass) {
+    stats_[pass] = RenderQueueStats();
+  }
+}
+
+void RenderQueue::Add(RenderPass pass, float depth, int layer, Shader *shader,
+                      Mesh *mesh, Material *material, const Renderer &renderer,
+                      const Texture *first_texture, const BatchQuad *quad) {
+  assert(shader && mesh && material);
+  Command command;
+  command.shader = shader;
+  command.mesh = mesh;
+  command.material = material;
+  command.first_texture = first_texture;
+  command.quad = quad;
+  command.model_view_projection = renderer.model_view_projection();
+  command.model = renderer.model();
+  command.color = renderer.color();
+  command.light_pos = renderer.light_pos();
+  command.camera_pos = renderer.camera_pos();
+
+  const Texture *texture =
+      first_texture ? first_texture
+                    : (material->textures().empty() ? nullptr
+                                                    : material->textures()[0]);
+  SortEntry entry;
+  entry.key = SortKey(pass, depth, layer, shader->program(),
+                      texture ? texture->id() : 0);
+  entry.index = commands_.size();
+  sorted_.push_back(entry);
+  commands_.push_back(command);
+}
+
+void RenderQueue::Sort() { std::sort(sorted_.begin(), sorted_.end()); }
+
+Shader *RenderQueue::BatchShader(const Shader *shader) const {
+  for (auto it = batch_shaders_.begin(); it != batch_shaders_.end(); ++it) {
+    if (it->first == shader) return it->second;
+  }
+  return nullptr;
+}
+
+bool RenderQueue::CanBatch(const Command &first, const Command &next) {
+  return next.quad != nullptr && next.shader == first.shader &&
+         next.material == first.material &&
+         next.first_texture == first.first_texture;
+}
+
+// Returns the end of the run of draws, starting at `begin`, that are merged
+// into one batch, and the shader to draw it with. A run of one isn't a batch.
+std::vector<RenderQueue::SortEntry>::const_iterator RenderQueue::BatchRunEnd(
+    std::vector<SortEntry>::const_iterator begin, RenderPass pass,
+    Shader **batch_shader) const {
+  const Command &command = commands_[begin->index];
+  auto end = begin + 1;
+  *batch_shader = command.quad ? BatchShader(command.shader) : nullptr;
+  if (*batch_shader) {
+    while (end != sorted_.cend() && KeyPass(end->key) == pass &&
+           CanBatch(command, commands_[end->index])) {
+      ++end;
+    }
+  }
+  return end;
+}
+
+void RenderQueue::BindShader(Shader *shader, Renderer &renderer,
+                             BoundState *bound, RenderQueueStats *stats) {
+  if (shader != bound->shader) {
+    shader->Set(renderer);
+    bound->shader = shader;
+    stats->shader_binds++;
+  } else {
+    shader->UpdateUniforms(renderer);
+    stats->shader_binds_elided++;
+  }
+}
+
+// Equivalent to Material::Set, minus redundant texture binds.
+void RenderQueue::BindMaterial(const Command &command, Renderer &renderer,
+                               BoundState *bound, RenderQueueStats *stats) {
+  const Material &material = *command.material;
+  renderer.SetBlendMode(static_cast<BlendMode>(material.blend_mode()));
+  const size_t num_textures = std::min(
+      material.textures().size(), static_cast<size_t>(kMaxTexturesPerShader));
+  for (size_t i = 0; i < num_textures; ++i) {
+    const Texture *texture = (i == 0 && command.first_texture)
+                                 ? command.first_texture
+                                 : material.textures()[i];
+    if (bound->texture_known[i] && bound->textures[i] == texture->id()) {
+      stats->texture_binds_elided++;
+      continue;
+    }
+    texture->Set(i);
+    bound->textures[i] = texture->id();
+    bound->texture_known[i] = true;
+    stats->texture_binds++;
+  }
+}
+
+void RenderQueue::DrawBatch(std::vector<SortEntry>::const_iterator begin,
+                            std::vector<SortEntry>::const_iterator end,
+                            Shader *batch_shader, Renderer &renderer,
+                            BoundState *bound, RenderQueueStats *stats) {
+  static const Attribute kBatchFormat[] = {kPosition3f, kTexCoord2f, kColor4f,
+                                           kEND};
+  static const unsigned short kQuadIndices[] = {0, 1, 2, 2, 1, 3};
+
+  const Command &first = commands_[begin->index];
+  renderer.model_view_projection() = view_projection_;
+  renderer.model() = mat4::Identity();
+  renderer.color() = mathfu::kOnes4f;
+  renderer.light_pos() = first.light_pos;
+  renderer.camera_pos() = first.camera_pos;
+  BindShader(batch_shader, renderer, bound, stats);
+  BindMaterial(first, renderer, bound, stats);
+
+  while (begin != end) {
+    const size_t num_quads =
+        std::min(static_cast<size_t>(end - begin), kMaxQuadsPerBatch);
+
+    // Bake each quad's transform and tint into its vertices.
+    batch_vertices_.resize(num_quads * 4);
+    for (size_t q = 0; q < num_quads; ++q, ++begin) {
+      const Command &command = commands_[begin->index];
+      const vec4_packed color(command.color);
+      for (int corner = 0; corner < 4; ++corner) {
+        BatchVertex &vertex = batch_vertices_[q * 4 + corner];
+        vertex.pos = command.model * vec3(command.quad->pos[corner]);
+        vertex.tc = command.quad->tc[corner];
+        vertex.color = color;
+      }
+    }
+
+    // The index pattern only depends on the number of quads, so it only
+    // needs extending when a batch is bigger than any before it.
+    for (size_t q = batch_indices_.size() / 6; q < num_quads; ++q) {
+      for (int i = 0; i < 6; ++i) {
+        batch_indices_.push_back(
+            static_cast<unsigned short>(q * 4 + kQuadIndices[i]));
+      }
+    }
+
+    Mesh::RenderArray(GL_TRIANGLES, static_cast<int>(num_quads * 6),
+                      kBatchFormat, sizeof(BatchVertex),
+                      reinterpret_cast<const char *>(&batch_vertices_[0]),
+                      &batch_indices_[0]);
+    stats->draws++;
+    stats->batches++;
+    stats->batched_quads += static_cast<int>(num_quads);
+    stats->batch_vertex_bytes += num_quads * 4 * sizeof(BatchVertex);
+  }
+}
+
+void RenderQueue::Execute(RenderPass pass, Renderer &renderer) {
+  // State set outside the queue is unknown, so every pass starts by binding
+  // its first shader and textures.
+  BoundState bound;
+  RenderQueueStats *stats = &stats_[pass];
+
+  for (auto it = sorted_.cbegin(); it != sorted_.cend();) {
+    if (KeyPass(it->key) != pass) {
+      ++it;
+      continue;
+    }
+    const Command &command = commands_[it->index];
+
+    // Find the run of following draws that can be merged with this one.
+    Shader *batch_shader;
+    auto run_end = BatchRunEnd(it, pass, &batch_shader);
+    if (run_end - it > 1) {
+      DrawBatch(it, run_end, batch_shader, renderer, &bound, stats);
+      it = run_end;
+      continue;
+    }
+
+    renderer.model_view_projection() = command.model_view_projection;
+    renderer.model() = command.model;
+    renderer.color() = command.color;
+    renderer.light_pos() = command.light_pos;
+    renderer.camera_pos() = command.camera_pos;
+    BindShader(command.shader, renderer, &bound, stats);
+    BindMaterial(command, renderer, &bound, stats);
+    command.mesh->Render(renderer, true);
+    stats->draws++;
+    ++it;
+  }
+}
+
+RenderQueueStats RenderQueue::PlanDraws(RenderPass pass) const {
+  RenderQueueStats stats;
+  for (auto it = sorted_.cbegin(); it != sorted_.cend();) {
+    if (KeyPass(it->key) != pass) {
+      ++it;
+      continue;
+    }
+    Shader *batch_shader;
+    const auto run_end = BatchRunEnd(it, pass, &batch_shader);
+    const size_t num_quads = run_end - it;
+    if (num_quads > 1) {
+      const int num_batches = static_cast<int>(
+          (num_quads + kMaxQuadsPerBatch - 1) / kMaxQuadsPerBatch);
+      stats.draws += num_batches;
+      stats.batches += num_batches;
+      stats.batched_quads += static_cast<int>(num_quads);
+      stats.batch_vertex_bytes += num_quads * 4 * sizeof(BatchVertex);
+    } else {
+      stats.draws++;
+    }
+    it = run_end;
+  }
+  return stats;
+}
+
+}  // namespace fpl
@@ -0,0 +1,208 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_RENDER_QUEUE_H
+#define FPL_RENDER_QUEUE_H
+
+#include "material.h"
+#include "mesh.h"
+#include "shader.h"
+
+namespace fpl {
+
+class Renderer;
+
+// Draws are grouped by pass. Each pass sorts its draws differently.
+enum RenderPass {
+  // Draws whose result doesn't depend on their order, such as shadows that
+  // all blend the same color onto the ground. Sorted by shader, then texture,
+  // then front-to-back, to minimize state changes.
+  kRenderPassUnordered,
+  // Alpha blended draws. Sorted back-to-front. Draws at the same depth are
+  // kept in layer order, and only then grouped by shader and texture.
+  kRenderPassBlended,
+
+  kRenderPassCount  // Must be at end.
+};
+
+// CPU-side copy of a four vertex quad mesh, with the same corner order and
+// index pattern as the Mesh it describes. Draws given one of these may be
+// merged into a batch by RenderQueue.
+struct BatchQuad {
+  vec3_packed pos[4];
+  vec2_packed tc[4];
+};
+
+// What RenderQueue::Execute() did for one pass since the last
+// RenderQueue::Clear(). The "elided" counts are binds that drawing each
+// command on its own would have issued, but that were skipped because the
+// state was already current. So binds + elided is the submission-order cost.
+struct RenderQueueStats {
+  RenderQueueStats()
+      : draws(0),
+        shader_binds(0),
+        shader_binds_elided(0),
+        texture_binds(0),
+        texture_binds_elided(0),
+        batches(0),
+        batched_quads(0),
+        batch_vertex_bytes(0) {}
+
+  // Number of glDrawElements calls, counting each batch as one.
+  int draws;
+  int shader_binds;
+  int shader_binds_elided;
+  int texture_binds;
+  int texture_binds_elided;
+  // Number of draws that were batches, and the draws merged into them.
+  int batches;
+  int batched_quads;
+  // Vertex data built on the CPU and sent to GL for batches.
+  size_t batch_vertex_bytes;
+};
+
+// Collects the draws for a frame, then issues them sorted by a key built
+// from (pass, shader, texture, depth), skipping glUseProgram and
+// glBindTexture calls whose state is already current.
+// Only meshes with a single material are supported, since the material is
+// applied by the queue rather than by Mesh::Render.
+//
+// Runs of adjacent draws (in sorted order) that share a shader and textures
+// and were given a BatchQuad are merged into a single draw: their quads are
+// transformed to world space and tinted on the CPU, and drawn with the batch
+// shader registered for their shader.
+class RenderQueue {
+ public:
+  RenderQueue() : view_projection_(mat4::Identity()) {}
+
+  // Draws using `shader` may be batched, and drawn with `batch_shader`
+  // instead. `batch_shader` is given world space positions in aPosition,
+  // aTexCoord, and the draw's color in aColor. It's set up with the view
+  // projection as model_view_projection, an identity model matrix and
+  // an opaque white color. `batch_shader` may be `shader` itself, if those
+  // inputs give the same result.
+  void SetBatchShader(Shader *shader, Shader *batch_shader);
+
+  // The camera transform used for batched draws.
+  void set_view_projection(const mat4 &view_projection) {
+    view_projection_ = view_projection;
+  }
+
+  // Removes all queued draws and resets stats().
+  void Clear();
+
+  // Queues `mesh` to be drawn with `shader` and `material`, using the standard
+  // uniform values currently held in `renderer`.
+  // `depth` is the distance (or any monotonic function of it) from the
+  // camera. `layer` orders draws with equal depth in kRenderPassBlended,
+  // lowest first, and must be less than 4.
+  // If `first_texture` is non-null, it replaces the material's first texture.
+  // If `quad` is non-null, `mesh` is that quad, and renderer.model() is its
+  // world matrix, so the draw may be batched. `quad` must outlive Execute().
+  void Add(RenderPass pass, float depth, int layer, Shader *shader,
+           Mesh *mesh, Material *material, const Renderer &renderer,
+           const Texture *first_texture = nullptr,
+           const BatchQuad *quad = nullptr);
+
+  // Sorts the queued draws. Must be called after the last Add() and before
+  // the first Execute().
+  void Sort();
+
+  // Issues every queued draw in `pass`, in sorted order. Global state that
+  // isn't part of a draw (depth test, per-shader constants) should be set
+  // by the caller before each pass.
+  void Execute(RenderPass pass, Renderer &renderer);
+
+  // Returns the draws, batches, batched quads and batch vertex bytes that
+  // Execute(pass) would count for the draws queued now, leaving the bind
+  // counts zero. Doesn't touch GL. Must be called after Sort().
+  RenderQueueStats PlanDraws(RenderPass pass) const;
+
+  const RenderQueueStats &stats(RenderPass pass) const { return stats_[pass]; }
+
+ private:
+  struct Command {
+    Shader *shader;
+    Mesh *mesh;
+    Material *material;
+    const Texture *first_texture;
+    const BatchQuad *quad;
+    mat4 model_view_projection;
+    mat4 model;
+    vec4 color;
+    vec3 light_pos;
+    vec3 camera_pos;
+  };
+
+  struct SortEntry {
+    uint64_t key;
+    size_t index;
+    bool operator<(const SortEntry &other) const {
+      return key < other.key || (key == other.key && index < other.index);
+    }
+  };
+
+  // One vertex of a batch.
+  struct BatchVertex {
+    vec3_packed pos;
+    vec2_packed tc;
+    // Float, like the color uniform of unbatched draws, so tints outside
+    // [0, 1] survive batching unchanged.
+    vec4_packed color;
+  };
+
+  // GL state set by the queue during one Execute() call.
+  struct BoundState {
+    BoundState() : shader(nullptr) {
+      for (int i = 0; i < kMaxTexturesPerShader; ++i) texture_known[i] = false;
+    }
+    const Shader *shader;
+    GLuint textures[kMaxTexturesPerShader];
+    bool texture_known[kMaxTexturesPerShader];
+  };
+
+  Shader *BatchShader(const Shader *shader) const;
+  static bool CanBatch(const Command &first, const Command &next);
+  std::vector<SortEntry>::const_iterator BatchRunEnd(
+      std::vector<SortEntry>::const_iterator begin, RenderPass pass,
+      Shader **batch_shader) const;
+  void BindShader(Shader *shader, Renderer &renderer, BoundState *bound,
+                  RenderQueueStats *stats);
+  void BindMaterial(const Command &command, Renderer &renderer,
+                    BoundState *bound, RenderQueueStats *stats);
+  void DrawBatch(std::vector<SortEntry>::const_iterator begin,
+                 std::vector<SortEntry>::const_iterator end,
+                 Shader *batch_shader, Renderer &renderer, BoundState *bound,
+                 RenderQueueStats *stats);
+
+  static uint64_t SortKey(RenderPass pass, float depth, int layer,
+                          GLuint program, GLuint texture);
+  static RenderPass KeyPass(uint64_t key);
+
+  std::vector<Command> commands_;
+  std::vector<SortEntry> sorted_;
+  RenderQueueStats stats_[kRenderPassCount];
+
+  // Pairs of (shader, batch shader).
+  std::vector<std::pair<Shader *, Shader *>> batch_shaders_;
+  mat4 view_projection_;
+
+  // Scratch buffers for building batches, kept to reuse their storage.
+  std::vector<BatchVertex> batch_vertices_;
+  std::vector<unsigned short> batch_indices_;
+};
+
+}  // namespace fpl
+
+#endif  // FPL_RENDER_QUEUE_H
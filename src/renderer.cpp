@@ -13,7 +13,9 @@
 // limitations under the License.
 
 #include "precompiled.h"
+#include "pixel_convert.h"
 #include "renderer.h"
+#include "texture_cache.h"
 #include "utilities.h"
 
 #include "webp/decode.h"
@@ -158,6 +160,7 @@ void Renderer::AdvanceFrame(bool minimized) {
   GL_CALL(glViewport(0, 0, window_size_.x(), window_size_.y()));
 #endif
   DepthTest(true);
+  uniform_stats_ = UniformStats();
 }
 
 void Renderer::ShutDown() {
@@ -223,7 +226,7 @@ Shader *Renderer::CompileAndLinkShader(const char *vs_source,
       GLint status;
       GL_CALL(glGetProgramiv(program, GL_LINK_STATUS, &status));
       if (status == GL_TRUE) {
-        auto shader = new Shader(program, vs, ps);
+        auto shader = new Shader(program, vs, ps, &uniform_stats_);
         GL_CALL(glUseProgram(program));
         shader->InitializeUniforms();
         return shader;
@@ -243,23 +246,21 @@ Shader *Renderer::CompileAndLinkShader(const char *vs_source,
 uint16_t *Renderer::Convert8888To5551(const uint8_t *buffer,
                                       const vec2i &size) {
   auto buffer16 = new uint16_t[size.x() * size.y()];
-  for (int i = 0; i < size.x() * size.y(); i++) {
-    auto c = &buffer[i * 4];
-    buffer16[i] = ((c[0] >> 3) << 11) | ((c[1] >> 3) << 6) |
-                  ((c[2] >> 3) << 1) | ((c[3] >> 7) << 0);
-  }
+  ConvertRGBA8888To5551(buffer, size.x() * size.y(), buffer16);
   return buffer16;
 }
 
 uint16_t *Renderer::Convert888To565(const uint8_t *buffer, const vec2i &size) {
   auto buffer16 = new uint16_t[size.x() * size.y()];
-  for (int i = 0; i < size.x() * size.y(); i++) {
-    auto c = &buffer[i * 3];
-    buffer16[i] = ((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | ((c[2] >> 3) << 0);
-  }
+  ConvertRGB888To565(buffer, size.x() * size.y(), buffer16);
   return buffer16;
 }
 
+uint16_t *Renderer::ConversionBuffer(const vec2i &size) {
+  conversion_buffer_.resize(size.x() * size.y());
+  return &conversion_buffer_[0];
+}
+
 GLuint Renderer::CreateTexture(const uint8_t *buffer, const vec2i &size,
                                bool has_alpha, TextureFormat desired) {
   int area = size.x() * size.y();
@@ -269,26 +270,16 @@ GLuint Renderer::CreateTexture(const uint8_t *buffer, const vec2i &size,
                  size.y());
     return 0;
   }
-  // TODO: support default args for mipmap/wrap/trilinear
-  GLuint texture_id;
-  GL_CALL(glGenTextures(1, &texture_id));
-  GL_CALL(glActiveTexture(GL_TEXTURE0));
-  GL_CALL(glBindTexture(GL_TEXTURE_2D, texture_id));
-  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
-  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
-  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-  GL_CALL(
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                      GL_LINEAR_MIPMAP_NEAREST /*GL_LINEAR_MIPMAP_LINEAR*/));
+  GLuint texture_id = GenerateTexture();
   if (desired == kFormatAuto) desired = has_alpha ? kFormat5551 : kFormat565;
   switch (desired) {
     case kFormat5551: {
       assert(has_alpha);
       if (use_16bpp_) {
-        auto buffer16 = Convert8888To5551(buffer, size);
+        auto buffer16 = ConversionBuffer(size);
+        ConvertRGBA8888To5551(buffer, area, buffer16);
         GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x(), size.y(), 0,
                              GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, buffer16));
-        delete[] buffer16;
       } else {
         // Fallback to 8888
         GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size.x(), size.y(), 0,
@@ -299,10 +290,10 @@ GLuint Renderer::CreateTexture(const uint8_t *buffer, const vec2i &size,
     case kFormat565: {
       assert(!has_alpha);
       if (use_16bpp_) {
-        auto buffer16 = Convert888To565(buffer, size);
+        auto buffer16 = ConversionBuffer(size);
+        ConvertRGB888To565(buffer, area, buffer16);
         GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x(), size.y(), 0,
                              GL_RGB, GL_UNSIGNED_SHORT_5_6_5, buffer16));
-        delete[] buffer16;
       } else {
         // Fallback to 888
         GL_CALL(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size.x(), size.y(), 0,
@@ -335,6 +326,44 @@ GLuint Renderer::CreateTexture(const uint8_t *buffer, const vec2i &size,
   return texture_id;
 }
 
+GLuint Renderer::CreateTexture(const GpuTexture &texture) {
+  // Same check as above. GpuTexture already skips such textures.
+  const vec2i size = texture.size();
+  int area = size.x() * size.y();
+  if (area & (area - 1)) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+                 "CreateTexture: not power of two in size: (%d,%d)", size.x(),
+                 size.y());
+    return 0;
+  }
+  GLuint texture_id = GenerateTexture();
+  // The small mip levels have rows that aren't 4 byte aligned.
+  GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  for (int i = 0; i < texture.num_levels(); i++) {
+    const GpuTexture::Level &level = texture.level(i);
+    GL_CALL(glTexImage2D(GL_TEXTURE_2D, i, texture.format(), level.size.x(),
+                         level.size.y(), 0, texture.format(), texture.type(),
+                         level.data));
+  }
+  GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+  return texture_id;
+}
+
+GLuint Renderer::GenerateTexture() {
+  // TODO: support default args for mipmap/wrap/trilinear
+  GLuint texture_id;
+  GL_CALL(glGenTextures(1, &texture_id));
+  GL_CALL(glActiveTexture(GL_TEXTURE0));
+  GL_CALL(glBindTexture(GL_TEXTURE_2D, texture_id));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+  GL_CALL(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CALL(
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                      GL_LINEAR_MIPMAP_NEAREST /*GL_LINEAR_MIPMAP_LINEAR*/));
+  return texture_id;
+}
+
 uint8_t *Renderer::UnpackTGA(const void *tga_buf, vec2i *dimensions,
                              bool *has_alpha) {
   struct TGA {
@@ -402,25 +431,32 @@ uint8_t *Renderer::LoadAndUnpackTexture(const char *filename, vec2i *dimensions,
                                         bool *has_alpha) {
   std::string file;
   if (LoadFile(filename, &file)) {
-    std::string ext = filename;
-    size_t ext_pos = ext.find_last_of(".");
-    if (ext_pos != std::string::npos) ext = ext.substr(ext_pos + 1);
-    if (ext == "tga") {
-      auto buf = UnpackTGA(file.c_str(), dimensions, has_alpha);
-      if (!buf) last_error() = std::string("TGA format problem: ") + filename;
-      return buf;
-    } else if (ext == "webp") {
-      auto buf = UnpackWebP(file.c_str(), file.length(), dimensions, has_alpha);
-      if (!buf) last_error() = std::string("WebP format problem: ") + filename;
-      return buf;
-    } else {
-      last_error() =
-          std::string("Can\'t figure out file type from extension: ") +
-          filename;
-      return nullptr;
+    return UnpackTexture(filename, file, dimensions, has_alpha);
+  }
+  SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Couldn\'t load: %s", filename);
+  return nullptr;
+}
+
+uint8_t *Renderer::UnpackTexture(const char *filename, const std::string &file,
+                                 vec2i *dimensions, bool *has_alpha) {
+  std::string ext = filename;
+  size_t ext_pos = ext.find_last_of(".");
+  if (ext_pos != std::string::npos) ext = ext.substr(ext_pos + 1);
+  if (ext == "tga") {
+    auto buf = UnpackTGA(file.c_str(), dimensions, has_alpha);
+    if (!buf) {
+      SDL_LogError(SDL_LOG_CATEGORY_ERROR, "TGA format problem: %s", filename);
+    }
+    return buf;
+  } else if (ext == "webp") {
+    auto buf = UnpackWebP(file.c_str(), file.length(), dimensions, has_alpha);
+    if (!buf) {
+      SDL_LogError(SDL_LOG_CATEGORY_ERROR, "WebP format problem: %s", filename);
     }
+    return buf;
   }
-  last_error() = std::string("Couldn\'t load: ") + filename;
+  SDL_LogError(SDL_LOG_CATEGORY_ERROR,
+               "Can\'t figure out file type from extension: %s", filename);
   return nullptr;
 }
 
@@ -26,6 +26,8 @@
 
 namespace fpl {
 
+class GpuTexture;
+
 // The core of the rendering system. Deals with setting up and shutting down
 // the window + OpenGL context (based on SDL), and creating/using resources
 // such as shaders, textures, and geometry.
@@ -56,6 +58,10 @@ class Renderer {
   GLuint CreateTexture(const uint8_t *buffer, const vec2i &size, bool has_alpha,
                        TextureFormat desired = kFormatAuto);
 
+  // Create a texture from one that's already in its final format, uploading
+  // each of its mip levels as is.
+  GLuint CreateTexture(const GpuTexture &texture);
+
   // Unpacks a memory buffer containing a TGA format file.
   // May only be uncompressed RGB or RGBA data, Y-flipped or not.
   // Returns RGBA array of returned dimensions or nullptr if the
@@ -72,13 +78,20 @@ class Renderer {
 
   // Loads the file in filename, and then unpacks the file format (supports
   // TGA and WebP).
-  // last_error() contains more information if nullptr is returned.
+  // This is called by several loader threads at once, so rather than using
+  // last_error(), it logs the reason if nullptr is returned.
   // You must free() the returned pointer when done.
   uint8_t *LoadAndUnpackTexture(const char *filename, vec2i *dimensions,
                                 bool *has_alpha);
 
+  // Like LoadAndUnpackTexture, but `file` holds the contents of `filename`,
+  // as returned by LoadFile().
+  uint8_t *UnpackTexture(const char *filename, const std::string &file,
+                         vec2i *dimensions, bool *has_alpha);
+
   // Utility functions to convert 32bit RGBA to 16bit.
-  // You must delete[] the return value afterwards.
+  // You must delete[] the return value afterwards. To convert into a buffer
+  // of your own, use the functions in pixel_convert.h.
   uint16_t *Convert8888To5551(const uint8_t *buffer, const vec2i &size);
   uint16_t *Convert888To565(const uint8_t *buffer, const vec2i &size);
 
@@ -139,9 +152,22 @@ class Renderer {
   vec2i &window_size() { return window_size_; }
   const vec2i &window_size() const { return window_size_; }
 
+  // Whether textures are stored at 16 bits per pixel where possible.
+  bool use_16bpp() const { return use_16bpp_; }
+
+  // Uniform uploads made by shaders created by this renderer, since the last
+  // AdvanceFrame().
+  const UniformStats &uniform_stats() const { return uniform_stats_; }
+
  private:
   GLuint CompileShader(GLenum stage, GLuint program, const GLchar *source);
 
+  // Creates and binds a texture object with the standard sampling parameters.
+  GLuint GenerateTexture();
+
+  // Returns conversion_buffer_, grown to hold `size` 16 bit pixels.
+  uint16_t *ConversionBuffer(const vec2i &size);
+
   // Initializes the framebuffer needed for Cardboard mode
   void InitializeUndistortFramebuffer(int width, int height);
 
@@ -155,6 +181,8 @@ class Renderer {
 
   vec2i window_size_;
 
+  UniformStats uniform_stats_;
+
   std::string last_error_;
 
   SDL_Window *window_;
@@ -164,6 +192,10 @@ class Renderer {
 
   bool use_16bpp_;
 
+  // Scratch space for 16bpp conversion in CreateTexture, kept so that each
+  // texture doesn't allocate its own.
+  std::vector<uint16_t> conversion_buffer_;
+
   // The id of the framebuffer that is used for rendering for Cardboard.
   // After rendering to it, passed to Cardboard's undistortTexture call, which
   // will transform and render it appropriately
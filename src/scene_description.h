@@ -16,7 +16,6 @@
 #define PIE_NOON_SCENE_DESCRIPTION_H
 
 #include "mathfu/glsl_mappings.h"
-#include <memory>
 #include <vector>
 
 namespace fpl {
@@ -47,22 +46,20 @@ class Renderable {
   mathfu::vec4 color_;
 };
 
+// Everything that needs to be drawn this frame.
+// Renderables and lights are stored by value in flat arrays. Clear() keeps
+// the arrays' capacity, so once the scene has reached its peak size, filling
+// it every frame does not touch the heap.
 class SceneDescription {
  public:
   const mathfu::mat4& camera() const { return camera_; }
   void set_camera(const mathfu::mat4& camera) { camera_ = camera; }
 
-  std::vector<std::unique_ptr<Renderable>>& renderables() {
-    return renderables_;
-  }
-  const std::vector<std::unique_ptr<Renderable>>& renderables() const {
-    return renderables_;
-  }
+  std::vector<Renderable>& renderables() { return renderables_; }
+  const std::vector<Renderable>& renderables() const { return renderables_; }
 
-  std::vector<std::unique_ptr<mathfu::vec3>>& lights() { return lights_; }
-  const std::vector<std::unique_ptr<mathfu::vec3>>& lights() const {
-    return lights_;
-  }
+  std::vector<mathfu::vec3>& lights() { return lights_; }
+  const std::vector<mathfu::vec3>& lights() const { return lights_; }
 
   // Clear out the render list. Should be called once per frame.
   void Clear() {
@@ -75,10 +72,10 @@ class SceneDescription {
   mathfu::mat4 camera_;
 
   // Array of items to be rendered and their positions.
-  std::vector<std::unique_ptr<Renderable>> renderables_;
+  std::vector<Renderable> renderables_;
 
   // Array of positions for where to place point lights.
-  std::vector<std::unique_ptr<mathfu::vec3>> lights_;
+  std::vector<mathfu::vec3> lights_;
 };
 
 }  // namespace fpl
@@ -23,42 +23,146 @@
 
 namespace fpl {
 
+// Returns the number of floats in a uniform of `type`, or 0 if it's not a
+// float type we cache.
+static int UniformTypeFloats(GLenum type) {
+  switch (type) {
+    case GL_FLOAT:
+      return 1;
+    case GL_FLOAT_VEC2:
+      return 2;
+    case GL_FLOAT_VEC3:
+      return 3;
+    case GL_FLOAT_VEC4:
+      return 4;
+    case GL_FLOAT_MAT4:
+      return 16;
+    default:
+      return 0;
+  }
+}
+
 void Shader::InitializeUniforms() {
+  // Cache the location of every active uniform, so that lookups by name
+  // never have to go to GL.
+  GLint num_uniforms = 0;
+  GLint max_name_length = 0;
+  GL_CALL(glGetProgramiv(program_, GL_ACTIVE_UNIFORMS, &num_uniforms));
+  GL_CALL(
+      glGetProgramiv(program_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length));
+  std::vector<char> name(max_name_length + 1, '\0');
+  uniforms_.clear();
+  uniforms_.reserve(num_uniforms);
+  for (GLint i = 0; i < num_uniforms; i++) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    GL_CALL(glGetActiveUniform(program_, i, static_cast<GLsizei>(name.size()),
+                               &length, &size, &type, &name[0]));
+    Uniform uniform;
+    uniform.name.assign(&name[0], length);
+    // Arrays may be reported as "name[0]". Refer to them by their plain name.
+    const size_t bracket = uniform.name.find('[');
+    if (bracket != std::string::npos) uniform.name.resize(bracket);
+    uniform.location = glGetUniformLocation(program_, uniform.name.c_str());
+    if (uniform.location < 0) continue;
+    uniform.type = type;
+    uniform.num_floats = size == 1 ? UniformTypeFloats(type) : 0;
+    uniform.uploaded = false;
+    uniforms_.push_back(uniform);
+  }
+
   // Look up variables that are standard, but still optionally present in a
   // shader.
   uniform_model_view_projection_ =
-      glGetUniformLocation(program_, "model_view_projection");
-  uniform_model_ = glGetUniformLocation(program_, "model");
+      UniformIndex(FindUniform("model_view_projection"));
+  uniform_model_ = UniformIndex(FindUniform("model"));
 
-  uniform_color_ = glGetUniformLocation(program_, "color");
+  uniform_color_ = UniformIndex(FindUniform("color"));
 
-  uniform_light_pos_ = glGetUniformLocation(program_, "light_pos");
-  uniform_camera_pos_ = glGetUniformLocation(program_, "camera_pos");
+  uniform_light_pos_ = UniformIndex(FindUniform("light_pos"));
+  uniform_camera_pos_ = UniformIndex(FindUniform("camera_pos"));
 
   // Set up the uniforms the shader uses for texture access.
   char texture_unit_name[] = "texture_unit_#####";
   for (int i = 0; i < kMaxTexturesPerShader; i++) {
     snprintf(texture_unit_name, sizeof(texture_unit_name), "texture_unit_%d",
              i);
-    auto loc = glGetUniformLocation(program_, texture_unit_name);
+    auto loc = FindUniform(texture_unit_name);
     if (loc >= 0) GL_CALL(glUniform1i(loc, i));
   }
 }
 
+GLint Shader::FindUniform(const char *uniform_name) const {
+  for (auto it = uniforms_.begin(); it != uniforms_.end(); ++it) {
+    if (it->name == uniform_name) return it->location;
+  }
+  return -1;
+}
+
+int Shader::UniformIndex(GLint location) const {
+  if (location < 0) return -1;
+  for (size_t i = 0; i < uniforms_.size(); i++) {
+    if (uniforms_[i].location == location) return static_cast<int>(i);
+  }
+  return -1;
+}
+
+void Shader::UploadUniform(int index, const float *value, int num_floats,
+                           bool use_program) const {
+  assert(index >= 0);
+  Uniform &uniform = uniforms_[index];
+  const bool cached = uniform.num_floats == num_floats;
+  if (cached && uniform.uploaded &&
+      memcmp(uniform.value, value, num_floats * sizeof(float)) == 0) {
+    if (stats_) stats_->uploads_skipped++;
+    return;
+  }
+
+  if (use_program) GL_CALL(glUseProgram(program_));
+  switch (num_floats) {
+    case 1:
+      GL_CALL(glUniform1fv(uniform.location, 1, value));
+      break;
+    case 2:
+      GL_CALL(glUniform2fv(uniform.location, 1, value));
+      break;
+    case 3:
+      GL_CALL(glUniform3fv(uniform.location, 1, value));
+      break;
+    case 4:
+      GL_CALL(glUniform4fv(uniform.location, 1, value));
+      break;
+    case 16:
+      GL_CALL(glUniformMatrix4fv(uniform.location, 1, false, value));
+      break;
+    default:
+      assert(0);
+  }
+  if (cached) {
+    memcpy(uniform.value, value, num_floats * sizeof(float));
+    uniform.uploaded = true;
+  }
+  if (stats_) stats_->uploads++;
+}
+
 void Shader::Set(const Renderer &renderer) const {
   GL_CALL(glUseProgram(program_));
+  UpdateUniforms(renderer);
+}
 
+void Shader::UpdateUniforms(const Renderer &renderer) const {
   if (uniform_model_view_projection_ >= 0)
-    GL_CALL(glUniformMatrix4fv(uniform_model_view_projection_, 1, false,
-                               &renderer.model_view_projection()[0]));
+    UploadUniform(uniform_model_view_projection_,
+                  &renderer.model_view_projection()[0], 16, false);
   if (uniform_model_ >= 0)
-    GL_CALL(glUniformMatrix4fv(uniform_model_, 1, false, &renderer.model()[0]));
+    UploadUniform(uniform_model_, &renderer.model()[0], 16, false);
   if (uniform_color_ >= 0)
-    GL_CALL(glUniform4fv(uniform_color_, 1, &renderer.color()[0]));
+    UploadUniform(uniform_color_, &renderer.color()[0], 4, false);
   if (uniform_light_pos_ >= 0)
-    GL_CALL(glUniform3fv(uniform_light_pos_, 1, &renderer.light_pos()[0]));
+    UploadUniform(uniform_light_pos_, &renderer.light_pos()[0], 3, false);
   if (uniform_camera_pos_ >= 0)
-    GL_CALL(glUniform3fv(uniform_camera_pos_, 1, &renderer.camera_pos()[0]));
+    UploadUniform(uniform_camera_pos_, &renderer.camera_pos()[0], 3, false);
 }
 
 }  // namespace fpl
@@ -29,14 +29,32 @@ class Renderer;
 
 static const int kMaxTexturesPerShader = 8;
 
+// Counts of glUniform calls issued and skipped by all shaders sharing this
+// struct. Renderer resets its copy every frame.
+struct UniformStats {
+  UniformStats() : uploads(0), uploads_skipped(0) {}
+
+  // Values that differed from what the program already held.
+  int uploads;
+  // Values that were already current, so no GL call was made.
+  int uploads_skipped;
+};
+
 // Represents a shader consisting of a vertex and pixel shader. Also stores
 // ids of standard uniforms. Use the Renderer class below to create these.
+//
+// The location of every active uniform is looked up once, at link time, and
+// the last value uploaded to each is kept. Setting a uniform to the value it
+// already holds doesn't call into GL. Uniform values are state of the
+// program, so this holds no matter which shaders were used in between.
 class Shader {
  public:
-  Shader(GLuint program, GLuint vs, GLuint ps)
+  // `stats`, if non-null, is updated by every uniform upload.
+  Shader(GLuint program, GLuint vs, GLuint ps, UniformStats *stats = nullptr)
       : program_(program),
         vs_(vs),
         ps_(ps),
+        stats_(stats),
         uniform_model_view_projection_(-1),
         uniform_model_(-1),
         uniform_color_(-1),
@@ -54,37 +72,27 @@ class Shader {
   // Renderer, if this shader refers to them.
   void Set(const Renderer &renderer) const;
 
+  // Like Set(), but only uploads the standard uniforms. This shader must
+  // already be the active one.
+  void UpdateUniforms(const Renderer &renderer) const;
+
   // Find a non-standard uniform by name, -1 means not found.
-  GLint FindUniform(const char *uniform_name) {
-    GL_CALL(glUseProgram(program_));
-    return glGetUniformLocation(program_, uniform_name);
-  }
+  // Doesn't call into GL: the locations were cached by InitializeUniforms().
+  GLint FindUniform(const char *uniform_name) const;
 
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable : 4127)  // conditional expression is constant
-#endif                           // _MSC_VER
   // Set an non-standard uniform to a vec2/3/4 value.
-  // Call this after Set() or FindUniform().
+  // If the value has to be uploaded, this shader is made the active one.
+  // Like glUniform, does nothing if `uniform_loc` isn't one of this shader's
+  // active uniforms (e.g. -1).
   template <int N>
   void SetUniform(GLint uniform_loc, const mathfu::Vector<float, N> &value) {
-    // This should amount to a compile-time if-then.
-    if (N == 2) {
-      GL_CALL(glUniform2fv(uniform_loc, 1, &value[0]));
-    } else if (N == 3) {
-      GL_CALL(glUniform3fv(uniform_loc, 1, &value[0]));
-    } else if (N == 4) {
-      GL_CALL(glUniform4fv(uniform_loc, 1, &value[0]));
-    } else {
-      assert(0);
-    }
+    static_assert(2 <= N && N <= 4, "Only vec2, vec3 and vec4 are supported");
+    const int index = UniformIndex(uniform_loc);
+    if (index < 0) return;
+    UploadUniform(index, &value[0], N, true);
   }
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif  // _MSC_VER
 
   // Convenience call that does a Lookup and a Set if found.
-  // Call this after Set().
   template <int N>
   bool SetUniform(const char *uniform_name,
                   const mathfu::Vector<float, N> &value) {
@@ -96,21 +104,51 @@ class Shader {
 
   bool SetUniform(const char *uniform_name, const float &value) {
     auto loc = FindUniform(uniform_name);
-    if (loc < 0) return false;
-    GL_CALL(glUniform1f(loc, value));
+    const int index = UniformIndex(loc);
+    if (index < 0) return false;
+    UploadUniform(index, &value, 1, true);
     return true;
   }
 
+  // Caches the locations of all active uniforms. This shader must be the
+  // active one.
   void InitializeUniforms();
 
+  GLuint program() const { return program_; }
+
  private:
+  // An active uniform of the program, and the value it was last given.
+  struct Uniform {
+    std::string name;
+    GLint location;
+    GLenum type;
+    // Number of floats in the value, or 0 if it isn't cached (samplers,
+    // arrays and integer types).
+    int num_floats;
+    // False until the first upload, since the initial value is unknown.
+    bool uploaded;
+    float value[16];
+  };
+
+  int UniformIndex(GLint location) const;
+  // Uploads `num_floats` floats to uniforms_[index], unless they're the
+  // values it already holds. `use_program` binds this shader first if an
+  // upload is needed, for callers that can't assume it's active.
+  void UploadUniform(int index, const float *value, int num_floats,
+                     bool use_program) const;
+
   GLuint program_, vs_, ps_;
 
-  GLint uniform_model_view_projection_;
-  GLint uniform_model_;
-  GLint uniform_color_;
-  GLint uniform_light_pos_;
-  GLint uniform_camera_pos_;
+  // Mutable, so that uploads from const methods can track what they sent.
+  mutable std::vector<Uniform> uniforms_;
+  UniformStats *stats_;
+
+  // Indices into uniforms_, -1 if the shader doesn't use them.
+  int uniform_model_view_projection_;
+  int uniform_model_;
+  int uniform_color_;
+  int uniform_light_pos_;
+  int uniform_camera_pos_;
 };
 
 }  // namespace fpl
@@ -0,0 +1,232 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef TEXT_CACHE_H
+#define TEXT_CACHE_H
+
+#include <string.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "common.h"
+
+namespace fpl {
+
+// The text cache keeps values made from a string at a size, such as the
+// FontBuffers and FontTextures of FontManager, within a budget of bytes.
+//
+// Entries are found through one hash table keyed by a 64 bit hash of the
+// string and the size. Each entry keeps its own copy of the string, made once
+// when it's inserted, to tell apart strings whose hashes collide. So a lookup
+// hashes and compares the caller's string in place, without allocating.
+//
+// Once the values take more than the budget, the least recently used entries
+// are evicted. Entries used in the current cycle are never evicted, so that
+// pointers to values the caller got since the last Update() stay valid.
+
+// Usage statistics of a TextCache. The counters are counted since the cache
+// was created, or since the last ResetStats(). Resident values are current.
+struct TextCacheStats {
+  TextCacheStats()
+      : lookups(0),
+        hits(0),
+        inserts(0),
+        evictions(0),
+        resident_entries(0),
+        resident_bytes(0) {}
+
+  // Find() calls, and those that found the string in the cache.
+  int32_t lookups;
+  int32_t hits;
+  // Entries added to the cache.
+  int32_t inserts;
+  // Entries evicted to keep within the byte budget.
+  int32_t evictions;
+  // Entries in the cache, and the bytes their values take.
+  int32_t resident_entries;
+  size_t resident_bytes;
+};
+
+template <typename T>
+class TextCache {
+ public:
+  // Constructor with the budget of bytes the values may take.
+  explicit TextCache(const size_t byte_budget)
+      : byte_budget_(byte_budget), counter_(0) {}
+  ~TextCache() {}
+
+  // Look up the value of a string at a size.
+  // Marks it as used in the current cycle, and as most recently used.
+  // Return value: The value, or nullptr if not found.
+  T *Find(const char *text, const int32_t size) {
+    stats_.lookups++;
+    size_t length;
+    const uint64_t key = Key(text, size, &length);
+    auto it = Lookup(key, text, length, size);
+    if (it == entries_.end()) return nullptr;
+
+    it->last_used_counter = counter_;
+    entries_.splice(entries_.end(), entries_, it);
+    stats_.hits++;
+    return it->value.get();
+  }
+
+  // Add the value of a string at a size, which takes `bytes` bytes, then
+  // evict entries to keep within the budget. The string must not be in the
+  // cache yet.
+  // Returns the value.
+  T *Insert(const char *text, const int32_t size, std::unique_ptr<T> value,
+            const size_t bytes) {
+    size_t length;
+    const uint64_t key = Key(text, size, &length);
+    assert(Lookup(key, text, length, size) == entries_.end());
+
+    Entry entry;
+    entry.text.assign(text, length);
+    entry.size = size;
+    entry.key = key;
+    entry.bytes = bytes;
+    entry.last_used_counter = counter_;
+    entry.value = std::move(value);
+    auto it = entries_.insert(entries_.end(), std::move(entry));
+    map_entries_.insert(std::make_pair(key, it));
+
+    stats_.inserts++;
+    stats_.resident_entries++;
+    stats_.resident_bytes += bytes;
+    Evict();
+    return it->value.get();
+  }
+
+  // Start a new cycle. Values returned before may be evicted from now on.
+  void Update() {
+    counter_++;
+    Evict();
+  }
+
+  // Evict every entry.
+  void Clear() {
+    map_entries_.clear();
+    entries_.clear();
+    stats_.resident_entries = 0;
+    stats_.resident_bytes = 0;
+  }
+
+  // Setter/Getter of the budget of bytes the values may take.
+  size_t get_byte_budget() const { return byte_budget_; }
+  void set_byte_budget(const size_t byte_budget) {
+    byte_budget_ = byte_budget;
+    Evict();
+  }
+
+  // Getter of the usage statistics.
+  const TextCacheStats &get_stats() const { return stats_; }
+
+  // Reset the counters of the usage statistics.
+  void ResetStats() {
+    TextCacheStats stats;
+    stats.resident_entries = stats_.resident_entries;
+    stats.resident_bytes = stats_.resident_bytes;
+    stats_ = stats;
+  }
+
+ private:
+  struct Entry {
+    // The string, its size, and the key of both.
+    std::string text;
+    int32_t size;
+    uint64_t key;
+
+    // Bytes the value takes.
+    size_t bytes;
+
+    // Cycle the entry was last used in.
+    uint32_t last_used_counter;
+
+    std::unique_ptr<T> value;
+  };
+  typedef typename std::list<Entry>::iterator iterator;
+
+  // FNV-1a hash of the string, then of the size. Also returns the length of
+  // the string.
+  static uint64_t Key(const char *text, const int32_t size, size_t *length) {
+    uint64_t hash = 14695981039346656037ULL;
+    const char *c = text;
+    for (; *c; ++c) {
+      hash ^= static_cast<uint8_t>(*c);
+      hash *= 1099511628211ULL;
+    }
+    hash ^= static_cast<uint32_t>(size);
+    hash *= 1099511628211ULL;
+    *length = c - text;
+    return hash;
+  }
+
+  // Returns the entry of a string, or entries_.end() if there is none.
+  iterator Lookup(const uint64_t key, const char *text, const size_t length,
+                  const int32_t size) {
+    auto range = map_entries_.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+      const Entry &entry = *it->second;
+      if (entry.size == size && entry.text.size() == length &&
+          memcmp(entry.text.data(), text, length) == 0) {
+        return it->second;
+      }
+    }
+    return entries_.end();
+  }
+
+  // Evict least recently used entries while the values take more than the
+  // budget. Entries used in the current cycle are the most recently used,
+  // so eviction stops at the first of them.
+  void Evict() {
+    while (stats_.resident_bytes > byte_budget_ && !entries_.empty() &&
+           entries_.front().last_used_counter != counter_) {
+      const Entry &entry = entries_.front();
+      auto range = map_entries_.equal_range(entry.key);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == entries_.begin()) {
+          map_entries_.erase(it);
+          break;
+        }
+      }
+      stats_.resident_entries--;
+      stats_.resident_bytes -= entry.bytes;
+      stats_.evictions++;
+      entries_.pop_front();
+    }
+  }
+
+  // Entries, least recently used first.
+  std::list<Entry> entries_;
+
+  // Hash table of the entries. Strings whose keys collide share a key.
+  std::unordered_multimap<uint64_t, iterator> map_entries_;
+
+  // Budget of bytes the values may take.
+  size_t byte_budget_;
+
+  // A cycle counter of the cache.
+  uint32_t counter_;
+
+  // Usage statistics.
+  TextCacheStats stats_;
+};
+
+}  // namespace fpl
+
+#endif  // TEXT_CACHE_H
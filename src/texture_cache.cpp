@@ -0,0 +1,373 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "pixel_convert.h"
+#include "texture_cache.h"
+#include "utilities.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif  // !_WIN32
+
+#ifdef _WIN32
+#define snprintf(buffer, count, format, ...) \
+  _snprintf_s(buffer, count, count, format, __VA_ARGS__)
+#endif  // _WIN32
+
+namespace fpl {
+
+// "FPTC" in a little endian file.
+static const uint32_t kTextureCacheMagic = 0x43545046;
+// Bump this whenever the layout, or the way levels are built, changes.
+static const uint32_t kTextureCacheVersion = 1;
+
+struct TextureCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash;
+  // The TextureFormat that was asked for, before kFormatAuto is resolved.
+  int32_t desired_format;
+  uint32_t gl_format;
+  uint32_t gl_type;
+  uint8_t has_alpha;
+  uint8_t use_16bpp;
+  uint16_t num_levels;
+  int32_t width;
+  int32_t height;
+};
+
+struct TextureCacheLevel {
+  uint32_t offset;
+  uint32_t bytes;
+};
+
+static const TextureCacheHeader &Header(const uint8_t *file) {
+  return *reinterpret_cast<const TextureCacheHeader *>(file);
+}
+
+// Picks the same GL format CreateTexture uses for `desired`. Returns false
+// for formats that aren't cached.
+static bool CachedFormat(TextureFormat desired, bool has_alpha,
+                         bool use_16bpp, GLenum *format, GLenum *type,
+                         int *bytes_per_pixel) {
+  if (desired == kFormatAuto) desired = has_alpha ? kFormat5551 : kFormat565;
+  switch (desired) {
+    case kFormat5551:
+      if (!has_alpha) return false;
+      *format = GL_RGBA;
+      *type = use_16bpp ? GL_UNSIGNED_SHORT_5_5_5_1 : GL_UNSIGNED_BYTE;
+      *bytes_per_pixel = use_16bpp ? 2 : 4;
+      return true;
+    case kFormat565:
+      if (has_alpha) return false;
+      *format = GL_RGB;
+      *type = use_16bpp ? GL_UNSIGNED_SHORT_5_6_5 : GL_UNSIGNED_BYTE;
+      *bytes_per_pixel = use_16bpp ? 2 : 3;
+      return true;
+    case kFormat8888:
+      if (!has_alpha) return false;
+      *format = GL_RGBA;
+      *type = GL_UNSIGNED_BYTE;
+      *bytes_per_pixel = 4;
+      return true;
+    case kFormat888:
+      if (has_alpha) return false;
+      *format = GL_RGB;
+      *type = GL_UNSIGNED_BYTE;
+      *bytes_per_pixel = 3;
+      return true;
+    default:
+      return false;
+  }
+}
+
+static vec2i MipSize(const vec2i &size, int level) {
+  return vec2i(std::max(size.x() >> level, 1), std::max(size.y() >> level, 1));
+}
+
+// Averages 2x2 blocks of `src` into `dst`, which is half the size (but at
+// least 1) in each dimension.
+static void Downsample(const uint8_t *src, const vec2i &src_size,
+                       int channels, uint8_t *dst) {
+  const vec2i dst_size = MipSize(src_size, 1);
+  const int x_step = src_size.x() > 1 ? 1 : 0;
+  const int y_step = src_size.y() > 1 ? src_size.x() : 0;
+  for (int y = 0; y < dst_size.y(); y++) {
+    const uint8_t *row = src + (y * 2) * src_size.x() * channels;
+    for (int x = 0; x < dst_size.x(); x++) {
+      const uint8_t *p = row + x * 2 * channels;
+      for (int c = 0; c < channels; c++) {
+        const int sum = p[c] + p[x_step * channels + c] +
+                        p[y_step * channels + c] +
+                        p[(x_step + y_step) * channels + c];
+        *dst++ = static_cast<uint8_t>((sum + 2) >> 2);
+      }
+    }
+  }
+}
+
+// Converts 8 bits per channel pixels to `type`, the same way CreateTexture
+// does.
+static void PackLevel(const uint8_t *src, int num_pixels, int channels,
+                      GLenum type, uint8_t *dst) {
+  auto dst16 = reinterpret_cast<uint16_t *>(dst);
+  switch (type) {
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+      ConvertRGBA8888To5551(src, num_pixels, dst16);
+      break;
+    case GL_UNSIGNED_SHORT_5_6_5:
+      ConvertRGB888To565(src, num_pixels, dst16);
+      break;
+    default:
+      memcpy(dst, src, num_pixels * channels);
+      break;
+  }
+}
+
+GpuTexture::GpuTexture() : file_(nullptr), file_size_(0), mapped_(false) {}
+
+GpuTexture::~GpuTexture() { Unmap(); }
+
+void GpuTexture::Unmap() {
+#ifndef _WIN32
+  if (mapped_) munmap(const_cast<uint8_t *>(file_), file_size_);
+#endif  // !_WIN32
+  file_ = nullptr;
+  file_size_ = 0;
+  mapped_ = false;
+  owned_.clear();
+  levels_.clear();
+}
+
+bool GpuTexture::Parse() {
+  levels_.clear();
+  if (file_size_ < sizeof(TextureCacheHeader)) return false;
+  const TextureCacheHeader &header = Header(file_);
+  if (header.magic != kTextureCacheMagic ||
+      header.version != kTextureCacheVersion || header.num_levels == 0) {
+    return false;
+  }
+  const size_t table_end = sizeof(TextureCacheHeader) +
+                           header.num_levels * sizeof(TextureCacheLevel);
+  if (file_size_ < table_end) return false;
+  const int bytes_per_pixel =
+      header.gl_type != GL_UNSIGNED_BYTE ? 2 : header.has_alpha ? 4 : 3;
+  auto table = reinterpret_cast<const TextureCacheLevel *>(
+      file_ + sizeof(TextureCacheHeader));
+  const vec2i size(header.width, header.height);
+  for (int i = 0; i < header.num_levels; i++) {
+    Level level;
+    level.size = MipSize(size, i);
+    level.bytes = table[i].bytes;
+    level.data = file_ + table[i].offset;
+    const size_t expected =
+        static_cast<size_t>(level.size.x()) * level.size.y() * bytes_per_pixel;
+    if (level.bytes != expected || table[i].offset < table_end ||
+        table[i].offset + level.bytes > file_size_) {
+      levels_.clear();
+      return false;
+    }
+    levels_.push_back(level);
+  }
+  return true;
+}
+
+bool GpuTexture::Map(const char *filename, uint64_t source_hash,
+                     TextureFormat desired, bool use_16bpp) {
+  Unmap();
+#ifndef _WIN32
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat info;
+  void *mapping = MAP_FAILED;
+  if (fstat(fd, &info) == 0 && info.st_size > 0) {
+    mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ,
+                   MAP_PRIVATE, fd, 0);
+  }
+  // The mapping stays valid after the file is closed.
+  close(fd);
+  if (mapping == MAP_FAILED) return false;
+  file_ = static_cast<const uint8_t *>(mapping);
+  file_size_ = static_cast<size_t>(info.st_size);
+  mapped_ = true;
+#else
+  // No mmap, so read the file instead. Still skips decoding and conversion.
+  FILE *file = fopen(filename, "rb");
+  if (!file) return false;
+  fseek(file, 0, SEEK_END);
+  owned_.resize(static_cast<size_t>(ftell(file)));
+  fseek(file, 0, SEEK_SET);
+  const size_t read =
+      owned_.empty() ? 0 : fread(&owned_[0], 1, owned_.size(), file);
+  fclose(file);
+  if (read != owned_.size() || owned_.empty()) {
+    owned_.clear();
+    return false;
+  }
+  file_ = &owned_[0];
+  file_size_ = owned_.size();
+#endif  // !_WIN32
+
+  // Files written before Build() rejected sizes that aren't a power of two
+  // are rebuilt too, which then falls back to the uncached path.
+  const int area = Parse() ? size().x() * size().y() : 0;
+  const bool valid = area && !(area & (area - 1)) &&
+                     Header(file_).source_hash == source_hash &&
+                     Header(file_).desired_format == desired &&
+                     (Header(file_).use_16bpp != 0) == use_16bpp;
+  if (!valid) Unmap();
+  return valid;
+}
+
+bool GpuTexture::Build(const uint8_t *pixels, const vec2i &size,
+                       bool has_alpha, uint64_t source_hash,
+                       TextureFormat desired, bool use_16bpp) {
+  Unmap();
+  // CreateTexture rejects textures that aren't a power of two in size, so
+  // leave them to it rather than caching a mip chain that can't be used.
+  const int area = size.x() * size.y();
+  if (area & (area - 1)) return false;
+  GLenum format, type;
+  int bytes_per_pixel;
+  if (!CachedFormat(desired, has_alpha, use_16bpp, &format, &type,
+                    &bytes_per_pixel)) {
+    return false;
+  }
+
+  // Lay out the file, keeping each level 4 byte aligned.
+  int num_levels = 1;
+  while (std::max(size.x(), size.y()) >> num_levels) num_levels++;
+  std::vector<TextureCacheLevel> table(num_levels);
+  size_t offset = sizeof(TextureCacheHeader) +
+                  num_levels * sizeof(TextureCacheLevel);
+  for (int i = 0; i < num_levels; i++) {
+    const vec2i level_size = MipSize(size, i);
+    offset = (offset + 3) & ~static_cast<size_t>(3);
+    table[i].offset = static_cast<uint32_t>(offset);
+    table[i].bytes = static_cast<uint32_t>(level_size.x() * level_size.y() *
+                                           bytes_per_pixel);
+    offset += table[i].bytes;
+  }
+  owned_.assign(offset, 0);
+
+  TextureCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kTextureCacheMagic;
+  header.version = kTextureCacheVersion;
+  header.source_hash = source_hash;
+  header.desired_format = desired;
+  header.gl_format = format;
+  header.gl_type = type;
+  header.has_alpha = has_alpha ? 1 : 0;
+  header.use_16bpp = use_16bpp ? 1 : 0;
+  header.num_levels = static_cast<uint16_t>(num_levels);
+  header.width = size.x();
+  header.height = size.y();
+  memcpy(&owned_[0], &header, sizeof(header));
+  memcpy(&owned_[sizeof(header)], &table[0],
+         num_levels * sizeof(TextureCacheLevel));
+
+  // Each level is filtered from the 8 bit one above it, not from the packed
+  // one, so that 16bpp quantization doesn't accumulate down the chain.
+  const int channels = has_alpha ? 4 : 3;
+  std::vector<uint8_t> current, next;
+  const uint8_t *level_pixels = pixels;
+  for (int i = 0; i < num_levels; i++) {
+    const vec2i level_size = MipSize(size, i);
+    PackLevel(level_pixels, level_size.x() * level_size.y(), channels, type,
+              &owned_[table[i].offset]);
+    if (i + 1 == num_levels) break;
+    const vec2i next_size = MipSize(size, i + 1);
+    next.resize(next_size.x() * next_size.y() * channels);
+    Downsample(level_pixels, level_size, channels, &next[0]);
+    current.swap(next);
+    level_pixels = &current[0];
+  }
+
+  file_ = &owned_[0];
+  file_size_ = owned_.size();
+  return Parse();
+}
+
+bool GpuTexture::Write(const char *filename) const {
+  if (!file_) return false;
+  // Loader threads may write the same texture at once, so each writes its
+  // own temporary file.
+  char thread_suffix[32];
+  snprintf(thread_suffix, sizeof(thread_suffix), ".%lu.tmp",
+           static_cast<unsigned long>(SDL_ThreadID()));
+  const std::string temp_filename = std::string(filename) + thread_suffix;
+  FILE *file = fopen(temp_filename.c_str(), "wb");
+  if (!file) return false;
+  const bool written = fwrite(file_, 1, file_size_, file) == file_size_;
+  if (fclose(file) != 0 || !written) {
+    remove(temp_filename.c_str());
+    return false;
+  }
+#ifdef _WIN32
+  // Windows won't rename over an existing file.
+  remove(filename);
+#endif  // _WIN32
+  return rename(temp_filename.c_str(), filename) == 0;
+}
+
+bool GpuTexture::has_alpha() const {
+  return file_ && Header(file_).has_alpha != 0;
+}
+
+GLenum GpuTexture::format() const {
+  return file_ ? Header(file_).gl_format : 0;
+}
+
+GLenum GpuTexture::type() const { return file_ ? Header(file_).gl_type : 0; }
+
+void TextureCache::set_directory(const std::string &directory) {
+  directory_ = directory;
+  if (!directory_.empty() && directory_[directory_.size() - 1] != '/' &&
+      directory_[directory_.size() - 1] != '\\') {
+    directory_ += '/';
+  }
+}
+
+std::string TextureCache::CachePath(const std::string &source_filename) const {
+  // Named by the hash of the whole source path, so that sources in different
+  // directories don't share a cache file. The source's own file name is kept
+  // in front, to make the cache directory readable.
+  const size_t separator = source_filename.find_last_of("/\\:");
+  const std::string name = separator == std::string::npos
+                               ? source_filename
+                               : source_filename.substr(separator + 1);
+  char hash[32];
+  snprintf(hash, sizeof(hash), ".%016llx.fptc",
+           static_cast<unsigned long long>(
+               Hash(source_filename.c_str(), source_filename.size())));
+  return directory_ + name + hash;
+}
+
+// static
+uint64_t TextureCache::Hash(const void *data, size_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  auto bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace fpl
@@ -0,0 +1,110 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_TEXTURE_CACHE_H
+#define FPL_TEXTURE_CACHE_H
+
+#include "common.h"
+#include "material.h"
+
+namespace fpl {
+
+// A texture in the form it's handed to GL: every mip level, already converted
+// to the pixel format it's uploaded in. Either memory-mapped from a cache
+// file, or built in memory from a decoded image.
+//
+// A cache file is a TextureCacheHeader, followed by a table with the offset
+// and size of each level, followed by the levels, largest first. It's only
+// ever read on the machine that wrote it, so it's in native byte order.
+class GpuTexture {
+ public:
+  struct Level {
+    vec2i size;
+    const uint8_t *data;
+    size_t bytes;
+  };
+
+  GpuTexture();
+  ~GpuTexture();
+
+  // Maps the cache file `filename`. Returns false if it doesn't exist, or if
+  // it wasn't built from a source with `source_hash`, for `desired` and
+  // `use_16bpp`.
+  bool Map(const char *filename, uint64_t source_hash, TextureFormat desired,
+           bool use_16bpp);
+
+  // Builds the full mip chain from decoded RGB or RGBA `pixels`, converting
+  // each level to the format CreateTexture would upload for `desired`.
+  // Returns false if the format can't be cached (luminance), or the size isn't
+  // a power of two.
+  bool Build(const uint8_t *pixels, const vec2i &size, bool has_alpha,
+             uint64_t source_hash, TextureFormat desired, bool use_16bpp);
+
+  // Writes a cache file that Map() can read. The file is written under a
+  // temporary name, unique to the calling thread, first, so a crash never
+  // leaves a partial cache file.
+  bool Write(const char *filename) const;
+
+  int num_levels() const { return static_cast<int>(levels_.size()); }
+  const Level &level(int i) const { return levels_[i]; }
+  vec2i size() const {
+    return levels_.empty() ? mathfu::kZeros2i : levels_[0].size;
+  }
+  bool has_alpha() const;
+  // Arguments for glTexImage2D.
+  GLenum format() const;
+  GLenum type() const;
+  // Size of the whole file, i.e. of all levels plus the header.
+  size_t file_size() const { return file_size_; }
+
+ private:
+  void Unmap();
+  bool Parse();
+
+  // The file contents, either mapped or in owned_.
+  const uint8_t *file_;
+  size_t file_size_;
+  bool mapped_;
+  std::vector<uint8_t> owned_;
+  std::vector<Level> levels_;
+
+  DISALLOW_COPY_AND_ASSIGN(GpuTexture);
+};
+
+// Keeps GPU-ready copies of textures in a directory, so that after the first
+// run, loading a texture skips decoding, 16bpp conversion and mipmap
+// generation. An entry is rebuilt when the hash of its source file changes.
+// Safe to use from several loader threads at once.
+class TextureCache {
+ public:
+  TextureCache() {}
+
+  // Directory the cache files go in, or empty to disable the cache.
+  void set_directory(const std::string &directory);
+  const std::string &directory() const { return directory_; }
+  bool enabled() const { return !directory_.empty(); }
+
+  // Returns the cache file used for the texture `source_filename`.
+  std::string CachePath(const std::string &source_filename) const;
+
+  // 64-bit FNV-1a hash, used to tell whether a source file has changed.
+  static uint64_t Hash(const void *data, size_t size);
+
+ private:
+  std::string directory_;
+};
+
+}  // namespace fpl
+
+#endif  // FPL_TEXTURE_CACHE_H
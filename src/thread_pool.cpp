@@ -0,0 +1,177 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "thread_pool.h"
+
+namespace fpl {
+
+static int PackShare(int begin, int end) { return (begin << 16) | end; }
+static int ShareBegin(int share) { return share >> 16; }
+static int ShareEnd(int share) { return share & 0xFFFF; }
+
+ThreadPool::ThreadPool() : task_(nullptr) {
+  for (int i = 0; i <= kMaxThreads; i++) {
+    SDL_AtomicSet(&shares_[i], 0);
+    workers_[i].pool = this;
+    workers_[i].index = i;
+  }
+  SDL_AtomicSet(&remaining_, 0);
+  SDL_AtomicSet(&stopping_, 0);
+  start_semaphore_ = SDL_CreateSemaphore(0);
+  done_semaphore_ = SDL_CreateSemaphore(0);
+  assert(start_semaphore_ && done_semaphore_);
+}
+
+ThreadPool::~ThreadPool() {
+  Stop();
+
+  if (start_semaphore_) {
+    SDL_DestroySemaphore(start_semaphore_);
+    start_semaphore_ = nullptr;
+  }
+  if (done_semaphore_) {
+    SDL_DestroySemaphore(done_semaphore_);
+    done_semaphore_ = nullptr;
+  }
+}
+
+void ThreadPool::Start(int num_threads) {
+  Stop();
+  SDL_AtomicSet(&stopping_, 0);
+
+  if (num_threads <= 0) num_threads = SDL_GetCPUCount() - 1;
+  num_threads = std::min(num_threads, static_cast<int>(kMaxThreads));
+  for (int i = 1; i <= num_threads; i++) {
+    auto thread = SDL_CreateThread(ThreadPool::WorkerThread, "FPL Worker",
+                                   &workers_[i]);
+    assert(thread);
+    threads_.push_back(thread);
+  }
+}
+
+void ThreadPool::Stop() {
+  SDL_AtomicSet(&stopping_, 1);
+  for (size_t i = 0; i < threads_.size(); i++) {
+    SDL_SemPost(start_semaphore_);
+  }
+  for (auto it = threads_.begin(); it != threads_.end(); ++it) {
+    SDL_WaitThread(*it, nullptr);
+  }
+  threads_.clear();
+}
+
+int ThreadPool::WorkerThread(void *user_data) {
+  auto worker = static_cast<Worker *>(user_data);
+  worker->pool->WorkerLoop(worker->index);
+  return 0;
+}
+
+void ThreadPool::WorkerLoop(int worker) {
+  for (;;) {
+    SDL_SemWait(start_semaphore_);
+    if (SDL_AtomicGet(&stopping_)) return;
+    RunTasks(worker);
+  }
+}
+
+void ThreadPool::RunTasks(int worker) {
+  while (RunTask(worker)) {
+  }
+}
+
+bool ThreadPool::RunTask(int worker) {
+  int task_index = -1;
+  // Stolen tasks after task_index that couldn't be kept as our share.
+  int stolen_end = -1;
+
+  // Our own share, from the front.
+  SDL_atomic_t *own = &shares_[worker];
+  int own_share;
+  for (;;) {
+    own_share = SDL_AtomicGet(own);
+    const int begin = ShareBegin(own_share);
+    const int end = ShareEnd(own_share);
+    if (begin >= end) break;
+    if (SDL_AtomicCAS(own, own_share, PackShare(begin + 1, end))) {
+      task_index = begin;
+      break;
+    }
+  }
+
+  // Otherwise the back half of someone else's, keeping the rest as our own.
+  // Nobody steals from an empty share, so our share is only replaced if it
+  // still holds the empty value we saw. A worker still searching after its
+  // batch ended can find the next batch published there instead, and then
+  // runs the stolen tasks itself.
+  const int num_shares = num_workers();
+  for (int i = 1; task_index < 0 && i < num_shares; i++) {
+    SDL_atomic_t *victim = &shares_[(worker + i) % num_shares];
+    for (;;) {
+      const int share = SDL_AtomicGet(victim);
+      const int begin = ShareBegin(share);
+      const int end = ShareEnd(share);
+      if (begin >= end) break;
+      const int middle = begin + (end - begin) / 2;
+      if (SDL_AtomicCAS(victim, share, PackShare(begin, middle))) {
+        task_index = middle;
+        if (middle + 1 < end &&
+            !SDL_AtomicCAS(own, own_share, PackShare(middle + 1, end))) {
+          stolen_end = end;
+        }
+        break;
+      }
+    }
+  }
+  if (task_index < 0) return false;
+
+  for (int index = task_index; index == task_index || index < stolen_end;
+       index++) {
+    (*task_)(index);
+    if (SDL_AtomicAdd(&remaining_, -1) == 1) {
+      SDL_SemPost(done_semaphore_);
+    }
+  }
+  return true;
+}
+
+void ThreadPool::ParallelFor(int count,
+                             const std::function<void(int)> &task) {
+  assert(count <= kMaxTasks);
+  if (count <= 0) return;
+  if (count == 1 || threads_.empty()) {
+    for (int i = 0; i < count; i++) task(i);
+    return;
+  }
+
+  // Publish the task before the shares, so that whoever takes a task from a
+  // share sees the right function.
+  task_ = &task;
+  SDL_MemoryBarrierRelease();
+  SDL_AtomicSet(&remaining_, count);
+  const int num_shares = num_workers();
+  for (int i = 0; i < num_shares; i++) {
+    SDL_AtomicSet(&shares_[i], PackShare(count * i / num_shares,
+                                         count * (i + 1) / num_shares));
+  }
+  for (size_t i = 0; i < threads_.size(); i++) {
+    SDL_SemPost(start_semaphore_);
+  }
+
+  RunTasks(0);
+  SDL_SemWait(done_semaphore_);
+  task_ = nullptr;
+}
+
+}  // namespace fpl
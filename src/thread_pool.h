@@ -0,0 +1,90 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef FPL_THREAD_POOL_H
+#define FPL_THREAD_POOL_H
+
+#include <functional>
+#include <vector>
+#include "SDL_atomic.h"
+#include "SDL_thread.h"
+
+namespace fpl {
+
+// Runs batches of independent tasks on a pool of worker threads, plus the
+// thread that hands over the batch.
+// Each thread starts on its own contiguous share of the batch. Once that
+// runs out, it steals the back half of what's left of another thread's
+// share, so that tasks of uneven length still keep every thread busy.
+class ThreadPool {
+ public:
+  ThreadPool();
+  ~ThreadPool();
+
+  // Launches the worker threads. `num_threads` of 0 means one per CPU core
+  // beyond the first, which the calling thread uses, up to kMaxThreads.
+  void Start(int num_threads = 0);
+
+  // Tells the worker threads to exit, and waits for them. Start() may be
+  // called again afterwards.
+  void Stop();
+
+  // Threads that run the tasks of a batch, including the caller.
+  int num_workers() const { return static_cast<int>(threads_.size()) + 1; }
+
+  // Calls task(i) for every i in [0, count), spread over the worker threads
+  // and the calling thread, and returns when every call has returned.
+  // Calls may happen in any order and at the same time, so they must not
+  // depend on each other. Only one thread may call this at a time.
+  void ParallelFor(int count, const std::function<void(int)> &task);
+
+  static const int kMaxThreads = 8;
+  // Tasks in one batch. Limited so that a share fits in one atomic int.
+  static const int kMaxTasks = 0x7FFF;
+
+ private:
+  struct Worker {
+    ThreadPool *pool;
+    int index;
+  };
+
+  // Takes one task, from `worker`'s own share or else by stealing, and runs
+  // it. Returns false if every share is empty.
+  bool RunTask(int worker);
+  void RunTasks(int worker);
+  void WorkerLoop(int worker);
+  static int WorkerThread(void *user_data);
+
+  // shares_[i] holds the tasks [begin, end) not yet taken by worker i, as
+  // begin << 16 | end. Worker 0 is the thread calling ParallelFor.
+  SDL_atomic_t shares_[kMaxThreads + 1];
+  Worker workers_[kMaxThreads + 1];
+
+  // The batch being run.
+  const std::function<void(int)> *task_;
+  // Tasks in the batch that haven't returned yet.
+  SDL_atomic_t remaining_;
+
+  std::vector<SDL_Thread *> threads_;
+  SDL_atomic_t stopping_;
+
+  // Posted once per worker thread to start a batch, or to make them exit.
+  SDL_semaphore *start_semaphore_;
+  // Posted by whichever thread finishes the last task of a batch.
+  SDL_semaphore *done_semaphore_;
+};
+
+}  // namespace fpl
+
+#endif  // FPL_THREAD_POOL_H
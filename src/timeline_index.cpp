@@ -0,0 +1,91 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "precompiled.h"
+#include "timeline_index.h"
+#include "timeline_generated.h"
+
+#include <limits>
+
+namespace fpl {
+namespace pie_noon {
+
+void TimelineIndex::Bake(const Timeline* timeline) {
+  renderable_times_.clear();
+  accessory_times_.clear();
+  accessory_interval_begin_.clear();
+  accessory_indices_.clear();
+
+  // The renderable index at t is one less than the first index from 1 on with
+  // a time after t.  That's the first index whose running maximum time is
+  // after t, and the running maximum is sorted.  Index 0 is shown whatever
+  // its time, so it doesn't count towards the maximum.
+  auto renderables = timeline ? timeline->renderables() : nullptr;
+  if (renderables) {
+    WorldTime max_time = std::numeric_limits<WorldTime>::min();
+    for (int i = 1; i < static_cast<int>(renderables->Length()); ++i) {
+      max_time = std::max(max_time,
+                          static_cast<WorldTime>(renderables->Get(i)->time()));
+      renderable_times_.push_back(max_time);
+    }
+  }
+
+  // Which accessories are shown only changes at their start and end times, so
+  // it's enough to work it out once for each interval between those.
+  auto accessories = timeline ? timeline->accessories() : nullptr;
+  if (accessories) {
+    for (auto it = accessories->begin(); it != accessories->end(); ++it) {
+      accessory_times_.push_back(it->time());
+      if (it->end_time() != 0) accessory_times_.push_back(it->end_time());
+    }
+    std::sort(accessory_times_.begin(), accessory_times_.end());
+    accessory_times_.erase(
+        std::unique(accessory_times_.begin(), accessory_times_.end()),
+        accessory_times_.end());
+  }
+  accessory_interval_begin_.push_back(0);
+  for (size_t n = 1; n <= accessory_times_.size(); ++n) {
+    accessory_interval_begin_.push_back(
+        static_cast<int>(accessory_indices_.size()));
+    const WorldTime t = accessory_times_[n - 1];
+    for (int i = 0; i < static_cast<int>(accessories->Length()); ++i) {
+      const TimelineAccessory* accessory = accessories->Get(i);
+      const WorldTime end_time = accessory->end_time();
+      if (accessory->time() <= t && (t < end_time || end_time == 0)) {
+        accessory_indices_.push_back(i);
+      }
+    }
+  }
+  accessory_interval_begin_.push_back(
+      static_cast<int>(accessory_indices_.size()));
+}
+
+int TimelineIndex::RenderableIndexAtTime(WorldTime t) const {
+  return static_cast<int>(std::upper_bound(renderable_times_.begin(),
+                                           renderable_times_.end(), t) -
+                          renderable_times_.begin());
+}
+
+int TimelineIndex::AccessoryIndicesAtTime(WorldTime t,
+                                          const int** indices) const {
+  const size_t n = std::upper_bound(accessory_times_.begin(),
+                                    accessory_times_.end(), t) -
+                   accessory_times_.begin();
+  const int begin = accessory_interval_begin_[n];
+  *indices = accessory_indices_.data() + begin;
+  return accessory_interval_begin_[n + 1] - begin;
+}
+
+}  // pie_noon
+}  // fpl
@@ -0,0 +1,64 @@
+// Copyright 2014 Google Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PIE_NOON_TIMELINE_INDEX_H_
+#define PIE_NOON_TIMELINE_INDEX_H_
+
+#include <vector>
+#include "common.h"
+
+namespace fpl {
+
+struct Timeline;
+
+namespace pie_noon {
+
+// The renderables and accessories of a Timeline, baked into sorted arrays of
+// the times at which they change, so that looking up what to show at a given
+// time is a binary search that doesn't allocate.
+// The answers are the same as TimelineIndexBeforeTime and
+// TimelineIndicesWithTime give on the timeline's vectors.
+class TimelineIndex {
+ public:
+  // Bakes `timeline`, which may be null.  The timeline isn't kept.
+  void Bake(const Timeline* timeline);
+
+  // Returns the index of the renderable to show at time t, as
+  // TimelineIndexBeforeTime(timeline->renderables(), t) does.
+  int RenderableIndexAtTime(WorldTime t) const;
+
+  // Sets *indices to the indices of the accessories to show at time t, and
+  // returns how many there are.  These are the ones with
+  // time <= t < end_time, in timeline order, as TimelineIndicesWithTime
+  // returns them.  *indices stays valid until the next Bake.
+  int AccessoryIndicesAtTime(WorldTime t, const int** indices) const;
+
+ private:
+  // renderable_times_[i] is the earliest time at which the renderable index
+  // is at least i + 1.
+  std::vector<WorldTime> renderable_times_;
+
+  // The times at which an accessory appears or disappears, in order.  The
+  // n-th interval between them (with interval 0 before the first) shows
+  // accessory_indices_[accessory_interval_begin_[n]] up to
+  // accessory_indices_[accessory_interval_begin_[n + 1]].
+  std::vector<WorldTime> accessory_times_;
+  std::vector<int> accessory_interval_begin_;
+  std::vector<int> accessory_indices_;
+};
+
+}  // pie_noon
+}  // fpl
+
+#endif  // PIE_NOON_TIMELINE_INDEX_H_